@@ -178,6 +178,10 @@
    the channel. Then, it returns a handle of the channel, with the data type 
    of __acp_ch_t__, without waiting for the completion of the connection. 
    The library implicitly progresses the establishment of the connection.
+   The function __acp_create_mbox_ch__ allocates an endpoint of a mailbox 
+   channel, that many sender processes share to send messages to one 
+   receiver process. The memory of the mailbox does not grow with the 
+   number of the senders.
 
    The non-blocking functions for sending and receiving messages, 
    __acp_nbsend_ch__ and __acp_nbrecv_ch__, on a channel can be invoked 
@@ -186,6 +190,16 @@
    and returns a request handle with the data type of __acp_request_t__. 
    It starts transferring messages after it has completed the connection. 
    The wait function, __acp_wait_ch__, wait for the completion of the request.
+   The test function, __acp_test_ch__, checks the completion of the request 
+   without waiting. The functions __acp_waitall_ch__, __acp_waitany_ch__ and 
+   __acp_testsome_ch__ handle an array of requests, e.g. the requests of 
+   receiving from many channels. Alternatively, __acp_set_callback_ch__ sets 
+   a function to be invoked at the completion of the request by the progress 
+   of the library.
+   The library progresses the channels only inside its functions by default. 
+   With the option __--acp-cl-progress-interval__, a thread progresses them 
+   at the given interval in microseconds, so that the communication overlaps 
+   a computation that does not call the library.
 
    The non-blocking de-allocation function, __acp_free_ch__, starts freeing 
    memory regions of the channel specified by the handle. The behavior of 
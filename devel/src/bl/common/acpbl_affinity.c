@@ -0,0 +1,255 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "acpbl_input.h"
+#include "acpbl_affinity.h"
+
+#define AFFINITY_SYSFS "/sys/devices/system"
+#define AFFINITY_SHMPATH "/dev/shm/acpbl_affinity"
+#define AFFINITY_WAIT_USEC 1000     /* interval of polls for the creator of the table */
+#define AFFINITY_WAIT_POLLS 5000    /* polls before giving up on the creator */
+
+static iacpbl_affinity_table_t *affinity_table = NULL;
+static int affinity_fd = -1;
+static char affinity_path[256];
+static int affinity_rank;
+static cpu_set_t affinity_rank_mask;    /* cores of the rank, or the core it runs on when unbound */
+static int affinity_rank_bound;
+
+static inline int table_test(volatile uint64_t *bits, int cpu)
+{
+    return (bits[cpu / 64] >> (cpu % 64)) & 1;
+}
+
+/* Atomically sets the bit of cpu and returns whether it was clear. */
+static inline int table_claim(volatile uint64_t *bits, int cpu)
+{
+    uint64_t bit = 1LLU << (cpu % 64);
+    return (__sync_fetch_and_or(&bits[cpu / 64], bit) & bit) == 0;
+}
+
+/* Reads a sysfs cpu list such as "0-3,8" into set. Returns the number of cores. */
+static int read_cpulist(const char *path, cpu_set_t *set)
+{
+    char buf[BUFSIZ], *p, *end;
+    unsigned long first, last;
+    FILE *fp;
+
+    CPU_ZERO(set);
+    if ((fp = fopen(path, "r")) == NULL) return 0;
+    p = fgets(buf, sizeof(buf), fp);
+    fclose(fp);
+    while (p != NULL && *p >= '0' && *p <= '9') {
+        first = last = strtoul(p, &end, 10);
+        if (*end == '-') last = strtoul(end + 1, &end, 10);
+        for (; first <= last && first < IACPBL_MAX_COMM_CORES; first++) CPU_SET(first, set);
+        p = (*end == ',') ? end + 1 : NULL;
+    }
+    return CPU_COUNT(set);
+}
+
+static int first_cpu(cpu_set_t *set)
+{
+    int cpu;
+    for (cpu = 0; cpu < IACPBL_MAX_COMM_CORES; cpu++)
+        if (CPU_ISSET(cpu, set)) return cpu;
+    return -1;
+}
+
+/* Clears the table left by a dead process, if owner is one. Returns 0 when the table is in use. */
+static int table_recover(iacpbl_affinity_table_t *table, uint64_t owner)
+{
+    if (kill((pid_t)owner, 0) == 0 || errno != ESRCH) return 0;
+    if (!__sync_bool_compare_and_swap(&table->owner, owner, 0)) return 1;
+    memset((void *)table->rank, 0, sizeof(table->rank));
+    memset((void *)table->comm, 0, sizeof(table->comm));
+    table->users = 0;
+    __sync_synchronize();
+    table->owner = getpid();
+    return 1;
+}
+
+/*
+ * Opens the table of the node in /dev/shm. The process that creates the
+ * file clears it; the others wait until it is cleared, so that no claim
+ * left by an earlier job with the same taskid is taken for a live one.
+ */
+static iacpbl_affinity_table_t *table_open(uint32_t taskid)
+{
+    iacpbl_affinity_table_t *table;
+    struct stat st;
+    uint64_t owner;
+    int created, polls;
+
+    sprintf(affinity_path, "%s_task%u", AFFINITY_SHMPATH, taskid);
+    affinity_fd = open(affinity_path, O_CREAT | O_EXCL | O_RDWR, 0600);
+    created = (affinity_fd >= 0);
+    if (!created && errno == EEXIST) affinity_fd = open(affinity_path, O_RDWR);
+    if (affinity_fd == -1) return NULL;
+
+    if (created) {
+        if (ftruncate(affinity_fd, sizeof(iacpbl_affinity_table_t)) == -1) goto fail;
+    } else {
+        for (polls = 0; fstat(affinity_fd, &st) == 0 && st.st_size < sizeof(iacpbl_affinity_table_t); polls++) {
+            if (polls == AFFINITY_WAIT_POLLS) goto fail;
+            usleep(AFFINITY_WAIT_USEC);
+        }
+    }
+    table = mmap(NULL, sizeof(iacpbl_affinity_table_t), PROT_READ | PROT_WRITE, MAP_SHARED, affinity_fd, 0);
+    if (table == MAP_FAILED) goto fail;
+
+    /* a new file is filled with zeros */
+    if (created) {
+        __sync_synchronize();
+        table->owner = getpid();
+    }
+    for (polls = 0; (owner = table->owner) == 0 || table_recover(table, owner); polls++) {
+        if (polls == AFFINITY_WAIT_POLLS) {
+            munmap((void *)table, sizeof(iacpbl_affinity_table_t));
+            goto fail;
+        }
+        usleep(AFFINITY_WAIT_USEC);
+    }
+    __sync_fetch_and_add(&table->users, 1);
+    return table;
+
+fail:
+    close(affinity_fd);
+    affinity_fd = -1;
+    return NULL;
+}
+
+int iacpbl_affinity_init(iacpbl_affinity_table_t *table, int rank, uint32_t taskid)
+{
+    cpu_set_t mask;
+    int cpu, bound;
+
+    affinity_rank = rank;
+    if (iacpbl_option.commaffinity_mode == IACPBL_AFFINITY_NONE) return 0;
+
+    if (table == NULL && (table = table_open(taskid)) == NULL) return -1;
+    affinity_table = table;
+
+    /* A rank allowed on every online core is not bound to any of them. */
+    CPU_ZERO(&mask);
+    sched_getaffinity(0, sizeof(cpu_set_t), &mask);
+    bound = CPU_COUNT(&mask) < sysconf(_SC_NPROCESSORS_ONLN);
+    affinity_rank_bound = bound;
+    if (bound) {
+        affinity_rank_mask = mask;
+        for (cpu = 0; cpu < IACPBL_MAX_COMM_CORES; cpu++)
+            if (CPU_ISSET(cpu, &mask)) table_claim(table->rank, cpu);
+    } else {
+        CPU_ZERO(&affinity_rank_mask);
+        cpu = sched_getcpu();
+        if (cpu >= 0 && cpu < IACPBL_MAX_COMM_CORES) CPU_SET(cpu, &affinity_rank_mask);
+    }
+    return 0;
+}
+
+/* Candidate cores in order of preference. Returns their number. */
+static int affinity_candidates(int *cand, const char **what)
+{
+    char path[256];
+    cpu_set_t set, node;
+    int base, cpu, n, i;
+
+    n = 0;
+    base = first_cpu(&affinity_rank_mask);
+    switch (iacpbl_option.commaffinity_mode) {
+    case IACPBL_AFFINITY_CORES:
+        *what = "core list";
+        for (i = 0; i < iacpbl_option.commcores_num; i++) cand[n++] = iacpbl_option.commcores_list[i];
+        break;
+    case IACPBL_AFFINITY_SIBLING:
+        *what = "smt sibling";
+        if (base < 0) break;
+        sprintf(path, "%s/cpu/cpu%d/topology/thread_siblings_list", AFFINITY_SYSFS, base);
+        read_cpulist(path, &set);
+        for (cpu = 0; cpu < IACPBL_MAX_COMM_CORES; cpu++)
+            if (CPU_ISSET(cpu, &set) && !CPU_ISSET(cpu, &affinity_rank_mask)) cand[n++] = cpu;
+        break;
+    case IACPBL_AFFINITY_SPARE:
+        *what = "numa spare";
+        if (base < 0) break;
+        /* the cores of the NUMA node of the rank, or every core without NUMA information */
+        CPU_ZERO(&node);
+        for (i = 0; i < IACPBL_MAX_COMM_CORES; i++) {
+            sprintf(path, "%s/node/node%d/cpulist", AFFINITY_SYSFS, i);
+            if (read_cpulist(path, &set) > 0 && CPU_ISSET(base, &set)) {
+                node = set;
+                break;
+            }
+        }
+        if (CPU_COUNT(&node) == 0) {
+            sprintf(path, "%s/cpu/online", AFFINITY_SYSFS);
+            read_cpulist(path, &node);
+        }
+        for (cpu = 0; cpu < IACPBL_MAX_COMM_CORES; cpu++)
+            if (CPU_ISSET(cpu, &node) && !CPU_ISSET(cpu, &affinity_rank_mask) && !table_test(affinity_table->rank, cpu))
+                cand[n++] = cpu;
+        break;
+    }
+    return n;
+}
+
+int iacpbl_affinity_place(pthread_t thread)
+{
+    static int cand[IACPBL_MAX_COMM_CORES];
+    const char *what = "";
+    cpu_set_t mask;
+    int n, i, cpu, shared;
+
+    if (iacpbl_option.commaffinity_mode == IACPBL_AFFINITY_NONE || affinity_table == NULL) return -1;
+
+    n = affinity_candidates(cand, &what);
+    if (n == 0) {
+        fprintf(stderr, "%d: acp affinity: no %s core for the communication thread, left unbound\n", affinity_rank, what);
+        return -1;
+    }
+
+    /* the first unclaimed candidate, or one shared round robin when all are taken */
+    cpu = -1;
+    for (i = 0; i < n && cpu < 0; i++)
+        if (table_claim(affinity_table->comm, cand[i])) cpu = cand[i];
+    shared = (cpu < 0);
+    if (shared) cpu = cand[affinity_rank % n];
+
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    if (pthread_setaffinity_np(thread, sizeof(cpu_set_t), &mask) != 0) {
+        fprintf(stderr, "%d: acp affinity: failed to bind the communication thread to cpu %d, left unbound\n", affinity_rank, cpu);
+        return -1;
+    }
+    if (affinity_rank_bound)
+        fprintf(stderr, "%d: acp affinity: communication thread on cpu %d (%s%s), rank bound to %d cpus from cpu %d\n",
+                affinity_rank, cpu, what, shared ? ", shared" : "",
+                CPU_COUNT(&affinity_rank_mask), first_cpu(&affinity_rank_mask));
+    else
+        fprintf(stderr, "%d: acp affinity: communication thread on cpu %d (%s%s), rank unbound\n",
+                affinity_rank, cpu, what, shared ? ", shared" : "");
+    return cpu;
+}
+
+void iacpbl_affinity_finalize(void)
+{
+    if (affinity_fd >= 0) {
+        /* the last process of the node removes the table */
+        if (__sync_sub_and_fetch(&affinity_table->users, 1) == 0) unlink(affinity_path);
+        munmap((void *)affinity_table, sizeof(iacpbl_affinity_table_t));
+        close(affinity_fd);
+        affinity_fd = -1;
+    }
+    affinity_table = NULL;
+    return;
+}
@@ -0,0 +1,46 @@
+#ifndef __INCLUDE_ACPBL_AFFINITY__
+#define __INCLUDE_ACPBL_AFFINITY__
+
+/*
+ * Placement of the communication thread of the basic layers.
+ *
+ * --acp-comm-affinity selects the core the communication thread runs on:
+ *   none     left to the scheduler (default)
+ *   cores    the first free core of the list given by --acp-comm-cores
+ *   sibling  an SMT sibling of the core the owning rank is bound to
+ *   spare    a core of the NUMA node of the owning rank that no rank
+ *            of the node is bound to
+ * The processes of a node record the cores their ranks are bound to and
+ * claim cores for their communication threads in a table in node shared
+ * memory, so that two communication threads share a core only when the
+ * candidates run out.  Each rank reports the chosen core on stderr.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "acpbl_input.h"
+
+#define IACPBL_AFFINITY_WORDS (IACPBL_MAX_COMM_CORES / 64)
+
+typedef struct {
+    volatile uint64_t rank[IACPBL_AFFINITY_WORDS];
+    volatile uint64_t comm[IACPBL_AFFINITY_WORDS];
+    volatile uint64_t owner;    /* /dev/shm table: pid of the process that cleared it, 0 while clearing */
+    volatile uint64_t users;    /* /dev/shm table: processes that have it open */
+} iacpbl_affinity_table_t;
+
+/*
+ * Records the cores of the calling rank in table, or in a table of its
+ * own in /dev/shm named after taskid when table is NULL.  Must be called
+ * by the rank on every process of the node before any of them calls
+ * iacpbl_affinity_place or iacpbl_affinity_finalize.  The /dev/shm table
+ * is cleared by the process that creates it, or that finds the one left
+ * by a dead process, and removed by the last process that finalizes.
+ */
+int iacpbl_affinity_init(iacpbl_affinity_table_t *table, int rank, uint32_t taskid);
+/* Binds thread to a core picked by --acp-comm-affinity. Returns the core or -1. */
+int iacpbl_affinity_place(pthread_t thread);
+void iacpbl_affinity_finalize(void);
+
+#endif /* __INCLUDE_ACPBL_AFFINITY__ */
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "acpbl_copy.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COPY_X86
+#include <immintrin.h>
+#endif
+
+static void *copy_memcpy(void *dst, const void *src, size_t size)
+{
+    return memcpy(dst, src, size);
+}
+
+void *(*iacpbl_copy_large)(void *dst, const void *src, size_t size) = copy_memcpy;
+size_t iacpbl_copy_threshold = 0;
+static const char *copy_kernel = "memcpy";
+
+#ifdef COPY_X86
+
+/*
+ * Each kernel copies the head with memcpy up to the first aligned
+ * destination, streams whole blocks of 4 vectors with unaligned loads
+ * and non-temporal stores, and copies the tail with memcpy.  The final
+ * sfence orders the streaming stores before the completion of the copy
+ * becomes visible to other processes.
+ */
+#define COPY_NT_KERNEL(name, isa, width, vec, load, stream) \
+__attribute__((target(isa))) \
+static void *name(void *dst, const void *src, size_t size) \
+{ \
+    char *d = (char *)dst; \
+    const char *s = (const char *)src; \
+    size_t head = (-(uintptr_t)d) & ((width) - 1); \
+    if (size < head + 4 * (width)) return memcpy(dst, src, size); \
+    memcpy(d, s, head); \
+    d += head; s += head; size -= head; \
+    while (size >= 4 * (width)) { \
+        vec v0 = load((const vec *)(s)); \
+        vec v1 = load((const vec *)(s + (width))); \
+        vec v2 = load((const vec *)(s + 2 * (width))); \
+        vec v3 = load((const vec *)(s + 3 * (width))); \
+        stream((vec *)(d), v0); \
+        stream((vec *)(d + (width)), v1); \
+        stream((vec *)(d + 2 * (width)), v2); \
+        stream((vec *)(d + 3 * (width)), v3); \
+        d += 4 * (width); s += 4 * (width); size -= 4 * (width); \
+    } \
+    _mm_sfence(); \
+    memcpy(d, s, size); \
+    return dst; \
+}
+
+COPY_NT_KERNEL(copy_sse2, "sse2", 16, __m128i, _mm_loadu_si128, _mm_stream_si128)
+COPY_NT_KERNEL(copy_avx2, "avx2", 32, __m256i, _mm256_loadu_si256, _mm256_stream_si256)
+#if defined(__GNUC__) && (__GNUC__ >= 7 || defined(__clang__))
+#define COPY_AVX512
+COPY_NT_KERNEL(copy_avx512, "avx512f", 64, __m512i, _mm512_loadu_si512, _mm512_stream_si512)
+#endif
+
+#endif /* COPY_X86 */
+
+void iacpbl_copy_init(uint64_t threshold)
+{
+    iacpbl_copy_threshold = (size_t)threshold;
+    iacpbl_copy_large = copy_memcpy;
+    copy_kernel = "memcpy";
+#ifdef COPY_X86
+    __builtin_cpu_init();
+#ifdef COPY_AVX512
+    if (__builtin_cpu_supports("avx512f")) {
+        iacpbl_copy_large = copy_avx512;
+        copy_kernel = "avx512";
+        return;
+    }
+#endif
+    if (__builtin_cpu_supports("avx2")) {
+        iacpbl_copy_large = copy_avx2;
+        copy_kernel = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        iacpbl_copy_large = copy_sse2;
+        copy_kernel = "sse2";
+    }
+#endif
+    return;
+}
+
+const char *iacpbl_copy_kernel(void)
+{
+    return iacpbl_copy_threshold ? copy_kernel : "memcpy";
+}
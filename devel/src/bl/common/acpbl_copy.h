@@ -0,0 +1,53 @@
+#ifndef __INCLUDE_ACPBL_COPY__
+#define __INCLUDE_ACPBL_COPY__
+
+/*
+ * Payload copy engine of the basic layers.
+ *
+ * iacpbl_copy_init picks a kernel for the CPU at run time: AVX-512,
+ * AVX2 or SSE2 on x86, or plain memcpy elsewhere.  Copies of at least
+ * the threshold given to iacpbl_copy_init bypass the cache with
+ * non-temporal stores, so that large local copies do not evict the
+ * working set of the compute thread.  Smaller copies use memcpy.
+ * A threshold of 0 disables non-temporal copies.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+extern void *(*iacpbl_copy_large)(void *dst, const void *src, size_t size);
+extern size_t iacpbl_copy_threshold;
+
+void iacpbl_copy_init(uint64_t threshold);
+const char *iacpbl_copy_kernel(void);
+
+static inline void iacpbl_copy(void *dst, const void *src, size_t size)
+{
+    if (iacpbl_copy_threshold && size >= iacpbl_copy_threshold)
+        iacpbl_copy_large(dst, src, size);
+    else
+        memcpy(dst, src, size);
+}
+
+/*
+ * Copy of a datagram payload of at most max bytes, used to pack the data
+ * of a get into a put datagram and to unpack put datagrams.  Full
+ * payloads and 4 and 8 byte payloads have a constant size the compiler
+ * expands into unrolled moves instead of a call.  The results of remote
+ * atomics are stored into the datagram directly, and come through the 4
+ * and 8 byte cases only when they are unpacked at the requester.
+ */
+static inline void iacpbl_copy_dg(void *dst, const void *src, size_t size, size_t max)
+{
+    if (size == max)
+        memcpy(dst, src, max);
+    else if (size == 8)
+        memcpy(dst, src, 8);
+    else if (size == 4)
+        memcpy(dst, src, 4);
+    else
+        memcpy(dst, src, size);
+}
+
+#endif /* __INCLUDE_ACPBL_COPY__ */
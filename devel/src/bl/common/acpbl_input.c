@@ -37,7 +37,37 @@ iacpbl_option_t iacpbl_option = {
     { 0,            0,      1 },
     { 128,          0,      0xffffffffffffffffLLU },
     { 131072,       0,      0xffffffffffffffffLLU },
-    { 1000,         1,      10000000 }
+    { 1000,         1,      10000000 },
+    { 0,            0,      1 },
+    { 0.0,          0.0,    1.0 },
+    { 0.0,          0.0,    1.0 },
+    { 0,            0,      10000000 },
+    { 0,            0,      10000000 },
+    { 0.0,          0.0,    1.0 },
+    { 1000,         0,      10000000 },
+    { 0.0,          0.0,    1.0 },
+    { 0,            0,      10000000 },
+    { 1,            0,      0xffffffffffffffffLLU },
+    { 1,            0,      1 },
+    { 2,            2,      64 },
+    { 1048576,      0,      0xffffffffffffffffLLU },
+    { 1048576,      0,      0xffffffffffffffffLLU },
+    { 0,            0,      1 },
+    { "none" },
+    IACPBL_AFFINITY_NONE,
+    { "" },
+    { 0 },
+    0,
+    { 1024,         1,      2097152 },
+    { 1,            0,      1 },
+    { 1,            0,      1 },
+    { 0,            0,      2097152 },
+    { 0,            0,      1 },
+    { 50,           0,      10000000 },
+    { 0,            0,      0xffffffffffffffffLLU },
+    { 1,            0,      1 },
+    { 1024,         16,     1048576 },
+    { 0,            0,      10000000 }
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -66,8 +96,35 @@ static const option_list_t option_list[] = {
     {arg_uint,          offsetof(iacpbl_option_t, mhooklow),    "--acp-malloc-hook-low",    "mallok hook low threshold"},
     {arg_uint,          offsetof(iacpbl_option_t, mhookhigh),   "--acp-malloc-hook-high",   "mallok hook high threshold"},
     {arg_uint,          offsetof(iacpbl_option_t, ethspeed),    "--acp-ethernet-speed",     "ethernet speed (in Mbps)"},
+    {arg_uint,          offsetof(iacpbl_option_t, copythreshold), "--acp-copy-nt-threshold", "local copies of this size or more bypass the cache (0 to disable)"},
+    {arg_uint,          offsetof(iacpbl_option_t, progthread),  "--acp-progress-thread",    "(udp) flag [0|1] to use a communication thread on single node jobs"},
+    {arg_uint,          offsetof(iacpbl_option_t, threadmultiple), "--acp-thread-multiple", "(udp) flag [0|1] to give each issuing thread its own command queue and handles"},
+    {arg_string,        offsetof(iacpbl_option_t, commaffinity), "--acp-comm-affinity",   "placement of the communication thread [none|cores|sibling|spare]"},
+    {arg_string,        offsetof(iacpbl_option_t, commcores),   "--acp-comm-cores",         "core list for --acp-comm-affinity cores, e.g. 0,2,8-11"},
+    {arg_uint,          offsetof(iacpbl_option_t, udponly),     "--acp-udp-only",           "(udp) flag [0|1] to put every process on its own node"},
+    {arg_double,        offsetof(iacpbl_option_t, emuloss),     "--acp-emu-loss",           "(udp) emulated packet loss rate on send [0..1]"},
+    {arg_double,        offsetof(iacpbl_option_t, emurxloss),   "--acp-emu-rx-loss",        "(udp) emulated packet loss rate on receive [0..1]"},
+    {arg_uint,          offsetof(iacpbl_option_t, emudelay),    "--acp-emu-delay",          "(udp) emulated one-way delay (in usec)"},
+    {arg_uint,          offsetof(iacpbl_option_t, emujitter),   "--acp-emu-jitter",         "(udp) emulated delay jitter (in usec)"},
+    {arg_double,        offsetof(iacpbl_option_t, emureorder),  "--acp-emu-reorder",        "(udp) emulated reordering rate [0..1]"},
+    {arg_uint,          offsetof(iacpbl_option_t, emureorderdelay), "--acp-emu-reorder-delay", "(udp) extra delay of reordered packets (in usec)"},
+    {arg_double,        offsetof(iacpbl_option_t, emudup),      "--acp-emu-dup",            "(udp) emulated duplication rate [0..1]"},
+    {arg_uint,          offsetof(iacpbl_option_t, emurate),     "--acp-emu-rate",           "(udp) emulated bandwidth per peer (in Mbps, 0 for unlimited)"},
+    {arg_uint,          offsetof(iacpbl_option_t, emuseed),     "--acp-emu-seed",           "(udp) random seed of the emulator"},
     //
     {arg_uint,          offsetof(iacpbl_option_t, taskid),      "--acp-taskid",             "parallel task identifier"},
+    {arg_uint,          offsetof(iacpbl_option_t, bsradix),     "--acp-bootstrap-radix",    "(udp) radix of the bootstrap tree, the parent of rank r is r / radix"},
+    {arg_uint,          offsetof(iacpbl_option_t, rkeycache),   "--acp-rkey-cache-size",    "(ib) number of peers whose remote key tables are cached"},
+    {arg_uint,          offsetof(iacpbl_option_t, rkeyprefetch), "--acp-rkey-prefetch",     "(ib) flag [0|1] to prefetch the remote key table of the next peer of a strided pattern"},
+    {arg_uint,          offsetof(iacpbl_option_t, nativeatomic), "--acp-native-atomics",   "(ib) flag [0|1] to run 8 byte atomics with the atomic operations of the HCA"},
+    {arg_uint,          offsetof(iacpbl_option_t, qppool),      "--acp-qp-pool-size",       "(ib) number of peers connected by a queue pair at a time, connections are made on first use (0, the default, to connect every peer at acp_init)"},
+    {arg_uint,          offsetof(iacpbl_option_t, eventwait),   "--acp-event-wait",         "(ib) flag [0|1] to let the idle communication thread and acp_complete sleep on completion events"},
+    {arg_uint,          offsetof(iacpbl_option_t, eventspin),   "--acp-event-spin",         "(ib) time to poll before sleeping with --acp-event-wait 1 (in usec)"},
+    {arg_uint,          offsetof(iacpbl_option_t, mrcache),     "--acp-mr-cache-size",      "(ib) bytes of unregistered memory kept registered for reuse (0, the default, to deregister at once)"},
+    {arg_uint,          offsetof(iacpbl_option_t, intranode),   "--acp-intranode",          "(ib) flag [0|1] to copy between processes of a node through shared memory instead of the HCA"},
+    {arg_uint,          offsetof(iacpbl_option_t, cmdqsize),    "--acp-cmdq-size",          "(ib) number of entries of the command queue, the same on every process"},
+    {arg_uint,          offsetof(iacpbl_option_t, bulkthreshold), "--acp-bulk-threshold", "(udp) copies to other nodes of this size or more go over TCP (0 to disable)"},
+    {arg_uint,          offsetof(iacpbl_option_t, clprogress),  "--acp-cl-progress-interval", "polling interval of the progress thread of the channels (in usec, 0 for no thread)"},
     //
     {arg_string,        offsetof(iacpbl_option_t, portfile),    "--acp-portfile",           "(for macprun) portfile name"},
     {arg_uint,          offsetof(iacpbl_option_t, offsetrank),  "--acp-offsetrank",         "(for macprun) rank offset"},
@@ -248,6 +305,53 @@ static int mygetopt_long_only( int *argc, char ***argv )
     return 0 ;
 }
 
+/* Translates --acp-comm-affinity into a mode and --acp-comm-cores into a  */
+/* list of cores in the given order ("0,2,8-11" is 0, 2, 8, 9, 10, 11).    */
+static int interpret_comm_affinity( void )
+{
+    char *mode = iacpbl_option.commaffinity.string ;
+    char *p    = iacpbl_option.commcores.string ;
+    unsigned long first, last ;
+    char *end ;
+
+    if      ( strcmp( mode, "none"    ) == 0 ) iacpbl_option.commaffinity_mode = IACPBL_AFFINITY_NONE ;
+    else if ( strcmp( mode, "cores"   ) == 0 ) iacpbl_option.commaffinity_mode = IACPBL_AFFINITY_CORES ;
+    else if ( strcmp( mode, "sibling" ) == 0 ) iacpbl_option.commaffinity_mode = IACPBL_AFFINITY_SIBLING ;
+    else if ( strcmp( mode, "spare"   ) == 0 ) iacpbl_option.commaffinity_mode = IACPBL_AFFINITY_SPARE ;
+    else {
+        fprintf( stderr, "Error: invalid --acp-comm-affinity \"%s\", expected none, cores, sibling or spare.\n", mode ) ;
+        return -1 ;
+    }
+
+    iacpbl_option.commcores_num = 0 ;
+    while ( *p != '\0' ) {
+        first = strtoul( p, &end, 10 ) ;
+        if ( end == p ) break ;
+        last = first ;
+        if ( *end == '-' ) {
+            p = end + 1 ;
+            last = strtoul( p, &end, 10 ) ;
+            if ( end == p ) break ;
+        }
+        if ( last < first || last >= IACPBL_MAX_COMM_CORES ) break ;
+        while ( first <= last && iacpbl_option.commcores_num < IACPBL_MAX_COMM_CORES ) {
+            iacpbl_option.commcores_list[ iacpbl_option.commcores_num++ ] = ( uint16_t ) first++ ;
+        }
+        p = end ;
+        if ( *p == ',' ) p++ ;
+        else if ( *p != '\0' ) break ;
+    }
+    if ( *p != '\0' ) {
+        fprintf( stderr, "Error: invalid --acp-comm-cores \"%s\".\n", iacpbl_option.commcores.string ) ;
+        return -1 ;
+    }
+    if ( iacpbl_option.commaffinity_mode == IACPBL_AFFINITY_CORES && iacpbl_option.commcores_num == 0 ) {
+        fprintf( stderr, "Error: --acp-comm-affinity cores needs --acp-comm-cores.\n" ) ;
+        return -1 ;
+    }
+    return 0 ;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -290,6 +394,10 @@ int iacpbl_interpret_option( int *argc, char ***argv )
         iacpbl_option.rhost_ip = *(uint32_t *)host->h_addr_list[0];
     }
     ///
+    if ( interpret_comm_affinity( ) ) {
+        exit( EXIT_FAILURE ) ;
+    }
+    ///
 
     return 0 ;
 }
@@ -1,6 +1,13 @@
 #ifndef __INCLUDE_ACPBL_INPUT__
 #define __INCLUDE_ACPBL_INPUT__
 
+/* placement of the communication thread, see acpbl_affinity.h */
+#define IACPBL_AFFINITY_NONE    0
+#define IACPBL_AFFINITY_CORES   1
+#define IACPBL_AFFINITY_SIBLING 2
+#define IACPBL_AFFINITY_SPARE   3
+#define IACPBL_MAX_COMM_CORES   1024
+
 typedef struct {
     uint64_t value;
 } iacpbl_option_nil_t;
@@ -40,6 +47,36 @@ typedef struct {
     iacpbl_option_uint_t mhooklow;
     iacpbl_option_uint_t mhookhigh;
     iacpbl_option_uint_t ethspeed;
+    iacpbl_option_uint_t udponly;
+    iacpbl_option_double_t emuloss;
+    iacpbl_option_double_t emurxloss;
+    iacpbl_option_uint_t emudelay;
+    iacpbl_option_uint_t emujitter;
+    iacpbl_option_double_t emureorder;
+    iacpbl_option_uint_t emureorderdelay;
+    iacpbl_option_double_t emudup;
+    iacpbl_option_uint_t emurate;
+    iacpbl_option_uint_t emuseed;
+    iacpbl_option_uint_t progthread;
+    iacpbl_option_uint_t bsradix;
+    iacpbl_option_uint_t bulkthreshold;
+    iacpbl_option_uint_t copythreshold;
+    iacpbl_option_uint_t threadmultiple;
+    iacpbl_option_string_t commaffinity;
+    uint32_t commaffinity_mode;
+    iacpbl_option_string_t commcores;
+    uint16_t commcores_list[IACPBL_MAX_COMM_CORES];
+    int commcores_num;
+    iacpbl_option_uint_t rkeycache;
+    iacpbl_option_uint_t rkeyprefetch;
+    iacpbl_option_uint_t nativeatomic;
+    iacpbl_option_uint_t qppool;
+    iacpbl_option_uint_t eventwait;
+    iacpbl_option_uint_t eventspin;
+    iacpbl_option_uint_t mrcache;
+    iacpbl_option_uint_t intranode;
+    iacpbl_option_uint_t cmdqsize;
+    iacpbl_option_uint_t clprogress;
 } iacpbl_option_t;
 
 extern iacpbl_option_t iacpbl_option;
@@ -0,0 +1,94 @@
+#ifndef __INCLUDE_ACPBL_STATS__
+#define __INCLUDE_ACPBL_STATS__
+
+/*
+ * Helpers for the statistics of the basic layer, shared by all devices.
+ * The counters themselves live in each device and are updated by the
+ * thread that owns the corresponding data structure, so that no extra
+ * lock is required on the fast path.
+ *
+ * Counters written by one thread outside of any lock are bracketed by
+ * iacpbl_stats_write_begin/end on a sequence number, which is odd while
+ * an update is in progress. iacpbl_stats_read copies them until it sees
+ * the same even sequence number before and after the copy, so a query
+ * never gets a half-updated set and the writer never waits.
+ */
+
+static inline void iacpbl_stats_write_begin(uint64_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void iacpbl_stats_write_end(uint64_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline void iacpbl_stats_read(uint64_t *seq, void *dst, const void *src, size_t size)
+{
+    uint64_t s;
+
+    do {
+        while ((s = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) sched_yield();
+        memcpy(dst, src, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(seq, __ATOMIC_RELAXED) != s);
+}
+
+static inline int iacpbl_stats_bin(uint64_t nsec)
+{
+    int bin;
+
+    bin = 63 - __builtin_clzll(nsec | 1);
+    if (bin >= ACP_STATS_HIST_BINS) bin = ACP_STATS_HIST_BINS - 1;
+    return bin;
+}
+
+static inline void iacpbl_stats_record(acp_stats_latency_t *lat, uint64_t nsec)
+{
+    lat->count++;
+    lat->total_nsec += nsec;
+    if (lat->max_nsec < nsec) lat->max_nsec = nsec;
+    lat->hist[iacpbl_stats_bin(nsec)]++;
+}
+
+static inline int iacpbl_stats_enabled(void)
+{
+    char *env;
+
+    env = getenv("ACP_STATS");
+    return env != NULL && env[0] != '\0' && env[0] != '0';
+}
+
+static inline void iacpbl_stats_dump(int rank, acp_stats_t *stats, acp_peer_stats_t *peer, int nprocs)
+{
+    static const char *opname[ACP_STATS_NUM_OPS] = {
+        "COPY", "CAS4", "CAS8", "SWAP4", "SWAP8", "ADD4", "ADD8",
+        "XOR4", "XOR8", "OR4", "OR8", "AND4", "AND8"
+    };
+    int i, j;
+
+    fprintf(stderr, "%d: acp stats: tx %lu bytes %lu packets, rx %lu bytes %lu packets, "
+            "retransmits %lu, queue full stalls %lu, loop iterations %lu\n",
+            rank, stats->tx_bytes, stats->tx_packets, stats->rx_bytes, stats->rx_packets,
+            stats->retransmits, stats->queue_full_stalls, stats->loop_iterations);
+    for (i = 0; i < ACP_STATS_NUM_OPS; i++) {
+        acp_stats_latency_t *lat = &stats->op[i];
+        if (lat->count == 0) continue;
+        fprintf(stderr, "%d: acp stats: %-5s count %lu avg %lu max %lu nsec, hist",
+                rank, opname[i], lat->count, lat->total_nsec / lat->count, lat->max_nsec);
+        for (j = 0; j < ACP_STATS_HIST_BINS; j++)
+            if (lat->hist[j] > 0) fprintf(stderr, " %d:%lu", j, lat->hist[j]);
+        fprintf(stderr, "\n");
+    }
+    if (peer == NULL) return;
+    for (i = 0; i < nprocs; i++) {
+        if (peer[i].tx_packets == 0 && peer[i].rx_packets == 0) continue;
+        fprintf(stderr, "%d: acp stats: peer %d tx %lu bytes %lu packets, rx %lu bytes %lu packets\n",
+                rank, i, peer[i].tx_bytes, peer[i].tx_packets, peer[i].rx_bytes, peer[i].rx_packets);
+    }
+    fflush(stderr);
+}
+
+#endif /* __INCLUDE_ACPBL_STATS__ */
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <acp.h>
+#include "acpbl_trace.h"
+
+#define TRACE_DEFAULT_EVENTS (1 << 16)
+
+typedef struct {
+    uint64_t nsec;
+    const char *cat;
+    const char *name;
+    uint64_t id;
+    uint64_t arg;
+    char ph;
+} trace_event_t;
+
+typedef struct trace_ring {
+    struct trace_ring *next;
+    const char *name;
+    int tid;
+    uint64_t num;
+    trace_event_t *ev;
+} trace_ring_t;
+
+volatile int iacpbl_trace_enabled = 0;
+
+const char *iacpbl_trace_gma_name[] = {
+    "copy", "cas4", "cas8", "swap4", "swap8", "add4", "add8",
+    "xor4", "xor8", "or4", "or8", "and4", "and8"
+};
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static trace_ring_t *trace_rings = NULL;
+static int trace_num_rings = 0;
+static int trace_gen = 0;
+static int trace_rank = 0;
+static uint64_t trace_mask = 0;
+static uint64_t trace_base_nsec = 0;
+static char trace_prefix[BUFSIZ];
+
+static __thread trace_ring_t *my_ring = NULL;
+static __thread int my_gen = -1;
+
+static trace_ring_t *new_ring(void)
+{
+    trace_ring_t *ring;
+
+    ring = (trace_ring_t *)malloc(sizeof(trace_ring_t));
+    if (ring == NULL) return NULL;
+    ring->ev = (trace_event_t *)malloc(sizeof(trace_event_t) * (trace_mask + 1));
+    if (ring->ev == NULL) {
+        free(ring);
+        return NULL;
+    }
+    ring->name = NULL;
+    ring->num = 0;
+
+    pthread_mutex_lock(&trace_mutex);
+    ring->tid = trace_num_rings++;
+    ring->next = trace_rings;
+    trace_rings = ring;
+    pthread_mutex_unlock(&trace_mutex);
+
+    return ring;
+}
+
+static inline trace_ring_t *get_ring(void)
+{
+    if (my_gen != trace_gen) {
+        my_ring = new_ring();
+        my_gen = trace_gen;
+    }
+    return my_ring;
+}
+
+void iacpbl_trace_record(uint64_t nsec, char ph, const char *cat, const char *name, uint64_t id, uint64_t arg)
+{
+    trace_ring_t *ring;
+    trace_event_t *ev;
+
+    ring = get_ring();
+    if (ring == NULL) return;
+
+    ev = &ring->ev[ring->num & trace_mask];
+    ev->nsec = nsec;
+    ev->ph = ph;
+    ev->cat = cat;
+    ev->name = name;
+    ev->id = id;
+    ev->arg = arg;
+    ring->num++;
+
+    return;
+}
+
+void iacpbl_trace_thread_name(const char *name)
+{
+    trace_ring_t *ring;
+
+    if (!iacpbl_trace_enabled) return;
+    ring = get_ring();
+    if (ring != NULL) ring->name = name;
+
+    return;
+}
+
+void iacpbl_trace_init(int rank)
+{
+    char *env;
+    uint64_t num;
+
+    env = getenv("ACP_TRACE");
+    if (env == NULL || env[0] == '\0') return;
+
+    num = TRACE_DEFAULT_EVENTS;
+    if (getenv("ACP_TRACE_EVENTS") != NULL) num = strtoull(getenv("ACP_TRACE_EVENTS"), NULL, 0);
+    if (num < 2) num = 2;
+    while (num & (num - 1)) num &= num - 1;
+
+    strncpy(trace_prefix, env, BUFSIZ - 1);
+    trace_prefix[BUFSIZ - 1] = '\0';
+    trace_rank = rank;
+    trace_mask = num - 1;
+    trace_base_nsec = iacpbl_trace_nsec();
+    iacpbl_trace_enabled = 1;
+    iacpbl_trace_thread_name("main");
+
+    return;
+}
+
+/* must be called just after acp_sync, to align the clocks of all ranks */
+void iacpbl_trace_align(void)
+{
+    if (iacpbl_trace_enabled) trace_base_nsec = iacpbl_trace_nsec();
+
+    return;
+}
+
+static void write_event(FILE *fp, trace_ring_t *ring, trace_event_t *ev)
+{
+    double ts;
+
+    ts = (double)((int64_t)(ev->nsec - trace_base_nsec)) / 1000.0;
+    fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+            ev->name, ev->cat, ev->ph, ts, trace_rank, ring->tid);
+    if (ev->ph == IACPBL_TRACE_ASYNC_BEGIN || ev->ph == IACPBL_TRACE_ASYNC_END)
+        fprintf(fp, ",\"id\":\"0x%" PRIx64 "\"", ev->id);
+    if (ev->ph == IACPBL_TRACE_INSTANT)
+        fprintf(fp, ",\"s\":\"t\",\"args\":{\"id\":\"0x%" PRIx64 "\",\"arg\":%" PRIu64 "}", ev->id, ev->arg);
+    else if (ev->ph != IACPBL_TRACE_END && ev->ph != IACPBL_TRACE_ASYNC_END)
+        fprintf(fp, ",\"args\":{\"arg\":%" PRIu64 "}", ev->arg);
+    fprintf(fp, "}");
+
+    return;
+}
+
+void iacpbl_trace_finalize(void)
+{
+    char path[BUFSIZ + 32];
+    FILE *fp;
+    trace_ring_t *ring, *next;
+    uint64_t i, start;
+
+    if (!iacpbl_trace_enabled) return;
+    iacpbl_trace_enabled = 0;
+
+    snprintf(path, sizeof(path), "%s.%d.json", trace_prefix, trace_rank);
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "%d: acp trace: cannot open %s\n", trace_rank, path);
+    } else {
+        fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+        fprintf(fp, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"rank %d\"}}",
+                trace_rank, trace_rank);
+        for (ring = trace_rings; ring != NULL; ring = ring->next) {
+            if (ring->name != NULL)
+                fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                        trace_rank, ring->tid, ring->name);
+            if (ring->num > trace_mask + 1)
+                fprintf(stderr, "%d: acp trace: %" PRIu64 " events of thread %d were overwritten\n",
+                        trace_rank, ring->num - trace_mask - 1, ring->tid);
+            start = (ring->num > trace_mask + 1) ? ring->num - trace_mask - 1 : 0;
+            for (i = start; i < ring->num; i++) write_event(fp, ring, &ring->ev[i & trace_mask]);
+        }
+        fprintf(fp, "\n]}\n");
+        fclose(fp);
+    }
+
+    pthread_mutex_lock(&trace_mutex);
+    for (ring = trace_rings; ring != NULL; ring = next) {
+        next = ring->next;
+        free(ring->ev);
+        free(ring);
+    }
+    trace_rings = NULL;
+    trace_num_rings = 0;
+    trace_gen++;
+    pthread_mutex_unlock(&trace_mutex);
+
+    return;
+}
@@ -0,0 +1,67 @@
+#ifndef __INCLUDE_ACPBL_TRACE__
+#define __INCLUDE_ACPBL_TRACE__
+
+/*
+ * Event trace of ACP operations in Chrome Trace Event format.
+ *
+ * Tracing is enabled by setting the environment variable ACP_TRACE to
+ * the prefix of the output files.  Each thread records events into its
+ * own ring buffer without locks, and acp_finalize writes the rings of
+ * the process to <prefix>.<rank>.json.  Timestamps are relative to the
+ * last acp_sync of acp_init, which aligns the clocks of all ranks.
+ * When tracing is disabled, every hook costs a single load and branch.
+ */
+
+/* phases of events */
+#define IACPBL_TRACE_BEGIN       'B'
+#define IACPBL_TRACE_END         'E'
+#define IACPBL_TRACE_ASYNC_BEGIN 'b'
+#define IACPBL_TRACE_ASYNC_END   'e'
+#define IACPBL_TRACE_INSTANT     'i'
+
+extern volatile int iacpbl_trace_enabled;
+
+/* names of GMA events indexed by ACP_STATS_OP_* */
+extern const char *iacpbl_trace_gma_name[];
+
+void iacpbl_trace_init(int rank);
+void iacpbl_trace_align(void);
+void iacpbl_trace_finalize(void);
+void iacpbl_trace_thread_name(const char *name);
+void iacpbl_trace_record(uint64_t nsec, char ph, const char *cat, const char *name, uint64_t id, uint64_t arg);
+
+static inline uint64_t iacpbl_trace_nsec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/* cat and name must be string literals or __func__, they are kept until acp_finalize */
+#define IACPBL_TRACE(ph, cat, name, id, arg) \
+    do { \
+        if (iacpbl_trace_enabled) iacpbl_trace_record(iacpbl_trace_nsec(), ph, cat, name, (uint64_t)(id), (uint64_t)(arg)); \
+    } while (0)
+
+/* duration event covering the rest of the enclosing function */
+typedef struct {
+    const char *cat;
+    const char *name;
+} iacpbl_trace_scope_t;
+
+static inline iacpbl_trace_scope_t iacpbl_trace_scope_begin(const char *cat, const char *name)
+{
+    iacpbl_trace_scope_t scope = { cat, name };
+    IACPBL_TRACE(IACPBL_TRACE_BEGIN, cat, name, 0, 0);
+    return scope;
+}
+
+static inline void iacpbl_trace_scope_end(iacpbl_trace_scope_t *scope)
+{
+    IACPBL_TRACE(IACPBL_TRACE_END, scope->cat, scope->name, 0, 0);
+}
+
+#define IACPBL_TRACE_SCOPE(cat) \
+    iacpbl_trace_scope_t iacpbl_trace_scope __attribute__((cleanup(iacpbl_trace_scope_end))) = iacpbl_trace_scope_begin(cat, __func__)
+
+#endif /* __INCLUDE_ACPBL_TRACE__ */
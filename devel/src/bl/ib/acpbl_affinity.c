@@ -0,0 +1 @@
+../common/acpbl_affinity.c
\ No newline at end of file
@@ -0,0 +1 @@
+../common/acpbl_copy.c
\ No newline at end of file
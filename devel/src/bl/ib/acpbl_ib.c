@@ -27,12 +27,26 @@
 #include <netinet/in.h>
 #include <sys/time.h>
 #include <sys/resource.h>
-#include <sched.h> /* for sched_yield and setaffnity */
+#include <time.h>
+#include <sched.h> /* for sched_yield */
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <stdarg.h>
+#include <malloc.h>
+#include <sys/uio.h> /* process_vm_readv() */
+#include <sys/stat.h>
 #include <arpa/inet.h>
 #include <acp.h>
 #include "acpbl.h"
 #include "acpbl_sync.h"
 #include "acpbl_input.h"
+#include "acpbl_stats.h"
+#include "acpbl_trace.h"
+#include "acpbl_copy.h"
+#include "acpbl_affinity.h"
 /* H.Honda Jan.12 2016 begin */
 #include <netdb.h>
 /* H.Honda Jan.12 2016 end   */
@@ -52,11 +66,13 @@ size_t iacp_starter_memory_size_cl = 1024;
 /* define sizes */
 #define MAX_RM_SIZE      255U
 #define MAX_CQ_SIZE     2048U
-#define MAX_WR_SIZE        1U
-#define MAX_CMDQ_ENTRY  1024U
+#define MAX_WR_SIZE       64U
+#define MAX_STAGE_SIZE  1024U
+#define MAX_POLL_SIZE     32U
+#define MAX_INLINE_SIZE   64U
+#define WR_SIGNAL_INTERVAL 16U
 #define MAX_RCMDB_SIZE  2048U
 #define MAX_ACK_COUNT   0x3fffffffffffffffLLU
-#define MAX_RKEY_CASH_SIZE 1024
 
 /* bits range on GA format */
 #define RANK_BITS    21U
@@ -74,6 +90,7 @@ size_t iacp_starter_memory_size_cl = 1024;
 
 #define MASK_WRID_RCMDB     0x8000000000000000LLU
 #define MASK_WRID_ACK       0xc000000000000000LLU
+#define WRID_RRM_PREFETCH   0xffffffffffffffffLLU
 #define MASK_ATOMIC   128U
 #define MASK_ATOMIC8  192U
 
@@ -120,6 +137,8 @@ size_t iacp_starter_memory_size_cl = 1024;
 #define CMD_PRE_WRITEBACK_FIN                22U
 #define CMD_PRE_PUTRRMGETEDFLAG_ISSUED       23U
 #define CMD_PRE_PUTRRMGETEDFLAG_PUT_DST      24U
+#define PRE_ATOMIC                           25U
+#define WAIT_ATOMIC                          26U
 
 /* comm. thread releases the own cpu time.  */
 #define ECOUNT 100
@@ -152,6 +171,10 @@ typedef struct connect_ib_info{
     uint32_t rkey;  /* rkey of starter memory */
     uint16_t lid;  /* local ID of Local IB */
     int rank;  /* local rank */
+    uint32_t ud_qp_num; /* QP number of the UD QP for connection messages */
+    uint32_t event_wait; /* the rank sleeps on completion events */
+    uint64_t hostid; /* hash of the host name */
+    uint32_t pid; /* process ID */
 } CII;
 
 typedef struct starter_memroy_info{
@@ -218,6 +241,9 @@ static acp_ga_t *sync_stepgatbl;
 volatile static int sync_nsteps, sync_peer;
 volatile static enum sync_role sync_myrole;
 volatile static int sync_status = ST_SYNC_INIT;
+static int sync_step;               /* index of sync_bodyla the barrier waits for next */
+static acp_handle_t sync_last;      /* last copy issued by the barrier */
+static uint64_t sync_epoch;         /* handle of the latest acp_isync */
 
 /* socket file descripter */
 static int sock_accept;
@@ -243,10 +269,258 @@ static uint32_t dst_addr; /* destination ip address */
 
 static SMI *smi_tb; /* starter memory info table */
 volatile static acp_handle_t head; /* the head of command queue */
-volatile static acp_handle_t tail; /* the tail of command queue */
-static RM **rrmtb; /* Remote addr/rkey info table */
+volatile static acp_handle_t tail; /* the tail of command queue, reserved by the issuing threads */
+static acp_handle_t issue_tail; /* the tail of the entries passed to the communication thread */
+static uint32_t cmdq_size; /* # of cmdq entries, the same on every rank */
+static volatile acp_handle_t *cmdq_ready; /* handle of each cmdq entry when it is filled */
+static RM **rrmtb; /* Remote addr/rkey info cache, rkey_cache_size slots and an empty one for misses */
 struct ibv_mr *libvmrtb[MAX_RM_SIZE]; /* local ibv_mr table */ 
 static uint32_t rkey_cache_size; /* max # of rrm table */
+static uint32_t *rrm_slot_tb; /* slot of rrmtb caching each rank, rkey_cache_size if none */
+static int *rrmtb_rank; /* rank cached in each slot of rrmtb, -1 if free */
+static char *rrmtb_ref; /* reference bit of each slot for the CLOCK replacement */
+static char *rrmtb_pf; /* slot filled by prefetch and not used yet */
+static uint32_t rrmtb_hand; /* CLOCK hand */
+
+/* prefetch of the rrm table of the next peer of a strided pattern */
+#define RRM_PF_IDLE      0
+#define RRM_PF_PENDING   1
+#define RRM_PF_WAIT      2
+#define RRM_PF_GETED     3
+#define RRM_PF_PUT_FLAG  4
+#define RRM_PF_WAIT_FLAG 5
+static int rrm_pf_stat; /* state of the prefetch */
+static int rrm_pf_rank; /* rank of the prefetched table */
+static int rrm_pf_stale; /* the table was reset while it was fetched */
+static int rrm_last_miss; /* rank of the last miss */
+static int rrm_stride; /* distance between the last two misses */
+
+static struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t prefetches;
+    uint64_t prefetch_hits;
+} rrm_stats; /* rrm cache counters, updated by the communication thread */
+
+/* send queue of a QP: work requests staged for the next doorbell and */
+/* work requests posted and not completed yet, in the order posted     */
+typedef struct send_queue{
+    uint64_t wr_id[MAX_WR_SIZE]; /* wr_id of the posted work requests */
+    char signaled[MAX_WR_SIZE]; /* the posted work request makes a CQE */
+    uint32_t head; /* oldest posted work request */
+    uint32_t num; /* # of posted work requests */
+    int stage_head; /* first staged work request, -1 if none */
+    int stage_tail; /* last staged work request */
+} SQ;
+
+typedef struct staged_work_request{
+    struct ibv_send_wr wr; /* work request, linked to the chain when posted */
+    struct ibv_sge sge; /* its scatter/gather entry */
+    int next; /* next staged work request of the same QP, or next free one */
+} SWR;
+
+typedef struct qp_number_info{
+    uint32_t qp_num; /* QP number */
+    int rank; /* rank the QP connects to */
+} QPN;
+
+static SQ **sqtb; /* send queue of each QP, allocated on the first work request */
+static SWR swrtb[MAX_STAGE_SIZE]; /* staged work requests */
+static int swr_free; /* first free entry of swrtb, -1 if none */
+static int *stage_ranks; /* ranks with staged work requests */
+static int stage_nranks; /* # of ranks with staged work requests */
+static QPN *qpntb; /* QP numbers sorted to find the rank of a CQE */
+static int qpn_num; /* # of QP numbers in qpntb */
+static uint32_t cq_pending; /* # of signaled work requests without CQE */
+static uint32_t max_inline_data; /* inline data size of the QPs */
+
+/* By default acp_init connects an RC QP to every rank, exchanging     */
+/* the QP numbers over the socket ring.  With --acp-qp-pool-size, the  */
+/* RC QP to a rank is created and connected when the first work        */
+/* request to the rank is flushed.  The QP numbers are exchanged by    */
+/* connection messages on a UD QP, whose number every rank learns at   */
+/* acp_init.  At most conn_max QPs are kept: an idle QP is             */
+/* disconnected, least recently used first, to make room for a new    */
+/* one.  A rank accepts every connection request and shrinks the pool  */
+/* afterwards.  The accepting rank posts only after the ready to use  */
+/* message, when the QP of the requester has left INIT.  A QP is named */
+/* by a serial of its rank, so that stale or repeated messages are     */
+/* told from those of a new connection.                                */
+#define CONN_NONE     0 /* no QP */
+#define CONN_REQ      1 /* QP created, request sent */
+#define CONN_ACCEPT   2 /* QP connected, reply sent */
+#define CONN_READY    3 /* QP connected, both ready */
+#define CONN_CLOSING  4 /* QP idle, disconnect sent */
+
+#define CMSG_REQ      1 /* request of connection */
+#define CMSG_REP      2 /* reply of connection */
+#define CMSG_RTU      3 /* ready to use */
+#define CMSG_DISC     4 /* request of disconnection */
+#define CMSG_DISC_ACK 5 /* disconnected */
+#define CMSG_DISC_NAK 6 /* not disconnected, the QP is in use */
+
+#define UD_QKEY         0x41435000U
+#define UD_RECV_SIZE    64U
+#define UD_SEND_SIZE    64U
+#define UD_GRH_SIZE     40U
+#define CONN_RETRY_NSEC 50000000LLU /* interval to send a request again */
+
+typedef struct connect_message{
+    uint32_t type; /* CMSG_* */
+    int rank; /* sender */
+    uint32_t qp_num; /* RC QP number of the sender */
+    uint32_t serial; /* serial of the RC QP of the sender */
+    uint32_t rserial; /* serial of the RC QP of the receiver it is for */
+} CMSG;
+
+typedef struct connection{
+    int stat; /* CONN_* */
+    uint32_t serial; /* serial of the QP to the rank */
+    uint32_t rserial; /* serial of the QP of the rank, 0 if none */
+    uint32_t rseen; /* largest serial of the rank seen in a request */
+    uint16_t lid; /* LID of the rank */
+    uint32_t ud_qp_num; /* UD QP number of the rank */
+    int event_wait; /* the rank sleeps on completion events, the commands to it carry an immediate */
+    struct ibv_ah *ah; /* address handle of the rank, created on the first message */
+    uint64_t nsec; /* time the last request, reply or disconnect was sent */
+    uint64_t used; /* flush round of the last post */
+    int list; /* index in conn_list */
+} CONN;
+
+static CONN *conntb; /* connection to each rank */
+static int *conn_list; /* ranks with a QP */
+static uint32_t conn_num; /* # of ranks with a QP */
+static uint32_t conn_max; /* size of the QP pool */
+static int conn_ondemand; /* QPs are connected on first use */
+static uint32_t conn_pending; /* # of QPs requesting, accepting or closing */
+static uint32_t conn_closing; /* # of QPs closing */
+static uint32_t conn_serial; /* serial of the last QP created */
+static uint64_t conn_clock; /* # of flush rounds */
+static uint64_t conn_check_nsec; /* time of the last check of retries */
+static int ib_port = 1; /* ib port */
+static struct ibv_qp_init_attr rc_init_attr; /* attributes of RC QPs */
+static struct ibv_qp *ud_qp; /* UD QP for connection messages */
+static struct ibv_cq *ud_cq; /* CQ of the UD QP */
+static struct ibv_mr *ud_mr; /* MR of ud_buf */
+static char *ud_buf; /* receive slots and send slots of connection messages */
+static uint32_t ud_send_next; /* next send slot */
+static uint32_t ud_send_num; /* # of sends in flight */
+static struct {
+    uint64_t connects;
+    uint64_t accepts;
+    uint64_t evictions;
+} conn_stats; /* connection counters, updated by the communication thread */
+
+/* Sleeping on completion events, --acp-event-wait.  The communication */
+/* thread polls for the spin time after its last progress, then arms   */
+/* the CQs and sleeps on their completion channel and on comm_wake_fd, */
+/* which an issuing thread writes when it finds the thread asleep.     */
+/* The commands and status other ranks write to a sleeping rank carry  */
+/* an immediate that completes a receive of the SRQ on rcq.  The other */
+/* flags written by other ranks are seen when the sleep times out.     */
+/* acp_complete sleeps on complete_cond, signaled as head moves.       */
+#define EVENT_RECV_SIZE    MAX_RCMDB_SIZE
+#define EVENT_TIMEOUT_MSEC 1
+static int event_wait; /* sleep on completion events */
+static uint64_t event_spin_nsec; /* time to poll before sleeping */
+static struct ibv_comp_channel *event_ch; /* completion channel of cq, ud_cq and rcq */
+static struct ibv_srq *srq; /* receives consumed by immediates */
+static struct ibv_cq *rcq; /* CQ of the receives of srq */
+static int comm_wake_fd = -1; /* eventfd to wake the communication thread */
+static volatile int comm_sleeping; /* the communication thread sleeps */
+static acp_handle_t event_tail; /* tail when the communication thread found itself idle */
+static volatile int complete_waiters; /* # of threads sleeping on complete_cond */
+static pthread_mutex_t complete_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t complete_cond = PTHREAD_COND_INITIALIZER;
+static struct {
+    uint64_t sleeps;
+    uint64_t timeouts;
+    uint64_t complete_sleeps;
+} event_stats; /* sleeps of the communication thread and of acp_complete */
+
+/* Registration cache.  acp_register_memory takes an MR of mrc that    */
+/* covers the pages of the region, or registers one for them merged    */
+/* with the MRs it overlaps.  An MR without tags stays registered      */
+/* until the idle MRs exceed --acp-mr-cache-size, least recently used  */
+/* first.  munmap, mremap and madvise below mark the MRs of the pages  */
+/* they release stale, so that they are not reused.  malloc releases   */
+/* pages by internal calls they do not see, so it is told to keep the  */
+/* freed memory mapped while idle MRs are cached.  The cache is off    */
+/* by default, so malloc of the application is left alone unless       */
+/* --acp-mr-cache-size is given.                                       */
+#define MAX_MRC_SIZE (MAX_RM_SIZE * 2U)
+
+typedef struct mr_cache_entry{
+    uintptr_t start; /* page aligned start of the MR */
+    uintptr_t end; /* page aligned end of the MR */
+    struct ibv_mr *mr; /* MR, NULL if the entry is free */
+    uint32_t refs; /* # of tags using the MR */
+    int stale; /* the pages were released, the MR is not reused */
+    uint64_t used; /* mrc_clock when the last tag released the MR */
+} MRC;
+
+static MRC mrc[MAX_MRC_SIZE]; /* registration cache */
+static int mrc_tag[MAX_RM_SIZE]; /* entry of mrc of each tag of lrmtb */
+static volatile uint32_t mrc_num; /* # of entries in use */
+static uint64_t mrc_idle; /* bytes of the MRs without tags */
+static uint64_t mrc_budget; /* bytes of the MRs without tags kept */
+static uint64_t mrc_clock; /* # of releases */
+static uintptr_t mrc_page = 4096; /* page size */
+static pthread_mutex_t mrc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread int mrc_owner; /* this thread holds mrc_mutex */
+static struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t invalidations;
+} mrc_stats; /* registration cache counters */
+
+static void free_mrc(void);
+
+/* Processes of a node.  With --acp-intranode the starter memory is a  */
+/* file of /dev/shm, mapped by the other processes of the node, and    */
+/* post_wr runs the work requests to them with the CPU instead of      */
+/* staging them for the HCA: reads and writes of starter memory        */
+/* through the mapping, those of registered memory by cross memory     */
+/* attach, and their completions are returned by poll_wc.  Cross       */
+/* memory attach is subject to the ptrace policy of the system, e.g.   */
+/* Yama, which is left as it is; a rank it refuses with EPERM goes     */
+/* through the HCA, as does a rank whose mapping fails.  The atomic    */
+/* operations of the HCA are not atomic with those of the CPU, so      */
+/* atomics run on the CPU only if the HCA reports IBV_ATOMIC_GLOB or   */
+/* no other node has the starter memory.  Writes with immediate data   */
+/* wake the peer through its receive queue and stay on the HCA.        */
+#define NODE_SHMPATH "/dev/shm/acpbl_ib"
+
+static char **node_sm; /* mapping of the starter memory of each rank of this node, NULL for the others */
+static pid_t *node_pid; /* process of each rank of this node for cross memory attach, 0 if it fails */
+static uint64_t node_hostid; /* hash of the host name */
+static int node_pop; /* # of ranks of this node */
+static int node_atomic; /* atomics on the mapped starter memory run on the CPU */
+static int node_fd = -1; /* file of the starter memory */
+static char node_path[256]; /* path of the file of the starter memory */
+static size_t sysmem_size; /* size of the starter memory */
+static uint64_t node_done[MAX_STAGE_SIZE]; /* wr_id of the work requests run by the CPU */
+static uint32_t node_done_head; /* oldest entry of node_done */
+static uint32_t node_done_num; /* # of entries of node_done */
+static struct {
+    uint64_t ops;
+    uint64_t bytes;
+    uint64_t cma;
+} node_stats; /* work requests run by the CPU */
+
+/* 8 byte atomics on the HCA. The atomic operations of an HCA are not */
+/* atomic with those of the CPU unless the device reports              */
+/* IBV_ATOMIC_GLOB, so without it every 8 byte atomic goes to the HCA, */
+/* including those on local memory and those the HCA has not, which    */
+/* run as compare and swap rounds.  With it only remote cas8 and add8  */
+/* do, and the others stay with the CPU of the target.                 */
+#define NATIVE_ATOMIC_NONE 0
+#define NATIVE_ATOMIC_HCA  1
+#define NATIVE_ATOMIC_GLOB 2
+static int native_atomic_mode; /* which 8 byte atomics run on the HCA */
+static uint64_t *atomic_expected; /* value the compare and swap round of each cmdq entry expects */
 
 static uint64_t ack_id; /* wr_id for ack */
 static uint64_t ack_comp_count;/* # of success ack */
@@ -303,78 +577,1670 @@ static int executed_acp_init = false; /* check if acp_init executed or not. */
 
 static pthread_t comm_thread_id; /* communcation thread ID */
 
-void acp_abort(const char *str){
-  
-    int i; /* general index */
+/* statistics */
+/* queue full stalls are updated atomically by the issuing threads, */
+/* the loop counter by the communication thread with a relaxed atomic, */
+/* and the others by the communication thread under stats_seq. */
+static acp_stats_t stats; /* statistics of this process */
+static acp_peer_stats_t *peer_stats; /* transport statistics per peer */
+static uint64_t stats_seq; /* sequence number of the updates of stats */
+static uint64_t *cmdq_issue_nsec; /* issue time of each cmdq entry */
+
+static inline uint64_t get_nsec(void){
     
-    /* release socket file descriptor */
-#ifdef DEBUG
-    fprintf(stdout, "internal acp_abort\n");
-    fflush(stdout);
-#endif
+    struct timespec now;
     
-#ifndef ACPBLONLY
-    iacp_abort_cl();
-    iacp_abort_dl();
-#endif
-    /* close IB resouce */
-    if (res.mr != NULL) {
-        ibv_dereg_mr(res.mr);
-        res.mr = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static inline int stats_op(uint32_t type){
+    
+    switch (type) {
+    case COPY:  return ACP_STATS_OP_COPY;
+    case CAS4:  return ACP_STATS_OP_CAS4;
+    case CAS8:  return ACP_STATS_OP_CAS8;
+    case SWAP4: return ACP_STATS_OP_SWAP4;
+    case SWAP8: return ACP_STATS_OP_SWAP8;
+    case ADD4:  return ACP_STATS_OP_ADD4;
+    case ADD8:  return ACP_STATS_OP_ADD8;
+    case XOR4:  return ACP_STATS_OP_XOR4;
+    case XOR8:  return ACP_STATS_OP_XOR8;
+    case OR4:   return ACP_STATS_OP_OR4;
+    case OR8:   return ACP_STATS_OP_OR8;
+    case AND4:  return ACP_STATS_OP_AND4;
+    case AND8:  return ACP_STATS_OP_AND8;
+    default:    return -1;
     }
-    for (i = 0;i < MAX_RM_SIZE;i++) {
-        if (libvmrtb[i] != NULL) {
-            ibv_dereg_mr(libvmrtb[i]);
-            libvmrtb[i] = NULL;
+}
+
+static inline void stats_tx(int torank, uint32_t len){
+    
+    iacpbl_stats_write_begin(&stats_seq);
+    stats.tx_bytes += len;
+    stats.tx_packets++;
+    if (peer_stats != NULL) {
+        peer_stats[torank].tx_bytes += len;
+        peer_stats[torank].tx_packets++;
+    }
+    iacpbl_stats_write_end(&stats_seq);
+}
+
+static inline void stats_rx(int fromrank, uint32_t len){
+    
+    iacpbl_stats_write_begin(&stats_seq);
+    stats.rx_bytes += len;
+    stats.rx_packets++;
+    if (peer_stats != NULL) {
+        peer_stats[fromrank].rx_bytes += len;
+        peer_stats[fromrank].rx_packets++;
+    }
+    iacpbl_stats_write_end(&stats_seq);
+}
+
+/* wait until head passes handle, sleeping after the spin time */
+static void complete_wait(acp_handle_t handle){
+    
+    uint64_t start; /* start of the wait */
+    
+    start = get_nsec();
+    while (head <= handle) {
+        if (get_nsec() - start < event_spin_nsec) {
+            continue;
+        }
+        pthread_mutex_lock(&complete_mutex);
+        __sync_fetch_and_add(&complete_waiters, 1);
+        event_stats.complete_sleeps++;
+        while (head <= handle) {
+            pthread_cond_wait(&complete_cond, &complete_mutex);
         }
+        __sync_fetch_and_sub(&complete_waiters, 1);
+        pthread_mutex_unlock(&complete_mutex);
     }
-    for (i = 0;i < acp_numprocs;i++) {
-        if (qp[i] != NULL) {
-            ibv_destroy_qp(qp[i]);
-            qp[i] = NULL;
+}
+
+/* wake the communication thread sleeping on events, after tail moved */
+static inline void comm_wake(void){
+    
+    uint64_t one = 1; /* increment of comm_wake_fd */
+    
+    if (event_wait) {
+        __sync_synchronize();
+        if (comm_sleeping) {
+            while (write(comm_wake_fd, &one, sizeof(one)) < 0 && errno == EINTR) ;
         }
     }
-    if (qp != NULL) {
-        free(qp);
-        qp = NULL;
+}
+
+/* Multiple threads issue commands.  Each reserves an entry by a fetch */
+/* and add on tail and stamps it in cmdq_ready once it is filled, and  */
+/* the communication thread moves issue_tail over the stamped entries  */
+/* in order.  A thread finding the queue full spins for                */
+/* --acp-event-spin, then sleeps until entries complete.               */
+static int init_cmdq(void){
+    
+    cmdq_size = (uint32_t)iacpbl_option.cmdqsize.value;
+    cmdq_ready = (volatile acp_handle_t *)calloc(cmdq_size, sizeof(acp_handle_t));
+    cmdq_issue_nsec = (uint64_t *)calloc(cmdq_size, sizeof(uint64_t));
+    atomic_expected = (uint64_t *)calloc(cmdq_size, sizeof(uint64_t));
+    if (cmdq_ready == NULL || cmdq_issue_nsec == NULL || atomic_expected == NULL) {
+        return -1;
     }
+    issue_tail = tail;
+    return 0;
+}
+
+static void free_cmdq(void){
     
-    if (cq != NULL) {
-        ibv_destroy_cq(cq);
-        cq = NULL;
+    free((void *)cmdq_ready);
+    free(cmdq_issue_nsec);
+    free(atomic_expected);
+    cmdq_ready = NULL;
+    cmdq_issue_nsec = NULL;
+    atomic_expected = NULL;
+}
+
+/* reserve a cmdq entry, and stamp its issue time. Returns its handle. */
+static inline acp_handle_t cmdq_reserve(void){
+    
+    acp_handle_t hdl; /* handle of the entry */
+    
+    hdl = __sync_fetch_and_add(&tail, 1);
+    if (hdl - head >= cmdq_size - 1) {
+        __sync_fetch_and_add(&stats.queue_full_stalls, 1);
+        while (hdl - head >= cmdq_size - 1) {
+            complete_wait(head);
+        }
     }
-    if (res.pd != NULL) {
-        ibv_dealloc_pd(res.pd);
-        res.pd = NULL;
+    cmdq_issue_nsec[hdl % cmdq_size] = get_nsec();
+    return hdl;
+}
+
+/* pass the filled entry hdl to the communication thread */
+static inline void cmdq_publish(acp_handle_t hdl){
+    
+    __sync_synchronize();
+    cmdq_ready[hdl % cmdq_size] = hdl;
+    comm_wake();
+}
+
+/* move issue_tail over the entries passed by the issuing threads */
+static inline void cmdq_collect(void){
+    
+    acp_handle_t start = issue_tail; /* issue_tail before the update */
+    
+    while (cmdq_ready[issue_tail % cmdq_size] == issue_tail) {
+        issue_tail++;
     }
-    if (res.ib_ctx != NULL) {
-        ibv_close_device(res.ib_ctx);
-        res.ib_ctx = NULL;
+    if (issue_tail != start) {
+        __sync_synchronize();
     }
+}
+
+/* RRM cache: the remote addr/rkey tables of at most rkey_cache_size ranks  */
+/* stay in rrmtb, the others are fetched again by getlrm on their next use. */
+/* Victims are chosen by CLOCK, so that a hit only sets a reference bit.   */
+
+static int init_rrmtb(void){
     
-    /* close socket file descritptor */
-    if (sock_accept) {
-        close(sock_accept);
+    uint32_t i; /* general index */
+    
+    rkey_cache_size = (uint32_t)iacpbl_option.rkeycache.value;
+    if (rkey_cache_size > acp_numprocs) {
+        rkey_cache_size = acp_numprocs;
     }
-    if (sock_connect) {
-        close(sock_connect);
+    rrmtb = (RM **)calloc(rkey_cache_size + 1, sizeof(RM *));
+    rrmtb_rank = (int *)malloc(sizeof(int) * rkey_cache_size);
+    rrmtb_ref = (char *)calloc(rkey_cache_size, sizeof(char));
+    rrmtb_pf = (char *)calloc(rkey_cache_size, sizeof(char));
+    rrm_slot_tb = (uint32_t *)malloc(sizeof(uint32_t) * acp_numprocs);
+    if (rrmtb == NULL || rrmtb_rank == NULL || rrmtb_ref == NULL || 
+        rrmtb_pf == NULL || rrm_slot_tb == NULL) {
+        return -1;
     }
-    
-    /* free acp region */
-    for (i = 0;i < rkey_cache_size ;i++) {
-        if (rrmtb[i] != NULL) {
-            free(rrmtb[i]);
-            rrmtb[i] = NULL;
-        }
+    for (i = 0; i < rkey_cache_size; i++) {
+        rrmtb_rank[i] = -1;
+    }
+    for (i = 0; i < acp_numprocs; i++) {
+        rrm_slot_tb[i] = rkey_cache_size;
     }
+    rrmtb_hand = 0;
+    rrm_pf_stat = RRM_PF_IDLE;
+    rrm_last_miss = acp_myrank;
+    rrm_stride = 0;
+    memset(&rrm_stats, 0, sizeof(rrm_stats));
+    
+    return 0;
+}
+
+static void free_rrmtb(void){
+    
+    uint32_t i; /* general index */
+    
     if (rrmtb != NULL) {
+        for (i = 0; i < rkey_cache_size; i++) {
+            if (rrmtb[i] != NULL) {
+                free(rrmtb[i]);
+                rrmtb[i] = NULL;
+            }
+        }
         free(rrmtb);
         rrmtb = NULL;
     }
-    if (sysmem != NULL) {
-        free(sysmem);
-        sysmem = NULL;
+    free(rrmtb_rank);
+    free(rrmtb_ref);
+    free(rrmtb_pf);
+    free(rrm_slot_tb);
+    rrmtb_rank = NULL;
+    rrmtb_ref = NULL;
+    rrmtb_pf = NULL;
+    rrm_slot_tb = NULL;
+}
+
+/* slot of rrmtb caching rank, or the empty slot rkey_cache_size */
+static inline uint32_t rrm_index(int rank){
+    
+    return rrm_slot_tb[rank];
+}
+
+/* slot of rrmtb for a command on tag of rank, counted as a hit if the tag is valid */
+static inline uint32_t rrm_lookup(int rank, int tag){
+    
+    uint32_t slot = rrm_slot_tb[rank];
+    
+    if (rrmtb[slot] != NULL && rrmtb[slot][tag].valid == true) {
+        rrm_stats.hits++;
+        rrmtb_ref[slot] = true;
+        if (rrmtb_pf[slot] == true) {
+            rrm_stats.prefetch_hits++;
+            rrmtb_pf[slot] = false;
+        }
+    }
+    return slot;
+}
+
+/* forget the table of rank, its slot keeps the buffer for the next table */
+static inline void rrm_drop(int rank){
+    
+    uint32_t slot = rrm_slot_tb[rank];
+    
+    if (slot == rkey_cache_size) {
+        return;
+    }
+    rrmtb_rank[slot] = -1;
+    rrmtb_ref[slot] = false;
+    rrmtb_pf[slot] = false;
+    rrm_slot_tb[rank] = rkey_cache_size;
+}
+
+/* a free slot, or the first one the CLOCK hand finds unreferenced */
+static inline uint32_t rrm_victim(void){
+    
+    uint32_t slot;
+    
+    for (;;) {
+        slot = rrmtb_hand;
+        rrmtb_hand = (rrmtb_hand + 1) % rkey_cache_size;
+        if (rrmtb_rank[slot] < 0) {
+            return slot;
+        }
+        if (rrmtb_ref[slot] == false) {
+            break;
+        }
+        rrmtb_ref[slot] = false;
+    }
+    rrm_stats.evictions++;
+    rrm_drop(rrmtb_rank[slot]);
+    
+    return slot;
+}
+
+/* after two misses at the same distance, prefetch the table of the next rank at that distance */
+static inline void rrm_predict(int rank){
+    
+    int stride; /* distance from the last miss */
+    int next; /* predicted rank */
+    
+    stride = (rank - rrm_last_miss + acp_numprocs) % acp_numprocs;
+    if (iacpbl_option.rkeyprefetch.value && stride != 0 && stride == rrm_stride && 
+        rrm_pf_stat == RRM_PF_IDLE) {
+        next = (rank + stride) % acp_numprocs;
+        if (next == acp_myrank) {
+            next = (next + stride) % acp_numprocs;
+        }
+        if (next != acp_myrank && rrm_slot_tb[next] == rkey_cache_size) {
+            rrm_pf_rank = next;
+            rrm_pf_stat = RRM_PF_PENDING;
+        }
+    }
+    rrm_last_miss = rank;
+    rrm_stride = stride;
+}
+
+/* Send queues: a transfer stages its work request with post_wr, and   */
+/* flush_wr links the staged ones of each QP into a chain posted by a  */
+/* single ibv_post_send at the end of each round of the communication  */
+/* thread.  Only every WR_SIGNAL_INTERVAL-th work request and the last */
+/* one of a chain make a CQE; poll_wc completes the unsignaled ones     */
+/* posted before a signaled one when its CQE arrives, since a QP        */
+/* completes its work requests in order, and likewise the ones posted   */
+/* before a failed one when its error CQE arrives.                      */
+
+static int qpn_compare(const void *a, const void *b){
+    
+    uint32_t x = ((const QPN *)a)->qp_num;
+    uint32_t y = ((const QPN *)b)->qp_num;
+    
+    return (x > y) - (x < y);
+}
+
+static int init_sq(void){
+    
+    int i; /* general index */
+    
+    sqtb = (SQ **)calloc(acp_numprocs, sizeof(SQ *));
+    stage_ranks = (int *)malloc(sizeof(int) * acp_numprocs);
+    qpntb = (QPN *)malloc(sizeof(QPN) * acp_numprocs);
+    if (sqtb == NULL || stage_ranks == NULL || qpntb == NULL) {
+        return -1;
+    }
+    for (i = 0; i < MAX_STAGE_SIZE; i++) {
+        swrtb[i].next = i + 1;
+    }
+    swrtb[MAX_STAGE_SIZE - 1].next = -1;
+    swr_free = 0;
+    stage_nranks = 0;
+    cq_pending = 0;
+    qpn_num = 0;
+    
+    return 0;
+}
+
+static void free_sq(void){
+    
+    int i; /* general index */
+    
+    if (sqtb != NULL) {
+        for (i = 0; i < acp_numprocs; i++) {
+            free(sqtb[i]);
+        }
+        free(sqtb);
+        sqtb = NULL;
+    }
+    free(stage_ranks);
+    free(qpntb);
+    stage_ranks = NULL;
+    qpntb = NULL;
+}
+
+/* add the QP number of rank to qpntb */
+static void qpn_insert(uint32_t qp_num, int rank){
+    
+    int i; /* insert position */
+    
+    for (i = qpn_num; i > 0 && qpntb[i - 1].qp_num > qp_num; i--) {
+        qpntb[i] = qpntb[i - 1];
+    }
+    qpntb[i].qp_num = qp_num;
+    qpntb[i].rank = rank;
+    qpn_num++;
+}
+
+/* remove a QP number from qpntb */
+static void qpn_remove(uint32_t qp_num){
+    
+    QPN key, *qpn; /* QP number to remove */
+    
+    key.qp_num = qp_num;
+    qpn = (QPN *)bsearch(&key, qpntb, qpn_num, sizeof(QPN), qpn_compare);
+    if (qpn != NULL) {
+        memmove(qpn, qpn + 1, sizeof(QPN) * (qpntb + qpn_num - qpn - 1));
+        qpn_num--;
+    }
+}
+
+/* post receive of slot of ud_buf */
+static int post_ud_recv(uint32_t slot){
+    
+    struct ibv_sge sge; /* scatter/gather entry */
+    struct ibv_recv_wr rr; /* receive work request */
+    struct ibv_recv_wr *bad_wr; /* return of receive work request */
+    
+    memset(&sge, 0, sizeof(sge));
+    sge.addr = (uintptr_t)(ud_buf + (UD_GRH_SIZE + sizeof(CMSG)) * slot);
+    sge.length = UD_GRH_SIZE + sizeof(CMSG);
+    sge.lkey = ud_mr->lkey;
+    
+    memset(&rr, 0, sizeof(rr));
+    rr.next = NULL;
+    rr.wr_id = slot;
+    rr.sg_list = &sge;
+    rr.num_sge = 1;
+    
+    return ibv_post_recv(ud_qp, &rr, &bad_wr);
+}
+
+/* post a receive for an immediate to srq */
+static int post_srq_recv(void){
+    
+    struct ibv_recv_wr rr; /* receive work request */
+    struct ibv_recv_wr *bad_wr; /* return of receive work request */
+    
+    memset(&rr, 0, sizeof(rr));
+    rr.next = NULL;
+    rr.wr_id = 0;
+    rr.sg_list = NULL;
+    rr.num_sge = 0;
+    
+    return ibv_post_srq_recv(srq, &rr, &bad_wr);
+}
+
+static int init_event(void){
+    
+    event_wait = (int)iacpbl_option.eventwait.value;
+    event_spin_nsec = iacpbl_option.eventspin.value * 1000;
+    memset(&event_stats, 0, sizeof(event_stats));
+    if (!event_wait) {
+        return 0;
+    }
+    event_ch = ibv_create_comp_channel(res.ib_ctx);
+    comm_wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (event_ch == NULL || comm_wake_fd < 0) {
+        fprintf(stderr, "%d: failed to create completion channel\n", acp_myrank);
+        return -1;
+    }
+    /* events are taken after poll tells there are some */
+    fcntl(event_ch->fd, F_SETFL, fcntl(event_ch->fd, F_GETFL) | O_NONBLOCK);
+    
+    return 0;
+}
+
+/* called after the CQs are destroyed */
+static void free_event(void){
+    
+    if (event_ch != NULL) {
+        ibv_destroy_comp_channel(event_ch);
+        event_ch = NULL;
+    }
+    if (comm_wake_fd >= 0) {
+        close(comm_wake_fd);
+        comm_wake_fd = -1;
+    }
+}
+
+static int init_conn(void){
+    
+    struct ibv_qp_init_attr ud_init_attr; /* attributes of the UD QP */
+    struct ibv_qp_init_attr probe_attr; /* attributes of the probe QP */
+    struct ibv_qp *probe_qp; /* QP to probe inline data */
+    struct ibv_qp_attr attr; /* modify queue pair */
+    struct ibv_srq_init_attr srq_attr; /* attributes of the SRQ */
+    size_t size; /* size of ud_buf */
+    uint32_t i; /* general index */
+    
+    conntb = (CONN *)calloc(acp_numprocs, sizeof(CONN));
+    conn_list = (int *)malloc(sizeof(int) * acp_numprocs);
+    if (conntb == NULL || conn_list == NULL) {
+        fprintf(stderr, "failed to malloc connection table\n");
+        return -1;
+    }
+    conn_max = (uint32_t)iacpbl_option.qppool.value;
+    conn_ondemand = (conn_max > 0);
+    if (conn_max == 0 || conn_max > acp_numprocs) {
+        conn_max = acp_numprocs;
+    }
+    else if (conn_max < 2) {
+        /* the QP to the own rank and one peer */
+        conn_max = 2;
+    }
+    conn_num = 0;
+    conn_pending = 0;
+    conn_closing = 0;
+    conn_serial = 0;
+    conn_clock = 0;
+    memset(&conn_stats, 0, sizeof(conn_stats));
+    
+    /* receives for the immediates of commands to this rank */
+    if (event_wait) {
+        rcq = ibv_create_cq(res.ib_ctx, EVENT_RECV_SIZE, NULL, event_ch, 0);
+        memset(&srq_attr, 0, sizeof(srq_attr));
+        srq_attr.attr.max_wr = EVENT_RECV_SIZE;
+        srq_attr.attr.max_sge = 1;
+        srq = ibv_create_srq(res.pd, &srq_attr);
+        if (rcq == NULL || srq == NULL) {
+            fprintf(stderr, "%d: failed to create SRQ\n", acp_myrank);
+            return -1;
+        }
+        for (i = 0; i < EVENT_RECV_SIZE; i++) {
+            if (post_srq_recv()) {
+                fprintf(stderr, "%d: failed to post RR\n", acp_myrank);
+                return -1;
+            }
+        }
+    }
+    
+    /* attributes of RC QPs */
+    memset(&rc_init_attr, 0, sizeof(rc_init_attr));
+    rc_init_attr.qp_type = IBV_QPT_RC;
+    rc_init_attr.sq_sig_all = 0; /* only work requests with IBV_SEND_SIGNALED enqueue CQEs. */
+    rc_init_attr.send_cq = cq;
+    rc_init_attr.recv_cq = (rcq != NULL) ? rcq : cq;
+    rc_init_attr.srq = srq;
+    rc_init_attr.cap.max_send_wr = MAX_WR_SIZE;
+    rc_init_attr.cap.max_recv_wr = 0;
+    rc_init_attr.cap.max_send_sge = 1;
+    rc_init_attr.cap.max_recv_sge = 0;
+    rc_init_attr.cap.max_inline_data = MAX_INLINE_SIZE;
+    
+    /* work requests are staged before their QP exists, so probe inline data now */
+    probe_attr = rc_init_attr;
+    probe_qp = ibv_create_qp(res.pd, &probe_attr);
+    if (probe_qp == NULL) {
+        /* the device has no inline data */
+        rc_init_attr.cap.max_inline_data = 0;
+        probe_attr = rc_init_attr;
+        probe_qp = ibv_create_qp(res.pd, &probe_attr);
+    }
+    if (probe_qp == NULL) {
+        fprintf(stderr, "failed to create QP\n");
+        return -1;
+    }
+    ibv_destroy_qp(probe_qp);
+    max_inline_data = rc_init_attr.cap.max_inline_data;
+    if (!conn_ondemand) {
+        return 0;
+    }
+    
+    /* UD QP for connection messages */
+    ud_cq = ibv_create_cq(res.ib_ctx, UD_RECV_SIZE + UD_SEND_SIZE, NULL, event_ch, 0);
+    size = (UD_GRH_SIZE + sizeof(CMSG)) * UD_RECV_SIZE + sizeof(CMSG) * UD_SEND_SIZE;
+    ud_buf = (char *)calloc(size, 1);
+    if (ud_cq == NULL || ud_buf == NULL) {
+        fprintf(stderr, "failed to create UD resources\n");
+        return -1;
+    }
+    ud_mr = ibv_reg_mr(res.pd, ud_buf, size, IBV_ACCESS_LOCAL_WRITE);
+    
+    memset(&ud_init_attr, 0, sizeof(ud_init_attr));
+    ud_init_attr.qp_type = IBV_QPT_UD;
+    ud_init_attr.send_cq = ud_cq;
+    ud_init_attr.recv_cq = ud_cq;
+    ud_init_attr.cap.max_send_wr = UD_SEND_SIZE;
+    ud_init_attr.cap.max_recv_wr = UD_RECV_SIZE;
+    ud_init_attr.cap.max_send_sge = 1;
+    ud_init_attr.cap.max_recv_sge = 1;
+    ud_qp = (ud_mr != NULL) ? ibv_create_qp(res.pd, &ud_init_attr) : NULL;
+    if (ud_qp == NULL) {
+        fprintf(stderr, "failed to create UD QP\n");
+        return -1;
+    }
+    
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_INIT;
+    attr.pkey_index = 0;
+    attr.port_num = ib_port;
+    attr.qkey = UD_QKEY;
+    if (ibv_modify_qp(ud_qp, &attr, IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT | IBV_QP_QKEY)) {
+        fprintf(stderr, "%d: change UD QP state to INIT failed\n", acp_myrank);
+        return -1;
+    }
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_RTR;
+    if (ibv_modify_qp(ud_qp, &attr, IBV_QP_STATE)) {
+        fprintf(stderr, "%d: change UD QP state to RTR failed\n", acp_myrank);
+        return -1;
+    }
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_RTS;
+    attr.sq_psn = 0;
+    if (ibv_modify_qp(ud_qp, &attr, IBV_QP_STATE | IBV_QP_SQ_PSN)) {
+        fprintf(stderr, "%d: change UD QP state to RTS failed\n", acp_myrank);
+        return -1;
+    }
+    for (i = 0; i < UD_RECV_SIZE; i++) {
+        if (post_ud_recv(i)) {
+            fprintf(stderr, "%d: failed to post RR\n", acp_myrank);
+            return -1;
+        }
+    }
+    ud_send_next = 0;
+    ud_send_num = 0;
+    
+    return 0;
+}
+
+static void free_conn(void){
+    
+    int i; /* general index */
+    
+    if (conntb != NULL) {
+        for (i = 0; i < acp_numprocs; i++) {
+            if (conntb[i].ah != NULL) {
+                ibv_destroy_ah(conntb[i].ah);
+            }
+        }
+        free(conntb);
+        conntb = NULL;
+    }
+    free(conn_list);
+    conn_list = NULL;
+    if (ud_qp != NULL) {
+        ibv_destroy_qp(ud_qp);
+        ud_qp = NULL;
+    }
+    if (ud_mr != NULL) {
+        ibv_dereg_mr(ud_mr);
+        ud_mr = NULL;
+    }
+    free(ud_buf);
+    ud_buf = NULL;
+    if (ud_cq != NULL) {
+        ibv_destroy_cq(ud_cq);
+        ud_cq = NULL;
+    }
+    if (srq != NULL) {
+        ibv_destroy_srq(srq);
+        srq = NULL;
+    }
+    if (rcq != NULL) {
+        ibv_destroy_cq(rcq);
+        rcq = NULL;
+    }
+}
+
+/* create the RC QP to rank in INIT */
+static void create_rc_qp(int rank){
+    
+    struct ibv_qp_init_attr init_attr; /* attributes of the QP */
+    struct ibv_qp_attr attr; /* modify queue pair */
+    CONN *conn = &conntb[rank]; /* connection to rank */
+    
+    init_attr = rc_init_attr;
+    qp[rank] = ibv_create_qp(res.pd, &init_attr);
+    if (qp[rank] == NULL) {
+        fprintf(stderr, "%d: failed to create QP to %d\n", acp_myrank, rank);
+        exit(-1);
+    }
+    
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_INIT;
+    attr.port_num = ib_port; /* physical port number (1...n)*/
+    attr.pkey_index = 0; /* normally 0 */
+    attr.qp_access_flags = 
+        IBV_ACCESS_LOCAL_WRITE | 
+        IBV_ACCESS_REMOTE_READ |
+        IBV_ACCESS_REMOTE_WRITE |
+        IBV_ACCESS_REMOTE_ATOMIC;
+    if (ibv_modify_qp(qp[rank], &attr, IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT | IBV_QP_ACCESS_FLAGS)) {
+        fprintf(stderr, "%d: change QP state to INIT failed\n", acp_myrank);
+        exit(-1);
+    }
+    
+    qpn_insert(qp[rank]->qp_num, rank);
+    conn->serial = ++conn_serial;
+    conn->rserial = 0;
+    conn->list = conn_num;
+    conn_list[conn_num++] = rank;
+}
+
+/* connect the RC QP to rank to the QP rqp_num of rank */
+static void connect_rc_qp(int rank, uint32_t rqp_num){
+    
+    struct ibv_qp_attr attr; /* modify queue pair */
+    int flags; /* flag of modify queue pair */
+    
+    /* modify the QP to RTR */
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_RTR;
+    attr.path_mtu = res.port_attr.active_mtu;
+    attr.dest_qp_num = rqp_num;
+    attr.rq_psn = 0;
+    attr.max_dest_rd_atomic = 1;
+    /* recommend value 0x12. miminum RNR (receive not ready) NAK timer */
+    attr.min_rnr_timer = 0x12; 
+    attr.ah_attr.dlid = conntb[rank].lid; 
+    attr.ah_attr.sl = 0;
+    attr.ah_attr.src_path_bits = 0;
+    attr.ah_attr.is_global = 0;
+    attr.ah_attr.port_num = ib_port;
+    flags = IBV_QP_STATE |
+        IBV_QP_AV | 
+        IBV_QP_PATH_MTU | 
+        IBV_QP_DEST_QPN |
+        IBV_QP_RQ_PSN | 
+        IBV_QP_MAX_DEST_RD_ATOMIC | 
+        IBV_QP_MIN_RNR_TIMER;
+    if (ibv_modify_qp(qp[rank], &attr, flags)) {
+        fprintf(stderr, "%d: failed to modify QP state to RTR\n", acp_myrank);
+        exit(-1);
+    }
+    
+    /* modify the QP to RTS */
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_RTS;
+    attr.timeout = 0x12;
+    attr.retry_cnt = 7; /* recommended 7 */
+    attr.rnr_retry = 7; /* recommended 7 */
+    attr.sq_psn = 0; /* send queue starting packet sequence number (should match remote QP’s rq_psn) */
+    attr.max_rd_atomic = 1; /* # of outstanding RDMA reads and atomic operations allowed.*/
+    flags = IBV_QP_STATE | 
+        IBV_QP_TIMEOUT | 
+        IBV_QP_RETRY_CNT | 
+        IBV_QP_RNR_RETRY |  
+        IBV_QP_SQ_PSN | 
+        IBV_QP_MAX_QP_RD_ATOMIC;
+    if (ibv_modify_qp(qp[rank], &attr, flags)) {
+        fprintf(stderr, "%d: failed to modify QP state to RTS\n", acp_myrank);
+        exit(-1);
+    }
+}
+
+/* the QP to rank is ready to post */
+static inline void conn_ready(int rank){
+    
+    if (conntb[rank].stat != CONN_NONE) {
+        conn_pending--;
+    }
+    conntb[rank].stat = CONN_READY;
+    conntb[rank].used = conn_clock;
+}
+
+/* destroy the RC QP to rank, which has no work request in flight */
+static void destroy_rc_qp(int rank){
+    
+    CONN *conn = &conntb[rank]; /* connection to rank */
+    int last; /* rank at the end of conn_list */
+    
+    if (conn->stat == CONN_REQ || conn->stat == CONN_ACCEPT || conn->stat == CONN_CLOSING) {
+        conn_pending--;
+    }
+    if (conn->stat == CONN_CLOSING) {
+        conn_closing--;
+    }
+    qpn_remove(qp[rank]->qp_num);
+    ibv_destroy_qp(qp[rank]);
+    qp[rank] = NULL;
+    last = conn_list[--conn_num];
+    conn_list[conn->list] = last;
+    conntb[last].list = conn->list;
+    conn->stat = CONN_NONE;
+    conn->rserial = 0;
+}
+
+/* the QP to rank has no work request in flight or staged */
+static inline int conn_idle(int rank){
+    
+    SQ *sq = sqtb[rank]; /* send queue of rank */
+    
+    return sq == NULL || (sq->num == 0 && sq->stage_head < 0);
+}
+
+/* send a connection message to rank, lost ones are sent again on the timeout of the requester */
+static void conn_send(int rank, uint32_t type, uint32_t rserial){
+    
+    struct ibv_ah_attr ah_attr; /* address of rank */
+    struct ibv_sge sge; /* scatter/gather entry */
+    struct ibv_send_wr sr; /* send work request */
+    struct ibv_send_wr *bad_wr; /* return of send work request */
+    CONN *conn = &conntb[rank]; /* connection to rank */
+    CMSG *msg; /* message */
+    
+    if (ud_send_num >= UD_SEND_SIZE) {
+        return;
+    }
+    if (conn->ah == NULL) {
+        memset(&ah_attr, 0, sizeof(ah_attr));
+        ah_attr.dlid = conn->lid;
+        ah_attr.port_num = ib_port;
+        conn->ah = ibv_create_ah(res.pd, &ah_attr);
+        if (conn->ah == NULL) {
+            return;
+        }
+    }
+    
+    msg = (CMSG *)(ud_buf + (UD_GRH_SIZE + sizeof(CMSG)) * UD_RECV_SIZE + sizeof(CMSG) * ud_send_next);
+    msg->type = type;
+    msg->rank = acp_myrank;
+    msg->qp_num = (qp[rank] != NULL) ? qp[rank]->qp_num : 0;
+    msg->serial = conn->serial;
+    msg->rserial = rserial;
+    
+    memset(&sge, 0, sizeof(sge));
+    sge.addr = (uintptr_t)msg;
+    sge.length = sizeof(CMSG);
+    sge.lkey = ud_mr->lkey;
+    
+    memset(&sr, 0, sizeof(sr));
+    sr.next = NULL;
+    sr.wr_id = 0;
+    sr.sg_list = &sge;
+    sr.num_sge = 1;
+    sr.opcode = IBV_WR_SEND;
+    sr.send_flags = IBV_SEND_SIGNALED;
+    sr.wr.ud.ah = conn->ah;
+    sr.wr.ud.remote_qpn = conn->ud_qp_num;
+    sr.wr.ud.remote_qkey = UD_QKEY;
+    if (ibv_post_send(ud_qp, &sr, &bad_wr) == 0) {
+        ud_send_next = (ud_send_next + 1) % UD_SEND_SIZE;
+        ud_send_num++;
+    }
+}
+
+/* start disconnecting the least recently used idle QP */
+static void conn_evict(void){
+    
+    uint32_t i; /* index of conn_list */
+    int rank, victim; /* rank */
+    
+    if (conn_closing > 0) {
+        return;
+    }
+    victim = -1;
+    for (i = 0; i < conn_num; i++) {
+        rank = conn_list[i];
+        if (conntb[rank].stat == CONN_READY && rank != acp_myrank && conn_idle(rank) &&
+            (victim < 0 || conntb[rank].used < conntb[victim].used)) {
+            victim = rank;
+        }
+    }
+    if (victim < 0) {
+        return;
+    }
+    conntb[victim].stat = CONN_CLOSING;
+    conntb[victim].nsec = get_nsec();
+    conn_closing++;
+    conn_pending++;
+    conn_stats.evictions++;
+    conn_send(victim, CMSG_DISC, conntb[victim].rserial);
+}
+
+/* start connecting a QP to rank */
+static void conn_request(int rank){
+    
+    CONN *conn = &conntb[rank]; /* connection to rank */
+    
+    if (conn->stat != CONN_NONE) {
+        return;
+    }
+    if (conn_num >= conn_max) {
+        conn_evict();
+        return;
+    }
+    create_rc_qp(rank);
+    conn_stats.connects++;
+    if (rank == acp_myrank) {
+        connect_rc_qp(rank, qp[rank]->qp_num);
+        conn->rserial = conn->serial;
+        conn_ready(rank);
+        return;
+    }
+    conn->stat = CONN_REQ;
+    conn->nsec = get_nsec();
+    conn_pending++;
+    conn_send(rank, CMSG_REQ, 0);
+}
+
+/* handle a connection message */
+static void conn_recv(CMSG *msg){
+    
+    CONN *conn; /* connection to the sender */
+    int rank; /* sender */
+    
+    rank = msg->rank;
+    if (rank < 0 || rank >= acp_numprocs || rank == acp_myrank) {
+        return;
+    }
+    conn = &conntb[rank];
+    
+    switch (msg->type) {
+    case CMSG_REQ:
+        if (conn->stat != CONN_NONE && conn->stat != CONN_REQ && conn->rserial == msg->serial) {
+            /* a repeated request, the reply was lost */
+            if (conn->stat == CONN_ACCEPT || conn->stat == CONN_READY) {
+                conn_send(rank, CMSG_REP, msg->serial);
+            }
+            break;
+        }
+        if (msg->serial <= conn->rseen || conn->stat == CONN_ACCEPT || conn->stat == CONN_READY) {
+            /* a stale request of a former connection */
+            break;
+        }
+        conn->rseen = msg->serial;
+        if (conn->stat == CONN_CLOSING) {
+            /* the rank dropped the closing QP and connects again */
+            destroy_rc_qp(rank);
+        }
+        if (conn->stat == CONN_NONE) {
+            create_rc_qp(rank);
+            conn_pending++;
+            conn_stats.accepts++;
+        }
+        /* when both connect at once, the QP of the own request is used */
+        connect_rc_qp(rank, msg->qp_num);
+        conn->stat = CONN_ACCEPT;
+        conn->rserial = msg->serial;
+        conn->nsec = get_nsec();
+        conn_send(rank, CMSG_REP, msg->serial);
+        break;
+        
+    case CMSG_REP:
+        if (msg->rserial != conn->serial) {
+            break;
+        }
+        if (conn->stat == CONN_REQ) {
+            connect_rc_qp(rank, msg->qp_num);
+            conn->rserial = msg->serial;
+            conn_ready(rank);
+        }
+        else if (conn->stat == CONN_ACCEPT && conn->rserial == msg->serial) {
+            /* both connected at once */
+            conn_ready(rank);
+        }
+        else if (conn->stat != CONN_READY || conn->rserial != msg->serial) {
+            break;
+        }
+        /* ready to use, sent again on a repeated reply */
+        conn_send(rank, CMSG_RTU, msg->serial);
+        break;
+        
+    case CMSG_RTU:
+        if (conn->stat == CONN_ACCEPT && conn->rserial == msg->serial && conn->serial == msg->rserial) {
+            conn_ready(rank);
+        }
+        break;
+        
+    case CMSG_DISC:
+        if ((conn->stat == CONN_ACCEPT || conn->stat == CONN_READY || conn->stat == CONN_CLOSING) &&
+            conn->rserial == msg->serial && conn->serial == msg->rserial) {
+            if (!conn_idle(rank)) {
+                conn_send(rank, CMSG_DISC_NAK, msg->serial);
+                break;
+            }
+            destroy_rc_qp(rank);
+        }
+        /* the QP is gone, or is already */
+        conn_send(rank, CMSG_DISC_ACK, msg->serial);
+        break;
+        
+    case CMSG_DISC_ACK:
+        if (conn->stat == CONN_CLOSING && msg->rserial == conn->serial) {
+            destroy_rc_qp(rank);
+        }
+        break;
+        
+    case CMSG_DISC_NAK:
+        if (conn->stat == CONN_CLOSING && msg->rserial == conn->serial) {
+            conn_closing--;
+            conn_ready(rank);
+        }
+        break;
+    }
+}
+
+/* handle connection messages, send requests again on timeout and shrink the pool. */
+/* Returns the # of completions of connection messages. */
+static int conn_progress(void){
+    
+    struct ibv_wc wc[UD_RECV_SIZE]; /* work completions */
+    uint64_t now; /* current time */
+    uint32_t i; /* general index */
+    int n; /* # of work completions */
+    int rank; /* rank */
+    
+    if (ud_cq == NULL) {
+        return 0;
+    }
+    n = ibv_poll_cq(ud_cq, UD_RECV_SIZE, wc);
+    if (n < 0) {
+        fprintf(stderr, "Fail poll cq\n");
+        exit(-1);
+    }
+    for (i = 0; i < n; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "%d: connection message failed, status %d\n", acp_myrank, wc[i].status);
+            exit(-1);
+        }
+        if (wc[i].opcode == IBV_WC_SEND) {
+            ud_send_num--;
+        }
+        else {
+            conn_recv((CMSG *)(ud_buf + (UD_GRH_SIZE + sizeof(CMSG)) * wc[i].wr_id + UD_GRH_SIZE));
+            post_ud_recv(wc[i].wr_id);
+        }
+    }
+    
+    if (conn_pending > 0) {
+        now = get_nsec();
+        if (now - conn_check_nsec >= CONN_RETRY_NSEC / 4) {
+            conn_check_nsec = now;
+            for (i = 0; i < conn_num; i++) {
+                rank = conn_list[i];
+                if ((conntb[rank].stat == CONN_REQ || conntb[rank].stat == CONN_ACCEPT || conntb[rank].stat == CONN_CLOSING) &&
+                    now - conntb[rank].nsec >= CONN_RETRY_NSEC) {
+                    conntb[rank].nsec = now;
+                    if (conntb[rank].stat == CONN_REQ) {
+                        conn_send(rank, CMSG_REQ, 0);
+                    }
+                    else if (conntb[rank].stat == CONN_ACCEPT) {
+                        conn_send(rank, CMSG_REP, conntb[rank].rserial);
+                    }
+                    else {
+                        conn_send(rank, CMSG_DISC, conntb[rank].rserial);
+                    }
+                }
+            }
+        }
+    }
+    if (conn_num > conn_max) {
+        conn_evict();
+    }
+    
+    return n;
+}
+
+/* repost the receives consumed by immediates. Returns their # */
+static int poll_imm(void){
+    
+    struct ibv_wc wc[MAX_POLL_SIZE]; /* work completions */
+    int n; /* # of work completions */
+    int i; /* general index */
+    
+    if (rcq == NULL) {
+        return 0;
+    }
+    n = ibv_poll_cq(rcq, MAX_POLL_SIZE, wc);
+    if (n < 0) {
+        fprintf(stderr, "Fail poll cq\n");
+        exit(-1);
+    }
+    /* the immediate only wakes the thread, the command is in rcmdbuf */
+    for (i = 0; i < n; i++) {
+        if (post_srq_recv()) {
+            fprintf(stderr, "%d: failed to post RR\n", acp_myrank);
+            exit(-1);
+        }
+    }
+    return n;
+}
+
+/* nothing to do until a completion, a command or a flag from another rank */
+static int comm_idle(void){
+    
+    acp_handle_t index; /* index of cmdq or rcmdbuf */
+    CMD *cmd; /* command */
+    
+    if (node_done_num > 0) {
+        return false;
+    }
+    cmdq_collect();
+    event_tail = issue_tail;
+    for (index = head; index < event_tail; index++) {
+        cmd = &cmdq[index % cmdq_size];
+        if (cmd->type == FIN) {
+            return false;
+        }
+        switch (cmd->stat) {
+        case UNISSUED:
+        case GETED_RRM:
+        case PRE_ATOMIC:
+        case PRE_PUTRRMFLAG:
+        case PRE_GET_HEAD:
+        case PRE_PUT_CMD:
+            return false;
+        }
+    }
+    for (index = *rcmdbuf_head; index < *rcmdbuf_tail; index++) {
+        cmd = &rcmdbuf[index % MAX_RCMDB_SIZE];
+        if (cmd->valid_head == false || cmd->valid_tail == false) {
+            continue;
+        }
+        switch (cmd->stat) {
+        case CMD_UNISSUED:
+        case CMD_GETED_RRM:
+        case CMD_PRE_WRITEBACK_FIN:
+        case CMD_PRE_PUTRRMGETEDFLAG_ISSUED:
+        case CMD_PRE_PUTRRMGETEDFLAG_PUT_DST:
+            return false;
+        }
+    }
+    return rrm_pf_stat == RRM_PF_IDLE || rrm_pf_stat == RRM_PF_WAIT || rrm_pf_stat == RRM_PF_WAIT_FLAG;
+}
+
+/* sleep until a completion, a command of an issuing thread or the timeout */
+static void comm_sleep(void){
+    
+    struct pollfd fds[2]; /* completion channel and comm_wake_fd */
+    struct ibv_cq *ev_cq; /* CQ of an event */
+    void *ev_ctx; /* context of the CQ */
+    uint64_t val; /* counter of comm_wake_fd */
+    
+    comm_sleeping = true;
+    __sync_synchronize();
+    if (tail == event_tail) {
+        fds[0].fd = event_ch->fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = comm_wake_fd;
+        fds[1].events = POLLIN;
+        event_stats.sleeps++;
+        if (poll(fds, 2, EVENT_TIMEOUT_MSEC) == 0) {
+            event_stats.timeouts++;
+        }
+    }
+    comm_sleeping = false;
+    while (ibv_get_cq_event(event_ch, &ev_cq, &ev_ctx) == 0) {
+        ibv_ack_cq_events(ev_cq, 1);
+    }
+    while (read(comm_wake_fd, &val, sizeof(val)) > 0) ;
+}
+
+/* called by the communication thread every round, it sleeps */
+/* after the spin time without progress. The CQs are armed  */
+/* a round before, so that the completions in between are   */
+/* polled and those after wake it.                          */
+static void comm_event_round(int busy){
+    
+    static uint64_t idle_nsec; /* start of the idle time, 0 if busy */
+    static int armed; /* the CQs are armed */
+    uint64_t now; /* current time */
+    
+    if (busy || !comm_idle()) {
+        idle_nsec = 0;
+        armed = false;
+        return;
+    }
+    now = get_nsec();
+    if (idle_nsec == 0) {
+        idle_nsec = now;
+        return;
+    }
+    if (now - idle_nsec < event_spin_nsec) {
+        return;
+    }
+    if (!armed) {
+        ibv_req_notify_cq(cq, 0);
+        if (ud_cq != NULL) {
+            ibv_req_notify_cq(ud_cq, 0);
+        }
+        ibv_req_notify_cq(rcq, 0);
+        armed = true;
+        return;
+    }
+    comm_sleep();
+    armed = false;
+}
+
+/* stage a work request for torank. Returns -1 if it has to be retried. */
+/* allocate the starter memory, in a file of /dev/shm with --acp-intranode */
+static int init_node(size_t size){
+    
+    char hostname[256]; /* host name */
+    unsigned char *c; /* character of hostname */
+    
+    sysmem_size = size;
+    node_done_head = 0;
+    node_done_num = 0;
+    node_pop = 1;
+    memset(&node_stats, 0, sizeof(node_stats));
+    
+    /* FNV-1a hash of the host name */
+    memset(hostname, 0, sizeof(hostname));
+    gethostname(hostname, sizeof(hostname) - 1);
+    node_hostid = 14695981039346656037LLU;
+    for (c = (unsigned char *)hostname; *c != '\0'; c++) {
+        node_hostid = (node_hostid ^ *c) * 1099511628211LLU;
+    }
+    
+    if (iacpbl_option.intranode.value && acp_numprocs > 1) {
+        node_sm = (char **)calloc(acp_numprocs, sizeof(char *));
+        node_pid = (pid_t *)calloc(acp_numprocs, sizeof(pid_t));
+        if (node_sm == NULL || node_pid == NULL) {
+            return -1;
+        }
+        sprintf(node_path, "%s_task%u_rank%d", NODE_SHMPATH, acp_taskid, acp_myrank);
+        node_fd = open(node_path, O_CREAT | O_TRUNC | O_RDWR, 0600);
+        if (node_fd >= 0 && ftruncate(node_fd, size) == 0) {
+            sysmem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, node_fd, 0);
+            if (sysmem == MAP_FAILED) {
+                sysmem = NULL;
+            }
+        }
+        if (sysmem == NULL) {
+            /* the other processes of the node go through the HCA */
+            fprintf(stderr, "%d: acp intranode: no shared memory at %s, left to the HCA\n", acp_myrank, node_path);
+            if (node_fd >= 0) {
+                close(node_fd);
+                unlink(node_path);
+                node_fd = -1;
+            }
+            free(node_sm);
+            free(node_pid);
+            node_sm = NULL;
+            node_pid = NULL;
+        }
+        else {
+            node_sm[acp_myrank] = sysmem;
+            node_pid[acp_myrank] = getpid();
+        }
+    }
+    if (sysmem == NULL) {
+        sysmem = (char *) malloc(size);
+    }
+    
+    return (sysmem == NULL) ? -1 : 0;
+}
+
+/* map the starter memory of the rank of cii if it is on this node */
+static void node_attach(CII *cii){
+    
+    struct stat st; /* status of the file */
+    char path[256]; /* path of the file */
+    char *addr; /* mapping */
+    int fd; /* file descriptor */
+    
+    if (node_sm == NULL || cii->hostid != node_hostid) {
+        return;
+    }
+    sprintf(path, "%s_task%u_rank%d", NODE_SHMPATH, acp_taskid, cii->rank);
+    fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return;
+    }
+    addr = NULL;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == sysmem_size) {
+        addr = mmap(NULL, sysmem_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (addr == NULL || addr == MAP_FAILED) {
+        return;
+    }
+    node_sm[cii->rank] = addr;
+    node_pid[cii->rank] = cii->pid;
+    node_pop++;
+}
+
+/* the ranks of the node have mapped the starter memory, remove its file */
+static void node_unlink(void){
+    
+    if (node_fd >= 0) {
+        close(node_fd);
+        unlink(node_path);
+        node_fd = -1;
+    }
+}
+
+/* unmap the starter memory of the node, and free it */
+static void free_node(void){
+    
+    int i; /* general index */
+    
+    node_unlink();
+    if (node_sm != NULL) {
+        for (i = 0; i < acp_numprocs; i++) {
+            if (node_sm[i] != NULL) {
+                munmap(node_sm[i], sysmem_size);
+            }
+        }
+        free(node_sm);
+        free(node_pid);
+        node_sm = NULL;
+        node_pid = NULL;
+    }
+    else if (sysmem != NULL) {
+        free(sysmem);
+    }
+    sysmem = NULL;
+}
+
+/* address of len bytes at raddr of the starter memory of torank in the mapping, NULL if outside */
+static inline char *node_addr(int torank, uint64_t raddr, size_t len){
+    
+    if (raddr < smi_tb[torank].addr || raddr + len > smi_tb[torank].addr + sysmem_size) {
+        return NULL;
+    }
+    return node_sm[torank] + (raddr - smi_tb[torank].addr);
+}
+
+/* write len bytes of src to dst, the last 8 bytes last as the HCA does */
+static inline void node_write(char *dst, char *src, size_t len){
+    
+    if (len > sizeof(uint64_t)) {
+        iacpbl_copy(dst, src, len - sizeof(uint64_t));
+        __sync_synchronize();
+        dst += len - sizeof(uint64_t);
+        src += len - sizeof(uint64_t);
+        len = sizeof(uint64_t);
+    }
+    memcpy(dst, src, len);
+    __sync_synchronize();
+}
+
+/* Runs sr to torank of this node with the CPU, and queues its         */
+/* completion for poll_wc.  Returns 0 if it ran, -1 if the completions */
+/* are full and 1 if it is left to the HCA.                            */
+static int node_wr(int torank, struct ibv_send_wr *sr){
+    
+    struct iovec liov, riov; /* local and remote vectors of cross memory attach */
+    char *local, *remote; /* local and remote address */
+    uint64_t raddr; /* remote address */
+    uint64_t old; /* value before the atomic */
+    size_t len; /* data size */
+    ssize_t n; /* bytes of cross memory attach */
+    
+    if (node_done_num == MAX_STAGE_SIZE) {
+        return -1;
+    }
+    local = (sr->num_sge > 0) ? (char *)(uintptr_t)sr->sg_list->addr : NULL;
+    len = (sr->num_sge > 0) ? sr->sg_list->length : 0;
+    
+    switch (sr->opcode) {
+    case IBV_WR_RDMA_WRITE:
+    case IBV_WR_RDMA_READ:
+        raddr = sr->wr.rdma.remote_addr;
+        if (torank == acp_myrank) {
+            remote = (char *)(uintptr_t)raddr;
+        }
+        else {
+            remote = node_addr(torank, raddr, len);
+        }
+        if (remote != NULL) {
+            if (sr->opcode == IBV_WR_RDMA_WRITE) {
+                node_write(remote, local, len);
+            }
+            else {
+                iacpbl_copy(local, remote, len);
+            }
+            break;
+        }
+        if (node_pid[torank] == 0) {
+            return 1;
+        }
+        liov.iov_base = local;
+        liov.iov_len = len;
+        riov.iov_base = (void *)(uintptr_t)raddr;
+        riov.iov_len = len;
+        if (sr->opcode == IBV_WR_RDMA_WRITE) {
+            n = process_vm_writev(node_pid[torank], &liov, 1, &riov, 1, 0);
+        }
+        else {
+            n = process_vm_readv(node_pid[torank], &liov, 1, &riov, 1, 0);
+        }
+        if (n != (ssize_t)len) {
+            /* not permitted, the rank goes through the HCA from now on */
+            fprintf(stderr, "%d: acp intranode: cross memory attach to %d failed (%s), left to the HCA\n",
+                    acp_myrank, torank, (n < 0) ? strerror(errno) : "short transfer");
+            node_pid[torank] = 0;
+            return 1;
+        }
+        node_stats.cma++;
+        break;
+        
+    case IBV_WR_ATOMIC_CMP_AND_SWP:
+    case IBV_WR_ATOMIC_FETCH_AND_ADD:
+        remote = node_addr(torank, sr->wr.atomic.remote_addr, sizeof(uint64_t));
+        if (!node_atomic || remote == NULL) {
+            return 1;
+        }
+        if (sr->opcode == IBV_WR_ATOMIC_CMP_AND_SWP) {
+            old = sync_val_compare_and_swap_8((volatile uint64_t *)remote, 
+                                              sr->wr.atomic.compare_add, sr->wr.atomic.swap);
+        }
+        else {
+            old = sync_fetch_and_add_8((volatile uint64_t *)remote, sr->wr.atomic.compare_add);
+        }
+        memcpy(local, &old, sizeof(uint64_t));
+        break;
+        
+    default:
+        return 1;
+    }
+    
+    node_done[(node_done_head + node_done_num) % MAX_STAGE_SIZE] = sr->wr_id;
+    node_done_num++;
+    node_stats.ops++;
+    node_stats.bytes += len;
+    
+    return 0;
+}
+
+static inline int post_wr(int torank, struct ibv_send_wr *sr){
+    
+    SQ *sq; /* send queue of torank */
+    SWR *swr; /* staged work request */
+    int s; /* index of swr */
+    int rc; /* return code of node_wr */
+    
+    /* the ranks of this node skip the HCA */
+    if (node_sm != NULL && node_sm[torank] != NULL) {
+        rc = node_wr(torank, sr);
+        if (rc <= 0) {
+            return rc;
+        }
+    }
+    if (swr_free < 0) {
+        return -1;
+    }
+    sq = sqtb[torank];
+    if (sq == NULL) {
+        sq = (SQ *)calloc(1, sizeof(SQ));
+        if (sq == NULL) {
+            return -1;
+        }
+        sq->stage_head = -1;
+        sqtb[torank] = sq;
+    }
+    s = swr_free;
+    swr = &swrtb[s];
+    swr_free = swr->next;
+    
+    swr->wr = *sr;
+    swr->wr.next = NULL;
+    if (sr->num_sge > 0) {
+        swr->sge = *sr->sg_list;
+        swr->wr.sg_list = &swr->sge;
+        /* small writes are copied into the WQE and need no DMA read of the source */
+        if (sr->opcode == IBV_WR_RDMA_WRITE && swr->sge.length <= max_inline_data) {
+            swr->wr.send_flags |= IBV_SEND_INLINE;
+        }
+    }
+    else {
+        swr->wr.sg_list = NULL;
+    }
+    swr->next = -1;
+    
+    if (sq->stage_head < 0) {
+        sq->stage_head = s;
+        stage_ranks[stage_nranks++] = torank;
+    }
+    else {
+        swrtb[sq->stage_tail].next = s;
+    }
+    sq->stage_tail = s;
+    
+    return 0;
+}
+
+/* post the staged work requests as one chain per QP, as far as the QP and the CQ have room */
+static void flush_wr(void){
+    
+    struct ibv_send_wr *first, *last, *bad_wr; /* chain to post */
+    SQ *sq; /* send queue */
+    int i, n; /* index of stage_ranks */
+    int rank; /* rank of the QP */
+    int s; /* index of swrtb */
+    uint32_t count; /* # of work requests in the chain */
+    uint32_t nsig; /* # of signaled work requests in the chain */
+    uint32_t since; /* # of unsignaled work requests since the last signaled one */
+    uint32_t pos; /* position in the posted work requests */
+    int next; /* next staged work request */
+    int rc; /* return code */
+    
+    conn_clock++;
+    n = 0;
+    for (i = 0; i < stage_nranks; i++) {
+        rank = stage_ranks[i];
+        sq = sqtb[rank];
+        if (conntb[rank].stat != CONN_READY) {
+            /* keep the work requests until the QP is connected */
+            conn_request(rank);
+            stage_ranks[n++] = rank;
+            continue;
+        }
+        conntb[rank].used = conn_clock;
+        first = last = NULL;
+        count = nsig = since = 0;
+        s = sq->stage_head;
+        while (s >= 0 && sq->num + count < MAX_WR_SIZE && cq_pending + nsig < MAX_CQ_SIZE) {
+            pos = (sq->head + sq->num + count) % MAX_WR_SIZE;
+            if ((swrtb[s].wr.send_flags & IBV_SEND_SIGNALED) || ++since == WR_SIGNAL_INTERVAL) {
+                swrtb[s].wr.send_flags |= IBV_SEND_SIGNALED;
+                nsig++;
+                since = 0;
+            }
+            sq->wr_id[pos] = swrtb[s].wr.wr_id;
+            sq->signaled[pos] = (swrtb[s].wr.send_flags & IBV_SEND_SIGNALED) != 0;
+            if (last == NULL) {
+                first = &swrtb[s].wr;
+            }
+            else {
+                last->next = &swrtb[s].wr;
+            }
+            last = &swrtb[s].wr;
+            count++;
+            s = swrtb[s].next;
+        }
+        if (count > 0) {
+            /* the last work request of a chain always makes a CQE */
+            if (!(last->send_flags & IBV_SEND_SIGNALED)) {
+                last->send_flags |= IBV_SEND_SIGNALED;
+                sq->signaled[(sq->head + sq->num + count - 1) % MAX_WR_SIZE] = true;
+                nsig++;
+            }
+            last->next = NULL;
+            rc = ibv_post_send(qp[rank], first, &bad_wr);
+            if (rc != 0) {
+                fprintf(stderr, "%d: Fail post send to %d: %s\n", acp_myrank, rank, strerror(rc));
+                exit(-1);
+            }
+            sq->num += count;
+            cq_pending += nsig;
+            /* release the posted entries */
+            while (sq->stage_head != s) {
+                next = swrtb[sq->stage_head].next;
+                swrtb[sq->stage_head].next = swr_free;
+                swr_free = sq->stage_head;
+                sq->stage_head = next;
+            }
+        }
+        if (sq->stage_head >= 0) {
+            stage_ranks[n++] = rank;
+        }
+    }
+    stage_nranks = n;
+}
+
+/* poll CQEs into wcs, with one entry for each completed work request. Returns the # of entries. */
+static int poll_wc(struct ibv_wc *wcs){
+    
+    static struct ibv_wc cqe[MAX_POLL_SIZE]; /* polled CQEs */
+    QPN key, *qpn; /* QP number to find */
+    SQ *sq; /* send queue of the CQE */
+    int ncqe; /* # of CQEs */
+    int nwc; /* # of entries in wcs */
+    int i; /* index of cqe */
+    uint32_t n; /* # of work requests before the failed one */
+    int sig; /* the work request made the CQE */
+    
+    /* the work requests run by the CPU first */
+    nwc = 0;
+    while (node_done_num > 0 && nwc < MAX_WR_SIZE) {
+        memset(&wcs[nwc], 0, sizeof(struct ibv_wc));
+        wcs[nwc].wr_id = node_done[node_done_head];
+        wcs[nwc].status = IBV_WC_SUCCESS;
+        node_done_head = (node_done_head + 1) % MAX_STAGE_SIZE;
+        node_done_num--;
+        nwc++;
+    }
+    
+    ncqe = ibv_poll_cq(cq, MAX_POLL_SIZE, cqe);
+    if (ncqe < 0) {
+        return ncqe;
+    }
+    for (i = 0; i < ncqe; i++) {
+        key.qp_num = cqe[i].qp_num;
+        qpn = (QPN *)bsearch(&key, qpntb, qpn_num, sizeof(QPN), qpn_compare);
+        sq = (qpn != NULL) ? sqtb[qpn->rank] : NULL;
+        if (sq == NULL || sq->num == 0) {
+            wcs[nwc++] = cqe[i];
+            continue;
+        }
+        if (cqe[i].status != IBV_WC_SUCCESS) {
+            /* an error CQE carries the wr_id of the failed work request itself, */
+            /* signaled or not, and the ones posted before it are done           */
+            for (n = 0; n < sq->num; n++) {
+                if (sq->wr_id[(sq->head + n) % MAX_WR_SIZE] == cqe[i].wr_id) {
+                    break;
+                }
+            }
+            if (n == sq->num) {
+                wcs[nwc++] = cqe[i];
+                continue;
+            }
+            while (n-- > 0) {
+                wcs[nwc] = cqe[i];
+                wcs[nwc].status = IBV_WC_SUCCESS;
+                wcs[nwc].wr_id = sq->wr_id[sq->head];
+                if (sq->signaled[sq->head]) {
+                    cq_pending--;
+                }
+                sq->head = (sq->head + 1) % MAX_WR_SIZE;
+                sq->num--;
+                nwc++;
+            }
+            wcs[nwc++] = cqe[i];
+            if (sq->signaled[sq->head]) {
+                cq_pending--;
+            }
+            sq->head = (sq->head + 1) % MAX_WR_SIZE;
+            sq->num--;
+            continue;
+        }
+        cq_pending--;
+        do {
+            wcs[nwc] = cqe[i];
+            wcs[nwc].wr_id = sq->wr_id[sq->head];
+            sig = sq->signaled[sq->head];
+            sq->head = (sq->head + 1) % MAX_WR_SIZE;
+            sq->num--;
+            nwc++;
+        } while (!sig && sq->num > 0);
+    }
+    
+    return nwc;
+}
+
+void acp_abort(const char *str){
+  
+    int i; /* general index */
+    
+    /* release socket file descriptor */
+#ifdef DEBUG
+    fprintf(stdout, "internal acp_abort\n");
+    fflush(stdout);
+#endif
+    
+#ifndef ACPBLONLY
+    iacp_abort_cl();
+    iacp_abort_dl();
+#endif
+    /* close IB resouce */
+    if (res.mr != NULL) {
+        ibv_dereg_mr(res.mr);
+        res.mr = NULL;
+    }
+    /* the MRs of the tags are deregistered by free_mrc */
+    for (i = 0;i < MAX_RM_SIZE;i++) {
+        libvmrtb[i] = NULL;
+    }
+    for (i = 0;i < acp_numprocs;i++) {
+        if (qp[i] != NULL) {
+            ibv_destroy_qp(qp[i]);
+            qp[i] = NULL;
+        }
+    }
+    if (qp != NULL) {
+        free(qp);
+        qp = NULL;
+    }
+    
+    free_conn();
+    if (cq != NULL) {
+        ibv_destroy_cq(cq);
+        cq = NULL;
+    }
+    free_event();
+    free_mrc();
+    if (res.pd != NULL) {
+        ibv_dealloc_pd(res.pd);
+        res.pd = NULL;
+    }
+    if (res.ib_ctx != NULL) {
+        ibv_close_device(res.ib_ctx);
+        res.ib_ctx = NULL;
+    }
+    
+    /* close socket file descritptor */
+    if (sock_accept) {
+        close(sock_accept);
+    }
+    if (sock_connect) {
+        close(sock_connect);
     }
+    
+    /* free acp region */
+    free_rrmtb();
+    free_sq();
+    free_cmdq();
+    free_node();
     if (smi_tb != NULL) {
         free(smi_tb);
         smi_tb = NULL;
@@ -586,10 +2452,19 @@ Error1:
     }
 }
 
+static void sync_send(int i)
+{
+    acp_handle_t h;
+    
+    do {
+        h = acp_copy( sync_stepgatbl[i], sync_bodyga, sizeof( uint64_t ), ACP_HANDLE_NULL );
+    } while ( h == ACP_HANDLE_NULL );
+    sync_last = h;
+}
+
 int iacp_start_rcdbsync()
 {
     int myrank;
-    acp_handle_t h;
 
     myrank = acp_rank();
 
@@ -600,70 +2475,72 @@ int iacp_start_rcdbsync()
     
     sync_status = ST_SYNC_BUSY;
 
-   sync_bodyla[0]++;
+    sync_bodyla[0]++;
+    sync_last = ACP_HANDLE_NULL;
+    sync_step = ( sync_myrole == PARENT ) ? 0 : 1;
     
-    if ( ( sync_myrole == NORMAL ) || ( sync_myrole == REMAIN ) ) {
-        do {
-            h = acp_copy( sync_stepgatbl[0], sync_bodyga, sizeof( uint64_t ), ACP_HANDLE_NULL );
-        } while ( h == ACP_HANDLE_NULL );
-    }
+    if ( ( sync_myrole == NORMAL ) || ( sync_myrole == REMAIN ) ) sync_send( 0 );
     
     return 0;
 }
 
-int iacp_wait_rcdbsync()
+/* Advances the barrier as far as the arrived notifications allow. */
+/* Returns 1 while it is in progress and 0 when it has completed. */
+int iacp_test_rcdbsync()
 {
-    int i, myrank;
     uint64_t curr_idx;
-    acp_handle_t h;
     
-    myrank = acp_rank();
+    if ( sync_status != ST_SYNC_BUSY ) return 0;
     
     curr_idx = sync_bodyla[0];
     
-    if ( sync_status != ST_SYNC_BUSY ) {
-        fprintf( stderr, "%d: iacp_wait_rcdbsync : Error. Irregular status %d\n", myrank, sync_status );
-        return -1;
-    }
-
     switch ( sync_myrole ) {
     case PARENT:
-        while ( sync_bodyla[sync_nsteps+1] < curr_idx );
-        
-        for ( i = 0; i < sync_nsteps; i++ ) {
-            do {
-                h = acp_copy( sync_stepgatbl[i], sync_bodyga, sizeof( uint64_t ), ACP_HANDLE_NULL );
-            } while ( h == ACP_HANDLE_NULL );
-            
-            while ( sync_bodyla[i+1] < curr_idx );
+        if ( sync_step == 0 ) {
+            if ( sync_bodyla[sync_nsteps+1] < curr_idx ) return 1;
+            sync_send( 0 );
+            sync_step = 1;
         }
-        
-        do {
-            h = acp_copy( sync_stepgatbl[sync_nsteps], sync_bodyga, sizeof(uint64_t), ACP_HANDLE_NULL );
-        } while ( h == ACP_HANDLE_NULL );
-        break;
+        /* fall through */
     case NORMAL:
-        while ( sync_bodyla[1] < curr_idx );
-        for ( i = 1; i < sync_nsteps; i++ ) {
-            do {
-                h = acp_copy( sync_stepgatbl[i], sync_bodyga, sizeof(uint64_t), ACP_HANDLE_NULL );
-            } while ( h == ACP_HANDLE_NULL );
-            while ( sync_bodyla[i+1] < curr_idx );
+        while ( sync_step <= sync_nsteps ) {
+            if ( sync_bodyla[sync_step] < curr_idx ) return 1;
+            /* the parent finally releases its remaining process */
+            if ( sync_step < sync_nsteps || sync_myrole == PARENT ) sync_send( sync_step );
+            sync_step++;
         }
         break;
     case REMAIN:
-        while ( sync_bodyla[1] < curr_idx );
+        if ( sync_bodyla[1] < curr_idx ) return 1;
         break;
     default:
-        fprintf( stderr, "%d: iacp_wait_rcdbsync : Error. Wrong role %d\n", sync_myrole );
+        fprintf( stderr, "%d: iacp_test_rcdbsync : Error. Wrong role %d\n", acp_rank(), sync_myrole );
     }
-    acp_complete( ACP_HANDLE_ALL );
+    
+    /* copies complete in order, so this also fences the GMAs issued before the barrier */
+    if ( acp_inquire( sync_last ) ) return 1;
     
     sync_status = ST_SYNC_IDLE;
     
     return 0;
 }
 
+int iacp_wait_rcdbsync()
+{
+    int myrank;
+    
+    myrank = acp_rank();
+    
+    if ( sync_status != ST_SYNC_BUSY ) {
+        fprintf( stderr, "%d: iacp_wait_rcdbsync : Error. Irregular status %d\n", myrank, sync_status );
+        return -1;
+    }
+
+    while ( iacp_test_rcdbsync() );
+    
+    return 0;
+}
+
 int iacp_free_rcdbsync()
 {
     int myrank = acp_rank();
@@ -683,12 +2560,50 @@ int iacp_free_rcdbsync()
     }
 }
 
+acp_handle_t acp_isync( void )
+{
+    if ( acp_procs() == 1 ) return ++sync_epoch;
+    if ( sync_status != ST_SYNC_IDLE ) return ACP_HANDLE_NULL;
+    
+    IACPBL_TRACE(IACPBL_TRACE_BEGIN, "sync", "acp_isync", 0, 0);
+    iacp_start_rcdbsync();
+    IACPBL_TRACE(IACPBL_TRACE_END, "sync", "acp_isync", 0, 0);
+    
+    sync_epoch = sync_bodyla[0];
+    return sync_epoch;
+}
+
+int acp_inquire_sync( acp_handle_t handle )
+{
+    if ( handle == ACP_HANDLE_ALL ) handle = sync_epoch;
+    /* earlier barriers have completed before this one could start */
+    if ( handle == ACP_HANDLE_NULL || handle != sync_epoch ) return 0;
+    
+    return iacp_test_rcdbsync();
+}
+
+int acp_wait_sync( acp_handle_t handle )
+{
+    if ( handle == ACP_HANDLE_ALL ) handle = sync_epoch;
+    if ( handle == ACP_HANDLE_NULL || handle != sync_epoch ) return 0;
+    
+    IACPBL_TRACE(IACPBL_TRACE_BEGIN, "sync", "acp_wait_sync", 0, 0);
+    while ( iacp_test_rcdbsync() );
+    IACPBL_TRACE(IACPBL_TRACE_END, "sync", "acp_wait_sync", 0, 0);
+    
+    return 0;
+}
+
 int acp_sync( void )
 {
     if ( acp_procs() == 1 ) return 0;
+    if ( sync_status != ST_SYNC_IDLE ) return -1;
     
+    IACPBL_TRACE(IACPBL_TRACE_BEGIN, "sync", "acp_sync", 0, 0);
     iacp_start_rcdbsync();
+    sync_epoch = sync_bodyla[0];
     iacp_wait_rcdbsync();
+    IACPBL_TRACE(IACPBL_TRACE_END, "sync", "acp_sync", 0, 0);
     
     return 0;
 }        
@@ -896,6 +2811,236 @@ acp_ga_t acp_query_ga(acp_atkey_t atkey, void* addr){
     }
 }
 
+static inline void mrc_lock(void){
+    
+    pthread_mutex_lock(&mrc_mutex);
+    mrc_owner = true;
+}
+
+static inline void mrc_unlock(void){
+    
+    mrc_owner = false;
+    pthread_mutex_unlock(&mrc_mutex);
+}
+
+static void init_mrc(void){
+    
+    mrc_page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    mrc_budget = iacpbl_option.mrcache.value;
+    mrc_num = 0;
+    mrc_idle = 0;
+    mrc_clock = 0;
+    memset(mrc, 0, sizeof(mrc));
+    memset(&mrc_stats, 0, sizeof(mrc_stats));
+    /* keep freed blocks mapped, so that their MRs stay valid for reuse. */
+    /* this changes malloc of the whole process, hence only with a cache */
+    if (mrc_budget > 0) {
+        mallopt(M_MMAP_MAX, 0);
+        mallopt(M_TRIM_THRESHOLD, -1);
+    }
+}
+
+/* deregister the MR of entry e, which has no tag */
+static void mrc_free(uint32_t e){
+    
+    mrc_idle -= mrc[e].end - mrc[e].start;
+    ibv_dereg_mr(mrc[e].mr);
+    mrc[e].mr = NULL;
+    mrc_num--;
+}
+
+static void free_mrc(void){
+    
+    uint32_t e; /* entry of mrc */
+    
+    mrc_lock();
+    for (e = 0; e < MAX_MRC_SIZE; e++) {
+        if (mrc[e].mr != NULL) {
+            if (mrc[e].refs > 0) {
+                mrc[e].refs = 0;
+                mrc_idle += mrc[e].end - mrc[e].start;
+            }
+            mrc_free(e);
+        }
+    }
+    mrc_unlock();
+}
+
+/* the least recently used MR without tags, MAX_MRC_SIZE if none */
+static uint32_t mrc_victim(void){
+    
+    uint32_t e, victim; /* entry of mrc */
+    
+    victim = MAX_MRC_SIZE;
+    for (e = 0; e < MAX_MRC_SIZE; e++) {
+        if (mrc[e].mr != NULL && mrc[e].refs == 0 &&
+            (victim == MAX_MRC_SIZE || mrc[e].used < mrc[victim].used)) {
+            victim = e;
+        }
+    }
+    return victim;
+}
+
+/* deregister the stale MRs without tags, and the others over the budget */
+static void mrc_trim(void){
+    
+    uint32_t e; /* entry of mrc */
+    
+    for (e = 0; e < MAX_MRC_SIZE; e++) {
+        if (mrc[e].mr != NULL && mrc[e].refs == 0 && mrc[e].stale) {
+            mrc_free(e);
+        }
+    }
+    while (mrc_idle > mrc_budget) {
+        e = mrc_victim();
+        if (e == MAX_MRC_SIZE) {
+            break;
+        }
+        mrc_free(e);
+        mrc_stats.evictions++;
+    }
+}
+
+/* take an MR covering size bytes at addr. Returns its entry of mrc, -1 on failure */
+static int mrc_get(void *addr, size_t size, int mr_flags){
+    
+    uintptr_t start, end; /* pages of the region */
+    uintptr_t ustart, uend; /* pages of the region and the MRs it overlaps */
+    struct ibv_mr *mr; /* new MR */
+    uint32_t e; /* entry of mrc */
+    
+    start = (uintptr_t)addr & ~(mrc_page - 1);
+    end = ((uintptr_t)addr + size + mrc_page - 1) & ~(mrc_page - 1);
+    if (end == start) {
+        end = start + mrc_page;
+    }
+    
+    mrc_lock();
+    mrc_trim();
+    for (e = 0; e < MAX_MRC_SIZE; e++) {
+        if (mrc[e].mr != NULL && !mrc[e].stale && mrc[e].start <= start && end <= mrc[e].end) {
+            if (mrc[e].refs++ == 0) {
+                mrc_idle -= mrc[e].end - mrc[e].start;
+            }
+            mrc_stats.hits++;
+            mrc_unlock();
+            return e;
+        }
+    }
+    mrc_stats.misses++;
+    
+    /* one MR for the region and those it overlaps, or for the region alone */
+    ustart = start;
+    uend = end;
+    for (e = 0; e < MAX_MRC_SIZE; e++) {
+        if (mrc[e].mr != NULL && !mrc[e].stale && mrc[e].start < end && start < mrc[e].end) {
+            if (mrc[e].start < ustart) ustart = mrc[e].start;
+            if (mrc[e].end > uend) uend = mrc[e].end;
+        }
+    }
+    mr = ibv_reg_mr(res.pd, (void *)ustart, uend - ustart, mr_flags);
+    if (mr == NULL && (ustart != start || uend != end)) {
+        ustart = start;
+        uend = end;
+        mr = ibv_reg_mr(res.pd, (void *)ustart, uend - ustart, mr_flags);
+    }
+    if (mr == NULL) {
+        mrc_unlock();
+        return -1;
+    }
+    
+    /* the MRs without tags inside the new one are not needed */
+    for (e = 0; e < MAX_MRC_SIZE; e++) {
+        if (mrc[e].mr != NULL && mrc[e].refs == 0 && ustart <= mrc[e].start && mrc[e].end <= uend) {
+            mrc_free(e);
+        }
+    }
+    for (e = 0; e < MAX_MRC_SIZE && mrc[e].mr != NULL; e++) ;
+    if (e == MAX_MRC_SIZE) {
+        /* there are fewer tags than entries, some have none */
+        e = mrc_victim();
+        mrc_free(e);
+        mrc_stats.evictions++;
+    }
+    mrc[e].start = ustart;
+    mrc[e].end = uend;
+    mrc[e].mr = mr;
+    mrc[e].refs = 1;
+    mrc[e].stale = false;
+    mrc_num++;
+    mrc_unlock();
+    
+    return e;
+}
+
+/* release the MR of entry e of mrc taken by a tag */
+static void mrc_put(int e){
+    
+    mrc_lock();
+    if (--mrc[e].refs == 0) {
+        mrc[e].used = ++mrc_clock;
+        mrc_idle += mrc[e].end - mrc[e].start;
+        mrc_trim();
+    }
+    mrc_unlock();
+}
+
+/* the pages from start to end are released, their MRs are not reused */
+static void mrc_invalidate(uintptr_t start, uintptr_t end){
+    
+    uint32_t e; /* entry of mrc */
+    int owner = mrc_owner; /* called back while this thread holds mrc_mutex */
+    
+    if (mrc_num == 0) {
+        return;
+    }
+    if (!owner) {
+        pthread_mutex_lock(&mrc_mutex);
+    }
+    for (e = 0; e < MAX_MRC_SIZE; e++) {
+        if (mrc[e].mr != NULL && !mrc[e].stale && mrc[e].start < end && start < mrc[e].end) {
+            mrc[e].stale = true;
+            mrc_stats.invalidations++;
+        }
+    }
+    if (!owner) {
+        pthread_mutex_unlock(&mrc_mutex);
+    }
+}
+
+int munmap(void *addr, size_t length){
+    
+    mrc_invalidate((uintptr_t)addr, (uintptr_t)addr + length);
+    return syscall(SYS_munmap, addr, length);
+}
+
+void *mremap(void *old_address, size_t old_size, size_t new_size, int flags, ...){
+    
+    va_list ap; /* new_address of MREMAP_FIXED */
+    void *new_address = NULL; /* address to move to */
+    
+    if (flags & MREMAP_FIXED) {
+        va_start(ap, flags);
+        new_address = va_arg(ap, void *);
+        va_end(ap);
+        mrc_invalidate((uintptr_t)new_address, (uintptr_t)new_address + new_size);
+    }
+    mrc_invalidate((uintptr_t)old_address, (uintptr_t)old_address + old_size);
+    return (void *)syscall(SYS_mremap, old_address, old_size, new_size, flags, new_address);
+}
+
+int madvise(void *addr, size_t length, int advice){
+    
+    if (advice == MADV_DONTNEED || advice == MADV_REMOVE
+#ifdef MADV_FREE
+        || advice == MADV_FREE
+#endif
+        ) {
+        mrc_invalidate((uintptr_t)addr, (uintptr_t)addr + length);
+    }
+    return syscall(SYS_madvise, addr, length, advice);
+}
+
 acp_atkey_t acp_register_memory(void* addr, size_t size, int color){
   
     int i; /* general index */
@@ -908,6 +3053,7 @@ acp_atkey_t acp_register_memory(void* addr, size_t size, int color){
     char found_empty_tag; /* found empty tag flag */
     char inserted_tag; /* inserted tag flag */
     int inst_tag_id; /* tag id will be inserted */
+    int entry; /* entry of mrc */
     volatile int nprocs; /* # of processes */
     
     acp_ga_t dst, src; /* ga of dst and src */
@@ -939,14 +3085,15 @@ acp_atkey_t acp_register_memory(void* addr, size_t size, int color){
         IBV_ACCESS_REMOTE_WRITE |
         IBV_ACCESS_REMOTE_ATOMIC;
     
-    /* execute register memory */
-    mr = ibv_reg_mr(res.pd, addr, size, mr_flags);
-    if (mr == NULL) {
+    /* execute register memory, or take a cached registration */
+    entry = mrc_get(addr, size, mr_flags);
+    if (entry < 0) {
 #ifdef DEBUG
         perror("ibv_reg_mr is failed:");
 #endif
         return ACP_ATKEY_NULL;
     }
+    mr = mrc[entry].mr;
 #ifdef DEBUG
     fprintf(stdout, "%d: mr address %p size %ld\n", myrank, mr, sizeof(mr));
     fflush(stdout);
@@ -965,7 +3112,21 @@ acp_atkey_t acp_register_memory(void* addr, size_t size, int color){
     /* search invalid tag, and set tag */
     found_empty_tag = false; /* initialze a founed empty tag flag */
     inserted_tag = false; /* initialize a inserted tag flag  */
+    /* a released tag of the same region and rkey is valid again, */
+    /* the copies other ranks hold of it are still right */
     for (i = 0;i < MAX_RM_SIZE;i++) {
+        if (lrmtb[i].valid == false && lrmtb[i].addr == addr && lrmtb[i].size == size && 
+            lrmtb[i].rkey == mr->rkey) {
+            found_empty_tag = true;
+            inserted_tag = true;
+            inst_tag_id = i;
+            libvmrtb[i] = mr;
+            lrmtb[i].valid = true;
+            lrmtb[i].lock = true;
+            break;
+        }
+    }
+    for (i = 0;i < MAX_RM_SIZE && inserted_tag == false;i++) {
         if (lrmtb[i].valid == false) { /* found empty tag */
             found_empty_tag = true;
             inst_tag_id = i;
@@ -991,7 +3152,7 @@ acp_atkey_t acp_register_memory(void* addr, size_t size, int color){
     
     /* empty tag is not found */
     if (found_empty_tag == false) {
-        ibv_dereg_mr(mr);
+        mrc_put(entry);
         fprintf(stdout, "%d: internal acp_register fin\n", myrank);
         return ACP_ATKEY_NULL;
     }
@@ -1092,6 +3253,7 @@ acp_atkey_t acp_register_memory(void* addr, size_t size, int color){
 
     /* set acp atkey for new memory region */
     gmtag = inst_tag_id;
+    mrc_tag[gmtag] = entry;
     key = ((uint64_t)(myrank + 1) << (COLOR_BITS + GMTAG_BITS + OFFSET_BITS))
         + ((uint64_t)color << (GMTAG_BITS + OFFSET_BITS))
         + ((uint64_t)gmtag << OFFSET_BITS);
@@ -1137,7 +3299,7 @@ int acp_unregister_memory(acp_atkey_t atkey){
                     acp_rank(), atkey, gmtag, lrmtb[gmtag].valid);
 #endif
             lrmtb[gmtag].valid = false;
-            ibv_dereg_mr(libvmrtb[gmtag]);
+            mrc_put(mrc_tag[gmtag]);
             libvmrtb[gmtag] = NULL;
             return 0;
         }
@@ -1223,12 +3385,11 @@ acp_handle_t acp_copy(acp_ga_t dst, acp_ga_t src, size_t size, acp_handle_t orde
     fflush(stdout);
 #endif
     
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-        
     /* check my rank */
     myrank = acp_rank();
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = (CMD *)&cmdq[tail4c];
  
     /* make a command, and enqueue command Queue. */ 
@@ -1240,7 +3401,6 @@ acp_handle_t acp_copy(acp_ga_t dst, acp_ga_t src, size_t size, acp_handle_t orde
     pcmdq->gasrc = src;
     pcmdq->gadst = dst;
     pcmdq->cmde.copy_cmd.size = size;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
@@ -1248,12 +3408,12 @@ acp_handle_t acp_copy(acp_ga_t dst, acp_ga_t src, size_t size, acp_handle_t orde
 #ifdef DEBUG
     fprintf(stdout, 
             "%d: tail %lx cmdq[%lx].wr_id = %lx size = %lu\n", 
-            myrank, tail, tail4c, pcmdq->wr_id, pcmdq->cmde.copy_cmd.size);
+            myrank, hdl, tail4c, pcmdq->wr_id, pcmdq->cmde.copy_cmd.size);
     fflush(stdout);
 #endif
   
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_copy fin\n", myrank);
@@ -1275,9 +3435,6 @@ acp_handle_t acp_cas4(acp_ga_t dst, acp_ga_t src, uint32_t oldval, uint32_t newv
     fflush(stdout);
 #endif
 
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-
     /* check my rank */
     myrank = acp_rank();
     /* check myrank is equal to dst rank or not */
@@ -1285,7 +3442,9 @@ acp_handle_t acp_cas4(acp_ga_t dst, acp_ga_t src, uint32_t oldval, uint32_t newv
         return ACP_HANDLE_NULL;
     }
 
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = &cmdq[tail4c];
     
     /* make a command, and enqueue command Queue. */ 
@@ -1298,7 +3457,6 @@ acp_handle_t acp_cas4(acp_ga_t dst, acp_ga_t src, uint32_t oldval, uint32_t newv
     pcmdq->gadst = dst;
     pcmdq->cmde.cas4_cmd.data1 = oldval;
     pcmdq->cmde.cas4_cmd.data2 = newval;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
@@ -1306,12 +3464,12 @@ acp_handle_t acp_cas4(acp_ga_t dst, acp_ga_t src, uint32_t oldval, uint32_t newv
 #ifdef DEBUG
     fprintf(stdout, 
             "%d: tail %lx cmdq[%lx].wr_id = %lx, data1 %u, data2 %u\n",
-            myrank, tail, tail4c, pcmdq->wr_id,  pcmdq->cmde.cas4_cmd.data1, pcmdq->cmde.cas4_cmd.data2) ;
+            myrank, hdl, tail4c, pcmdq->wr_id,  pcmdq->cmde.cas4_cmd.data1, pcmdq->cmde.cas4_cmd.data2) ;
     fflush(stdout);
 #endif
     
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_cas4 fin\n", myrank);
@@ -1333,9 +3491,6 @@ acp_handle_t acp_cas8(acp_ga_t dst, acp_ga_t src, uint64_t oldval, uint64_t newv
     fflush(stdout);
 #endif
     
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-    
     /* check my rank */
     myrank = acp_rank();
     /* check myrank is equal to dst rank or not */
@@ -1343,7 +3498,9 @@ acp_handle_t acp_cas8(acp_ga_t dst, acp_ga_t src, uint64_t oldval, uint64_t newv
         return ACP_HANDLE_NULL;
     }
 
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = &cmdq[tail4c];
     
     /* make a command, and enqueue command Queue. */ 
@@ -1356,19 +3513,18 @@ acp_handle_t acp_cas8(acp_ga_t dst, acp_ga_t src, uint64_t oldval, uint64_t newv
     pcmdq->gadst = dst;
     pcmdq->cmde.cas8_cmd.data1 = oldval;
     pcmdq->cmde.cas8_cmd.data2 = newval;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
 
 #ifdef DEBUG
     fprintf(stdout, "%d: tail %lx cmdq[%lx].wr_id = %lx data1 %lu data2 %lu\n", 
-            acp_rank(), tail, tail4c, pcmdq->wr_id,   pcmdq->cmde.cas8_cmd.data1, pcmdq->cmde.cas8_cmd.data2);
+            acp_rank(), hdl, tail4c, pcmdq->wr_id,   pcmdq->cmde.cas8_cmd.data1, pcmdq->cmde.cas8_cmd.data2);
     fflush(stdout);
 #endif
   
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_cas8 fin\n", acp_rank());
@@ -1390,9 +3546,6 @@ acp_handle_t acp_swap4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t
     fflush(stdout);
 #endif
     
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-        
     /* check my rank */
     myrank = acp_rank();
     /* check myrank is equal to dst rank or not */
@@ -1400,7 +3553,9 @@ acp_handle_t acp_swap4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t
         return ACP_HANDLE_NULL;
     }
    
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = &cmdq[tail4c];
     
     
@@ -1413,7 +3568,6 @@ acp_handle_t acp_swap4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t
     pcmdq->gasrc = src;
     pcmdq->gadst = dst;
     pcmdq->cmde.atomic4_cmd.data = value;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
@@ -1421,12 +3575,12 @@ acp_handle_t acp_swap4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t
 #ifdef DEBUG
     fprintf(stdout, 
             "%d: tail %lx cmdq[%lx].wr_id = %lx value %u\n", 
-            myrank, tail, tail4c, pcmdq->wr_id,  pcmdq->cmde.atomic4_cmd.data);
+            myrank, hdl, tail4c, pcmdq->wr_id,  pcmdq->cmde.atomic4_cmd.data);
     fflush(stdout);
 #endif
     
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d, internal acp_swap4 fin\n", myrank);
@@ -1448,9 +3602,6 @@ acp_handle_t acp_swap8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t
     fflush(stdout);
 #endif
     
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-        
     /* check my rank */
     myrank = acp_rank();
     /* check myrank is equal to dst rank or not */
@@ -1458,7 +3609,9 @@ acp_handle_t acp_swap8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t
         return ACP_HANDLE_NULL;
     }
 
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = &cmdq[tail4c];
   
     /* make a command, and enqueue command Queue. */ 
@@ -1470,7 +3623,6 @@ acp_handle_t acp_swap8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t
     pcmdq->gasrc = src;
     pcmdq->gadst = dst;
     pcmdq->cmde.atomic8_cmd.data = value;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
@@ -1478,12 +3630,12 @@ acp_handle_t acp_swap8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t
 #ifdef DEBUG
     fprintf(stdout, 
             "%d: tail %lx cmdq[%lx].wr_id = %lx valude %lu\n", 
-            myrank, tail, tail4c, pcmdq->wr_id,   pcmdq->cmde.atomic8_cmd.data);
+            myrank, hdl, tail4c, pcmdq->wr_id,   pcmdq->cmde.atomic8_cmd.data);
     fflush(stdout);
 #endif
   
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_swap8 fin\n", myrank);
@@ -1505,9 +3657,6 @@ acp_handle_t acp_add4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t o
     fflush(stdout);
 #endif
     
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-    
     /* check my rank */
     myrank = acp_rank();
     /* check myrank is equal to dst rank or not */
@@ -1515,7 +3664,9 @@ acp_handle_t acp_add4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t o
         return ACP_HANDLE_NULL;
     }
 
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = &cmdq[tail4c];
     
     /* make a command, and enqueue command Queue. */ 
@@ -1527,7 +3678,6 @@ acp_handle_t acp_add4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t o
     pcmdq->gasrc = src;
     pcmdq->gadst = dst;
     pcmdq->cmde.atomic4_cmd.data = value;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
@@ -1535,12 +3685,12 @@ acp_handle_t acp_add4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t o
 #ifdef DEBUG
     fprintf(stdout, 
             "%d: tail %lx cmdq[%lx].wr_id = %lx value %u\n", 
-            myrank, tail, tail4c, pcmdq->wr_id,   pcmdq->cmde.atomic4_cmd.data);
+            myrank, hdl, tail4c, pcmdq->wr_id,   pcmdq->cmde.atomic4_cmd.data);
     fflush(stdout);
 #endif
     
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_add4 fin\n", myrank);
@@ -1562,9 +3712,6 @@ acp_handle_t acp_add8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t o
     fflush(stdout);
 #endif
     
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-        
     /* check my rank */
     myrank = acp_rank();
     /* check myrank is equal to dst rank or not */
@@ -1572,7 +3719,9 @@ acp_handle_t acp_add8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t o
         return ACP_HANDLE_NULL;
     }
 
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = &cmdq[tail4c];
     
     /* make a command, and enqueue command Queue. */ 
@@ -1584,7 +3733,6 @@ acp_handle_t acp_add8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t o
     pcmdq->gasrc = src;
     pcmdq->gadst = dst;
     pcmdq->cmde.atomic8_cmd.data = value;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
@@ -1592,12 +3740,12 @@ acp_handle_t acp_add8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t o
 #ifdef DEBUG
     fprintf(stdout, 
             "%d: tail %lx cmdq[%lx].wr_id = %lx value %lu\n", 
-            myrank, tail, tail4c, pcmdq->wr_id,   pcmdq->cmde.atomic8_cmd.data);
+            myrank, hdl, tail4c, pcmdq->wr_id,   pcmdq->cmde.atomic8_cmd.data);
     fflush(stdout);
 #endif
     
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_add8 fin\n", myrank);
@@ -1619,9 +3767,6 @@ acp_handle_t acp_xor4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t o
     fflush(stdout);
 #endif
     
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-    
     /* check my rank */
     myrank = acp_rank();
     /* check myrank is equal to dst rank or not */
@@ -1629,7 +3774,9 @@ acp_handle_t acp_xor4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t o
         return ACP_HANDLE_NULL;
     }
 
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = &cmdq[tail4c];
     
     /* make a command, and enqueue command Queue. */ 
@@ -1641,7 +3788,6 @@ acp_handle_t acp_xor4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t o
     pcmdq->gasrc = src;
     pcmdq->gadst = dst;
     pcmdq->cmde.atomic4_cmd.data = value;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
@@ -1649,12 +3795,12 @@ acp_handle_t acp_xor4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t o
 #ifdef DEBUG
     fprintf(stdout, 
             "%d: tail %lx cmdq[%lx].wr_id = %lx value %u\n", 
-            myrank, tail, tail4c, pcmdq->wr_id, pcmdq->cmde.atomic4_cmd.data);
+            myrank, hdl, tail4c, pcmdq->wr_id, pcmdq->cmde.atomic4_cmd.data);
     fflush(stdout);
 #endif
     
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_xor4 fin\n", myrank);
@@ -1676,9 +3822,6 @@ acp_handle_t acp_xor8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t o
     fflush(stdout);
 #endif
 
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-    
     /* check my rank */
     myrank = acp_rank();
     /* check myrank is equal to dst rank or not */
@@ -1686,7 +3829,9 @@ acp_handle_t acp_xor8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t o
         return ACP_HANDLE_NULL;
     }
 
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = &cmdq[tail4c];
     
     /* make a command, and enqueue command Queue. */ 
@@ -1698,7 +3843,6 @@ acp_handle_t acp_xor8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t o
     pcmdq->gasrc = src;
     pcmdq->gadst = dst;
     pcmdq->cmde.atomic8_cmd.data = value;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
@@ -1706,12 +3850,12 @@ acp_handle_t acp_xor8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t o
 #ifdef DEBUG
     fprintf(stdout, 
             "%d: tail %lx cmdq[%lx].wr_id = %lx value %lu \n", 
-            myrank, tail, tail4c, pcmdq->wr_id, pcmdq->cmde.atomic8_cmd.data);
+            myrank, hdl, tail4c, pcmdq->wr_id, pcmdq->cmde.atomic8_cmd.data);
     fflush(stdout);
 #endif
     
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_xor8 fin\n", myrank);
@@ -1733,9 +3877,6 @@ acp_handle_t acp_or4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t or
     fflush(stdout);
 #endif
 
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-    
     /* check my rank */
     myrank = acp_rank();
     /* check myrank is equal to dst rank or not */
@@ -1743,7 +3884,9 @@ acp_handle_t acp_or4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t or
         return ACP_HANDLE_NULL;
     }
 
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = &cmdq[tail4c];
     
     /* make a command, and enqueue command Queue. */ 
@@ -1755,7 +3898,6 @@ acp_handle_t acp_or4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t or
     pcmdq->gasrc = src;
     pcmdq->gadst = dst;
     pcmdq->cmde.atomic4_cmd.data = value;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
@@ -1763,12 +3905,12 @@ acp_handle_t acp_or4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t or
 #ifdef DEBUG
     fprintf(stdout, 
             "%d: tail %lx cmdq[%lx].wr_id = %lx value %u\n", 
-            myrank, tail, tail4c, pcmdq->wr_id, pcmdq->cmde.atomic4_cmd.data);
+            myrank, hdl, tail4c, pcmdq->wr_id, pcmdq->cmde.atomic4_cmd.data);
     fflush(stdout);
 #endif
     
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_or4 fin\n", myrank);
@@ -1790,9 +3932,6 @@ acp_handle_t acp_or8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t or
     fflush(stdout);
 #endif
     
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-    
     /* check my rank */
     myrank = acp_rank();
     /* check myrank is equal to dst rank or not */
@@ -1800,7 +3939,9 @@ acp_handle_t acp_or8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t or
         return ACP_HANDLE_NULL;
     }
 
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = &cmdq[tail4c];
     
     /* make a command, and enqueue command Queue. */ 
@@ -1812,7 +3953,6 @@ acp_handle_t acp_or8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t or
     pcmdq->gasrc = src;
     pcmdq->gadst = dst;
     pcmdq->cmde.atomic8_cmd.data = value;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
@@ -1820,12 +3960,12 @@ acp_handle_t acp_or8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t or
 #ifdef DEBUG
     fprintf(stdout, 
             "%d: tail %lx cmdq[%lx].wr_id = %lx value %lu\n", 
-            myrank, tail, tail4c, pcmdq->wr_id, pcmdq->cmde.atomic8_cmd.data);
+            myrank, hdl, tail4c, pcmdq->wr_id, pcmdq->cmde.atomic8_cmd.data);
     fflush(stdout);
 #endif
     
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_or8 fin\n", myrank);
@@ -1847,9 +3987,6 @@ acp_handle_t acp_and4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t o
     fflush(stdout);
 #endif
 
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-    
     /* check my rank */
     myrank = acp_rank();
     /* check myrank is equal to dst rank or not */
@@ -1857,7 +3994,9 @@ acp_handle_t acp_and4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t o
         return ACP_HANDLE_NULL;
     }
 
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = &cmdq[tail4c];
     
     /* make a command, and enqueue command Queue. */ 
@@ -1869,7 +4008,6 @@ acp_handle_t acp_and4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t o
     pcmdq->gasrc = src;
     pcmdq->gadst = dst;
     pcmdq->cmde.atomic4_cmd.data = value;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
@@ -1877,12 +4015,12 @@ acp_handle_t acp_and4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t o
 #ifdef DEBUG
     fprintf(stdout, 
             "%d: tail %lx cmdq[%lx].wr_id = %lx value %u\n", 
-            myrank, tail, tail4c, pcmdq->wr_id, pcmdq->cmde.atomic4_cmd.data);
+            myrank, hdl, tail4c, pcmdq->wr_id, pcmdq->cmde.atomic4_cmd.data);
     fflush(stdout);
 #endif
     
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_and4 fin\n", myrank);
@@ -1904,9 +4042,6 @@ acp_handle_t acp_and8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t o
     fflush(stdout);
 #endif
     
-    /* if queue is full, wait issuing */
-    while ( tail - head == MAX_CMDQ_ENTRY - 1 );
-
     /* check my rank */
     myrank = acp_rank();
     /* check myrank is equal to dst rank or not */
@@ -1914,7 +4049,9 @@ acp_handle_t acp_and8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t o
         return ACP_HANDLE_NULL;
     }
 
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    /* reserve a cmdq entry, waiting while the queue is full */
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = &cmdq[tail4c];
     
     /* make a command, and enqueue command Queue. */ 
@@ -1926,7 +4063,6 @@ acp_handle_t acp_and8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t o
     pcmdq->gasrc = src;
     pcmdq->gadst = dst;
     pcmdq->cmde.atomic8_cmd.data = value;
-    hdl = tail;
     pcmdq->wr_id = hdl;
     pcmdq->ishdl = hdl;
     pcmdq->valid_tail = true;
@@ -1934,12 +4070,12 @@ acp_handle_t acp_and8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t o
 #ifdef DEBUG
     fprintf(stdout, 
             "%d: tail %lx cmdq[%lx].wr_id = %lx value %lu\n", 
-            myrank, tail, tail4c, pcmdq->wr_id, pcmdq->cmde.atomic8_cmd.data);
+            myrank, hdl, tail4c, pcmdq->wr_id, pcmdq->cmde.atomic8_cmd.data);
     fflush(stdout);
 #endif
     
-    /* update tail */
-    tail++;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_and8 fin\n", myrank);
@@ -2004,7 +4140,12 @@ void acp_complete(volatile acp_handle_t handle){
     fflush(stdout);
 #endif
     /* check status of handle if it is COMPLETED or not. */
-    while (head <= handle);
+    if (event_wait) {
+        complete_wait(handle);
+    }
+    else {
+        while (head <= handle);
+    }
            
 #ifdef DEBUG
     fprintf(stdout, "%d: internal acp_complete fin\n", acp_rank()); 
@@ -2085,12 +4226,37 @@ int acp_inquire(acp_handle_t handle){
     }
 }
 
+int acp_query_stats(acp_stats_t *buf){
+    
+    if (buf == NULL) {
+        return -1;
+    }
+    iacpbl_stats_read(&stats_seq, buf, &stats, sizeof(acp_stats_t));
+    buf->queue_full_stalls = __atomic_load_n(&stats.queue_full_stalls, __ATOMIC_RELAXED);
+    buf->loop_iterations = __atomic_load_n(&stats.loop_iterations, __ATOMIC_RELAXED);
+    
+    return 0;
+}
+
+int acp_query_peer_stats(int rank, acp_peer_stats_t *buf){
+    
+    if (buf == NULL || rank < 0 || rank >= acp_numprocs) {
+        return -1;
+    }
+    if (peer_stats == NULL) {
+        memset(buf, 0, sizeof(acp_peer_stats_t));
+        return 0;
+    }
+    iacpbl_stats_read(&stats_seq, buf, &peer_stats[rank], sizeof(acp_peer_stats_t));
+    
+    return 0;
+}
+
 /* get remote register memory table */
 static inline int getlrm(uint64_t wr_id, int torank){
   
     struct ibv_sge sge; /* scatter/gather entry */
     struct ibv_send_wr sr; /* send work reuqest */
-    struct ibv_send_wr *bad_wr = NULL;/* return of send work reuqest */
     
     int rc; /* return code */
     int rank; /* rank id */
@@ -2133,11 +4299,12 @@ static inline int getlrm(uint64_t wr_id, int torank){
     sr.wr.rdma.remote_addr = smi_tb[torank].addr + offset_lrmtb;
     sr.wr.rdma.rkey = smi_tb[torank].rkey;
     
-    /* post send by ibv_post_send */
-    rc = ibv_post_send(qp[torank], &sr, &bad_wr);
+    /* stage the work request, posted by flush_wr */
+    rc = post_wr(torank, &sr);
+    if (rc == 0) stats_tx(torank, sge.length);
     
 #ifdef DEBUG
-    fprintf(stdout, "%d: get lrm ibv_post_send return code = %d\n", rank, rc);
+    fprintf(stdout, "%d: get lrm post_wr return code = %d\n", rank, rc);
     fflush(stdout);
 #endif
     
@@ -2149,7 +4316,6 @@ static inline int writebackstat(uint64_t idx){
     
     struct ibv_sge sge; /* scatter/gather entry */
     struct ibv_send_wr sr; /* send work reuqest */
-    struct ibv_send_wr *bad_wr = NULL;/* return of send work reuqest */
     
     int rc; /* return code */
     uint64_t cmdqidx; /* index of cmdq from issued handle */
@@ -2189,11 +4355,11 @@ static inline int writebackstat(uint64_t idx){
     fflush(stdout);
 #endif
     
-    /* get Get opcode in send work request */
-    sr.opcode = IBV_WR_RDMA_WRITE;
+    /* get Get opcode in send work request, with an immediate to wake a sleeping rank */
+    sr.opcode = conntb[torank].event_wait ? IBV_WR_RDMA_WRITE_WITH_IMM : IBV_WR_RDMA_WRITE;
     
     /* Set remote address and rkey in send work request */
-    cmdqidx = (rcmdbuf[idx].ishdl) % MAX_CMDQ_ENTRY;
+    cmdqidx = (rcmdbuf[idx].ishdl) % cmdq_size;
     
 #ifdef DEBUG
     fprintf(stdout, 
@@ -2206,8 +4372,9 @@ static inline int writebackstat(uint64_t idx){
     sr.wr.rdma.remote_addr = smi_tb[torank].addr + offset_cmdq + sizeof(CMD) * cmdqidx + offset_stat;
     sr.wr.rdma.rkey = smi_tb[torank].rkey;
     
-    /* post send by ibv_post_send */
-    rc = ibv_post_send(qp[torank], &sr, &bad_wr);
+    /* stage the work request, posted by flush_wr */
+    rc = post_wr(torank, &sr);
+    if (rc == 0) stats_tx(torank, sge.length);
 #if 0
     if (0 == rc) {
         fprintf(stderr, "failed to post SR\n");
@@ -2217,7 +4384,7 @@ static inline int writebackstat(uint64_t idx){
 
 #ifdef DEBUG
     fprintf(stdout, 
-            "%d: writeback cmdq  ibv_post_send return code = %d\n", 
+            "%d: writeback cmdq  post_wr return code = %d\n", 
             acp_rank(), rc);
     fflush(stdout);
 #endif
@@ -2229,7 +4396,6 @@ static inline int gethead(acp_handle_t idx, int torank){
     
     struct ibv_sge sge; /* scatter/gather entry */
     struct ibv_send_wr sr; /* send work reuqest */
-    struct ibv_send_wr *bad_wr = NULL;/* return of send work reuqest */
     
     int rc; /* return code */
     
@@ -2267,11 +4433,12 @@ static inline int gethead(acp_handle_t idx, int torank){
     sr.wr.rdma.remote_addr = smi_tb[torank].addr + offset_rcmdbuf_head;
     sr.wr.rdma.rkey = smi_tb[torank].rkey;
     
-    /* post send by ibv_post_send */
-    rc = ibv_post_send(qp[torank], &sr, &bad_wr);
+    /* stage the work request, posted by flush_wr */
+    rc = post_wr(torank, &sr);
+    if (rc == 0) stats_tx(torank, sge.length);
     
 #ifdef DEBUG
-    fprintf(stdout, "%d: get head ibv_post_send return code = %d\n", acp_rank(), rc);
+    fprintf(stdout, "%d: get head post_wr return code = %d\n", acp_rank(), rc);
     fflush(stdout);
 #endif
     
@@ -2282,7 +4449,6 @@ static inline int gettail(acp_handle_t idx, int torank){
     
     struct ibv_sge sge; /* scatter/gather entry */
     struct ibv_send_wr sr; /* send work reuqest */
-    struct ibv_send_wr *bad_wr = NULL;/* return of send work reuqest */
     
     int rc; /* return code */
     
@@ -2323,11 +4489,12 @@ static inline int gettail(acp_handle_t idx, int torank){
     sr.wr.atomic.rkey = smi_tb[torank].rkey;
     sr.wr.atomic.compare_add = 1ULL;
     
-    /* post send by ibv_post_send */
-    rc = ibv_post_send(qp[torank], &sr, &bad_wr);
+    /* stage the work request, posted by flush_wr */
+    rc = post_wr(torank, &sr);
+    if (rc == 0) stats_tx(torank, sge.length);
     
 #ifdef DEBUG
-    fprintf(stdout, "%d: get tail ibv_post_send return code = %d\n", acp_rank(), rc);
+    fprintf(stdout, "%d: get tail post_wr return code = %d\n", acp_rank(), rc);
     fflush(stdout);
 #endif
     
@@ -2338,7 +4505,6 @@ static inline int putrrmgetedflag(uint64_t wr_id, int torank){
     
     struct ibv_sge sge; /* scatter/gather entry */
     struct ibv_send_wr sr; /* send work reuqest */
-    struct ibv_send_wr *bad_wr = NULL;/* return of send work reuqest */
     
     int myrank;/* my rank ID */
     int rc; /* return code */
@@ -2382,11 +4548,12 @@ static inline int putrrmgetedflag(uint64_t wr_id, int torank){
     sr.wr.rdma.remote_addr = smi_tb[torank].addr + offset_rrm_get_flag_tb + sizeof(char) * myrank;
     sr.wr.rdma.rkey = smi_tb[torank].rkey;
     
-    /* post send by ibv_post_send */
-    rc = ibv_post_send(qp[torank], &sr, &bad_wr);
+    /* stage the work request, posted by flush_wr */
+    rc = post_wr(torank, &sr);
+    if (rc == 0) stats_tx(torank, sge.length);
     
 #ifdef DEBUG
-    fprintf(stdout, "%d: put rrm get flag ibv_post_send return code = %d\n", acp_rank(), rc);
+    fprintf(stdout, "%d: put rrm get flag post_wr return code = %d\n", acp_rank(), rc);
     fflush(stdout);
 #endif
     
@@ -2397,7 +4564,6 @@ static inline int putrrmackflag(uint64_t wr_id, int torank){
     
     struct ibv_sge sge; /* scatter/gather entry */
     struct ibv_send_wr sr; /* send work reuqest */
-    struct ibv_send_wr *bad_wr = NULL;/* return of send work reuqest */
   
     int myrank;
     int rc; /* return code */
@@ -2439,11 +4605,12 @@ static inline int putrrmackflag(uint64_t wr_id, int torank){
     sr.wr.rdma.remote_addr = smi_tb[torank].addr + offset_rrm_ack_flag_tb +  sizeof(char) * myrank;
     sr.wr.rdma.rkey = smi_tb[torank].rkey;
     
-    /* post send by ibv_post_send */
-    rc = ibv_post_send(qp[torank], &sr, &bad_wr);
+    /* stage the work request, posted by flush_wr */
+    rc = post_wr(torank, &sr);
+    if (rc == 0) stats_tx(torank, sge.length);
     
 #ifdef DEBUG
-    fprintf(stdout, "%d: put rrm ack flag ibv_post_send return code = %d\n", myrank, rc);
+    fprintf(stdout, "%d: put rrm ack flag post_wr return code = %d\n", myrank, rc);
     fflush(stdout);
 #endif
     
@@ -2454,7 +4621,6 @@ static inline int putreplydata(acp_handle_t idx, int dstrank, int dstgmtag, uint
     
     struct ibv_sge sge; /* scatter/gather entry */
     struct ibv_send_wr sr; /* send work reuqest */
-    struct ibv_send_wr *bad_wr = NULL;/* return of send work reuqest */
     
     int rc; /* return code */
     
@@ -2508,16 +4674,17 @@ static inline int putreplydata(acp_handle_t idx, int dstrank, int dstgmtag, uint
     }
     /* using global memory */
     else {
-        idx = dstrank % rkey_cache_size;
+        idx = rrm_index(dstrank);
         sr.wr.rdma.remote_addr = (uintptr_t)(rrmtb[idx][dstgmtag].addr) + dstoffset;
         sr.wr.rdma.rkey = rrmtb[idx][dstgmtag].rkey;
     }
     
-    /* post send by ibv_post_send */
-    rc = ibv_post_send(qp[dstrank], &sr, &bad_wr);
+    /* stage the work request, posted by flush_wr */
+    rc = post_wr(dstrank, &sr);
+    if (rc == 0) stats_tx(dstrank, sge.length);
 
 #ifdef DEBUG
-    fprintf(stdout, "%d: put replydata ibv_post_send return code = %d\n", acp_rank(), rc);
+    fprintf(stdout, "%d: put replydata post_wr return code = %d\n", acp_rank(), rc);
     fflush(stdout);
 #endif
     return rc;
@@ -2527,7 +4694,6 @@ static inline int putcmd(acp_handle_t idx, int torank, uint64_t rcmdbid){
     
     struct ibv_sge sge; /* scatter/gather entry */
     struct ibv_send_wr sr; /* send work reuqest */
-    struct ibv_send_wr *bad_wr = NULL;/* return of send work reuqest */
     
     int rc; /* return code */
         
@@ -2565,19 +4731,20 @@ static inline int putcmd(acp_handle_t idx, int torank, uint64_t rcmdbid){
     fflush(stdout);   
 #endif
     
-    /* Set Get opcode in send work request */
-    sr.opcode = IBV_WR_RDMA_WRITE;
+    /* Set Get opcode in send work request, with an immediate to wake a sleeping rank */
+    sr.opcode = conntb[torank].event_wait ? IBV_WR_RDMA_WRITE_WITH_IMM : IBV_WR_RDMA_WRITE;
 
     /* Set remote address and rkey in send work request */
     rcmdbid = rcmdbid % MAX_RCMDB_SIZE;
     sr.wr.rdma.remote_addr = smi_tb[torank].addr + offset_rcmdbuf + sizeof(CMD) * rcmdbid;
     sr.wr.rdma.rkey = smi_tb[torank].rkey;
     
-    /* post send by ibv_post_send */
-    rc = ibv_post_send(qp[torank], &sr, &bad_wr);
+    /* stage the work request, posted by flush_wr */
+    rc = post_wr(torank, &sr);
+    if (rc == 0) stats_tx(torank, sge.length);
  
 #ifdef DEBUG
-    fprintf(stdout, "%d: putcmd ibv_post_send return code = %d\n", acp_rank(), rc);
+    fprintf(stdout, "%d: putcmd post_wr return code = %d\n", acp_rank(), rc);
     fflush(stdout);
 #endif
     
@@ -2591,7 +4758,6 @@ static inline int icopy(uint64_t wr_id ,
 {
     struct ibv_sge sge; /* scatter/gather entry */
     struct ibv_send_wr sr; /* send work reuqest */
-    struct ibv_send_wr *bad_wr = NULL; /* return of send work reuqest */
     
     int torank = -1; /* remote rank */
     int rc; /* return code */
@@ -2696,7 +4862,7 @@ static inline int icopy(uint64_t wr_id ,
     }
     /* using global memory */
     else {
-        idx = torank % rkey_cache_size;
+        idx = rrm_index(torank);
         sr.wr.rdma.remote_addr = (uintptr_t)(rrmtb[idx][remote_gmtag].addr) + remote_offset;
         sr.wr.rdma.rkey = rrmtb[idx][remote_gmtag].rkey;
     }
@@ -2714,11 +4880,12 @@ static inline int icopy(uint64_t wr_id ,
     }
 #endif
 
-    /* post send by ibv_post_send */
-    rc = ibv_post_send(qp[torank], &sr, &bad_wr);
+    /* stage the work request, posted by flush_wr */
+    rc = post_wr(torank, &sr);
+    if (rc == 0) stats_tx(torank, sge.length);
         
 #ifdef DEBUG
-    fprintf(stdout, "%d: icopy ibv_post_send return code = %d\n", acp_rank(), rc);
+    fprintf(stdout, "%d: icopy post_wr return code = %d\n", acp_rank(), rc);
     fprintf(stdout, "%d: internal icopy fin\n", acp_rank());
     fflush(stdout);
 #endif
@@ -2759,46 +4926,199 @@ static inline void selectatomic(void *srcaddr, CMD *cmd){
         cmd->replydata = (uint32_t)sync_fetch_and_add_4(srcaddr4, cmd->cmde.atomic4_cmd.data);
         break;
     case ADD8:
-        srcaddr8 = (uint64_t *)srcaddr;
-        cmd->replydata = sync_fetch_and_add_8(srcaddr8, cmd->cmde.atomic8_cmd.data);
-        break;
-    case XOR4:
-        srcaddr4 = (uint32_t *)srcaddr;
-        cmd->replydata = (uint32_t)sync_fetch_and_xor_4(srcaddr4, cmd->cmde.atomic4_cmd.data);
-        break;
-    case XOR8:
-        srcaddr8 = (uint64_t *)srcaddr;
-        cmd->replydata = sync_fetch_and_xor_8(srcaddr8, cmd->cmde.atomic8_cmd.data);
-        break;
-    case OR4:
-        srcaddr4 = (uint32_t *)srcaddr;
-        cmd->replydata = (uint32_t)sync_fetch_and_or_4(srcaddr4, cmd->cmde.atomic4_cmd.data);
-        break;
-    case OR8:
-        srcaddr8 = (uint64_t *)srcaddr;
-        cmd->replydata = sync_fetch_and_or_8(srcaddr8, cmd->cmde.atomic8_cmd.data);
-        break;
-    case AND4:
-        srcaddr4 = (uint32_t *)srcaddr;
-        cmd->replydata = (uint32_t)sync_fetch_and_and_4(srcaddr4, cmd->cmde.atomic4_cmd.data);
+        srcaddr8 = (uint64_t *)srcaddr;
+        cmd->replydata = sync_fetch_and_add_8(srcaddr8, cmd->cmde.atomic8_cmd.data);
+        break;
+    case XOR4:
+        srcaddr4 = (uint32_t *)srcaddr;
+        cmd->replydata = (uint32_t)sync_fetch_and_xor_4(srcaddr4, cmd->cmde.atomic4_cmd.data);
+        break;
+    case XOR8:
+        srcaddr8 = (uint64_t *)srcaddr;
+        cmd->replydata = sync_fetch_and_xor_8(srcaddr8, cmd->cmde.atomic8_cmd.data);
+        break;
+    case OR4:
+        srcaddr4 = (uint32_t *)srcaddr;
+        cmd->replydata = (uint32_t)sync_fetch_and_or_4(srcaddr4, cmd->cmde.atomic4_cmd.data);
+        break;
+    case OR8:
+        srcaddr8 = (uint64_t *)srcaddr;
+        cmd->replydata = sync_fetch_and_or_8(srcaddr8, cmd->cmde.atomic8_cmd.data);
+        break;
+    case AND4:
+        srcaddr4 = (uint32_t *)srcaddr;
+        cmd->replydata = (uint32_t)sync_fetch_and_and_4(srcaddr4, cmd->cmde.atomic4_cmd.data);
+        break;
+    case AND8:
+        srcaddr8 = (uint64_t *)srcaddr;
+        cmd->replydata = sync_fetch_and_and_8(srcaddr8, cmd->cmde.atomic8_cmd.data);
+        break;
+    }
+    
+#ifdef DEBUG
+    fprintf(stdout, "%d: internal selectatomic fin cmd->replydata %u\n", acp_rank(), cmd->replydata);
+    fflush(stdout);
+#endif
+    
+    return;
+}
+
+/* the 8 byte atomic of cmd on srcrank runs on the HCA */
+static inline int use_native_atomic(CMD *cmd, int srcrank){
+    
+    switch (native_atomic_mode) {
+    case NATIVE_ATOMIC_HCA:
+        return (cmd->type & MASK_ATOMIC8) == MASK_ATOMIC8;
+    case NATIVE_ATOMIC_GLOB:
+        return srcrank != acp_myrank && (cmd->type == CAS8 || cmd->type == ADD8);
+    default:
+        return false;
+    }
+}
+
+/* value the compare and swap round of cmd writes in place of old */
+static inline uint64_t apply_atomic8(CMD *cmd, uint64_t old){
+    
+    switch (cmd->type) {
+    case SWAP8:
+        return cmd->cmde.atomic8_cmd.data;
+    case XOR8:
+        return old ^ cmd->cmde.atomic8_cmd.data;
+    case OR8:
+        return old | cmd->cmde.atomic8_cmd.data;
+    case AND8:
+        return old & cmd->cmde.atomic8_cmd.data;
+    default:
+        return old;
+    }
+}
+
+/* have the remote addr/rkey of tag of rank, on which the HCA runs an atomic */
+static inline int have_atomic_rm(int rank, uint32_t tag){
+    
+    uint32_t idx; /* rrm index */
+    
+    if (tag == TAG_SM || rank == acp_myrank) {
+        return true;
+    }
+    idx = rrm_lookup(rank, tag);
+    return rrmtb[idx] != NULL && rrmtb[idx][tag].valid == true && rrmtb[idx][tag].rank == rank;
+}
+
+/* Posts a round of the native atomic of cmdq[idx] on src, the value   */
+/* before it is returned into replydata of the entry.  CAS8 and ADD8   */
+/* take a single round, the others compare and swap until the value   */
+/* they expect, 0 at first, is the one they replace.                   */
+static inline int iatomic(acp_handle_t idx, int srcrank, uint32_t srctag, uint64_t srcoffset){
+    
+    struct ibv_sge sge; /* scatter/gather entry */
+    struct ibv_send_wr sr; /* send work reuqest */
+    CMD *cmd; /* command */
+    uint32_t rrmidx; /* rrm index */
+    int rc; /* return code */
+    
+    cmd = &cmdq[idx];
+    
+    /* the reply lands in the command itself */
+    memset(&sge, 0, sizeof(sge));
+    sge.addr = (uintptr_t)&cmd->replydata;
+    sge.length = sizeof(uint64_t);
+    sge.lkey = res.mr->lkey;
+    
+    memset(&sr, 0, sizeof(sr));
+    sr.next = NULL;
+    sr.wr_id = cmd->wr_id;
+    sr.sg_list = &sge;
+    sr.num_sge = 1;
+    
+    /* remote address and rkey of src */
+    if (srctag == TAG_SM) {
+        sr.wr.atomic.remote_addr = smi_tb[srcrank].addr + srcoffset;
+        sr.wr.atomic.rkey = smi_tb[srcrank].rkey;
+    }
+    else if (srcrank == acp_myrank) {
+        if (lrmtb[srctag].valid != true) {
+            return -1;
+        }
+        sr.wr.atomic.remote_addr = (uintptr_t)(lrmtb[srctag].addr) + srcoffset;
+        sr.wr.atomic.rkey = libvmrtb[srctag]->rkey;
+    }
+    else {
+        rrmidx = rrm_index(srcrank);
+        sr.wr.atomic.remote_addr = (uintptr_t)(rrmtb[rrmidx][srctag].addr) + srcoffset;
+        sr.wr.atomic.rkey = rrmtb[rrmidx][srctag].rkey;
+    }
+    
+    switch (cmd->type) {
+    case CAS8:
+        sr.opcode = IBV_WR_ATOMIC_CMP_AND_SWP;
+        sr.wr.atomic.compare_add = cmd->cmde.cas8_cmd.data1;
+        sr.wr.atomic.swap = cmd->cmde.cas8_cmd.data2;
+        break;
+    case ADD8:
+        sr.opcode = IBV_WR_ATOMIC_FETCH_AND_ADD;
+        sr.wr.atomic.compare_add = cmd->cmde.atomic8_cmd.data;
         break;
-    case AND8:
-        srcaddr8 = (uint64_t *)srcaddr;
-        cmd->replydata = sync_fetch_and_and_8(srcaddr8, cmd->cmde.atomic8_cmd.data);
+    default:
+        sr.opcode = IBV_WR_ATOMIC_CMP_AND_SWP;
+        sr.wr.atomic.compare_add = atomic_expected[idx];
+        sr.wr.atomic.swap = apply_atomic8(cmd, atomic_expected[idx]);
         break;
     }
     
+    /* stage the work request, posted by flush_wr */
+    rc = post_wr(srcrank, &sr);
+    if (rc == 0) stats_tx(srcrank, sge.length);
+    
 #ifdef DEBUG
-    fprintf(stdout, "%d: internal selectatomic fin cmd->replydata %u\n", acp_rank(), cmd->replydata);
+    fprintf(stdout, "%d: iatomic type %u srcrank %d post_wr return code = %d\n", 
+            acp_rank(), cmd->type, srcrank, rc);
     fflush(stdout);
 #endif
     
-    return;
+    return rc;
+}
+
+static inline void check_cmdq_complete(uint64_t index);
+
+/* a round of the native atomic of cmdq entry index completed */
+static inline void complete_atomic(uint64_t index){
+    
+    uint64_t idx; /* index for cmdq */
+    CMD *cmd; /* command */
+    int srcrank; /* rank of src */
+    
+    idx = index % cmdq_size;
+    cmd = &cmdq[idx];
+    
+    if (cmd->type != CAS8 && cmd->type != ADD8 && cmd->replydata != atomic_expected[idx]) {
+        /* the value was not the one expected, try again with it */
+        atomic_expected[idx] = cmd->replydata;
+        if (apply_atomic8(cmd, atomic_expected[idx]) != atomic_expected[idx]) {
+            cmd->stat = PRE_ATOMIC;
+            return;
+        }
+        /* the operation leaves the value as it was read */
+    }
+    memcpy(acp_query_address(cmd->gadst), &cmd->replydata, sizeof(uint64_t));
+    
+    /* tell the owner that this rank has its table, as after a first copy */
+    srcrank = acp_query_rank(cmd->gasrc);
+    if (query_gmtag(cmd->gasrc) != TAG_SM && srcrank != acp_myrank && 
+        rrm_hav_flag_tb[srcrank] != true) {
+        rrm_hav_flag_tb[srcrank] = true;
+        cmd->stat = PRE_PUTRRMFLAG;
+        return;
+    }
+    cmd->stat = FINISHED;
+    check_cmdq_complete(index);
 }
 
 static inline void check_cmdq_complete(uint64_t index){
     
     uint64_t idx; /* index for cmdq */
+    int op; /* index of stats.op */
+    acp_handle_t start = head; /* head before the update */
     
 #ifdef DEBUG_L2
     fprintf(stdout, "%d: internal check_cmdq_complete\n", acp_rank());
@@ -2808,17 +5128,30 @@ static inline void check_cmdq_complete(uint64_t index){
     /* if after cmdq status is FINISHED,  */
     /* changr COMPLETE and update head to new index */
     /* which have a COMPLETE status. */
-    idx = head % MAX_CMDQ_ENTRY;
-    while (head <= tail) {
+    idx = head % cmdq_size;
+    while (head < issue_tail) {
         /* if status FINISED */
         if (cmdq[idx].stat == FINISHED) {
+            op = stats_op(cmdq[idx].type);
+            if (op >= 0) {
+                iacpbl_stats_write_begin(&stats_seq);
+                iacpbl_stats_record(&stats.op[op], get_nsec() - cmdq_issue_nsec[idx]);
+                iacpbl_stats_write_end(&stats_seq);
+                if (iacpbl_trace_enabled) {
+                    iacpbl_trace_record(cmdq_issue_nsec[idx], IACPBL_TRACE_ASYNC_BEGIN, "gma", 
+                                        iacpbl_trace_gma_name[op], head, 
+                                        (op == ACP_STATS_OP_COPY) ? cmdq[idx].cmde.copy_cmd.size : 0);
+                    iacpbl_trace_record(get_nsec(), IACPBL_TRACE_ASYNC_END, "gma", 
+                                        iacpbl_trace_gma_name[op], head, 0);
+                }
+            }
             cmdq[idx].stat = COMPLETED;
             head++;
-            idx = (idx + 1) % MAX_CMDQ_ENTRY;
+            idx = (idx + 1) % cmdq_size;
 #ifdef DEBUG
             fprintf(stdout, 
                     "%d: chcomp update idx %ld head %ld tail %ld\n", 
-                    acp_rank(), idx, head, tail);
+                    acp_rank(), idx, head, issue_tail);
             fflush(stdout);
 #endif
         }
@@ -2828,6 +5161,16 @@ static inline void check_cmdq_complete(uint64_t index){
         }
     }
     
+    /* wake acp_complete and issuing threads sleeping on a handle */
+    if (head != start) {
+        __sync_synchronize();
+        if (complete_waiters > 0) {
+            pthread_mutex_lock(&complete_mutex);
+            pthread_cond_broadcast(&complete_cond);
+            pthread_mutex_unlock(&complete_mutex);
+        }
+    }
+    
 #ifdef DEBUG_L2
     fprintf(stdout, "%d: internal check_cmdq_complete fin\n", acp_rank());
     fflush(stdout);
@@ -2877,7 +5220,7 @@ static inline void rcmdbuf_update_head(){
 #endif
 }
 
-static inline void setrrm(int torank){
+static inline void setrrm(int torank, int prefetch){
   
     int i; /* general index */
     int idx; /* rkey index */
@@ -2886,7 +5229,23 @@ static inline void setrrm(int torank){
     fprintf(stdout, "%d: internal setrrm\n", acp_rank()); 
     fflush(stdout);
 #endif
-    idx = torank % rkey_cache_size;
+    idx = rrm_index(torank);
+    if (idx == rkey_cache_size) {
+        idx = rrm_victim();
+        rrmtb_rank[idx] = torank;
+        rrm_slot_tb[torank] = idx;
+        if (!prefetch) {
+            rrm_predict(torank);
+        }
+    }
+    if (prefetch) {
+        rrm_stats.prefetches++;
+    }
+    else {
+        rrm_stats.misses++;
+    }
+    rrmtb_ref[idx] = true;
+    rrmtb_pf[idx] = prefetch;
 #ifdef DEBUG
     static int j = 0;
     j++;
@@ -2922,13 +5281,69 @@ static inline void setrrm(int torank){
 #endif
 }
 
+/* issue the steps of a pending prefetch, one at a time */
+static inline void rrm_prefetch_progress(void){
+    
+    switch (rrm_pf_stat) {
+    case RRM_PF_PENDING:
+        if (recv_rrm_flag != true) {
+            break;
+        }
+        if (rrm_index(rrm_pf_rank) != rkey_cache_size) {
+            rrm_pf_stat = RRM_PF_IDLE;
+        }
+        else if (getlrm(WRID_RRM_PREFETCH, rrm_pf_rank) == 0) {
+            recv_rrm_flag = false;
+            rrm_pf_stale = false;
+            rrm_pf_stat = RRM_PF_WAIT;
+        }
+        break;
+    case RRM_PF_GETED:
+        if (rrm_pf_stale == false) {
+            setrrm(rrm_pf_rank, true);
+        }
+        recv_rrm_flag = true;
+        /* tell the owner that this rank has its table, as after a first access */
+        if (rrm_pf_stale == true || rrm_hav_flag_tb[rrm_pf_rank] == true) {
+            rrm_pf_stat = RRM_PF_IDLE;
+        }
+        else {
+            rrm_pf_stat = RRM_PF_PUT_FLAG;
+        }
+        break;
+    case RRM_PF_PUT_FLAG:
+        if (putrrmgetedflag(WRID_RRM_PREFETCH, rrm_pf_rank) == 0) {
+            rrm_pf_stat = RRM_PF_WAIT_FLAG;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* completion of the work request of a prefetch */
+static inline void rrm_prefetch_complete(void){
+    
+    if (rrm_pf_stat == RRM_PF_WAIT) {
+        rrm_pf_stat = RRM_PF_GETED;
+    }
+    else if (rrm_pf_stat == RRM_PF_WAIT_FLAG) {
+        if (rrm_pf_stale == false) {
+            rrm_hav_flag_tb[rrm_pf_rank] = true;
+        }
+        rrm_pf_stat = RRM_PF_IDLE;
+    }
+}
+
 static void *comm_thread_func(void *dm){
   
     int rc; /* return code for cq */
-    int ret; /* return code for ibv_post_send */
-    int i, j; /* general index */
+    int ret; /* return code for post_wr */
+    int i; /* general index */
     
-    struct ibv_wc wc; /* work completion for poll_cq */
+    static struct ibv_wc wcs[(MAX_POLL_SIZE + 1) * MAX_WR_SIZE]; /* work completions of poll_wc */
+    struct ibv_wc wc; /* work completion in process */
+    int k; /* index of wcs */
     int myrank; /* my rank id */
     uint64_t idx; /* CMDQ index */
     acp_handle_t index; /* acp handle index */
@@ -2942,9 +5357,9 @@ static void *comm_thread_func(void *dm){
     
     int count; /* check count for cmdq and rcmdbuf */
     int comp_cqe_flag = false; /* flag of completion of processing cqe */
+    int busy = false; /* the last round had completions, for --acp-event-wait */
     
     uint32_t rrmtb_idx; /* index of rrm table */
-    uint32_t cur_rank; /* current of rank on rrmt table */
   
     
     uint64_t iter = 0, pre_iter = 0;
@@ -2952,39 +5367,8 @@ static void *comm_thread_func(void *dm){
     int comm_work;
     int no_event_count;
     
-#ifdef SETAFFINITY
-    cpu_set_t mask;
-    int cpuid;
-    int cpumax;
-
-    
-    fprintf(stdout, "%d: getcpu %d\n", acp_rank(), sched_getcpu());
-    
-    rc = sched_getaffinity(0, sizeof(cpu_set_t), &mask);
-    if (0 != rc) {
-        perror("failed schecd_getaffinity");
-        exit(1);
-    }
+    iacpbl_trace_thread_name("comm");
     
-#ifdef SETAFFINITY_LAST
-    cpumax = CPU_COUNT(&mask);
-    fprintf(stdout, "%d: getcpu %d maxcpu %d \n", acp_rank(), sched_getcpu(), cpumax);
-    CPU_ZERO(&mask);
-    cpuid = cpumax - 1;
-#elif SETAFFINITY_FIRST
-    CPU_ZERO(&mask);
-    cpuid = 0;
-#endif
-    
-    CPU_SET(cpuid, &mask);
-    rc = sched_setaffinity(0, sizeof(cpu_set_t), &mask);
-    if (0 != rc) {
-        perror("failed schecd_setaffinity");
-        exit(1);
-    }
-    fprintf(stdout, "%d: setaffnity getcpu %d\n", acp_rank(), sched_getcpu());
-#endif
-
     /* get my rank id */
     myrank = acp_rank();
     /* get # of rank */
@@ -2993,6 +5377,7 @@ static void *comm_thread_func(void *dm){
     no_event_count = 0;
     
     while (1) {
+        __atomic_store_n(&stats.loop_iterations, stats.loop_iterations + 1, __ATOMIC_RELAXED);
         if ( 0 == comm_work ) {
             if ( ECOUNT == no_event_count ){
                 no_event_count = 0;
@@ -3007,14 +5392,23 @@ static void *comm_thread_func(void *dm){
         }
         /* iter ++; */
         /* CHECK IB COMPLETION QUEUE section */
-        rc = ibv_poll_cq(cq, 1, &wc);
+        /* connect QPs, and post the work requests staged in the last round */
+        busy |= (conn_progress() > 0);
+        busy |= (poll_imm() > 0);
+        flush_wr();
+        if (event_wait) {
+            comm_event_round(busy);
+        }
+        rc = poll_wc(wcs);
+        busy = (rc > 0);
         /* error of ibv poll cq*/
         if (rc < 0) {
             fprintf(stderr, "Fail poll cq\n");
             exit(-1);
         }
         /* get cqes */
-        if (rc > 0) {
+        for (k = 0; k < rc; k++) {
+            wc = wcs[k];
             comm_work ++;
             /* set index by cmdq head */
             index = head;
@@ -3032,9 +5426,9 @@ static void *comm_thread_func(void *dm){
 #endif
                     comp_cqe_flag = false;
                     count = 0;
-                    while (index < tail && comp_cqe_flag == false && count < MAX_CMDQ_ENTRY) {
+                    while (index < issue_tail && comp_cqe_flag == false && count < cmdq_size) {
                         /* check which acp handle command complete. */
-                        idx = index % MAX_CMDQ_ENTRY;
+                        idx = index % cmdq_size;
                         if (cmdq[idx].wr_id == wc.wr_id) {
                             switch (cmdq[idx].stat) {
                             case ISSUED: /* issued gma command */
@@ -3100,6 +5494,15 @@ static void *comm_thread_func(void *dm){
                                 comp_cqe_flag = true;
                                 break;
 
+                            case WAIT_ATOMIC: /* completed a round of native atomic */
+#ifdef DEBUG
+                                fprintf(stdout, "%d: WAIT_ATOMIC\n", myrank);
+                                fflush(stdout);
+#endif
+                                complete_atomic(index);
+                                comp_cqe_flag = true;
+                                break;
+                                
                             case WAIT_PUT_CMD: /* completed put command into rcmdbuf */
 #ifdef DEBUG
                                 fprintf(stdout, "%d: WAIT_PUT_CMD\n", myrank);
@@ -3228,6 +5631,9 @@ static void *comm_thread_func(void *dm){
 #endif
                     } /* loop rcmdbuf index */
                 }
+                else if (wc.wr_id == WRID_RRM_PREFETCH) { /* complete prefetch of rrm table */
+                    rrm_prefetch_complete();
+                }
                 else { /* complete ack comm */
                     ack_comp_count++;
                     if (ack_comp_count > MAX_ACK_COUNT) {
@@ -3250,11 +5656,12 @@ static void *comm_thread_func(void *dm){
 	    }
         }
         /* CHECK COMMAND QUEUE section */
+        cmdq_collect();
         /* cmdq is not empty */
-        if ( tail > head ) {
+        if ( issue_tail > head ) {
             index = head;
-            while ( index < tail ) {
-                idx = index % MAX_CMDQ_ENTRY;
+            while ( index < issue_tail ) {
+                idx = index % cmdq_size;
 #ifdef DEBUG_L2
                 fprintf(stdout, 
                         "%d: cmdq section: head %ld tail %ld cmdq[%ld].stat %lx\n", 
@@ -3312,7 +5719,7 @@ static void *comm_thread_func(void *dm){
                                 void *srcaddr, *dstaddr;
                                 srcaddr = acp_query_address(src);
                                 dstaddr = acp_query_address(dst);
-                                memcpy(dstaddr, srcaddr, size);
+                                iacpbl_copy(dstaddr, srcaddr, size);
 #ifdef DEBUG
                                 fprintf(stdout, "%d: local copy dadr %p sadr %p\n", 
                                         myrank, dstaddr, srcaddr);
@@ -3344,7 +5751,7 @@ static void *comm_thread_func(void *dm){
                                 }
                                 else {/* if tag point globl memory */
                                     /* if have a remote rm table of target rank */
-                                    rrmtb_idx = torank % rkey_cache_size;
+                                    rrmtb_idx = rrm_lookup(torank, totag);
                                     if (rrmtb[rrmtb_idx] != NULL) {
 #ifdef DEBUG
                                         fprintf(stdout, 
@@ -3443,7 +5850,27 @@ static void *comm_thread_func(void *dm){
                             }
                         }
                         else { /* type is atomic */
-                            if (myrank == srcrank) {
+                            if (use_native_atomic(&cmdq[idx], srcrank)) {
+                                atomic_expected[idx] = 0;
+                                if (have_atomic_rm(srcrank, srctag)) {
+                                    ret = iatomic(idx, srcrank, srctag, srcoffset);
+                                    if ( 0 == ret ) {
+                                        cmdq[idx].stat = WAIT_ATOMIC;
+                                    }
+                                }
+                                else if (recv_rrm_flag == true) {
+                                    ret = getlrm(cmdq[idx].wr_id, srcrank);
+                                    if ( 0 == ret ) {
+                                        recv_rrm_flag = false;
+                                        cmdq[idx].stat = WAIT_RRM;
+                                    }
+                                }
+                                else {
+                                    index++;
+                                    continue;
+                                }
+                            }
+                            else if (myrank == srcrank) {
                                 void *srcaddr, *dstaddr;
                                 
                                 srcaddr = acp_query_address(src);
@@ -3499,23 +5926,51 @@ static void *comm_thread_func(void *dm){
                         }
                         
                         /* set remote rkey mem table */
-                        setrrm(torank);
+                        setrrm(torank, false);
                         recv_rrm_flag = true;
                         
-                        /* issued copy */
-                        ret = icopy(cmdq[idx].wr_id, dstrank, dsttag, 
-                                    dstoffset, srcrank, srctag, srcoffset, size);
-                        
-                        if ( 0 == ret ) {
-                            if (rrm_hav_flag_tb[torank] == true) {
-                                cmdq[idx].stat = ISSUED;
+                        /* issued native atomic */
+                        if (cmdq[idx].type != COPY) {
+                            ret = iatomic(idx, srcrank, srctag, srcoffset);
+                            if ( 0 == ret ) {
+                                cmdq[idx].stat = WAIT_ATOMIC;
                             }
                             else {
-                                cmdq[idx].stat = FIRST_ISSUED;
+                                cmdq[idx].stat = PRE_ATOMIC;
                             }
                         }
                         else {
-                            cmdq[idx].stat = GETED_RRM;
+                            /* issued copy */
+                            ret = icopy(cmdq[idx].wr_id, dstrank, dsttag, 
+                                        dstoffset, srcrank, srctag, srcoffset, size);
+                            
+                            if ( 0 == ret ) {
+                                if (rrm_hav_flag_tb[torank] == true) {
+                                    cmdq[idx].stat = ISSUED;
+                                }
+                                else {
+                                    cmdq[idx].stat = FIRST_ISSUED;
+                                }
+                            }
+                            else {
+                                cmdq[idx].stat = GETED_RRM;
+                            }
+                        }
+                    }
+                    else if ( cmdq[idx].stat == PRE_ATOMIC ) {
+                        /* set ga of src from cmdq */
+                        src = cmdq[idx].gasrc;
+                        srcrank = acp_query_rank(src);
+                        srctag = query_gmtag(src);
+                        srcoffset = query_offset(src);
+                        
+                        /* the table was dropped since the last round, start over */
+                        if (srctag != TAG_SM && myrank != srcrank && rrm_index(srcrank) == rkey_cache_size) {
+                            cmdq[idx].stat = UNISSUED;
+                        }
+                        /* issued next round of native atomic */
+                        else if ( 0 == iatomic(idx, srcrank, srctag, srcoffset) ) {
+                            cmdq[idx].stat = WAIT_ATOMIC;
                         }
                     }
                     else if ( cmdq[idx].stat == PRE_PUTRRMFLAG ) {
@@ -3623,6 +6078,7 @@ static void *comm_thread_func(void *dm){
             if ( rcmdbuf[idx].valid_head == true && rcmdbuf[idx].valid_tail == true ) {
                 comm_work ++;
                 if ( rcmdbuf[idx].stat == CMD_UNISSUED ) {
+                    stats_rx(rcmdbuf[idx].rank, sizeof(CMD));
 #ifdef DEBUG_L2
                     fprintf(stdout, "%d: rcmdq section: CMD_UNISSUED\n", myrank);
                     fflush(stdout);
@@ -3653,7 +6109,7 @@ static void *comm_thread_func(void *dm){
                             void *srcaddr, *dstaddr;
                             srcaddr = acp_query_address(src);
                             dstaddr = acp_query_address(dst);
-                            memcpy(dstaddr, srcaddr, size);
+                            iacpbl_copy(dstaddr, srcaddr, size);
 #ifdef DEBUG
                             fprintf(stdout, "%d: local copy:dadr %p sadr %p\n", 
                                     myrank, dstaddr, srcaddr);
@@ -3683,7 +6139,7 @@ static void *comm_thread_func(void *dm){
                                 }
                             }
                             else{
-                                rrmtb_idx = dstrank % rkey_cache_size;
+                                rrmtb_idx = rrm_lookup(dstrank, dsttag);
                                 /* if have a remote rm table of target rank */
                                 if (rrmtb[rrmtb_idx] != NULL) {
 #ifdef DEBUG
@@ -3820,7 +6276,7 @@ static void *comm_thread_func(void *dm){
                             }
                             /* if tag point globl memory */
                             else {
-                                rrmtb_idx = dstrank % rkey_cache_size;
+                                rrmtb_idx = rrm_lookup(dstrank, dsttag);
                                 /* if have a remote rm table of dst rank */
                                 if (rrmtb[rrmtb_idx] != NULL ) {
 #ifdef DEBUG
@@ -3964,7 +6420,7 @@ static void *comm_thread_func(void *dm){
                     dstrank = acp_query_rank(dst);
                     
                     /* set remote rkey memory table of dst rank */
-                    setrrm(dstrank);
+                    setrrm(dstrank, false);
                     recv_rrm_flag = true;
                     
                     dsttag = query_gmtag(dst);
@@ -4072,31 +6528,24 @@ static void *comm_thread_func(void *dm){
             /* increment index of rcmdbuf */
             index++;
         }
+        /* RRM PREFETCH SECTION */
+        if (rrm_pf_stat != RRM_PF_IDLE) {
+            rrm_prefetch_progress();
+        }
         /* PUT RRM ACK SECTION */
         for (i = 0; i < nprocs; i++) {
             /* check rrm reset flag table */
             if (true == rrm_reset_flag_tb[i]) {
                 comm_work ++;
-                /* free remote rkey table */
-                for (j = 0; j < MAX_RM_SIZE; j++) {
-                    rrmtb_idx = i % rkey_cache_size;
-                    if (rrmtb[rrmtb_idx] != NULL) { 
-                        if (rrmtb[rrmtb_idx][j].valid == true) {
-                            cur_rank = rrmtb[rrmtb_idx][j].rank;
-                            break;
-                        }
-                    }
+                /* forget remote rkey table */
+                rrm_drop(i);
+                if (rrm_pf_stat != RRM_PF_IDLE && rrm_pf_rank == i) {
+                    rrm_pf_stale = true;
                 }
-                if (cur_rank == i) {
-                    rrmtb_idx = cur_rank % rkey_cache_size;
-                    free(rrmtb[rrmtb_idx]);
-                    rrmtb[rrmtb_idx] = NULL;
 #ifdef DEBUG
-		    fprintf(stdout, "%d: rrm_tb[%d] = %p cur_rank %d\n", 
-			    acp_rank(), rrmtb_idx, rrmtb[rrmtb_idx], cur_rank);
-		    fflush(stdout);
+		fprintf(stdout, "%d: rrm table of %d dropped\n", acp_rank(), i);
+		fflush(stdout);
 #endif
-		}
 		
                 /* put rrm ack flag */
                 ret = putrrmackflag(ack_id, i);
@@ -4123,7 +6572,7 @@ static void *comm_thread_func(void *dm){
 int iacp_init(void){
     
     int rc = 0; /* return code */
-    int i, j; /* general index */
+    int i; /* general index */
     
     int sock_s; /* socket server */
     socklen_t addrlen;/* address length */
@@ -4131,29 +6580,17 @@ int iacp_init(void){
     struct ibv_device **dev_list = NULL; /* IB device list */
     char *dev_name = NULL; /* device name */
     
-    /* initalize queue pair attribute information*/
-    struct ibv_qp_init_attr qp_init_attr;
     int mr_flags = 0; /* flag of memory registeration*/
-    int ib_port = 1; /* ib port */
     int cq_size = MAX_CQ_SIZE; /* CQ size */
-    
-    /* post recieve in RTR */
-    struct ibv_recv_wr rr;
-    struct ibv_sge sge;
-    struct ibv_recv_wr *bad_wr;
-    
-    uint32_t *local_qp_num; /* local each qp number */
-    uint32_t *tmp_qp_num; /* temporary qp number */
-    uint32_t *remote_qp_num; /* remote each qp number */
+    struct ibv_device_attr dev_attr; /* device attributes */
     
     CII local_data; /* local data for socket communication */
     CII remote_data; /* remote data for socket communication */
     CII tmp_data; /* temporary data for socket communication */
+    uint32_t *tmp_qp_num = NULL; /* QP numbers of a rank to every rank, relayed on the ring */
+    uint32_t *remote_qp_num; /* QP numbers received from the ring */
     int torank; /* rank ID */
     
-    struct ibv_qp_attr attr; /* modify queue pair */
-    int flags; /* flag of modify queue pair */
-    
     /* allocate the starter memory adn register memory */
     size_t syssize;
     /* ajusting variable for alignment 8 bytes */
@@ -4163,9 +6600,17 @@ int iacp_init(void){
     /* create iacp_starter_memory_size_dl_heap */
     uint64_t iacp_starter_memory_size_dl_heap = 256;
 
+    /* initialize event trace */
+    iacpbl_trace_init(acp_myrank);
+    
     /* initialize head, tail */
     head = 1;
     tail = 1;  
+    if (init_cmdq()) {
+        fprintf(stderr, "failed to malloc cmdq tables\n");
+        rc = -1;
+        goto exit;
+    }
     
     recv_rrm_flag = true; /* get enable recv rrm falg */
     
@@ -4207,7 +6652,7 @@ int iacp_init(void){
         
     /* sysmem size */
     syssize = acp_smsize_adj + sizeof(RM) * (MAX_RM_SIZE) * 2  + sizeof(uint64_t) * 4 +
-        sizeof(CMD) * MAX_CMDQ_ENTRY + sizeof(CMD) * MAX_RCMDB_SIZE + sizeof(CMD) * MAX_CMDQ_ENTRY +
+        sizeof(CMD) * cmdq_size + sizeof(CMD) * MAX_RCMDB_SIZE + sizeof(CMD) * cmdq_size +
         ncharflagtb_adj + acp_smdlsize_adj + acp_smclsize_adj;	
     
     /* malloc sysmem */
@@ -4215,9 +6660,7 @@ int iacp_init(void){
     fprintf(stdout, "%d: pre sysmem  malloc %zu bytes to memory buffer\n", acp_myrank, syssize);
     fflush(stdout);
 #endif
-    sysmem = (char *) malloc(syssize);
-    
-    if (NULL == sysmem ) {
+    if (init_node(syssize)) {
         fprintf(stderr, "failed to malloc %zu bytes to memory buffer\n", 
                 syssize);
         rc = -1;
@@ -4264,16 +6707,16 @@ int iacp_init(void){
     offset_stat = (char *)&cmdq[0].stat - (char *)&cmdq[0];
         
     /* initialize command recv buffer */
-    rcmdbuf = (CMD *)((char *)cmdq + sizeof(CMD) * MAX_CMDQ_ENTRY);
-    offset_rcmdbuf = offset_cmdq + sizeof(CMD) * MAX_CMDQ_ENTRY;
+    rcmdbuf = (CMD *)((char *)cmdq + sizeof(CMD) * cmdq_size);
+    offset_rcmdbuf = offset_cmdq + sizeof(CMD) * cmdq_size;
     
     /* initilaize put cmd buffer */
     putcmdbuf = (CMD *)((char*)rcmdbuf + sizeof(CMD) * MAX_RCMDB_SIZE);
     offset_putcmdbuf = offset_rcmdbuf + sizeof(CMD) * MAX_RCMDB_SIZE;
     
     /* initilaize get flag table */
-    rrm_get_flag_tb = (char *)((char*)putcmdbuf + sizeof(CMD) * MAX_CMDQ_ENTRY);
-    offset_rrm_get_flag_tb = offset_putcmdbuf + sizeof(CMD) * MAX_CMDQ_ENTRY;
+    rrm_get_flag_tb = (char *)((char*)putcmdbuf + sizeof(CMD) * cmdq_size);
+    offset_rrm_get_flag_tb = offset_putcmdbuf + sizeof(CMD) * cmdq_size;
     
     /* initilaize reset flag table */
     rrm_reset_flag_tb = (char *)((char*)rrm_get_flag_tb + sizeof(char) * acp_numprocs);
@@ -4308,19 +6751,11 @@ int iacp_init(void){
 #endif
 
     /* remote register memory table */
-    if(acp_numprocs > MAX_RKEY_CASH_SIZE){
-        rkey_cache_size = MAX_RKEY_CASH_SIZE;
-    }
-    else{
-        rkey_cache_size = acp_numprocs;
-    }
-    rrmtb = (RM **) malloc (sizeof (RM *) * rkey_cache_size);
-    if (rrmtb == NULL) {
+    if (init_rrmtb()) {
         fprintf(stderr, "failed to malloc rrmtb\n");
         rc = -1;
         goto exit;
     }
-    memset(rrmtb, 0, sizeof(RM *) * rkey_cache_size);
     
     /* generate server socket */
     if ((sock_s = socket (AF_INET, SOCK_STREAM, 0)) < 0) {
@@ -4499,6 +6934,22 @@ int iacp_init(void){
         rc = -1;
         goto exit;
     }
+    
+    /* get atomic capability */
+    if (ibv_query_device(res.ib_ctx, &dev_attr)) {
+        fprintf(stderr, "ibv_query_device failed\n");
+        rc = -1;
+        goto exit;
+    }
+    native_atomic_mode = NATIVE_ATOMIC_NONE;
+    if (iacpbl_option.nativeatomic.value) {
+        if (dev_attr.atomic_cap == IBV_ATOMIC_GLOB) {
+            native_atomic_mode = NATIVE_ATOMIC_GLOB;
+        }
+        else if (dev_attr.atomic_cap == IBV_ATOMIC_HCA) {
+            native_atomic_mode = NATIVE_ATOMIC_HCA;
+        }
+    }
 
     /* allocate Protection Domain */
     res.pd = ibv_alloc_pd(res.ib_ctx);
@@ -4507,10 +6958,15 @@ int iacp_init(void){
         rc = -1;
         goto exit;
     }
+    init_mrc();
     
     /* each side will send only one WR, */
     /*   so Completion Queue with 1 entry is enough */
-    cq = ibv_create_cq(res.ib_ctx, cq_size, NULL, NULL, 0);
+    if (init_event()) {
+        rc = -1;
+        goto exit;
+    }
+    cq = ibv_create_cq(res.ib_ctx, cq_size, NULL, event_ch, 0);
     if (!cq) {
         fprintf(stderr, 
                 "failed to create CQ with %u entries\n", cq_size);
@@ -4548,52 +7004,29 @@ int iacp_init(void){
     }
     memset(qp, 0, sizeof(struct ibv_qp *) * acp_numprocs);
     
-    memset(&qp_init_attr, 0, sizeof(qp_init_attr));
-    qp_init_attr.qp_type = IBV_QPT_RC;
-    qp_init_attr.sq_sig_all = 1; /* if work request COMPLETE, CQE enqueue cq. */
-    qp_init_attr.send_cq = cq;
-    qp_init_attr.recv_cq = cq;
-    qp_init_attr.cap.max_send_wr = MAX_WR_SIZE;
-    qp_init_attr.cap.max_recv_wr = 0; /* use only first post recv */
-    qp_init_attr.cap.max_send_sge = 1;
-    qp_init_attr.cap.max_recv_sge = 0;
-    
-    /* local arays of queue pair number */
-    local_qp_num = (uint32_t *)malloc(sizeof(uint32_t) * acp_numprocs);
-    if (local_qp_num == NULL) {
-        fprintf(stderr, "failed to malloc local_qp_num\n");
-        rc = -1;
-        goto exit;
-    }
-    /* temporary arays of queue pair number for data recieving */
-    tmp_qp_num = (uint32_t *)malloc(sizeof(uint32_t) * acp_numprocs);
-    if (tmp_qp_num == NULL) {
-        fprintf(stderr, "failed to malloc tmp_qp_num\n");
+    /* QPs are connected below, or on first use with a QP pool, see conn_request */
+    if (init_conn()) {
         rc = -1;
         goto exit;
     }
-    /* remote arays of queue pair number */
-    remote_qp_num = (uint32_t *)malloc(sizeof(uint32_t) * acp_numprocs);
-    if (remote_qp_num == NULL) {
-        fprintf(stderr, "failed to malloc remote_qp_num\n");
+    /* send queues of the QPs */
+    if (init_sq()) {
+        fprintf(stderr, "failed to malloc send queues\n");
         rc = -1;
         goto exit;
     }
-    
-    for (i = 0;i < acp_numprocs;i++) {
-        qp[i] = ibv_create_qp(res.pd, &qp_init_attr);
-        if (!qp[i]) {
-            fprintf(stderr, "failed to create QP\n");
+    if (!conn_ondemand) {
+        tmp_qp_num = (uint32_t *)malloc(sizeof(uint32_t) * acp_numprocs * 2);
+        if (tmp_qp_num == NULL) {
+            fprintf(stderr, "failed to malloc tmp_qp_num\n");
             rc = -1;
             goto exit;
         }
-        local_qp_num[i] = qp[i]->qp_num;
-        
-#ifdef DEBUG
-        fprintf(stdout, "QP[%d] was created, QP number=0x%x\n", 
-                i, local_qp_num[i]);
-        fflush(stdout);
-#endif        
+        remote_qp_num = tmp_qp_num + acp_numprocs;
+        for (i = 0; i < acp_numprocs; i++) {
+            create_rc_qp(i);
+            tmp_qp_num[i] = qp[i]->qp_num;
+        }
     }
     
     /* exchange using TCP sockets info required to connect QPs */
@@ -4601,6 +7034,10 @@ int iacp_init(void){
     local_data.rkey = res.mr->rkey;
     local_data.lid = res.port_attr.lid;
     local_data.rank = acp_myrank;
+    local_data.ud_qp_num = (ud_qp != NULL) ? ud_qp->qp_num : 0;
+    local_data.event_wait = event_wait;
+    local_data.hostid = node_hostid;
+    local_data.pid = getpid();
     smi_tb = (SMI *)malloc(sizeof(SMI) * acp_numprocs);
     if (smi_tb == NULL) {
         fprintf(stderr, "failed to malloc starter memory info table\n");
@@ -4616,208 +7053,75 @@ int iacp_init(void){
     fflush(stdout);
 #endif
     
-    tmp_data.addr = local_data.addr;
-    tmp_data.rkey = local_data.rkey;
-    tmp_data.lid = local_data.lid;
-    tmp_data.rank = local_data.rank;
-    for (i = 0;i < acp_numprocs; i++) {
-        tmp_qp_num[i] = local_qp_num[i];
-    }
+    tmp_data = local_data;
     
     /* address and rkey of my process */
     smi_tb[acp_myrank].addr = local_data.addr;
     smi_tb[acp_myrank].rkey = local_data.rkey;
+    conntb[acp_myrank].lid = local_data.lid;
+    conntb[acp_myrank].ud_qp_num = local_data.ud_qp_num;
+    conntb[acp_myrank].event_wait = local_data.event_wait;
     
     for (i = 0;i < acp_numprocs - 1;i++) {
         /* TCP sendrecv */
-#ifdef DEBUG
-        fprintf(stdout, "%d:-----------------------------\n", acp_rank());
-        fflush(stdout);
-#endif
         memset(&remote_data, 0, sizeof(remote_data));
-        memset(remote_qp_num, 0, sizeof(uint32_t) * acp_numprocs);
         
         while (write(sock_connect, &tmp_data, sizeof(tmp_data)) < 0);
         while (recv(sock_accept, &remote_data, sizeof(remote_data), MSG_WAITALL) < 0) ;
-        while (write(sock_connect, tmp_qp_num, sizeof(uint32_t) * acp_numprocs) < 0);
-        while (recv(sock_accept, remote_qp_num, sizeof(uint32_t) * acp_numprocs, MSG_WAITALL) < 0);
+        if (!conn_ondemand) {
+            while (write(sock_connect, tmp_qp_num, sizeof(uint32_t) * acp_numprocs) < 0);
+            while (recv(sock_accept, remote_qp_num, sizeof(uint32_t) * acp_numprocs, MSG_WAITALL) < 0);
+        }
         
         /* copy addr and rkey to start buffer information table */
         torank = remote_data.rank;
         smi_tb[torank].addr = remote_data.addr;
         smi_tb[torank].rkey = remote_data.rkey;
+        conntb[torank].lid = remote_data.lid;
+        conntb[torank].ud_qp_num = remote_data.ud_qp_num;
+        conntb[torank].event_wait = remote_data.event_wait;
+        node_attach(&remote_data);
         
-        /* save the remote side attributes, we will need it for the post SR */
 #ifdef DEBUG
         fprintf(stdout, "%d: Remote address = %lx\n", acp_rank(), remote_data.addr);
         fprintf(stdout, "%d: Remote rkey = %u\n", acp_rank(), remote_data.rkey);
         fprintf(stdout, "%d: Remote rank = %d\n", acp_rank(), torank);
         fprintf(stdout, "%d: Remote LID = %u\n", acp_rank(), remote_data.lid);
-        fprintf(stdout, "%d: Remote QP number = %d 0x%x\n", acp_rank(), torank, remote_qp_num[acp_myrank]);
-        fflush(stdout);
-#endif
-    
-        /* modify the QP to init */
-        /* initialize ibv_qp_attr */
-        memset(&attr, 0, sizeof(attr));
-        
-        /* set attribution for INIT */
-        attr.qp_state = IBV_QPS_INIT;
-        attr.port_num = ib_port; /* physical port number (1...n)*/
-        attr.pkey_index = 0; /* normally 0 */
-        attr.qp_access_flags = 
-            IBV_ACCESS_LOCAL_WRITE | 
-            IBV_ACCESS_REMOTE_READ |
-            IBV_ACCESS_REMOTE_WRITE |
-            IBV_ACCESS_REMOTE_ATOMIC;
-        
-        /* set flag for INIT */
-        flags = IBV_QP_STATE |
-            IBV_QP_PKEY_INDEX | 
-            IBV_QP_PORT | 
-            IBV_QP_ACCESS_FLAGS;
-        
-        rc = ibv_modify_qp(qp[torank], &attr, flags);
-        
-        if (rc) {
-            fprintf(stderr, "%d: change QP state to INIT failed\n", acp_rank());
-            goto exit;
-        }
-#ifdef DEBUG
-        fprintf(stdout, "%d: QP state was change to INIT\n", acp_rank());
-        fflush(stdout);
-#endif
-#if 0
-        /* let the client post RR to be prepared for incoming messages */
-        /* prepare the scatter/gather entry */
-        memset(&sge, 0, sizeof(sge));
-        
-        sge.addr = (uintptr_t)sysmem;
-        sge.length = syssize;
-        sge.lkey = res.mr->lkey;
-        
-        /* prepare the receive work request */
-        memset(&rr, 0, sizeof(rr));
-        
-        rr.next = NULL;
-        rr.wr_id = ACP_HANDLE_NULL;
-        rr.sg_list = &sge;
-        rr.num_sge = 1;
-        
-        /* post the Receive Request to the RQ */
-        rc = ibv_post_recv(qp[torank], &rr, &bad_wr);
-        
-        if (rc) {
-            fprintf(stderr, "%d: failed to post RR\n", acp_rank());
-            goto exit;
-        }
-#endif
-#ifdef DEBUG
-        fprintf(stdout, "%d: Post Receive Request\n", acp_rank());
-        fflush(stdout);
-#endif
-        
-        /* modify the QP to RTR */
-        memset(&attr, 0, sizeof(attr));
-        
-        /* set attribution for RTR */
-        attr.qp_state = IBV_QPS_RTR;
-        attr.path_mtu = res.port_attr.active_mtu;
-        attr.dest_qp_num = remote_qp_num[acp_myrank];
-        attr.rq_psn = 0;
-        attr.max_dest_rd_atomic = 1;
-        /* recommend value 0x12. miminum RNR (receive not ready) NAK timer */
-        attr.min_rnr_timer = 0x12; 
-        /* minimally ah_attr.dlid needs t o be filled in ah for UD */
-        attr.ah_attr.dlid = remote_data.lid; 
-        attr.ah_attr.sl = 0;
-        attr.ah_attr.src_path_bits = 0;
-        attr.ah_attr.is_global = 0;
-        attr.ah_attr.port_num = ib_port;
-        
-        /* set flags for RTR */
-        flags = IBV_QP_STATE |
-            IBV_QP_AV | 
-            IBV_QP_PATH_MTU | 
-            IBV_QP_DEST_QPN |
-            IBV_QP_RQ_PSN | 
-            IBV_QP_MAX_DEST_RD_ATOMIC | 
-            IBV_QP_MIN_RNR_TIMER;
-        
-        rc = ibv_modify_qp(qp[torank], &attr, flags);
-        
-        if (rc) {
-            fprintf(stderr, "%d: failed to modify QP state to RTR\n", acp_rank());
-            goto exit;
-        }
-#ifdef DEBUG
-        fprintf(stdout, "%d: QP state was change to RTR\n", acp_rank());
+        fprintf(stdout, "%d: Remote UD QP number = 0x%x\n", acp_rank(), remote_data.ud_qp_num);
         fflush(stdout);
 #endif
         
-        /* modify the QP to RTS */
-        memset(&attr, 0, sizeof(attr));
-        
-        /* set attribution for RTS */
-        attr.qp_state = IBV_QPS_RTS;
-        attr.timeout = 0x12;
-        attr.retry_cnt = 7; /* recommended 7 */
-        attr.rnr_retry = 7; /* recommended 7 */
-        attr.sq_psn = 0; /* send queue starting packet sequence number (should match remote QP’s rq_psn) */
-        attr.max_rd_atomic = 1; /* # of outstanding RDMA reads and atomic operations allowed.*/
-        
-        /* set flag for RTS */
-        flags = IBV_QP_STATE | 
-            IBV_QP_TIMEOUT | 
-            IBV_QP_RETRY_CNT | 
-            IBV_QP_RNR_RETRY |  
-            IBV_QP_SQ_PSN | 
-            IBV_QP_MAX_QP_RD_ATOMIC;
-        
-        rc = ibv_modify_qp(qp[torank], &attr, flags);
-        
-        if (rc) {
-            fprintf(stderr, "%d: failed to modify QP state to RTR\n", acp_rank());
-            goto exit;
+        if (!conn_ondemand) {
+            connect_rc_qp(torank, remote_qp_num[acp_myrank]);
+            conn_ready(torank);
+            memcpy(tmp_qp_num, remote_qp_num, sizeof(uint32_t) * acp_numprocs);
         }
-#ifdef DEBUG
-        fprintf(stdout, "%d: QP state was change to RTS\n", acp_rank());
-        fflush(stdout);
-#endif
         
         /* copy remote data to temporary buffer for bukects relay */
-        tmp_data.addr = remote_data.addr;
-        tmp_data.rkey = remote_data.rkey;
-        tmp_data.lid = remote_data.lid;
-        tmp_data.rank = remote_data.rank;
-#ifdef DEBUG
-        fprintf(stdout, "%d: tmp Remote address = %lx\n", acp_rank(), tmp_data.addr);
-        fprintf(stdout, "%d: tmp Remote rkey = %u\n", acp_rank(), tmp_data.rkey);
-        fprintf(stdout, "%d: tmp Remote rank = %d\n", acp_rank(), tmp_data.rank);
-        fprintf(stdout, "%d: tmp Remote LID = %u\n", acp_rank(), tmp_data.lid);
-        fflush(stdout);
-#endif
-        for (j = 0;j < acp_numprocs; j++) {
-            tmp_qp_num[j] = remote_qp_num[j];
-        }
-    }
-
-    /* free acp_init tmporary */
-    if (local_qp_num != NULL) {
-        free(local_qp_num);
-        local_qp_num = NULL;
+        tmp_data = remote_data;
     }
-    if (tmp_qp_num != NULL) {
+    if (!conn_ondemand) {
+        connect_rc_qp(acp_myrank, qp[acp_myrank]->qp_num);
+        conn_ready(acp_myrank);
         free(tmp_qp_num);
         tmp_qp_num = NULL;
     }
-    if (remote_qp_num != NULL) {
-        free(remote_qp_num);
-        remote_qp_num = NULL;
+    /* the CPU atomics of the node are atomic with those of the HCA, or no HCA atomic reaches the node */
+    node_atomic = (dev_attr.atomic_cap == IBV_ATOMIC_GLOB || node_pop == acp_numprocs);
+
+    /* initialize statistics */
+    memset(&stats, 0, sizeof(acp_stats_t));
+    peer_stats = (acp_peer_stats_t *)calloc(acp_numprocs, sizeof(acp_peer_stats_t));
+    
+    if (iacpbl_affinity_init(NULL, acp_myrank, acp_taskid)) {
+        fprintf(stderr, "%d: acp_init: failed to open the affinity table\n", acp_myrank);
     }
     pthread_create(&comm_thread_id, NULL, comm_thread_func, NULL);
     
     iacp_internal_sync();
+    node_unlink();
+    iacpbl_affinity_place(comm_thread_id);
+    iacpbl_trace_align();
     iacp_init_rcdbsync();
     
     /* exec internel init function dl and cl */
@@ -4829,19 +7133,7 @@ int iacp_init(void){
     return rc;
     
 exit:
-    /* free acp_init tmporary */
-    if (local_qp_num != NULL) {
-        free(local_qp_num);
-        local_qp_num = NULL;
-    }
-    if (tmp_qp_num != NULL) {
-        free(tmp_qp_num);
-        tmp_qp_num = NULL;
-    }
-    if (remote_qp_num != NULL) {
-        free(remote_qp_num);
-        remote_qp_num = NULL;
-    }
+    free(tmp_qp_num);
     
     /* close IB resource */
     if (res.mr != NULL) {
@@ -4860,10 +7152,13 @@ exit:
         qp = NULL;
     }
     
+    free_conn();
     if (cq != NULL) {
         ibv_destroy_cq(cq);
         cq = NULL;
     }
+    free_event();
+    free_mrc();
     
     if (res.pd != NULL) {
         ibv_dealloc_pd(res.pd);
@@ -4891,25 +7186,13 @@ exit:
         close(sock_s);
     }
     
-    /* free acp region */
-    for (i = 0;i < rkey_cache_size ;i++) {
-        if (rrmtb[i] != NULL) {
-            free(rrmtb[i]);
-            rrmtb[i] = NULL;
-        }
-    }
-    
     /* free rrm tables */
-    if (rrmtb != NULL) {
-        free(rrmtb);
-        rrmtb = NULL;
-    }
+    free_rrmtb();
+    free_sq();
+    free_cmdq();
     
     /* free system memory */
-    if (system != NULL) {
-        free(sysmem);
-        sysmem = NULL;
-    }
+    free_node();
     
     /* free starter memory info */
     if (smi_tb != NULL) {
@@ -4930,6 +7213,7 @@ int acp_init(int *argc, char ***argv)
     fflush(stdout);
 #endif
     iacpbl_interpret_option( argc, argv ) ;
+    iacpbl_copy_init( iacpbl_option.copythreshold.value ) ;
     acp_myrank                  = ( int      ) iacpbl_option.myrank.value   ;
     acp_numprocs                = ( int      ) iacpbl_option.nprocs.value   ;
     acp_taskid                  = ( uint32_t ) iacpbl_option.taskid.value   ;
@@ -4970,6 +7254,7 @@ int acp_finalize(){
     int i; /* genral index */
     int myrank; /* my rank for command*/
     acp_handle_t tail4c; /* tail for cmdq */
+    acp_handle_t hdl; /* handle of FIN */
     CMD *pcmdq; /* pointer of cmd */
   
 #ifdef DEBUG
@@ -4982,27 +7267,54 @@ int acp_finalize(){
     iacp_finalize_dl();
 #endif
 
-    /* Insert FIN command into cmdq */
-    while (tail - head == MAX_CMDQ_ENTRY - 1) ;
     iacp_free_rcdbsync();
     /* wait all process execute acp_finalize */
     iacp_internal_sync();
     /* check my rank */
     myrank = acp_rank();
     /* make a FIN command, and enqueue command Queue. */
-    tail4c = tail % MAX_CMDQ_ENTRY;
+    hdl = cmdq_reserve();
+    tail4c = hdl % cmdq_size;
     pcmdq = (CMD *)&cmdq[tail4c];
     pcmdq->rank = myrank;
     pcmdq->type = FIN;
-    pcmdq->ishdl = tail;
-    pcmdq->wr_id = tail;
+    pcmdq->ishdl = hdl;
+    pcmdq->wr_id = hdl;
     pcmdq->stat = ISSUED;
     
-    /* update tail */
-    tail++ ;
+    /* pass the entry to the communication thread */
+    cmdq_publish(hdl);
     
     /* complete communication thread */
     pthread_join(comm_thread_id, NULL);
+    iacpbl_affinity_finalize();
+    
+    /* dump and free statistics */
+    if (iacpbl_stats_enabled()) {
+        iacpbl_stats_dump(myrank, &stats, peer_stats, acp_numprocs);
+        fprintf(stderr, "%d: acp rkey cache: capacity %u, hits %lu, misses %lu, evictions %lu, prefetches %lu (%lu used)\n",
+                myrank, rkey_cache_size, rrm_stats.hits, rrm_stats.misses, rrm_stats.evictions,
+                rrm_stats.prefetches, rrm_stats.prefetch_hits);
+        fprintf(stderr, "%d: acp connections: pool %u, connected %u, connects %lu, accepts %lu, evictions %lu\n",
+                myrank, conn_max, conn_num, conn_stats.connects, conn_stats.accepts, conn_stats.evictions);
+        if (node_sm != NULL) {
+            fprintf(stderr, "%d: acp intranode: ranks %d, operations %lu, bytes %lu, cross memory attach %lu\n",
+                    myrank, node_pop, node_stats.ops, node_stats.bytes, node_stats.cma);
+        }
+        fprintf(stderr, "%d: acp registration cache: idle %lu bytes, hits %lu, misses %lu, evictions %lu, invalidations %lu\n",
+                myrank, mrc_idle, mrc_stats.hits, mrc_stats.misses, mrc_stats.evictions, mrc_stats.invalidations);
+        if (event_wait) {
+            fprintf(stderr, "%d: acp event wait: sleeps %lu, timeouts %lu, acp_complete sleeps %lu\n",
+                    myrank, event_stats.sleeps, event_stats.timeouts, event_stats.complete_sleeps);
+        }
+    }
+    if (peer_stats != NULL) {
+        free(peer_stats);
+        peer_stats = NULL;
+    }
+    
+    /* write event trace */
+    iacpbl_trace_finalize();
     
     /* close IB resouce */
     if (res.mr != NULL) {
@@ -5010,11 +7322,9 @@ int acp_finalize(){
         res.mr = NULL;
     }
     
+    /* the MRs of the tags are deregistered by free_mrc */
     for (i = 0;i < MAX_RM_SIZE;i++) {
-        if (libvmrtb[i] != NULL) {
-            ibv_dereg_mr(libvmrtb[i]);
-            libvmrtb[i] = NULL;
-        }
+        libvmrtb[i] = NULL;
     }
     
     for (i = 0;i < acp_numprocs;i++) {
@@ -5028,10 +7338,13 @@ int acp_finalize(){
         qp = NULL;
     }
 
+    free_conn();
     if (cq != NULL) {
         ibv_destroy_cq(cq);
         cq = NULL;
     }
+    free_event();
+    free_mrc();
     
     if (res.pd != NULL) {
         ibv_dealloc_pd(res.pd);
@@ -5052,20 +7365,10 @@ int acp_finalize(){
     }
     
     /* free acp region */
-    for (i = 0;i < rkey_cache_size ;i++) {
-        if (rrmtb[i] != NULL) {
-            free(rrmtb[i]);
-            rrmtb[i] = NULL;
-        }
-    }
-    if (rrmtb != NULL) {
-        free(rrmtb);
-        rrmtb = NULL;
-    }
-    if (sysmem != NULL) {
-        free(sysmem);
-        sysmem = NULL;
-    }
+    free_rrmtb();
+    free_sq();
+    free_cmdq();
+    free_node();
     if (smi_tb != NULL) {
         free(smi_tb);
         smi_tb = NULL;
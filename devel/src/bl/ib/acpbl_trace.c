@@ -0,0 +1 @@
+../common/acpbl_trace.c
\ No newline at end of file
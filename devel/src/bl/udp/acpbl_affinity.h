@@ -0,0 +1 @@
+../common/acpbl_affinity.h
\ No newline at end of file
@@ -0,0 +1 @@
+../common/acpbl_copy.h
\ No newline at end of file
@@ -0,0 +1 @@
+../common/acpbl_stats.h
\ No newline at end of file
@@ -0,0 +1 @@
+../common/acpbl_trace.h
\ No newline at end of file
@@ -20,11 +20,13 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <acp.h>
 #include "acpbl.h"
 #include "acpbl_sync.h"
@@ -32,21 +34,33 @@
 #include "acpbl_udp_gmm.h"
 #include "acpbl_udp_gma.h"
 #include "acpbl_input.h"
+#include "acpbl_trace.h"
 /* H.Honda Nov.16 2015 begin */
 #ifdef MPIACP
 #include "mpi.h"
 #endif /* MPIACP */
 /* H.Honda Nov.16 2015 end   */
 
+#define ACPBL_UDP_RANK_ERROR 0xffffffff
+#define ACPBL_UDP_TASKID_ERROR 0xffffffff
+#define MAX_BOOTSTRAP_RADIX 64
+
+#define SYNC_IDLE   0
+#define SYNC_REDUCE 1
+#define SYNC_BCAST  2
+
 static uint16_t my_port;
 static uint16_t parent_port;
 static uint32_t parent_addr;
-static int sock_listen, sock_accept0, sock_accept1, sock_connect;
-static int num_child;
+static int sock_listen, sock_connect;
+static int sock_child[MAX_BOOTSTRAP_RADIX];
+static int num_child, bootstrap_radix;
 static uint64_t sync_sequence_number;
-
-#define ACPBL_UDP_RANK_ERROR 0xffffffff
-#define ACPBL_UDP_TASKID_ERROR 0xffffffff
+static int sync_state;              /* SYNC_IDLE, SYNC_REDUCE or SYNC_BCAST */
+static int sync_arrived[MAX_BOOTSTRAP_RADIX];
+static int num_sync_arrived;
+static uint64_t sync_epoch;         /* handle of the latest barrier */
+static int udp_only;
 
 uint32_t iacpbludp_my_rank;
 uint32_t iacpbludp_num_procs;
@@ -63,18 +77,88 @@ uint16_t* iacpbludp_inum_table;
 uint32_t* iacpbludp_gtwy_table;
 uint32_t* iacpbludp_lmem_table;
 
+/* Bootstrap helpers */
+
+typedef struct {
+    uint32_t rank;
+    uint32_t addr;
+    uint16_t port;
+    uint16_t pad;
+} bootstrap_rec_t;
+
+typedef struct {
+    uint32_t rank;
+    uint32_t taskid;
+    uint32_t parent_addr;
+    uint32_t status;
+    uint32_t num_rec;
+} bootstrap_hdr_t;
+
+static void recv_all(int sock, void* buf, size_t len)
+{
+    ssize_t r;
+    
+    while (len > 0) {
+        r = recv(sock, buf, len, MSG_WAITALL);
+        if (r < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
+            continue;
+        }
+        if (r == 0) exit(-1);
+        buf = (char*)buf + r;
+        len -= r;
+    }
+    return;
+}
+
+static void sendv_all(int sock, struct iovec* iov, int iovcnt)
+{
+    ssize_t r;
+    
+    while (iovcnt > 0) {
+        r = writev(sock, iov, iovcnt);
+        if (r < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
+            continue;
+        }
+        while (iovcnt > 0 && r >= iov->iov_len) {
+            r -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + r;
+            iov->iov_len -= r;
+        }
+    }
+    return;
+}
+
+static void send_all(int sock, void* buf, size_t len)
+{
+    struct iovec iov;
+    
+    iov.iov_base = buf;
+    iov.iov_len  = len;
+    sendv_all(sock, &iov, 1);
+    return;
+}
+
 static int iacp_init(void)
 {
-    struct sockaddr_in addr_listen, addr_accept0, addr_accept1, addr_connect;
-    uint32_t rank0, rank1;
-    uint32_t taskid0, taskid1;
-    uint32_t num_descendant0, num_descendant1, num_descendant;
-    uint16_t port0, port1;
+    struct sockaddr_in addr_listen, addr_accept[MAX_BOOTSTRAP_RADIX], addr_connect;
+    bootstrap_hdr_t hdr;
+    bootstrap_rec_t* recs;
+    uint32_t first_child, num_descendant, num_rec, status;
     uint32_t my_addr;
+    socklen_t len;
     const int option = 1;
+    int i;
     
 //    acp_errno = 0;
     
+    iacpbl_trace_init(MY_RANK);
+    
     /* Allocate infrastructure tables */
     
     RANK_TABLE = malloc(NUM_PROCS * sizeof(uint32_t));
@@ -88,21 +172,25 @@ static int iacp_init(void)
     debug printf("rank %d - inum_table 0x%016" PRIx64 "\n", MY_RANK, (uint64_t)INUM_TABLE);
     debug printf("rank %d - gtwy_table 0x%016" PRIx64 "\n", MY_RANK, (uint64_t)GTWY_TABLE);
     
-    /* Count branchs */
+    /* Count branches */
     
-    num_child = NUM_PROCS - MY_RANK - MY_RANK;
-    if (num_child < 0) num_child = 0;
-    if (num_child > 2) num_child = 2;
-    if (MY_RANK == 0) num_child = ((NUM_PROCS > 1) ? 1 : 0);
+    first_child = (MY_RANK == 0) ? 1 : MY_RANK * bootstrap_radix;
+    num_child = 0;
+    if (first_child < NUM_PROCS && first_child > MY_RANK) {
+        num_child = (MY_RANK == 0) ? bootstrap_radix - 1 : bootstrap_radix;
+        if (num_child > NUM_PROCS - first_child) num_child = NUM_PROCS - first_child;
+    }
     debug printf("rank %d - num_child %d\n", MY_RANK, num_child);
     
     sync_sequence_number = TASKID;
+    sync_state = SYNC_IDLE;
+    
+    recs = malloc(NUM_PROCS * sizeof(bootstrap_rec_t));
+    if (recs == NULL) exit(-1);
     
     /* Establish TCP connection */
     
     if (num_child > 0) {
-        unsigned int len;
-        
         sock_listen = socket(AF_INET, SOCK_STREAM, 0);
         addr_listen.sin_family = AF_INET;
         addr_listen.sin_port = my_port;
@@ -113,221 +201,142 @@ static int iacp_init(void)
                 printf("rank %d - ERROR in bind().\n", MY_RANK);
                 exit(-1);
             }
-        if (listen(sock_listen, 10) < 0) exit(-1);
-        
-        len = sizeof(addr_accept0);
-        while ((sock_accept0 = accept(sock_listen, (struct sockaddr *)&addr_accept0, &len)) < 0)
-            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
-                printf("rank %d - ERROR in accept().\n", MY_RANK);
-                exit(-1);
-            }
-        debug printf("rank %d - accept0(%s)\n", MY_RANK, inet_ntoa(addr_accept0.sin_addr));
-        if (num_child > 1)
-            while ((sock_accept1 = accept(sock_listen, (struct sockaddr *)&addr_accept1, &len)) < 0)
-                if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
-                    printf("rank %d - ERROR in accept().\n", MY_RANK);
-                    exit(-1);
-                }
-#ifdef DEBUG
-        if (num_child > 1)
-            printf("rank %d - accept1(%s)\n", MY_RANK, inet_ntoa(addr_accept1.sin_addr));
-#endif
-        close(sock_listen);
+        if (listen(sock_listen, MAX_BOOTSTRAP_RADIX) < 0) exit(-1);
     }
     if (MY_RANK > 0) {
-        sock_connect = socket(AF_INET, SOCK_STREAM, 0);
+        useconds_t backoff = 1000;
+        
         addr_connect.sin_family = AF_INET;
         addr_connect.sin_port = parent_port;
         addr_connect.sin_addr.s_addr = parent_addr;
-        while (connect(sock_connect, (struct sockaddr *)&addr_connect, sizeof(addr_connect)) < 0)
+        while (1) {
+            sock_connect = socket(AF_INET, SOCK_STREAM, 0);
+            if (connect(sock_connect, (struct sockaddr *)&addr_connect, sizeof(addr_connect)) == 0) break;
             if (errno != EINTR && errno != EAGAIN && errno != ECONNREFUSED) {
                 printf("rank %d - ERROR in connect(), errno %d.\n", MY_RANK, errno);
                 exit(-1);
-            } else
-                sleep(1);
+            }
+            close(sock_connect);
+            usleep(backoff);
+            if (backoff < 1000000) backoff <<= 1;
+        }
         debug printf("rank %d - connect(%s)\n", MY_RANK, inet_ntoa(addr_connect.sin_addr));
     }
-    
-    /* Reduce rank */
-    
-    if (num_child == 1) {
-        while (recv(sock_accept0, &rank0, sizeof(rank0), MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-        debug printf("rank %d - recv rank0: %d\n", MY_RANK, rank0);
-        if (MY_RANK == 0 && rank0 != 1)
-            MY_RANK = ACPBL_UDP_RANK_ERROR;
-        if (MY_RANK > 0 && rank0 != MY_RANK + MY_RANK)
-            MY_RANK = ACPBL_UDP_RANK_ERROR;
-    } else if (num_child == 2) {
-        while (recv(sock_accept0, &rank0, sizeof(rank0), MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-        while (recv(sock_accept1, &rank1, sizeof(rank1), MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-        debug printf("rank %d - recv rank0: %d, rank1: %d\n", MY_RANK, rank0, rank1);
-        if (rank0 == MY_RANK + MY_RANK + 1 && rank1 == MY_RANK + MY_RANK) {
-            int sock_tmp;
-            struct sockaddr_in addr_tmp;
-            uint32_t rank_tmp;
-            
-            sock_tmp = sock_accept1;
-            addr_tmp = addr_accept1;
-            rank_tmp = rank1;
-            sock_accept1 = sock_accept0;
-            addr_accept1 = addr_accept0;
-            rank1 = rank0;
-            sock_accept0 = sock_tmp;
-            addr_accept0 = addr_tmp;
-            rank0 = rank_tmp;
-            debug printf("rank %d - exchange accept0 <-> accept1\n", MY_RANK);
+    if (num_child > 0) {
+        for (i = 0; i < num_child; i++) {
+            len = sizeof(addr_accept[i]);
+            while ((sock_child[i] = accept(sock_listen, (struct sockaddr *)&addr_accept[i], &len)) < 0)
+                if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+                    printf("rank %d - ERROR in accept().\n", MY_RANK);
+                    exit(-1);
+                }
+            debug printf("rank %d - accept(%s)\n", MY_RANK, inet_ntoa(addr_accept[i].sin_addr));
         }
-        if (rank0 != MY_RANK + MY_RANK || rank1 != MY_RANK + MY_RANK + 1)
-            MY_RANK = ACPBL_UDP_RANK_ERROR;
+        close(sock_listen);
     }
-    if (MY_RANK > 0)
-        while (write(sock_connect, &MY_RANK, sizeof(MY_RANK)) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    
-    /* Reduce task ID */
-    
-    taskid0 = taskid1 = TASKID;
-    if (num_child > 0)
-        while (recv(sock_accept0, &taskid0, sizeof(taskid0), MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    if (num_child > 1)
-        while (recv(sock_accept1, &taskid1, sizeof(taskid1), MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-#ifdef DEBUG
-    if (num_child == 1)
-        printf("rank %d - recv taskid0: 0x%08x\n", MY_RANK, taskid0);
-    if (num_child == 2)
-        printf("rank %d - recv taskid0: 0x%08x, taskid1: 0x%08x\n", MY_RANK, taskid0, taskid1);
-#endif
-    if (taskid0 != TASKID && taskid1 != TASKID)
-        TASKID = ACPBL_UDP_TASKID_ERROR;
-    if (MY_RANK > 0)
-        while (write(sock_connect, &TASKID, sizeof(TASKID)) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    
-    /* Broadcast Rank and GPID Error */
-    
-    if (MY_RANK > 0)
-        while (recv(sock_connect, &TASKID, sizeof(TASKID), MSG_WAITALL) < 0) ;
-    else if (MY_RANK == ACPBL_UDP_RANK_ERROR)
-        TASKID = ACPBL_UDP_TASKID_ERROR;
-    if (num_child > 0)
-        while (write(sock_accept0, &TASKID, sizeof(TASKID)) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    if (num_child > 1)
-        while (write(sock_accept1, &TASKID, sizeof(TASKID)) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    if (TASKID == ACPBL_UDP_TASKID_ERROR)
-        exit(-1);
-    debug printf("rank %d - allreduced taskid 0x%08x\n", MY_RANK, TASKID);
-    
-    /* Reduce number of descendants */
     
-    num_descendant0 = num_descendant1 = 0;
-    if (num_child > 0)
-        while (recv(sock_accept0, &num_descendant0, sizeof(num_descendant0), MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    if (num_child > 1)
-        while (recv(sock_accept1, &num_descendant1, sizeof(num_descendant1), MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    num_descendant = num_child + num_descendant0 + num_descendant1;
-    if (MY_RANK > 0)
-        while (write(sock_connect, &num_descendant, sizeof(num_descendant)) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
+    /* Gather rank, task ID, port and address of the subtree */
+    
+    /*
+     * Every child sends one header and the records of its subtree,
+     * its own record first. The address of a process is the one its
+     * parent accepted it from, and the root learns its own address
+     * from the header of its first child.
+     */
+    status = 0;
+    my_addr = 0;
+    num_rec = 1;
+    recs[0].rank = MY_RANK;
+    recs[0].addr = 0;
+    recs[0].port = my_port;
+    recs[0].pad  = 0;
+    for (i = 0; i < num_child; i++) {
+        recv_all(sock_child[i], &hdr, sizeof(hdr));
+        if (hdr.rank < first_child || hdr.rank >= first_child + num_child || hdr.taskid != TASKID || hdr.status != 0
+            || hdr.num_rec < 1 || hdr.num_rec > NUM_PROCS - num_rec) {
+            status = 1;
+            break;
+        }
+        recv_all(sock_child[i], recs + num_rec, sizeof(bootstrap_rec_t) * hdr.num_rec);
+        if (recs[num_rec].rank != hdr.rank) {
+            status = 1;
+            break;
+        }
+        recs[num_rec].addr = addr_accept[i].sin_addr.s_addr;
+        if (hdr.rank == first_child) my_addr = hdr.parent_addr;
+        num_rec += hdr.num_rec;
+    }
+    num_descendant = num_rec - 1;
+    if (MY_RANK > 0) {
+        struct iovec iov[2];
+        
+        hdr.rank        = MY_RANK;
+        hdr.taskid      = TASKID;
+        hdr.parent_addr = parent_addr;
+        hdr.status      = status;
+        hdr.num_rec     = num_rec;
+        iov[0].iov_base = &hdr;
+        iov[0].iov_len  = sizeof(hdr);
+        iov[1].iov_base = recs;
+        iov[1].iov_len  = sizeof(bootstrap_rec_t) * num_rec;
+        sendv_all(sock_connect, iov, 2);
+    }
     debug printf("rank %d - num_descendant %d\n", MY_RANK, num_descendant);
     
-    /* Transfer port number */
-    
-    if (MY_RANK > 0)
-        while (write(sock_connect, &my_port, sizeof(my_port)) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    if (num_child > 0)
-        while (recv(sock_accept0, &port0, sizeof(port0), MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    if (num_child > 1)
-        while (recv(sock_accept1, &port1, sizeof(port1), MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-#ifdef DEBUG
-    if (num_child > 0)
-        printf("rank %d - branch0 %s:%d num_descendant %d\n", MY_RANK, inet_ntoa(addr_accept0.sin_addr), port0, num_descendant0);
-    if (num_child > 1)
-        printf("rank %d - branch1 %s:%d num_descendant %d\n", MY_RANK, inet_ntoa(addr_accept1.sin_addr), port1, num_descendant1);
-#endif
-    
-    /* Transfer address */
-    
-    if (MY_RANK == 1 || (MY_RANK > 1 && (MY_RANK & 1) == 0))
-        while (write(sock_connect, &parent_addr, sizeof(parent_addr)) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    if (num_child > 0)
-        while (recv(sock_accept0, &my_addr, sizeof(my_addr), MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    if (MY_RANK == 0 && NUM_PROCS < 2)
-        my_addr = inet_addr("127.0.0.1");
-#ifdef DEBUG
-    if (num_child > 0) {
-        struct in_addr addr;
-        addr.s_addr = my_addr;
-        debug printf("rank %d - my_addr %s\n", MY_RANK, inet_ntoa(addr));
+    if (MY_RANK == 0) {
+        if (NUM_PROCS < 2) my_addr = inet_addr("127.0.0.1");
+        recs[0].addr = my_addr;
+        if (num_rec != NUM_PROCS) status = 1;
+        for (i = 0; i < NUM_PROCS; i++) PORT_TABLE[i] = 0;
+        for (i = 0; i < num_rec && status == 0; i++) {
+            if (recs[i].rank >= NUM_PROCS || PORT_TABLE[recs[i].rank] != 0) {
+                status = 1;
+                break;
+            }
+            PORT_TABLE[recs[i].rank] = recs[i].port;
+            ADDR_TABLE[recs[i].rank] = recs[i].addr;
+        }
+        if (status) TASKID = ACPBL_UDP_TASKID_ERROR;
     }
-#endif
+    free(recs);
+    for (i = 0; i < NUM_PROCS; i++) RANK_TABLE[i] = i;
     
-    /* Gather rank, port and address */
+    /* Broadcast task ID, port and address tables */
     
-    if (MY_RANK > 0) {
-        if (num_child > 0) {
-            RANK_TABLE[0] = rank0;
-            PORT_TABLE[0] = port0;
-            ADDR_TABLE[0] = addr_accept0.sin_addr.s_addr;
-            if (num_descendant0 > 0) {
-                while (recv(sock_accept0, RANK_TABLE + 1, sizeof(RANK_TABLE[0]) * num_descendant0, MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-                while (recv(sock_accept0, PORT_TABLE + 1, sizeof(PORT_TABLE[0]) * num_descendant0, MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-                while (recv(sock_accept0, ADDR_TABLE + 1, sizeof(ADDR_TABLE[0]) * num_descendant0, MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
+    {
+        struct iovec iov[3];
+        
+        iov[0].iov_base = &TASKID;
+        iov[0].iov_len  = sizeof(TASKID);
+        iov[1].iov_base = PORT_TABLE;
+        iov[1].iov_len  = sizeof(PORT_TABLE[0]) * NUM_PROCS;
+        iov[2].iov_base = ADDR_TABLE;
+        iov[2].iov_len  = sizeof(ADDR_TABLE[0]) * NUM_PROCS;
+        if (MY_RANK > 0) {
+            recv_all(sock_connect, &TASKID, sizeof(TASKID));
+            if (TASKID != ACPBL_UDP_TASKID_ERROR) {
+                recv_all(sock_connect, PORT_TABLE, sizeof(PORT_TABLE[0]) * NUM_PROCS);
+                recv_all(sock_connect, ADDR_TABLE, sizeof(ADDR_TABLE[0]) * NUM_PROCS);
             }
         }
-        if (num_child > 1) {
-            RANK_TABLE[1 + num_descendant0] = rank1;
-            PORT_TABLE[1 + num_descendant0] = port1;
-            ADDR_TABLE[1 + num_descendant0] = addr_accept1.sin_addr.s_addr;
-            if (num_descendant1 > 0) {
-                while (recv(sock_accept1, RANK_TABLE + 2 + num_descendant0, sizeof(RANK_TABLE[0]) * num_descendant1, MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-                while (recv(sock_accept1, PORT_TABLE + 2 + num_descendant0, sizeof(PORT_TABLE[0]) * num_descendant1, MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-                while (recv(sock_accept1, ADDR_TABLE + 2 + num_descendant0, sizeof(ADDR_TABLE[0]) * num_descendant1, MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-            }
+        if (TASKID == ACPBL_UDP_TASKID_ERROR || status) {
+            TASKID = ACPBL_UDP_TASKID_ERROR;
+            for (i = 0; i < num_child; i++) send_all(sock_child[i], &TASKID, sizeof(TASKID));
+            exit(-1);
         }
-        if (num_descendant > 0) {
-            while (write(sock_connect, RANK_TABLE, sizeof(RANK_TABLE[0]) * num_descendant) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-            while (write(sock_connect, PORT_TABLE, sizeof(PORT_TABLE[0]) * num_descendant) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-            while (write(sock_connect, ADDR_TABLE, sizeof(ADDR_TABLE[0]) * num_descendant) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
+        for (i = 0; i < num_child; i++) sendv_all(sock_child[i], iov, 3);
+    }
+    debug printf("rank %d - allreduced taskid 0x%08x\n", MY_RANK, TASKID);
 #ifdef DEBUG
-    if (num_descendant > 0) {
+    if (MY_RANK == 0) {
         struct in_addr addr;
-        int i;
         printf("rank %d - gathered info\n", MY_RANK);
-        for (i = 0; i < num_descendant; i++) {
+        for (i = 0; i < NUM_PROCS; i++) {
             addr.s_addr = ADDR_TABLE[i];
-            printf("rank %d - rank %6d = %s:%d\n", MY_RANK, RANK_TABLE[i], inet_ntoa(addr), PORT_TABLE[i]);
+            printf("rank %d - rank %6d = %s:%d\n", MY_RANK, i, inet_ntoa(addr), PORT_TABLE[i]);
         }
     }
 #endif
-        }
-    } else {
-        RANK_TABLE[0] = 0;
-        PORT_TABLE[0] = my_port;
-        ADDR_TABLE[0] = my_addr;
-        RANK_TABLE[1] = 1;
-        PORT_TABLE[1] = port0;
-        ADDR_TABLE[1] = addr_accept0.sin_addr.s_addr;
-        if (num_descendant0 > 0) {
-            int i;
-            while (recv(sock_accept0, RANK_TABLE + 2, sizeof(RANK_TABLE[0]) * num_descendant0, MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-            for (i = 2; i < NUM_PROCS; i++)
-                while (recv(sock_accept0, PORT_TABLE + RANK_TABLE[i], sizeof(PORT_TABLE[0]), MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-            for (i = 2; i < NUM_PROCS; i++)
-                while (recv(sock_accept0, ADDR_TABLE + RANK_TABLE[i], sizeof(ADDR_TABLE[0]), MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-        }
-    }
-    
-    /* Broadcast port and address tables */
-    
-    if (MY_RANK > 0) {
-        while (recv(sock_connect, PORT_TABLE, sizeof(PORT_TABLE[0]) * NUM_PROCS, MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-        while (recv(sock_connect, ADDR_TABLE, sizeof(ADDR_TABLE[0]) * NUM_PROCS, MSG_WAITALL) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    }
-    if (num_child > 0) {
-        while (write(sock_accept0, PORT_TABLE, sizeof(PORT_TABLE[0]) * NUM_PROCS) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-        while (write(sock_accept0, ADDR_TABLE, sizeof(ADDR_TABLE[0]) * NUM_PROCS) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    }
-    if (num_child > 1) {
-        while (write(sock_accept1, PORT_TABLE, sizeof(PORT_TABLE[0]) * NUM_PROCS) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-        while (write(sock_accept1, ADDR_TABLE, sizeof(ADDR_TABLE[0]) * NUM_PROCS) < 0) if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    }
     
     /* Initialize gateways and local numnbers */
     {
@@ -335,7 +344,7 @@ static int iacp_init(void)
         for (i = 0; i < NUM_PROCS; i++) {
             int n = 0, g = i;
             for (j = i; j > 0; j--) {
-                if (ADDR_TABLE[j - 1] == ADDR_TABLE[i]) {
+                if (!udp_only && ADDR_TABLE[j - 1] == ADDR_TABLE[i]) {
                     n = INUM_TABLE[j - 1] + 1;
                     g = GTWY_TABLE[j - 1];
                     break;
@@ -384,6 +393,7 @@ static int iacp_init(void)
     if (iacp_init_cl()) return -1;
     /* if (iacp_init_vd()) return -1; */
     acp_sync();
+    iacpbl_trace_align();
     
     return 0;
 }
@@ -402,6 +412,14 @@ int acp_init(int* argc, char*** argv)
     iacp_starter_memory_size_cl = ( size_t   ) iacpbl_option.szsmemcl.value ;
     iacp_starter_memory_size_dl = ( size_t   ) iacpbl_option.szsmemdl.value ;
     iacpbludp_eth_speed         = ( uint32_t ) iacpbl_option.ethspeed.value ;
+    bootstrap_radix             = ( int      ) iacpbl_option.bsradix.value  ;
+    /* The network emulator acts on the UDP transport only, so it also */
+    /* keeps processes sharing a host off the shared memory path.      */
+    udp_only                    = ( iacpbl_option.udponly.value
+                                    || iacpbl_option.emuloss.value > 0.0 || iacpbl_option.emurxloss.value > 0.0
+                                    || iacpbl_option.emudelay.value || iacpbl_option.emujitter.value
+                                    || iacpbl_option.emureorder.value > 0.0 || iacpbl_option.emudup.value > 0.0
+                                    || iacpbl_option.emurate.value ) ;
 ///
 ///    fprintf( stderr, "myrank, nprocs, taskid, myport, parent_port, parent_addr, smem, smem_cl, smem_dl:\n" ) ;
 ///    fprintf( stderr, "%u, %u, %u, %u, %u, %u, %d, %lu, %lu\n",
@@ -417,6 +435,7 @@ int acp_init(int* argc, char*** argv)
 static int iacp_finalize(void)
 {
     unsigned char buf[256];
+    int i;
     
     acp_complete(ACP_HANDLE_ALL);
     acp_sync();
@@ -433,6 +452,8 @@ static int iacp_finalize(void)
     
     iacpbludp_finalize_gmm();
     
+    iacpbl_trace_finalize();
+    
     free(LMEM_TABLE);
     free(GTWY_TABLE);
     free(INUM_TABLE);
@@ -448,13 +469,9 @@ static int iacp_finalize(void)
     
     /* Close TCP connection */
     
-    if (num_child > 0){
-        while (recv(sock_accept0, buf, sizeof(buf), MSG_WAITALL));
-        close(sock_accept0);
-    }
-    if (num_child > 1){
-        while (recv(sock_accept1, buf, sizeof(buf), MSG_WAITALL));
-        close(sock_accept1);
+    for (i = 0; i < num_child; i++) {
+        while (recv(sock_child[i], buf, sizeof(buf), MSG_WAITALL));
+        close(sock_child[i]);
     }
     if (MY_RANK > 0){
         shutdown(sock_connect, SHUT_RDWR);
@@ -467,6 +484,8 @@ static int iacp_finalize(void)
 
 static void iacp_abort(void)
 {
+    int i;
+    
     /* iacp_abort_vd(); */
     iacp_abort_cl();
     iacp_abort_dl();
@@ -492,13 +511,9 @@ static void iacp_abort(void)
     
     /* Shutdown TCP connection */
     
-    if (num_child > 0){
-        shutdown(sock_accept0, SHUT_RDWR);
-        close(sock_accept0);
-    }
-    if (num_child > 1){
-        shutdown(sock_accept1, SHUT_RDWR);
-        close(sock_accept1);
+    for (i = 0; i < num_child; i++) {
+        shutdown(sock_child[i], SHUT_RDWR);
+        close(sock_child[i]);
     }
     if (MY_RANK > 0){
         shutdown(sock_connect, SHUT_RDWR);
@@ -529,37 +544,148 @@ void acp_abort(const char* str)
     return;
 }
 
-int acp_sync(void)
+static void sync_recv(int sock, uint64_t* buf)
+{
+    while (recv(sock, buf, sizeof(uint64_t), MSG_WAITALL) < 0)
+        if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
+    return;
+}
+
+static void sync_send(int sock)
+{
+    while (write(sock, &sync_sequence_number, sizeof(uint64_t)) < 0)
+        if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
+    return;
+}
+
+static int sync_ready(int sock)
 {
-    uint64_t seq0, seq1;
+    struct pollfd pfd;
+    
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) > 0;
+}
+
+static void sync_start(void)
+{
+    int i;
+    
+    for (i = 0; i < num_child; i++) sync_arrived[i] = 0;
+    num_sync_arrived = 0;
+    sync_state = SYNC_REDUCE;
+    sync_epoch++;
+    return;
+}
+
+/* Advances the barrier without blocking. Returns 1 while it is in progress. */
+static int sync_test(void)
+{
+    uint64_t seq;
+    int i;
+    
+    if (sync_state == SYNC_IDLE) return 0;
+    iacpbludp_progress_gma();
     
     /* Reduce sequence number */
     
-    seq0 = seq1 = sync_sequence_number;
-    if (num_child > 0)
-        while (recv(sock_accept0, &seq0, sizeof(uint64_t), MSG_WAITALL) < 0)
-            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    if (num_child > 1)
-        while (recv(sock_accept1, &seq1, sizeof(uint64_t), MSG_WAITALL) < 0)
-            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    if (seq0 != sync_sequence_number || seq1 != sync_sequence_number) exit(-1);
+    if (sync_state == SYNC_REDUCE) {
+        for (i = 0; i < num_child; i++) {
+            if (sync_arrived[i] || !sync_ready(sock_child[i])) continue;
+            sync_recv(sock_child[i], &seq);
+            if (seq != sync_sequence_number) exit(-1);
+            sync_arrived[i] = 1;
+            num_sync_arrived++;
+        }
+        if (num_sync_arrived < num_child) return 1;
+        if (MY_RANK > 0) sync_send(sock_connect);
+        else sync_sequence_number++;
+        sync_state = SYNC_BCAST;
+    }
+    
+    /* Broadcast result */
+    
     if (MY_RANK > 0) {
-        while (write(sock_connect, &sync_sequence_number, sizeof(uint64_t)) < 0)
-            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
+        if (!sync_ready(sock_connect)) return 1;
+        sync_recv(sock_connect, &sync_sequence_number);
+    }
+    for (i = 0; i < num_child; i++) sync_send(sock_child[i]);
+    sync_state = SYNC_IDLE;
+    
+    return 0;
+}
+
+/* Sleeps until a message of the barrier arrives, or keeps serving the */
+/* GMAs of the other processes in the inline progress mode.            */
+static void sync_block(void)
+{
+    struct pollfd pfd[MAX_BOOTSTRAP_RADIX];
+    int i, n;
+    
+    n = 0;
+    if (sync_state == SYNC_REDUCE) {
+        for (i = 0; i < num_child; i++) {
+            if (sync_arrived[i]) continue;
+            pfd[n].fd = sock_child[i];
+            pfd[n].events = POLLIN;
+            pfd[n++].revents = 0;
+        }
+    } else if (MY_RANK > 0) {
+        pfd[n].fd = sock_connect;
+        pfd[n].events = POLLIN;
+        pfd[n++].revents = 0;
+    }
+    if (n == 0) return;
+    
+    if (iacpbludp_progress_gma()) {
+        if (poll(pfd, n, 0) == 0) sched_yield();
     } else
-        sync_sequence_number++;
+        poll(pfd, n, -1);
+    return;
+}
+
+acp_handle_t acp_isync(void)
+{
+    if (sync_state != SYNC_IDLE) return ACP_HANDLE_NULL;
     
-    /* Broadcast result */
+    IACPBL_TRACE(IACPBL_TRACE_BEGIN, "sync", "acp_isync", 0, 0);
+    sync_start();
+    sync_test();
+    IACPBL_TRACE(IACPBL_TRACE_END, "sync", "acp_isync", 0, 0);
     
-    if (MY_RANK > 0)
-        while (recv(sock_connect, &sync_sequence_number, sizeof(uint64_t), MSG_WAITALL) < 0)
-            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    if (num_child > 0)
-        while (write(sock_accept0, &sync_sequence_number, sizeof(uint64_t)) < 0)
-            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
-    if (num_child > 1)
-        while (write(sock_accept1, &sync_sequence_number, sizeof(uint64_t)) < 0)
-            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) exit(-1);
+    return sync_epoch;
+}
+
+int acp_inquire_sync(acp_handle_t handle)
+{
+    if (handle == ACP_HANDLE_ALL) handle = sync_epoch;
+    /* earlier barriers have completed before this one could start */
+    if (handle == ACP_HANDLE_NULL || handle != sync_epoch) return 0;
+    
+    return sync_test();
+}
+
+int acp_wait_sync(acp_handle_t handle)
+{
+    if (handle == ACP_HANDLE_ALL) handle = sync_epoch;
+    if (handle == ACP_HANDLE_NULL || handle != sync_epoch) return 0;
+    
+    IACPBL_TRACE(IACPBL_TRACE_BEGIN, "sync", "acp_wait_sync", 0, 0);
+    while (sync_test()) sync_block();
+    IACPBL_TRACE(IACPBL_TRACE_END, "sync", "acp_wait_sync", 0, 0);
+    
+    return 0;
+}
+
+int acp_sync(void)
+{
+    if (sync_state != SYNC_IDLE) return -1;
+    
+    IACPBL_TRACE(IACPBL_TRACE_BEGIN, "sync", "acp_sync", 0, 0);
+    sync_start();
+    while (sync_test()) sync_block();
+    IACPBL_TRACE(IACPBL_TRACE_END, "sync", "acp_sync", 0, 0);
     
     return 0;
 }
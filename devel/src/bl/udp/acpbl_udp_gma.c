@@ -30,12 +30,18 @@
 #include <time.h>
 #include <fcntl.h>
 #include <sched.h>
+#include <errno.h>
 #include <acp.h>
 #include "acpbl.h"
 #include "acpbl_sync.h"
 #include "acpbl_udp.h"
 #include "acpbl_udp_gmm.h"
 #include "acpbl_udp_gma.h"
+#include "acpbl_input.h"
+#include "acpbl_stats.h"
+#include "acpbl_trace.h"
+#include "acpbl_copy.h"
+#include "acpbl_affinity.h"
 
 /*
 Xeon 5160     2.933333 GHz -> 15/44 nsec (hana)
@@ -54,6 +60,291 @@ static inline uint64_t get_nsec(void)
 #endif
 }
 
+/**************/
+/* Statistics */
+/**************/
+
+/*
+ * Latencies and queue full stalls are kept per command queue under its
+ * lock and added up by stats_collect. Transport counters are updated
+ * only by the communication thread of the gateway process (MY_INUM == 0),
+ * which transmits and receives datagrams on behalf of all processes of
+ * the node, or in the inline progress mode by the thread that holds
+ * mutex_progress. They are written under the sequence number stats_seq
+ * and read with iacpbl_stats_read. The loop counter is bumped on every
+ * pass, so it is a single relaxed atomic outside of stats_seq instead.
+ * retransmits counts the datagrams resent because their acknowledgement
+ * timed out.
+ */
+static acp_stats_t stats;
+static acp_peer_stats_t* peer_stats;
+static uint64_t stats_seq;
+
+static void stats_collect(acp_stats_t* buf);
+
+static void init_stats(void)
+{
+    memset(&stats, 0, sizeof(acp_stats_t));
+    peer_stats = (acp_peer_stats_t*)calloc(NUM_PROCS, sizeof(acp_peer_stats_t));
+    stats_seq = 0;
+    return;
+}
+
+static void finalize_stats(void)
+{
+    acp_stats_t all;
+    
+    if (iacpbl_stats_enabled()) {
+        stats_collect(&all);
+        iacpbl_stats_dump(MY_RANK, &all, peer_stats, NUM_PROCS);
+    }
+    if (peer_stats != NULL) free(peer_stats);
+    peer_stats = NULL;
+    return;
+}
+
+static inline void stats_tx(uint32_t rank, int len)
+{
+    iacpbl_stats_write_begin(&stats_seq);
+    stats.tx_bytes += len;
+    stats.tx_packets++;
+    if (peer_stats != NULL && rank < NUM_PROCS) {
+        peer_stats[rank].tx_bytes += len;
+        peer_stats[rank].tx_packets++;
+    }
+    iacpbl_stats_write_end(&stats_seq);
+    return;
+}
+
+static inline void stats_rx(uint32_t rank, int len)
+{
+    iacpbl_stats_write_begin(&stats_seq);
+    stats.rx_bytes += len;
+    stats.rx_packets++;
+    if (peer_stats != NULL && rank < NUM_PROCS) {
+        peer_stats[rank].rx_bytes += len;
+        peer_stats[rank].rx_packets++;
+    }
+    iacpbl_stats_write_end(&stats_seq);
+    return;
+}
+
+/********************/
+/* Network emulator */
+/********************/
+
+/*
+ * Opt-in impairment of the UDP transport for reproducing lossy, slow or
+ * reordering networks on a single host. It is configured by the
+ * --acp-emu-* options, which also put every process on its own node so that the transport is used even
+ * on localhost. Datagrams are dropped or duplicated on transmission,
+ * and the others are held in a heap ordered by due time, computed from
+ * the delay, the jitter, the reordering hold and a per-peer bandwidth
+ * cap. The heap is flushed by the communication thread of the gateway.
+ */
+typedef struct {
+    uint64_t due;
+    uint64_t order;
+    int sock;
+    int len;
+    struct sockaddr_in addr;
+    char dg[MAX_DG_SIZE];
+} emu_packet_t;
+
+static int emu_enabled;
+static double emu_loss, emu_rx_loss, emu_reorder, emu_dup;
+static uint64_t emu_delay_nsec, emu_jitter_nsec, emu_reorder_nsec, emu_rate;
+static uint64_t emu_rng;
+static uint64_t* emu_peer_free_nsec;
+static emu_packet_t** emu_heap;
+static int emu_heap_num, emu_heap_max;
+static uint64_t emu_order;
+static uint64_t emu_dropped, emu_rx_dropped, emu_duplicated, emu_reordered, emu_delayed;
+
+static inline double emu_uniform(void)
+{
+    /* xorshift64* */
+    emu_rng ^= emu_rng >> 12;
+    emu_rng ^= emu_rng << 25;
+    emu_rng ^= emu_rng >> 27;
+    return (double)((emu_rng * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void init_emu(void)
+{
+    emu_loss         = iacpbl_option.emuloss.value;
+    emu_rx_loss      = iacpbl_option.emurxloss.value;
+    emu_reorder      = iacpbl_option.emureorder.value;
+    emu_dup          = iacpbl_option.emudup.value;
+    emu_delay_nsec   = iacpbl_option.emudelay.value * 1000;
+    emu_jitter_nsec  = iacpbl_option.emujitter.value * 1000;
+    emu_reorder_nsec = iacpbl_option.emureorderdelay.value * 1000;
+    emu_rate         = iacpbl_option.emurate.value;
+    
+    emu_enabled = (emu_loss > 0.0 || emu_rx_loss > 0.0 || emu_reorder > 0.0 || emu_dup > 0.0
+                   || emu_delay_nsec || emu_jitter_nsec || emu_rate);
+    emu_heap = NULL;
+    emu_heap_num = emu_heap_max = 0;
+    emu_order = 0;
+    emu_dropped = emu_rx_dropped = emu_duplicated = emu_reordered = emu_delayed = 0;
+    emu_peer_free_nsec = NULL;
+    if (!emu_enabled) return;
+    
+    emu_rng = (iacpbl_option.emuseed.value + 1) * 0x9E3779B97F4A7C15ULL + MY_RANK;
+    if (emu_rng == 0) emu_rng = 1;
+    emu_peer_free_nsec = (uint64_t*)calloc(NUM_PROCS, sizeof(uint64_t));
+    if (emu_peer_free_nsec == NULL) emu_rate = 0;
+    return;
+}
+
+static void finalize_emu(void)
+{
+    int i;
+    
+    if (!emu_enabled) return;
+    if (iacpbl_stats_enabled())
+        fprintf(stderr, "%d: acp emu: dropped %lu, rx dropped %lu, duplicated %lu, reordered %lu, delayed %lu, pending %d\n",
+                MY_RANK, emu_dropped, emu_rx_dropped, emu_duplicated, emu_reordered, emu_delayed, emu_heap_num);
+    for (i = 0; i < emu_heap_num; i++) free(emu_heap[i]);
+    if (emu_heap != NULL) free(emu_heap);
+    if (emu_peer_free_nsec != NULL) free(emu_peer_free_nsec);
+    emu_heap = NULL;
+    emu_heap_num = emu_heap_max = 0;
+    emu_peer_free_nsec = NULL;
+    emu_enabled = 0;
+    return;
+}
+
+static inline int emu_before(emu_packet_t* a, emu_packet_t* b)
+{
+    return a->due < b->due || (a->due == b->due && a->order < b->order);
+}
+
+static void emu_push(emu_packet_t* pkt)
+{
+    int i, parent;
+    
+    if (emu_heap_num == emu_heap_max) {
+        int max = (emu_heap_max == 0) ? 256 : emu_heap_max * 2;
+        emu_packet_t** heap = (emu_packet_t**)realloc(emu_heap, max * sizeof(emu_packet_t*));
+        if (heap == NULL) {
+            free(pkt);
+            emu_dropped++;
+            return;
+        }
+        emu_heap = heap;
+        emu_heap_max = max;
+    }
+    for (i = emu_heap_num++; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (!emu_before(pkt, emu_heap[parent])) break;
+        emu_heap[i] = emu_heap[parent];
+    }
+    emu_heap[i] = pkt;
+    return;
+}
+
+static emu_packet_t* emu_pop(void)
+{
+    emu_packet_t *top, *last;
+    int i, child;
+    
+    top = emu_heap[0];
+    last = emu_heap[--emu_heap_num];
+    for (i = 0; (child = i * 2 + 1) < emu_heap_num; i = child) {
+        if (child + 1 < emu_heap_num && emu_before(emu_heap[child + 1], emu_heap[child])) child++;
+        if (!emu_before(emu_heap[child], last)) break;
+        emu_heap[i] = emu_heap[child];
+    }
+    if (emu_heap_num > 0) emu_heap[i] = last;
+    return top;
+}
+
+static void emu_transmit(int sock, void* dg, int len, struct sockaddr_in* addr, uint32_t send_to)
+{
+    emu_packet_t* pkt;
+    uint64_t now, start, due;
+    int copies;
+    
+    if (emu_loss > 0.0 && emu_uniform() < emu_loss) {
+        emu_dropped++;
+        return;
+    }
+    copies = 1;
+    if (emu_dup > 0.0 && emu_uniform() < emu_dup) {
+        emu_duplicated++;
+        copies = 2;
+    }
+    
+    now = get_nsec();
+    while (copies-- > 0) {
+        start = now;
+        if (emu_rate && send_to < NUM_PROCS) {
+            if (emu_peer_free_nsec[send_to] > start) start = emu_peer_free_nsec[send_to];
+            emu_peer_free_nsec[send_to] = start + (uint64_t)len * 8000 / emu_rate;
+        }
+        due = start + emu_delay_nsec;
+        if (emu_jitter_nsec) due += (uint64_t)(emu_uniform() * (double)emu_jitter_nsec);
+        if (emu_reorder > 0.0 && emu_uniform() < emu_reorder) {
+            emu_reordered++;
+            due += emu_reorder_nsec;
+        }
+        
+        if (due <= now && emu_heap_num == 0) {
+            sendto(sock, dg, (ssize_t)len, 0, (struct sockaddr *)addr, sizeof(struct sockaddr_in));
+            continue;
+        }
+        pkt = (emu_packet_t*)malloc(sizeof(emu_packet_t));
+        if (pkt == NULL) {
+            emu_dropped++;
+            continue;
+        }
+        pkt->due = due;
+        pkt->order = emu_order++;
+        pkt->sock = sock;
+        pkt->len = len;
+        pkt->addr = *addr;
+        memcpy(pkt->dg, dg, len);
+        emu_delayed++;
+        emu_push(pkt);
+    }
+    return;
+}
+
+static inline void emu_progress(void)
+{
+    emu_packet_t* pkt;
+    uint64_t now;
+    
+    if (emu_heap_num == 0) return;
+    now = get_nsec();
+    while (emu_heap_num > 0 && emu_heap[0]->due <= now) {
+        pkt = emu_pop();
+        sendto(pkt->sock, pkt->dg, (ssize_t)pkt->len, 0, (struct sockaddr *)&pkt->addr, sizeof(struct sockaddr_in));
+        free(pkt);
+    }
+    return;
+}
+
+static inline int emu_drop_rx(void)
+{
+    if (emu_rx_loss > 0.0 && emu_uniform() < emu_rx_loss) {
+        emu_rx_dropped++;
+        return 1;
+    }
+    return 0;
+}
+
+static inline void transmit_dg(int sock, void* dg, int len, struct sockaddr_in* addr, uint32_t send_to)
+{
+    if (emu_enabled)
+        emu_transmit(sock, dg, len, addr, send_to);
+    else
+        sendto(sock, dg, (ssize_t)len, 0, (struct sockaddr *)addr, sizeof(struct sockaddr_in));
+    stats_tx(send_to, len);
+    return;
+}
+
 /****************************/
 /* Thread control variables */
 /****************************/
@@ -62,6 +353,17 @@ static pthread_mutex_t mutex_comm_thread_ready;
 static pthread_cond_t cond_comm_thread_ready;
 static pthread_mutex_t mutex_comm_thread_start;
 static pthread_cond_t cond_comm_thread_start;
+static int comm_thread_ready, comm_thread_start;
+
+/*
+ * In the inline progress mode, used by single node jobs on request, no
+ * communication thread is started and the user threads run the progress
+ * function from the interface functions. A process then serves the
+ * operations of the other processes on its memory only while it is in
+ * an ACP function.
+ */
+static int progress_inline;
+static pthread_mutex_t mutex_progress;
 static pthread_mutex_t mutex_quit_comm_thread;
 static int quit_comm_thread;
 
@@ -142,6 +444,7 @@ static inline int compare_seq(uint16_t seq1, uint16_t seq2)
 static int shmfd;
 static void* shmbuf;
 static size_t shmbuf_size;
+static iacpbl_affinity_table_t* affinity_table;
 static doorbell_t *doorbell;
 static ibuf_t *ibuf;
 static txbuf_t *txbuf;
@@ -170,6 +473,8 @@ static int init_shmbuffer()
         shmbuf_size = (sizeof(doorbell_t) + sizeof(ibuf_t) * NODE_POP + sizeof(txbuf_t) + sizeof(rxbuf_t)) * NODE_POP;
     size_t shareseg_offset = shmbuf_size;
     shmbuf_size += sizeof(uint64_t) * NODE_POP * SEGMAX;
+    size_t affinity_offset = shmbuf_size;
+    shmbuf_size += sizeof(iacpbl_affinity_table_t);
     size_t segcl_size = iacp_starter_memory_size_cl * NODE_POP;
     size_t segdl_size = iacp_starter_memory_size_dl * NODE_POP;
     size_t segst_size = SMEM_SIZE * NODE_POP;
@@ -189,6 +494,7 @@ static int init_shmbuffer()
         rxbuf = (rxbuf_t*)(shmbuf + (sizeof(doorbell_t) + sizeof(ibuf_t) * NODE_POP + sizeof(txbuf_t)) * NODE_POP);
     }
     iacpbludp_shared_segment = (volatile uint64_t*)(shmbuf + shareseg_offset);
+    affinity_table = (iacpbl_affinity_table_t*)(shmbuf + affinity_offset);
     for (i = 0; i < SEGMAX; i++) {
         SHARESEG(MY_INUM, i, 0) = SEGMENT[i][0];
         SHARESEG(MY_INUM, i, 1) = SEGMENT[i][1];
@@ -327,10 +633,22 @@ static void finalize_shmbuffer()
 
 /* Doorbell functions */
 
+static uint64_t doorbell_wait_nsec; /* 0 to wait until rung */
+
 static inline void doorbell_wait(void)
 {
+    struct timespec ts;
+    
     /* Need doorbell.[MY_INUM].mutex locked */
     if (MY_INUM == 0 && NUM_PROCS != NODE_POP) return;
+    if (doorbell_wait_nsec) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += doorbell_wait_nsec;
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&doorbell[MY_INUM].cond, &doorbell[MY_INUM].mutex, &ts);
+        return;
+    }
     pthread_cond_wait(&doorbell[MY_INUM].cond, &doorbell[MY_INUM].mutex);
     return;
 }
@@ -1101,10 +1419,54 @@ static inline int rxbuf_pop_free_vc1ack(int inum)
 /* Interface functions */
 /***********************/
 
-static cqe_t cq[WIDTH_CQ];
-static uint64_t cqwp, cqxp, cqcp;
-static acp_ga_t cq_latest_src_rank, cq_latest_dst_rank;
-static pthread_mutex_t mutex_cq;
+static void comm_progress(void);
+
+static inline void inline_progress(void)
+{
+    if (pthread_mutex_trylock(&mutex_progress)) return;
+    comm_progress();
+    pthread_mutex_unlock(&mutex_progress);
+    return;
+}
+
+/*
+ * Command queues. Every thread issues into command queue 0 unless
+ * --acp-thread-multiple is set. With that option, each issuing thread
+ * gets its own queue on its first GMA. The queue brings a separate lock
+ * and handle space, so threads do not serialize on each other. Threads
+ * beyond MAX_CQ share queues. The communication thread serves the
+ * queues round robin.
+ *
+ * Handles, and the pointers carried by delegate queue entries and
+ * datagrams, hold the queue number above CQ_QID_SHIFT, so that any
+ * thread can complete or inquire a handle issued by another thread.
+ * ACP_HANDLE_ALL and ACP_HANDLE_CONT cover only the GMAs of the queue
+ * of the calling thread, both given to acp_complete and acp_inquire
+ * and as the order of a GMA, so a thread never waits for the traffic of
+ * other threads unless it names their handles. A GMA ordered after a
+ * handle of another queue waits for the completion of that handle
+ * before it is issued.
+ */
+#define MAX_CQ          64
+#define CQ_QID_SHIFT    56
+#define CQ_WP_MASK      ((1LLU << CQ_QID_SHIFT) - 1LLU)
+
+typedef struct {
+    cqe_t cq[WIDTH_CQ];
+    uint64_t cqwp, cqxp, cqcp;
+    int latest_src_rank, latest_dst_rank;
+    int qid;
+    pthread_mutex_t mutex;
+    acp_stats_latency_t op[ACP_STATS_NUM_OPS];
+    uint64_t queue_full_stalls;
+} cqueue_t;
+
+static cqueue_t* cqs[MAX_CQ];
+static volatile int num_cqs;
+static int cq_thread_multiple, cq_shared_next, cq_gen;
+static pthread_mutex_t mutex_cqs;
+static __thread cqueue_t* my_cq = NULL;
+static __thread int my_cq_gen = -1;
 
 /*
                 .
@@ -1121,297 +1483,484 @@ static pthread_mutex_t mutex_cq;
  [main thread]  .  [protocol thread]
 */
 
-static void init_cq(void)
+static cqueue_t* cq_alloc(int qid)
 {
-    cqwp = cqxp = cqcp = 1;
-    cq_latest_src_rank = cq_latest_dst_rank = -1;
-    pthread_mutex_init(&mutex_cq, NULL);
-    return;
+    cqueue_t* q;
+    
+    q = (cqueue_t*)malloc(sizeof(cqueue_t));
+    if (q == NULL) return NULL;
+    memset(q, 0, sizeof(cqueue_t));
+    q->cqwp = q->cqxp = q->cqcp = 1;
+    q->latest_src_rank = q->latest_dst_rank = -1;
+    q->qid = qid;
+    pthread_mutex_init(&q->mutex, NULL);
+    return q;
+}
+
+static int init_cq(void)
+{
+    cq_thread_multiple = iacpbl_option.threadmultiple.value;
+    cq_shared_next = 0;
+    pthread_mutex_init(&mutex_cqs, NULL);
+    cqs[0] = cq_alloc(0);
+    if (cqs[0] == NULL) return -1;
+    num_cqs = 1;
+    
+    /* The thread calling acp_init keeps queue 0 */
+    cq_gen++;
+    my_cq = cqs[0];
+    my_cq_gen = cq_gen;
+    return 0;
 }
 
 static void finalize_cq(void)
 {
+    int i;
+    
+    for (i = 0; i < num_cqs; i++) {
+        pthread_mutex_destroy(&cqs[i]->mutex);
+        free(cqs[i]);
+        cqs[i] = NULL;
+    }
+    num_cqs = 0;
+    pthread_mutex_destroy(&mutex_cqs);
     return;
 }
 
-static inline int cq_open_entry(acp_ga_t dst, acp_ga_t src, acp_handle_t order)
+static cqueue_t* cq_attach(void)
+{
+    cqueue_t* q;
+    int n;
+    
+    if (!cq_thread_multiple) return cqs[0];
+    pthread_mutex_lock(&mutex_cqs);
+    n = num_cqs;
+    if (n < MAX_CQ && (q = cq_alloc(n)) != NULL) {
+        cqs[n] = q;
+        sync_synchronize();
+        num_cqs = n + 1;
+        debug printf("rank %d - command queue %d attached\n", MY_RANK, n);
+    } else {
+        q = cqs[cq_shared_next];
+        cq_shared_next = (cq_shared_next + 1) % n;
+    }
+    pthread_mutex_unlock(&mutex_cqs);
+    return q;
+}
+
+static inline cqueue_t* my_cqueue(void)
+{
+    if (my_cq_gen != cq_gen) {
+        my_cq = cq_attach();
+        my_cq_gen = cq_gen;
+    }
+    return my_cq;
+}
+
+static inline uint64_t cq_ptr(cqueue_t* q, uint64_t wp)
+{
+    return ((uint64_t)q->qid << CQ_QID_SHIFT) | wp;
+}
+
+static inline cqe_t* cq_entry(uint64_t ptr)
 {
-    int src_rank, dst_rank, is_src_local, is_dst_local, p;
+    return &cqs[ptr >> CQ_QID_SHIFT]->cq[ptr & MASK_CQ];
+}
+
+static inline int handle_is_entry(acp_handle_t handle)
+{
+    return handle != ACP_HANDLE_NULL && handle != ACP_HANDLE_ALL && handle != ACP_HANDLE_CONT;
+}
+
+void acp_complete(acp_handle_t handle);
+
+static inline int cq_open_entry(cqueue_t* q, acp_ga_t dst, acp_ga_t src, acp_handle_t order)
+{
+    int src_rank, dst_rank, is_src_local, is_dst_local, p, stall = 0;
     
     src_rank = ga2rank(src);
     dst_rank = ga2rank(dst);
     is_src_local = isgalocal(src);
     is_dst_local = isgalocal(dst);
     
+    /* entries are ordered only after entries of the same queue */
+    if (handle_is_entry(order)) {
+        if ((order >> CQ_QID_SHIFT) != (uint64_t)q->qid) {
+            acp_complete(order);
+            order = ACP_HANDLE_NULL;
+        } else {
+            order &= CQ_WP_MASK;
+        }
+    }
+    
     while (1) {
-        pthread_mutex_lock(&mutex_cq);
-        if (cqcp + WIDTH_CQ > cqwp) break;
-        pthread_mutex_unlock(&mutex_cq);
+        pthread_mutex_lock(&q->mutex);
+        if (q->cqcp + WIDTH_CQ > q->cqwp) break;
+        if (stall == 0) q->queue_full_stalls++;
+        stall = 1;
+        pthread_mutex_unlock(&q->mutex);
+        if (progress_inline) inline_progress();
         sched_yield();
     }
-    p = (int)(cqwp & MASK_CQ);
+    p = (int)(q->cqwp & MASK_CQ);
     
-    cq[p].order = (order == ACP_HANDLE_ALL || order == ACP_HANDLE_CONT) ? cqwp - 1 : order;
-    cq[p].ptr = cqwp;
-    cq[p].rank = MY_RANK;
-    cq[p].src = src;
-    cq[p].dst = dst;
+    q->cq[p].issue_nsec = get_nsec();
+    q->cq[p].order = (order == ACP_HANDLE_ALL || order == ACP_HANDLE_CONT) ? q->cqwp - 1 : order;
+    q->cq[p].ptr = cq_ptr(q, q->cqwp);
+    q->cq[p].rank = MY_RANK;
+    q->cq[p].src = src;
+    q->cq[p].dst = dst;
     
     if (is_src_local && is_dst_local) {
-        cq[p].stat = CQSTAT_11;
-        cq[p].inum = MY_INUM;
-        cq[p].gateway = MY_GATEWAY;
-        cq[p].rfence = 0;
+        q->cq[p].stat = CQSTAT_11;
+        q->cq[p].inum = MY_INUM;
+        q->cq[p].gateway = MY_GATEWAY;
+        q->cq[p].rfence = 0;
     } else {
         if (is_src_local) {
-            cq[p].stat = CQSTAT_12;
-            cq[p].inum = MY_INUM;
-            cq[p].gateway = MY_GATEWAY;
+            q->cq[p].stat = CQSTAT_12;
+            q->cq[p].inum = MY_INUM;
+            q->cq[p].gateway = MY_GATEWAY;
         } else {
-            cq[p].stat = CQSTAT_2X;
-            cq[p].inum = INUM_TABLE[src_rank];
-            cq[p].gateway = GTWY_TABLE[src_rank];
+            q->cq[p].stat = CQSTAT_2X;
+            q->cq[p].inum = INUM_TABLE[src_rank];
+            q->cq[p].gateway = GTWY_TABLE[src_rank];
         }
-        cq[p].rfence = (cq[p].order == cqwp - 1 && src_rank == cq_latest_src_rank && dst_rank == cq_latest_dst_rank) ? 1 : 0;
+        q->cq[p].rfence = (q->cq[p].order == q->cqwp - 1 && src_rank == q->latest_src_rank && dst_rank == q->latest_dst_rank) ? 1 : 0;
     }
     
-    cq_latest_src_rank = src_rank;
-    cq_latest_dst_rank = dst_rank;
+    q->latest_src_rank = src_rank;
+    q->latest_dst_rank = dst_rank;
     
     return p;
 }
 
-static inline acp_handle_t cq_close_entry(void)
+static inline acp_handle_t cq_close_entry(cqueue_t* q)
 {
-    uint64_t wp = cqwp++;
-    pthread_mutex_unlock(&mutex_cq);
-    if (MY_INUM > 0 || NUM_PROCS == NODE_POP) {
+    uint64_t wp = q->cqwp++;
+    int p = (int)(wp & MASK_CQ);
+    IACPBL_TRACE(IACPBL_TRACE_ASYNC_BEGIN, "gma", iacpbl_trace_gma_name[q->cq[p].type], q->cq[p].ptr, (q->cq[p].type == COPY) ? q->cq[p].size : 0);
+    pthread_mutex_unlock(&q->mutex);
+    if (progress_inline) {
+        inline_progress();
+    } else if (MY_INUM > 0 || NUM_PROCS == NODE_POP) {
         pthread_mutex_lock(&doorbell[MY_INUM].mutex);
         doorbell_ring(MY_INUM);
         pthread_mutex_unlock(&doorbell[MY_INUM].mutex);
     }
-    return (acp_handle_t)wp;
+    return (acp_handle_t)cq_ptr(q, wp);
 }
 
-static inline acp_handle_t cq_finish_entry(void)
+static inline acp_handle_t cq_finish_entry(cqueue_t* q)
 {
-    uint64_t wp = cqwp++;
-    cqcp = cqxp = cqwp;
-    pthread_mutex_unlock(&mutex_cq);
-    return (acp_handle_t)wp;
+    uint64_t wp = q->cqwp++;
+    int p = (int)(wp & MASK_CQ);
+    iacpbl_stats_record(&q->op[q->cq[p].type], get_nsec() - q->cq[p].issue_nsec);
+    IACPBL_TRACE(IACPBL_TRACE_ASYNC_BEGIN, "gma", iacpbl_trace_gma_name[q->cq[p].type], q->cq[p].ptr, (q->cq[p].type == COPY) ? q->cq[p].size : 0);
+    IACPBL_TRACE(IACPBL_TRACE_ASYNC_END, "gma", iacpbl_trace_gma_name[q->cq[p].type], q->cq[p].ptr, 0);
+    q->cqcp = q->cqxp = q->cqwp;
+    pthread_mutex_unlock(&q->mutex);
+    return (acp_handle_t)cq_ptr(q, wp);
 }
 
-void acp_complete(acp_handle_t handle)
+/* Wait until queue q has completed wp */
+static void cq_complete(cqueue_t* q, uint64_t wp)
 {
-    if (handle == ACP_HANDLE_NULL) return;
     while (1) {
-        pthread_mutex_lock(&mutex_cq);
-        if (handle == ACP_HANDLE_ALL || handle == ACP_HANDLE_CONT) handle = cqwp - 1;
-        if(cqcp > handle) break;
-        pthread_mutex_unlock(&mutex_cq);
+        pthread_mutex_lock(&q->mutex);
+        if (q->cqcp > wp) break;
+        pthread_mutex_unlock(&q->mutex);
+        if (progress_inline) inline_progress();
         sched_yield();
     }
-    pthread_mutex_unlock(&mutex_cq);
+    pthread_mutex_unlock(&q->mutex);
+    
+    return;
+}
+
+void acp_complete(acp_handle_t handle)
+{
+    cqueue_t* q;
+    uint64_t wp;
+    
+    if (handle == ACP_HANDLE_NULL) return;
+    if (handle_is_entry(handle)) {
+        cq_complete(cqs[handle >> CQ_QID_SHIFT], handle & CQ_WP_MASK);
+        return;
+    }
+    
+    q = my_cqueue();
+    pthread_mutex_lock(&q->mutex);
+    wp = q->cqwp - 1;
+    pthread_mutex_unlock(&q->mutex);
+    cq_complete(q, wp);
     
     return;
 }
 
+/* Return 1 while the GMA of handle, or one issued before it in its queue, is incomplete, and 0 otherwise */
 int acp_inquire(acp_handle_t handle)
 {
+    cqueue_t* q;
     int ret = 0;
     
     if (handle == ACP_HANDLE_NULL) return ret;
-    pthread_mutex_lock(&mutex_cq);
-    if (handle == ACP_HANDLE_ALL || handle == ACP_HANDLE_CONT) handle = cqwp - 1;
-    if (cqcp > handle) ret = 1;
-    pthread_mutex_unlock(&mutex_cq);
+    if (progress_inline) inline_progress();
+    if (handle_is_entry(handle)) {
+        q = cqs[handle >> CQ_QID_SHIFT];
+        pthread_mutex_lock(&q->mutex);
+        if (q->cqcp <= (handle & CQ_WP_MASK)) ret = 1;
+        pthread_mutex_unlock(&q->mutex);
+        return ret;
+    }
+    
+    q = my_cqueue();
+    pthread_mutex_lock(&q->mutex);
+    if (q->cqcp < q->cqwp) ret = 1;
+    pthread_mutex_unlock(&q->mutex);
     
     return ret;
 }
 
+/* Copy stats with the latencies and stalls of all command queues added */
+static void stats_collect(acp_stats_t* buf)
+{
+    cqueue_t* q;
+    int i, j, k;
+    
+    iacpbl_stats_read(&stats_seq, buf, &stats, sizeof(acp_stats_t));
+    buf->loop_iterations = __atomic_load_n(&stats.loop_iterations, __ATOMIC_RELAXED);
+    for (i = 0; i < num_cqs; i++) {
+        q = cqs[i];
+        pthread_mutex_lock(&q->mutex);
+        for (j = 0; j < ACP_STATS_NUM_OPS; j++) {
+            buf->op[j].count += q->op[j].count;
+            buf->op[j].total_nsec += q->op[j].total_nsec;
+            if (buf->op[j].max_nsec < q->op[j].max_nsec) buf->op[j].max_nsec = q->op[j].max_nsec;
+            for (k = 0; k < ACP_STATS_HIST_BINS; k++) buf->op[j].hist[k] += q->op[j].hist[k];
+        }
+        buf->queue_full_stalls += q->queue_full_stalls;
+        pthread_mutex_unlock(&q->mutex);
+    }
+    return;
+}
+
+int acp_query_stats(acp_stats_t *buf)
+{
+    if (buf == NULL) return -1;
+    stats_collect(buf);
+    
+    return 0;
+}
+
+int acp_query_peer_stats(int rank, acp_peer_stats_t *buf)
+{
+    if (buf == NULL || rank < 0 || rank >= NUM_PROCS) return -1;
+    if (peer_stats == NULL) {
+        memset(buf, 0, sizeof(acp_peer_stats_t));
+        return 0;
+    }
+    iacpbl_stats_read(&stats_seq, buf, &peer_stats[rank], sizeof(acp_peer_stats_t));
+    
+    return 0;
+}
+
 acp_handle_t acp_copy(acp_ga_t dst, acp_ga_t src, size_t size, acp_handle_t order)
 {
     debug printf("rank %d - main acp_copy(0x%016" PRIx64 ",  0x%016" PRIx64 ", %d, 0x%016" PRIx64 ");\n", MY_RANK, dst, src, size, order);
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = COPY;
-    cq[p].size = size;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        memcpy(ga2address(cq[p].dst), ga2address(cq[p].src), cq[p].size);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = COPY;
+    q->cq[p].size = size;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        iacpbl_copy(ga2address(q->cq[p].dst), ga2address(q->cq[p].src), q->cq[p].size);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 acp_handle_t acp_cas4(acp_ga_t dst, acp_ga_t src, uint32_t oldval, uint32_t newval, acp_handle_t order)
 {
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = CAS4;
-    cq[p].old4 = oldval;
-    cq[p].new4 = newval;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        *(uint32_t*)ga2address(cq[p].dst) = sync_val_compare_and_swap_4((uint32_t*)ga2address(cq[p].src), cq[p].old4, cq[p].new4);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = CAS4;
+    q->cq[p].old4 = oldval;
+    q->cq[p].new4 = newval;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        *(uint32_t*)ga2address(q->cq[p].dst) = sync_val_compare_and_swap_4((uint32_t*)ga2address(q->cq[p].src), q->cq[p].old4, q->cq[p].new4);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 acp_handle_t acp_cas8(acp_ga_t dst, acp_ga_t src, uint64_t oldval, uint64_t newval, acp_handle_t order)
 {
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = CAS8;
-    cq[p].old8 = oldval;
-    cq[p].new8 = newval;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        *(uint64_t*)ga2address(cq[p].dst) = sync_val_compare_and_swap_8((uint64_t*)ga2address(cq[p].src), cq[p].old8, cq[p].new8);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = CAS8;
+    q->cq[p].old8 = oldval;
+    q->cq[p].new8 = newval;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        *(uint64_t*)ga2address(q->cq[p].dst) = sync_val_compare_and_swap_8((uint64_t*)ga2address(q->cq[p].src), q->cq[p].old8, q->cq[p].new8);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 acp_handle_t acp_swap4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t order)
 {
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = SWAP4;
-    cq[p].val4 = value;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        *(uint32_t*)ga2address(cq[p].dst) = sync_swap_4((uint32_t*)ga2address(cq[p].src), cq[p].val4);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = SWAP4;
+    q->cq[p].val4 = value;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        *(uint32_t*)ga2address(q->cq[p].dst) = sync_swap_4((uint32_t*)ga2address(q->cq[p].src), q->cq[p].val4);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 acp_handle_t acp_swap8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t order)
 {
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = SWAP8;
-    cq[p].val8 = value;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        *(uint64_t*)ga2address(cq[p].dst) = sync_swap_8((uint64_t*)ga2address(cq[p].src), cq[p].val8);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = SWAP8;
+    q->cq[p].val8 = value;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        *(uint64_t*)ga2address(q->cq[p].dst) = sync_swap_8((uint64_t*)ga2address(q->cq[p].src), q->cq[p].val8);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 acp_handle_t acp_add4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t order)
 {
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = ADD4;
-    cq[p].val4 = value;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        *(uint32_t*)ga2address(cq[p].dst) = sync_fetch_and_add_4((uint32_t*)ga2address(cq[p].src), cq[p].val4);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = ADD4;
+    q->cq[p].val4 = value;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        *(uint32_t*)ga2address(q->cq[p].dst) = sync_fetch_and_add_4((uint32_t*)ga2address(q->cq[p].src), q->cq[p].val4);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 acp_handle_t acp_add8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t order)
 {
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = ADD8;
-    cq[p].val8 = value;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        *(uint64_t*)ga2address(cq[p].dst) = sync_fetch_and_add_8((uint64_t*)ga2address(cq[p].src), cq[p].val8);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = ADD8;
+    q->cq[p].val8 = value;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        *(uint64_t*)ga2address(q->cq[p].dst) = sync_fetch_and_add_8((uint64_t*)ga2address(q->cq[p].src), q->cq[p].val8);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 acp_handle_t acp_xor4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t order)
 {
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = XOR4;
-    cq[p].val4 = value;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        *(uint32_t*)ga2address(cq[p].dst) = sync_fetch_and_xor_4((uint32_t*)ga2address(cq[p].src), cq[p].val4);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = XOR4;
+    q->cq[p].val4 = value;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        *(uint32_t*)ga2address(q->cq[p].dst) = sync_fetch_and_xor_4((uint32_t*)ga2address(q->cq[p].src), q->cq[p].val4);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 acp_handle_t acp_xor8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t order)
 {
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = XOR8;
-    cq[p].val8 = value;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        *(uint64_t*)ga2address(cq[p].dst) = sync_fetch_and_xor_8((uint64_t*)ga2address(cq[p].src), cq[p].val8);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = XOR8;
+    q->cq[p].val8 = value;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        *(uint64_t*)ga2address(q->cq[p].dst) = sync_fetch_and_xor_8((uint64_t*)ga2address(q->cq[p].src), q->cq[p].val8);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 acp_handle_t acp_or4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t order)
 {
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = OR4;
-    cq[p].val4 = value;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        *(uint32_t*)ga2address(cq[p].dst) = sync_fetch_and_or_4((uint32_t*)ga2address(cq[p].src), cq[p].val4);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = OR4;
+    q->cq[p].val4 = value;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        *(uint32_t*)ga2address(q->cq[p].dst) = sync_fetch_and_or_4((uint32_t*)ga2address(q->cq[p].src), q->cq[p].val4);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 acp_handle_t acp_or8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t order)
 {
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = OR8;
-    cq[p].val8 = value;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        *(uint64_t*)ga2address(cq[p].dst) = sync_fetch_and_or_8((uint64_t*)ga2address(cq[p].src), cq[p].val8);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = OR8;
+    q->cq[p].val8 = value;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        *(uint64_t*)ga2address(q->cq[p].dst) = sync_fetch_and_or_8((uint64_t*)ga2address(q->cq[p].src), q->cq[p].val8);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 acp_handle_t acp_and4(acp_ga_t dst, acp_ga_t src, uint32_t value, acp_handle_t order)
 {
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = AND4;
-    cq[p].val4 = value;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        *(uint32_t*)ga2address(cq[p].dst) = sync_fetch_and_and_4((uint32_t*)ga2address(cq[p].src), cq[p].val4);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = AND4;
+    q->cq[p].val4 = value;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        *(uint32_t*)ga2address(q->cq[p].dst) = sync_fetch_and_and_4((uint32_t*)ga2address(q->cq[p].src), q->cq[p].val4);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 acp_handle_t acp_and8(acp_ga_t dst, acp_ga_t src, uint64_t value, acp_handle_t order)
 {
-    int p = cq_open_entry(dst, src, order);
-    cq[p].type = AND8;
-    cq[p].val8 = value;
-    if (cq[p].stat == CQSTAT_11 && cq[p].order < cqcp) {
-        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-        *(uint64_t*)ga2address(cq[p].dst) = sync_fetch_and_and_8((uint64_t*)ga2address(cq[p].src), cq[p].val8);
-        cq[p].stat = CQSTAT_DONE;
-        if (cqxp == cqwp && cqcp == cqwp) return cq_finish_entry();
+    cqueue_t* q = my_cqueue();
+    int p = cq_open_entry(q, dst, src, order);
+    q->cq[p].type = AND8;
+    q->cq[p].val8 = value;
+    if (q->cq[p].stat == CQSTAT_11 && q->cq[p].order < q->cqcp) {
+        debug printf("rank %d - main Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+        *(uint64_t*)ga2address(q->cq[p].dst) = sync_fetch_and_and_8((uint64_t*)ga2address(q->cq[p].src), q->cq[p].val8);
+        q->cq[p].stat = CQSTAT_DONE;
+        if (q->cqxp == q->cqwp && q->cqcp == q->cqwp) return cq_finish_entry(q);
     }
-    return cq_close_entry();
+    return cq_close_entry(q);
 }
 
 /************************/
@@ -1489,7 +2038,8 @@ static inline int dq_push(uint64_t ptr, uint32_t rank, uint32_t rfence, uint16_t
         dqhead = dqexec = dqtail = pos;
         dqoffset = 0;
     } else {
-        dqnext[dqtail] = dqtail = pos;
+        dqnext[dqtail] = pos;
+        dqtail = pos;
         if (dqexec < 0) {
             dqexec = pos;
             dqoffset = 0;
@@ -1535,6 +2085,323 @@ static inline void dq_free(int pos)
     return;
 }
 
+/* Bulk transfer */
+
+/*
+ * Copies of bulk_threshold bytes or more to a process on another node do
+ * not go through the datagram path. The process owning the source streams
+ * a bulk_hdr_t and the payload over a TCP connection to the process owning
+ * the destination, which receives it straight into the destination and
+ * returns the delegate queue position as an acknowledgement. The entry is
+ * then completed with the usual VC2 end datagram. Every process listens on
+ * its own port number for TCP; connections are opened on first use and
+ * kept until finalization.
+ */
+#define BULK_POLL_NSEC  1000000LLU
+
+typedef struct {
+    uint32_t task;
+    uint32_t pos;
+    acp_ga_t dst;
+    uint64_t size;
+} bulk_hdr_t;
+
+typedef struct {
+    int rank;       /* destination rank of an outgoing connection, -1 if accepted */
+    int len;        /* received bytes of ack or hdr */
+    int pending;    /* transfers waiting for an ack on an outgoing connection */
+    uint32_t ack;
+    uint64_t offset;
+    bulk_hdr_t hdr;
+} bulk_conn_t;
+
+static uint64_t bulk_threshold;
+static int bulk_listen = -1;
+static int* bulk_tx_conn;       /* connection index per rank, -1 if none, -2 if unreachable */
+static bulk_conn_t* bulk_conn;
+static struct pollfd* bulk_pfds; /* [0] is the listening socket, [i + 1] is bulk_conn[i] */
+static int bulk_conn_num, bulk_conn_max;
+static int bulk_rx_active;
+static uint64_t bulk_tx_count, bulk_tx_bytes, bulk_rx_count, bulk_rx_bytes;
+
+static void init_bulk(void)
+{
+    struct sockaddr_in addr;
+    int i, option = 1;
+    
+    bulk_threshold = iacpbl_option.bulkthreshold.value;
+    bulk_listen = -1;
+    bulk_tx_conn = NULL;
+    bulk_conn = NULL;
+    bulk_pfds = NULL;
+    bulk_conn_num = bulk_conn_max = 0;
+    bulk_rx_active = 0;
+    bulk_tx_count = bulk_tx_bytes = bulk_rx_count = bulk_rx_bytes = 0;
+    
+    /* Only between nodes, and not under the emulator which shapes datagrams only */
+    if (bulk_threshold == 0 || NUM_PROCS == NODE_POP || emu_enabled) return;
+    
+    bulk_tx_conn = (int*)malloc(NUM_PROCS * sizeof(int));
+    bulk_pfds = (struct pollfd*)malloc(sizeof(struct pollfd));
+    if (bulk_tx_conn == NULL || bulk_pfds == NULL) goto fail;
+    for (i = 0; i < NUM_PROCS; i++) bulk_tx_conn[i] = -1;
+    
+    bulk_listen = socket(AF_INET, SOCK_STREAM, 0);
+    if (bulk_listen < 0) goto fail;
+    setsockopt(bulk_listen, SOL_SOCKET, SO_REUSEADDR, (const void*)&option, sizeof(option));
+    addr.sin_family = AF_INET;
+    addr.sin_port = PORT_TABLE[MY_RANK];
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(bulk_listen, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(bulk_listen, SOMAXCONN) < 0) {
+        close(bulk_listen);
+        bulk_listen = -1;
+        goto fail;
+    }
+    fcntl(bulk_listen, F_SETFL, fcntl(bulk_listen, F_GETFL) | O_NONBLOCK);
+    bulk_pfds[0].fd = bulk_listen;
+    bulk_pfds[0].events = POLLIN;
+    bulk_pfds[0].revents = 0;
+    
+    /* Non-gateway threads sleep on the doorbell; wake them up to accept */
+    doorbell_wait_nsec = BULK_POLL_NSEC;
+    return;
+    
+fail:
+    /* Peers fall back to datagrams when they cannot connect */
+    debug printf("rank %d - bulk transfer disabled\n", MY_RANK);
+    if (bulk_tx_conn != NULL) free(bulk_tx_conn);
+    if (bulk_pfds != NULL) free(bulk_pfds);
+    bulk_tx_conn = NULL;
+    bulk_pfds = NULL;
+    return;
+}
+
+static void finalize_bulk(void)
+{
+    int i;
+    
+    if (bulk_listen < 0) return;
+    if (iacpbl_stats_enabled())
+        fprintf(stderr, "%d: acp bulk: sent %lu (%lu bytes), received %lu (%lu bytes)\n",
+                MY_RANK, bulk_tx_count, bulk_tx_bytes, bulk_rx_count, bulk_rx_bytes);
+    for (i = 0; i < bulk_conn_num; i++) if (bulk_pfds[i + 1].fd >= 0) close(bulk_pfds[i + 1].fd);
+    close(bulk_listen);
+    free(bulk_tx_conn);
+    free(bulk_pfds);
+    if (bulk_conn != NULL) free(bulk_conn);
+    bulk_listen = -1;
+    bulk_tx_conn = NULL;
+    bulk_conn = NULL;
+    bulk_pfds = NULL;
+    bulk_conn_num = bulk_conn_max = 0;
+    doorbell_wait_nsec = 0;
+    return;
+}
+
+static int bulk_add_conn(int sock, int rank)
+{
+    bulk_conn_t* conn;
+    struct pollfd* pfds;
+    int n;
+    
+    if (bulk_conn_num == bulk_conn_max) {
+        n = bulk_conn_max ? bulk_conn_max * 2 : 16;
+        conn = (bulk_conn_t*)realloc(bulk_conn, n * sizeof(bulk_conn_t));
+        if (conn == NULL) return -1;
+        bulk_conn = conn;
+        pfds = (struct pollfd*)realloc(bulk_pfds, (n + 1) * sizeof(struct pollfd));
+        if (pfds == NULL) return -1;
+        bulk_pfds = pfds;
+        bulk_conn_max = n;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    n = bulk_conn_num++;
+    bulk_conn[n].rank = rank;
+    bulk_conn[n].len = 0;
+    bulk_conn[n].pending = 0;
+    bulk_conn[n].offset = 0;
+    bulk_pfds[n + 1].fd = sock;
+    bulk_pfds[n + 1].events = POLLIN;
+    bulk_pfds[n + 1].revents = 0;
+    return n;
+}
+
+static void bulk_close_conn(int n)
+{
+    if (bulk_conn[n].rank >= 0) {
+        /* Peers close their side at finalization */
+        if (bulk_conn[n].pending > 0) {
+            printf("rank %d - ERROR bulk connection to rank %d closed.\n", MY_RANK, bulk_conn[n].rank);
+            exit(-1);
+        }
+        bulk_tx_conn[bulk_conn[n].rank] = -1;
+    } else if (bulk_conn[n].len > 0) bulk_rx_active--;
+    close(bulk_pfds[n + 1].fd);
+    bulk_pfds[n + 1].fd = -1;
+    return;
+}
+
+static inline int is_bulk(int pos)
+{
+    return bulk_listen >= 0 && dq[pos].type == COPY && dq[pos].size >= bulk_threshold
+           && dq[pos].gateway != MY_GATEWAY && bulk_tx_conn[ga2rank(dq[pos].dst)] != -2;
+}
+
+/* Connect to the process owning the destination; -1 to fall back to datagrams */
+static int bulk_connect(int rank)
+{
+    struct sockaddr_in addr;
+    int sock, n;
+    
+    if (bulk_tx_conn[rank] >= 0) return bulk_tx_conn[rank];
+    addr.sin_family = AF_INET;
+    addr.sin_port = PORT_TABLE[rank];
+    addr.sin_addr.s_addr = ADDR_TABLE[rank];
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock >= 0 && connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0
+        && (n = bulk_add_conn(sock, rank)) >= 0) {
+        bulk_tx_conn[rank] = n;
+        debug printf("rank %d - bulk connect to rank %d\n", MY_RANK, rank);
+        return n;
+    }
+    if (sock >= 0) close(sock);
+    bulk_tx_conn[rank] = -2;
+    debug printf("rank %d - bulk connect to rank %d failed, errno %d\n", MY_RANK, rank, errno);
+    return -1;
+}
+
+/* Stream as much of dq[pos] as the socket takes; 1 when the whole entry is sent */
+static int bulk_send(int pos)
+{
+    struct msghdr msg;
+    struct iovec iov[2];
+    bulk_hdr_t hdr;
+    ssize_t n;
+    int c;
+    
+    if ((c = bulk_connect(ga2rank(dq[pos].dst))) < 0) return -1;
+    
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    if (dqoffset < sizeof(bulk_hdr_t)) {
+        hdr.task = TASKID;
+        hdr.pos  = pos;
+        hdr.dst  = dq[pos].dst;
+        hdr.size = dq[pos].size;
+        iov[0].iov_base = (char*)&hdr + dqoffset;
+        iov[0].iov_len  = sizeof(bulk_hdr_t) - dqoffset;
+        iov[1].iov_base = ga2address(dq[pos].src);
+        iov[1].iov_len  = dq[pos].size;
+        msg.msg_iovlen = 2;
+    } else {
+        iov[0].iov_base = ga2address(dq[pos].src) + dqoffset - sizeof(bulk_hdr_t);
+        iov[0].iov_len  = dq[pos].size + sizeof(bulk_hdr_t) - dqoffset;
+        msg.msg_iovlen = 1;
+    }
+    n = sendmsg(bulk_pfds[c + 1].fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+        printf("rank %d - ERROR in bulk sendmsg(), errno %d.\n", MY_RANK, errno);
+        exit(-1);
+    }
+    if (dqoffset == 0) bulk_conn[c].pending++;
+    dqoffset += n;
+    if (dqoffset < dq[pos].size + sizeof(bulk_hdr_t)) return 0;
+    bulk_tx_count++;
+    bulk_tx_bytes += dq[pos].size;
+    return 1;
+}
+
+/* Receive on an accepted connection straight into the destination */
+static void bulk_receive(int n)
+{
+    bulk_conn_t* conn = &bulk_conn[n];
+    int sock = bulk_pfds[n + 1].fd;
+    ssize_t r;
+    
+    while (1) {
+        if (conn->len < sizeof(bulk_hdr_t)) {
+            r = recv(sock, (char*)&conn->hdr + conn->len, sizeof(bulk_hdr_t) - conn->len, MSG_DONTWAIT);
+            if (r <= 0) break;
+            if (conn->len == 0) bulk_rx_active++;
+            conn->len += r;
+            if (conn->len < sizeof(bulk_hdr_t)) continue;
+            if (conn->hdr.task != TASKID) {
+                printf("rank %d - ERROR bulk transfer of another task.\n", MY_RANK);
+                exit(-1);
+            }
+            conn->offset = 0;
+        }
+        r = recv(sock, ga2address(conn->hdr.dst) + conn->offset, conn->hdr.size - conn->offset, MSG_DONTWAIT);
+        if (r <= 0) break;
+        conn->offset += r;
+        if (conn->offset < conn->hdr.size) continue;
+        
+        /* Acknowledge with the position of the delegate queue entry at the source */
+        if (send(sock, &conn->hdr.pos, sizeof(uint32_t), MSG_NOSIGNAL) != sizeof(uint32_t)) {
+            printf("rank %d - ERROR in bulk send(), errno %d.\n", MY_RANK, errno);
+            exit(-1);
+        }
+        debug printf("rank %d - bulk received %" PRIu64 " bytes for dq[%d] of rank %d\n", MY_RANK, conn->hdr.size, conn->hdr.pos, ga2rank(conn->hdr.dst));
+        bulk_rx_count++;
+        bulk_rx_bytes += conn->hdr.size;
+        bulk_rx_active--;
+        conn->len = 0;
+    }
+    if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) bulk_close_conn(n);
+    return;
+}
+
+/* Read acks on an outgoing connection and complete the corresponding entries */
+static void bulk_receive_ack(int n)
+{
+    bulk_conn_t* conn = &bulk_conn[n];
+    ssize_t r;
+    int pos;
+    
+    while ((r = recv(bulk_pfds[n + 1].fd, (char*)&conn->ack + conn->len, sizeof(uint32_t) - conn->len, MSG_DONTWAIT)) > 0) {
+        conn->len += r;
+        if (conn->len < sizeof(uint32_t)) continue;
+        conn->len = 0;
+        conn->pending--;
+        pos = conn->ack;
+        /* if (dq[pos].stat != DQSTAT_WAIT) exception */
+        if (dq[pos].rank != MY_RANK) {
+            dq[pos].stat = DQSTAT_NOTIFY;
+            dq[pos].inum = INUM_TABLE[dq[pos].rank];
+            dq[pos].gateway = GTWY_TABLE[dq[pos].rank];
+        } else { /* dq[pos].rank == MY_RANK */
+            /* Notify completion directly to the corresponding CQ entry */
+            cq_entry(dq[pos].ptr)->stat = CQSTAT_DONE;
+            dq_free(pos);
+        }
+        debug printf("rank %d - protocol dq[%d] got ack from bulk connection\n", MY_RANK, pos);
+    }
+    if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) bulk_close_conn(n);
+    return;
+}
+
+static void bulk_progress(void)
+{
+    int i, sock;
+    
+    if (poll(bulk_pfds, bulk_conn_num + 1, 0) <= 0) return;
+    if (bulk_pfds[0].revents & POLLIN) {
+        while ((sock = accept(bulk_listen, NULL, NULL)) >= 0) {
+            if (bulk_add_conn(sock, -1) < 0) close(sock);
+            debug printf("rank %d - bulk accept\n", MY_RANK);
+        }
+    }
+    for (i = 0; i < bulk_conn_num; i++) {
+        if (bulk_pfds[i + 1].fd < 0 || bulk_pfds[i + 1].revents == 0) continue;
+        if (bulk_conn[i].rank >= 0)
+            bulk_receive_ack(i);
+        else
+            bulk_receive(i);
+    }
+    return;
+}
+
 /* Datagram size utilities */
 
 static inline int dg_size_vc0(uint32_t type)
@@ -1795,1017 +2662,1088 @@ static inline void insert_retx_time(int pos, uint64_t time)
     return;
 }
 
-/* Communication thread function */
+/* State of the progress function */
 
-static void* comm_thread_func(void *param)
+static struct pollfd* pfds;
+static uint64_t estimated_nsec;
+static int tx_vc0_next_inum, tx_vc1_next_inum, tx_vc2_next_inum, rx_vc0_next_inum, rx_vc1_next_inum;
+
+/* Progress function */
+
+/*
+ * One pass of the transport and protocol processing. It is repeated by
+ * the communication thread, or called by the user threads from the
+ * interface functions in the inline progress mode.
+ */
+static void comm_progress(void)
 {
-    struct pollfd* pfds;
     struct sockaddr_in addr, from;
     socklen_t addr_len;
     ssize_t recv_len;
     dg_union* dgp;
     dg_control_t dgc;
     uint32_t send_to;
-    uint64_t estimated_nsec = 0, current_nsec, tmp_nsec, count, size;
-    int i, j, check, check_clear, check_cont, check_not_full, check_quit, check_wait;
-    int elem_id, inum, len, next, p, pos, prev, ptr, sock, tx_bytes, type, vc;
-    int tx_vc0_next_inum = 0, tx_vc1_next_inum = 0, tx_vc2_next_inum = 0, rx_vc0_next_inum = 0, rx_vc1_next_inum = 0;
+    uint64_t current_nsec, tmp_nsec, size;
+    int i, check, check_clear, check_cont, check_not_full, check_wait;
+    int bulk, elem_id, inum, len, next, num_cq, p, pos, prev, ptr, sock, tx_bytes, type, vc;
+    cqueue_t* q;
     
-    /******** Initinalization for the transport processing ********/
+    __atomic_store_n(&stats.loop_iterations, stats.loop_iterations + 1, __ATOMIC_RELAXED);
+    addr_len = sizeof(struct sockaddr_in);
+    
+    /******** Transport processing ********/
     
     if (MY_INUM == 0 && NUM_PROCS != NODE_POP) {
-        debug printf("rank %d - initinalization for the transport processing\n", MY_RANK);
-        init_ser();
-        init_seq();
-        init_txtime(get_nsec());
-        init_rtt_pred();
-        init_retx_list();
         
-        /*** Setup pollfds for UDP communication ***/
+        /*** Flush datagrams held by the emulator ***/
+        if (emu_enabled) emu_progress();
         
-        pfds = (struct pollfd*)malloc(sizeof(struct pollfd) * NODE_POP);
-        if (pfds == NULL) {
-            pthread_mutex_lock(&mutex_comm_thread_ready);
-            pthread_cond_signal(&cond_comm_thread_ready);
-            pthread_mutex_unlock(&mutex_comm_thread_ready);
-            finalize_retx_list();
-            finalize_rtt_pred();
-            finalize_txtime();
-            finalize_seq();
-            finalize_ser();
-            return NULL;
+        /*** Sweep rxbuf vc1 ack ***/
+        current_nsec = get_nsec();
+        tx_bytes = 0;
+        
+        for (inum = 0; inum < NODE_POP; inum++) {
+            while((elem_id = rxbuf_pop_free_vc1ack(inum)) >= 0) {
+                dgp = (dg_union*)rxbuf[inum].list[elem_id].dg;
+                send_to = dgp->put.rank;
+                pos = inum * NUM_PROCS + send_to;
+                sock = pfds[inum].fd;
+                dgc.task = TASKID;
+                dgc.c = ACK;
+                dgc.vc = 1;
+                dgc.rank = LMEM_TABLE[inum];
+                dgc.ser = dgp->put.ser;
+                inc_seq(&seq_table[pos].rxseq1);
+                dgc.seq = seq_table[pos].rxseq0;
+                dgc.seq1 = seq_table[pos].rxseq1;
+                dgc.seq2 = seq_table[pos].rxseq2;
+                len = 16;
+                addr.sin_family = AF_INET;
+                addr.sin_port = PORT_TABLE[send_to];
+                addr.sin_addr.s_addr = ADDR_TABLE[send_to];
+                tx_bytes += dg_biased_size(len);
+                rxbuf_push_free(inum, elem_id);
+                transmit_dg(sock, (void*)&dgc, len, &addr, send_to);
+                debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
+            }
         }
         
-        addr_len = sizeof(struct sockaddr_in);
-        for (i = 0; i < NODE_POP; i++) {
-            /* bind socket */
-            pfds[i].fd = socket(AF_INET, SOCK_DGRAM, 0);
-            addr.sin_family = AF_INET;
-            addr.sin_port = PORT_TABLE[LMEM_TABLE[i]];
-            addr.sin_addr.s_addr = INADDR_ANY;
-            if (bind(pfds[i].fd, (struct sockaddr *)&addr, addr_len)) {
-                for (j = i - 1; j >= 0; j--) close(pfds[j].fd);
-                pthread_mutex_lock(&mutex_comm_thread_ready);
-                pthread_cond_signal(&cond_comm_thread_ready);
-                pthread_mutex_unlock(&mutex_comm_thread_ready);
-                finalize_retx_list();
-                finalize_rtt_pred();
-                finalize_txtime();
-                finalize_seq();
-                finalize_ser();
-                return NULL;
-            }
-            /* set events */
-            pfds[i].events = POLLIN;
-            pfds[i].revents = 0;
-        }
-    }
-    
-    /*** Main loop ***/
-    pthread_mutex_lock(&mutex_comm_thread_ready);
-    pthread_cond_signal(&cond_comm_thread_ready);
-    pthread_mutex_unlock(&mutex_comm_thread_ready);
-    debug printf("rank %d - communication thread ready\n", MY_RANK);
-    
-    pthread_mutex_lock(&mutex_comm_thread_start);
-    pthread_cond_wait(&cond_comm_thread_start, &mutex_comm_thread_start);
-    pthread_mutex_unlock(&mutex_comm_thread_start);
-    debug printf("rank %d - communication thread start\n", MY_RANK);
-    
-    while (1) {
-        /*** Quit check ***/
-        
-        pthread_mutex_lock(&mutex_quit_comm_thread);
-        check_quit = quit_comm_thread;
-        pthread_mutex_unlock(&mutex_quit_comm_thread);
-        if (check_quit) break;
+        /*** Recieve datagram ***/
         
-        /******** Transport processing ********/
-        
-        if (MY_INUM == 0 && NUM_PROCS != NODE_POP) {
-            
-            /*** Sweep rxbuf vc1 ack ***/
-            current_nsec = get_nsec();
-            tx_bytes = 0;
-            
-            for (inum = 0; inum < NODE_POP; inum++) {
-                while((elem_id = rxbuf_pop_free_vc1ack(inum)) >= 0) {
-                    dgp = (dg_union*)rxbuf[inum].list[elem_id].dg;
-                    send_to = dgp->put.rank;
-                    pos = inum * NUM_PROCS + send_to;
-                    sock = pfds[inum].fd;
-                    dgc.task = TASKID;
-                    dgc.c = ACK;
-                    dgc.vc = 1;
-                    dgc.rank = LMEM_TABLE[inum];
-                    dgc.ser = dgp->put.ser;
-                    inc_seq(&seq_table[pos].rxseq1);
-                    dgc.seq = seq_table[pos].rxseq0;
-                    dgc.seq1 = seq_table[pos].rxseq1;
-                    dgc.seq2 = seq_table[pos].rxseq2;
-                    len = 16;
-                    addr.sin_family = AF_INET;
-                    addr.sin_port = PORT_TABLE[send_to];
-                    addr.sin_addr.s_addr = ADDR_TABLE[send_to];
-                    tx_bytes += dg_biased_size(len);
-                    rxbuf_push_free(inum, elem_id);
-                    sendto(sock, (void*)&dgc, (ssize_t)len, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
-                    debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
-                }
+        poll(pfds, NODE_POP, 0);
+        for (inum = 0; inum < NODE_POP; inum++) {
+            if ((pfds[inum].revents & POLLIN) == 0) continue;
+            elem_id = rxbuf_pop_free(inum);
+            dgp = (dg_union*)rxbuf[inum].list[elem_id].dg;
+            recv_len = recvfrom(pfds[inum].fd, (void*)dgp, MAX_DG_SIZE, 0, (struct sockaddr*)&from, &addr_len);
+            if (emu_enabled && emu_drop_rx()) {
+                rxbuf_push_free(inum, elem_id);
+                continue;
             }
-            
-            /*** Recieve datagram ***/
-            
-            poll(pfds, NODE_POP, 0);
-            for (inum = 0; inum < NODE_POP; inum++) {
-                if ((pfds[inum].revents & POLLIN) == 0) continue;
-                elem_id = rxbuf_pop_free(inum);
-                dgp = (dg_union*)rxbuf[inum].list[elem_id].dg;
-                recv_len = recvfrom(pfds[inum].fd, (void*)dgp, MAX_DG_SIZE, 0, (struct sockaddr*)&from, &addr_len);
-                if (dgp->ack.task != TASKID) {
-                    rxbuf_push_free(inum, elem_id);
-                    continue;
-                    
-                } else if (dgp->ack.c != NORMAL) {
-                    debug printf("rank %d - transport Receive control %d from = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgp->ack.c, dgp->ack.rank, dgp->ack.vc, dgp->ack.ser, dgp->ack.seq, dgp->ack.seq1, dgp->ack.seq2);
-                    /* Check txbuf vc2 wait list */
-                    prev = -1;
-                    ptr = txbuf[inum].vc2.wait.head;
-                    while (ptr >= 0) {
-                        next = txbuf[inum].vc2.list[ptr].next;
-                        if (txbuf[inum].vc2.list[ptr].send_to == dgp->ack.rank && compare_seq(((dg_control_t*)&txbuf[inum].vc2.list[ptr].dg)->seq, dgp->ack.seq2) < 0) {
-                            if (prev == -1) {
-                                txbuf[inum].vc2.wait.head = next;
-                                if (next == -1) txbuf[inum].vc2.wait.tail = -1;
-                            } else {
-                                txbuf[inum].vc2.list[prev].next = next;
-                                if (next == -1) txbuf[inum].vc2.wait.tail = prev;
-                            }
-                            delete_retx_entry(retx_list_pos(inum, 2, ptr));
-                            txbuf_vc2_push_free(inum, ptr);
-                        } else
-                            prev = ptr;
-                        ptr = next;
-                    }
-                    
-                    /* Check txbuf vc1 wait list */
-                    prev = -1;
-                    ptr = txbuf[inum].vc1.wait.head;
-                    while (ptr >= 0) {
-                        next = txbuf[inum].vc1.list[ptr].next;
-                        if (txbuf[inum].vc1.list[ptr].send_to == dgp->ack.rank && compare_seq(((dg_control_t*)&txbuf[inum].vc1.list[ptr].dg)->seq, dgp->ack.seq1) < 0) {
-                            if (prev == -1) {
-                                txbuf[inum].vc1.wait.head = next;
-                                if (next == -1) txbuf[inum].vc1.wait.tail = -1;
-                            } else {
-                                txbuf[inum].vc1.list[prev].next = next;
-                                if (next == -1) txbuf[inum].vc1.wait.tail = prev;
-                            }
-                            delete_retx_entry(retx_list_pos(inum, 1, ptr));
-                            txbuf_vc1_push_ack(inum, ptr);
-                        } else
-                            prev = ptr;
-                        ptr = next;
-                    }
-                    
-                    /* Check txbuf vc0 wait list */
-                    prev = -1;
-                    ptr = txbuf[inum].vc0.wait.head;
-                    while (ptr >= 0) {
-                        next = txbuf[inum].vc0.list[ptr].next;
-                        if (txbuf[inum].vc0.list[ptr].send_to == dgp->ack.rank && compare_seq(((dg_control_t*)&txbuf[inum].vc0.list[ptr].dg)->seq, dgp->ack.seq) < 0) {
-                            if (prev == -1) {
-                                txbuf[inum].vc0.wait.head = next;
-                                if (next == -1) txbuf[inum].vc0.wait.tail = -1;
-                            } else {
-                                txbuf[inum].vc0.list[prev].next = next;
-                                if (next == -1) txbuf[inum].vc0.wait.tail = prev;
-                            }
-                            delete_retx_entry(retx_list_pos(inum, 0, ptr));
-                            txbuf_vc0_push_free(inum, ptr);
-                        } else
-                            prev = ptr;
-                        ptr = next;
-                    }
-                    
-                    /* Update full flag */
-                    if (dgp->ack.c == ACK) {
-                        if (dgp->ack.vc == 0) seq_table[NUM_PROCS * inum + dgp->ack.rank].full0 = 0;
-                        if (dgp->ack.vc == 1) seq_table[NUM_PROCS * inum + dgp->ack.rank].full1 = 0;
-                        if (dgp->ack.vc == 2) seq_table[NUM_PROCS * inum + dgp->ack.rank].full2 = 0;
-                    } else if (dgp->full.c == FULL) {
-                        if (dgp->full.vc == 0) seq_table[NUM_PROCS * inum + dgp->full.rank].full0 = 1;
-                        if (dgp->full.vc == 1) seq_table[NUM_PROCS * inum + dgp->full.rank].full1 = 1;
-                        if (dgp->full.vc == 2) seq_table[NUM_PROCS * inum + dgp->full.rank].full2 = 1;
-                    }
-                    
-                    /* Update round trip time */
-                    if (update_ser(inum, dgp->ack.vc, dgp->ack.ser)) rtt_update(dgp->ack.rank, dgp->ack.vc, get_nsec() - txtime(inum, dgp->ack.vc, dgp->ack.ser));
-                    rxbuf_push_free(inum, elem_id);
-                    continue;
-                    
-                } else if (dgp->end.vc == 2) {
-                    debug printf("rank %d - transport Receive END from = %d, ser = 0x%04x, seq = 0x%04x, cqp = 0x%016" PRIx64 "\n", MY_RANK, dgp->end.rank, dgp->end.ser, dgp->end.seq, dgp->end.ptr);
-                    send_to = dgp->end.rank;
-                    pos = inum * NUM_PROCS + send_to;
-                    sock = pfds[inum].fd;
-                    dgc.task = TASKID;
-                    dgc.c = ACK;
-                    dgc.vc = 2;
-                    dgc.rank = LMEM_TABLE[inum];
-                    dgc.ser = dgp->end.ser;
-                    dgc.seq = seq_table[pos].rxseq0;
-                    dgc.seq1 = seq_table[pos].rxseq1;
-                    dgc.seq2 = seq_table[pos].rxseq2;
-                    len = 16;
-                    addr.sin_family = AF_INET;
-                    addr.sin_port = PORT_TABLE[send_to];
-                    addr.sin_addr.s_addr = ADDR_TABLE[send_to];
-                    tx_bytes += dg_biased_size(len);
-                    if (dgp->end.seq == dgc.seq2) {
-                        if (inum > 0) pthread_mutex_lock(&doorbell[inum].mutex);
-                        if (rxbuf[inum].vc2.dg.num > (RXBUF_VC2_SIZE >> 1)) dgc.c = FULL;
-                        if (rxbuf[inum].vc2.dg.num < RXBUF_VC2_SIZE) {
-                            rxbuf[inum].list[elem_id].next = -1;
-                            if (rxbuf[inum].vc2.dg.tail < 0)
-                                rxbuf[inum].vc2.dg.head = elem_id;
-                            else
-                                rxbuf[inum].list[rxbuf[inum].vc2.dg.tail].next = elem_id;
-                            rxbuf[inum].vc2.dg.tail = elem_id;
-                            rxbuf[inum].vc2.dg.num += 1;
-                            doorbell_ring(inum);
-                            if (inum > 0) pthread_mutex_unlock(&doorbell[inum].mutex);
-                            inc_seq(&seq_table[pos].rxseq2);
-                            dgc.seq2 = seq_table[pos].rxseq2;
-                            sendto(sock, (void*)&dgc, (ssize_t)len, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
-                            debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
-                            continue;
+            if (dgp->ack.task == TASKID) stats_rx(dgp->ack.rank, (int)recv_len);
+            if (dgp->ack.task != TASKID) {
+                rxbuf_push_free(inum, elem_id);
+                continue;
+                
+            } else if (dgp->ack.c != NORMAL) {
+                debug printf("rank %d - transport Receive control %d from = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgp->ack.c, dgp->ack.rank, dgp->ack.vc, dgp->ack.ser, dgp->ack.seq, dgp->ack.seq1, dgp->ack.seq2);
+                /* Check txbuf vc2 wait list */
+                prev = -1;
+                ptr = txbuf[inum].vc2.wait.head;
+                while (ptr >= 0) {
+                    next = txbuf[inum].vc2.list[ptr].next;
+                    if (txbuf[inum].vc2.list[ptr].send_to == dgp->ack.rank && compare_seq(((dg_control_t*)&txbuf[inum].vc2.list[ptr].dg)->seq, dgp->ack.seq2) < 0) {
+                        if (prev == -1) {
+                            txbuf[inum].vc2.wait.head = next;
+                            if (next == -1) txbuf[inum].vc2.wait.tail = -1;
+                        } else {
+                            txbuf[inum].vc2.list[prev].next = next;
+                            if (next == -1) txbuf[inum].vc2.wait.tail = prev;
                         }
-                        if (inum > 0) pthread_mutex_unlock(&doorbell[inum].mutex);
-                    }
-                    dgc.c = NACK;
-                    rxbuf_push_free(inum, elem_id);
-                    sendto(sock, (void*)&dgc, (ssize_t)len, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
-                    debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
-                    continue;
-                    
-                } else if (dgp->put.vc == 1) {
-                    debug printf("rank %d - transport Receive PUT from = %d, ser = 0x%04x, seq = 0x%04x, dst = 0x%016" PRIx64 ", len = %d\n", MY_RANK, dgp->put.rank, dgp->put.ser, dgp->put.seq, dgp->put.dst, dgp->put.len);
-                    send_to = dgp->put.rank;
-                    pos = inum * NUM_PROCS + send_to;
-                    sock = pfds[inum].fd;
-                    dgc.task = TASKID;
-                    dgc.c = ACK;
-                    dgc.vc = 1;
-                    dgc.rank = LMEM_TABLE[inum];
-                    dgc.ser = dgp->put.ser;
-                    dgc.seq = seq_table[pos].rxseq0;
-                    dgc.seq1 = seq_table[pos].rxseq1;
-                    dgc.seq2 = seq_table[pos].rxseq2;
-                    len = 16;
-                    addr.sin_family = AF_INET;
-                    addr.sin_port = PORT_TABLE[send_to];
-                    addr.sin_addr.s_addr = ADDR_TABLE[send_to];
-                    tx_bytes += dg_biased_size(len);
-                    if (dgp->put.seq == seq_table[pos].rxseq1fwd) {
-                        if (inum > 0) pthread_mutex_lock(&doorbell[inum].mutex);
-                        if (rxbuf[inum].vc1.dg.num > (RXBUF_VC1_SIZE >> 1)) dgc.c = FULL;
-                        if (rxbuf[inum].vc1.dg.num < RXBUF_VC1_SIZE) {
-                            rxbuf[inum].list[elem_id].next = -1;
-                            if (rxbuf[inum].vc1.dg.tail < 0)
-                                rxbuf[inum].vc1.dg.head = elem_id;
-                            else
-                                rxbuf[inum].list[rxbuf[inum].vc1.dg.tail].next = elem_id;
-                            rxbuf[inum].vc1.dg.tail = elem_id;
-                            rxbuf[inum].vc1.dg.num += 1;
-                            doorbell_ring(inum);
-                            if (inum > 0) pthread_mutex_unlock(&doorbell[inum].mutex);
-                            inc_seq(&seq_table[pos].rxseq1fwd);
-                            debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
-                            continue;
+                        delete_retx_entry(retx_list_pos(inum, 2, ptr));
+                        txbuf_vc2_push_free(inum, ptr);
+                    } else
+                        prev = ptr;
+                    ptr = next;
+                }
+                
+                /* Check txbuf vc1 wait list */
+                prev = -1;
+                ptr = txbuf[inum].vc1.wait.head;
+                while (ptr >= 0) {
+                    next = txbuf[inum].vc1.list[ptr].next;
+                    if (txbuf[inum].vc1.list[ptr].send_to == dgp->ack.rank && compare_seq(((dg_control_t*)&txbuf[inum].vc1.list[ptr].dg)->seq, dgp->ack.seq1) < 0) {
+                        if (prev == -1) {
+                            txbuf[inum].vc1.wait.head = next;
+                            if (next == -1) txbuf[inum].vc1.wait.tail = -1;
+                        } else {
+                            txbuf[inum].vc1.list[prev].next = next;
+                            if (next == -1) txbuf[inum].vc1.wait.tail = prev;
                         }
-                        if (inum > 0) pthread_mutex_unlock(&doorbell[inum].mutex);
-                    }
-                    dgc.c = NACK;
-                    rxbuf_push_free(inum, elem_id);
-                    sendto(sock, (void*)&dgc, (ssize_t)len, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
-                    debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
-                    continue;
-                    
-                } else if (dgp->copy.vc == 0) {
-                    debug printf("rank %d - transport Receive COMMAND %d from = %d, ser = 0x%04x, seq = 0x%04x, ptr = 0x%016" PRIx64 ", s = %d, dst = 0x%016" PRIx64 ", src = 0x%016" PRIx64 "\n", MY_RANK, dgp->copy.type, dgp->copy.rank, dgp->copy.ser, dgp->copy.seq, dgp->copy.ptr, dgp->copy.s, dgp->copy.dst, dgp->copy.src);
-                    send_to = dgp->copy.rank;
-                    pos = inum * NUM_PROCS + send_to;
-                    sock = pfds[inum].fd;
-                    dgc.task = TASKID;
-                    dgc.c = ACK;
-                    dgc.vc = 0;
-                    dgc.rank = LMEM_TABLE[inum];
-                    dgc.ser = dgp->copy.ser;
-                    dgc.seq = seq_table[pos].rxseq0;
-                    dgc.seq1 = seq_table[pos].rxseq1;
-                    dgc.seq2 = seq_table[pos].rxseq2;
-                    len = 16;
-                    addr.sin_family = AF_INET;
-                    addr.sin_port = PORT_TABLE[send_to];
-                    addr.sin_addr.s_addr = ADDR_TABLE[send_to];
-                    tx_bytes += dg_biased_size(len);
-                    if (dgp->copy.seq == dgc.seq) {
-                        if (inum > 0) pthread_mutex_lock(&doorbell[inum].mutex);
-                        if (rxbuf[inum].vc0.dg.num > (RXBUF_VC0_SIZE >> 1)) dgc.c = FULL;
-                        if (rxbuf[inum].vc0.dg.num < RXBUF_VC0_SIZE) {
-                            rxbuf[inum].list[elem_id].next = -1;
-                            if (rxbuf[inum].vc0.dg.tail < 0)
-                                rxbuf[inum].vc0.dg.head = elem_id;
-                            else
-                                rxbuf[inum].list[rxbuf[inum].vc0.dg.tail].next = elem_id;
-                            rxbuf[inum].vc0.dg.tail = elem_id;
-                            rxbuf[inum].vc0.dg.num += 1;
-                            doorbell_ring(inum);
-                            if (inum > 0) pthread_mutex_unlock(&doorbell[inum].mutex);
-                            inc_seq(&seq_table[pos].rxseq0);
-                            dgc.seq = seq_table[pos].rxseq0;
-                            sendto(sock, (void*)&dgc, (ssize_t)len, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
-                            debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
-                            continue;
+                        delete_retx_entry(retx_list_pos(inum, 1, ptr));
+                        txbuf_vc1_push_ack(inum, ptr);
+                    } else
+                        prev = ptr;
+                    ptr = next;
+                }
+                
+                /* Check txbuf vc0 wait list */
+                prev = -1;
+                ptr = txbuf[inum].vc0.wait.head;
+                while (ptr >= 0) {
+                    next = txbuf[inum].vc0.list[ptr].next;
+                    if (txbuf[inum].vc0.list[ptr].send_to == dgp->ack.rank && compare_seq(((dg_control_t*)&txbuf[inum].vc0.list[ptr].dg)->seq, dgp->ack.seq) < 0) {
+                        if (prev == -1) {
+                            txbuf[inum].vc0.wait.head = next;
+                            if (next == -1) txbuf[inum].vc0.wait.tail = -1;
+                        } else {
+                            txbuf[inum].vc0.list[prev].next = next;
+                            if (next == -1) txbuf[inum].vc0.wait.tail = prev;
                         }
+                        delete_retx_entry(retx_list_pos(inum, 0, ptr));
+                        txbuf_vc0_push_free(inum, ptr);
+                    } else
+                        prev = ptr;
+                    ptr = next;
+                }
+                
+                /* Update full flag */
+                if (dgp->ack.c == ACK) {
+                    if (dgp->ack.vc == 0) seq_table[NUM_PROCS * inum + dgp->ack.rank].full0 = 0;
+                    if (dgp->ack.vc == 1) seq_table[NUM_PROCS * inum + dgp->ack.rank].full1 = 0;
+                    if (dgp->ack.vc == 2) seq_table[NUM_PROCS * inum + dgp->ack.rank].full2 = 0;
+                } else if (dgp->full.c == FULL) {
+                    if (dgp->full.vc == 0) seq_table[NUM_PROCS * inum + dgp->full.rank].full0 = 1;
+                    if (dgp->full.vc == 1) seq_table[NUM_PROCS * inum + dgp->full.rank].full1 = 1;
+                    if (dgp->full.vc == 2) seq_table[NUM_PROCS * inum + dgp->full.rank].full2 = 1;
+                }
+                
+                /* Update round trip time */
+                if (update_ser(inum, dgp->ack.vc, dgp->ack.ser)) rtt_update(dgp->ack.rank, dgp->ack.vc, get_nsec() - txtime(inum, dgp->ack.vc, dgp->ack.ser));
+                rxbuf_push_free(inum, elem_id);
+                continue;
+                
+            } else if (dgp->end.vc == 2) {
+                debug printf("rank %d - transport Receive END from = %d, ser = 0x%04x, seq = 0x%04x, cqp = 0x%016" PRIx64 "\n", MY_RANK, dgp->end.rank, dgp->end.ser, dgp->end.seq, dgp->end.ptr);
+                send_to = dgp->end.rank;
+                pos = inum * NUM_PROCS + send_to;
+                sock = pfds[inum].fd;
+                dgc.task = TASKID;
+                dgc.c = ACK;
+                dgc.vc = 2;
+                dgc.rank = LMEM_TABLE[inum];
+                dgc.ser = dgp->end.ser;
+                dgc.seq = seq_table[pos].rxseq0;
+                dgc.seq1 = seq_table[pos].rxseq1;
+                dgc.seq2 = seq_table[pos].rxseq2;
+                len = 16;
+                addr.sin_family = AF_INET;
+                addr.sin_port = PORT_TABLE[send_to];
+                addr.sin_addr.s_addr = ADDR_TABLE[send_to];
+                tx_bytes += dg_biased_size(len);
+                if (dgp->end.seq == dgc.seq2) {
+                    if (inum > 0) pthread_mutex_lock(&doorbell[inum].mutex);
+                    if (rxbuf[inum].vc2.dg.num > (RXBUF_VC2_SIZE >> 1)) dgc.c = FULL;
+                    if (rxbuf[inum].vc2.dg.num < RXBUF_VC2_SIZE) {
+                        rxbuf[inum].list[elem_id].next = -1;
+                        if (rxbuf[inum].vc2.dg.tail < 0)
+                            rxbuf[inum].vc2.dg.head = elem_id;
+                        else
+                            rxbuf[inum].list[rxbuf[inum].vc2.dg.tail].next = elem_id;
+                        rxbuf[inum].vc2.dg.tail = elem_id;
+                        rxbuf[inum].vc2.dg.num += 1;
+                        doorbell_ring(inum);
                         if (inum > 0) pthread_mutex_unlock(&doorbell[inum].mutex);
+                        inc_seq(&seq_table[pos].rxseq2);
+                        dgc.seq2 = seq_table[pos].rxseq2;
+                        transmit_dg(sock, (void*)&dgc, len, &addr, send_to);
+                        debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
+                        continue;
                     }
-                    dgc.c = NACK;
-                    rxbuf_push_free(inum, elem_id);
-                    sendto(sock, (void*)&dgc, (ssize_t)len, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
-                    debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
-                    continue;
+                    if (inum > 0) pthread_mutex_unlock(&doorbell[inum].mutex);
                 }
-            }
-            
-            /*** Check injection rate ***/
-            if (estimated_nsec > current_nsec) {
-                estimated_nsec += tx_bytes * 8000ULL / NETWORK_BANDWIDTH;
+                dgc.c = NACK;
+                rxbuf_push_free(inum, elem_id);
+                transmit_dg(sock, (void*)&dgc, len, &addr, send_to);
+                debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
                 continue;
-            }
-            
-            /*** Retransmit datagram ***/
-            
-            pos = retx_head;
-            check = 0;
-            while (0) {//while (pos >= 0) {
-                if (retx_list[pos].time > current_nsec) break;
-                next = retx_list[pos].next;
-                inum = retx_list_pos_inum(pos);
-                vc = retx_list_pos_inum(pos);
-                elem_id = retx_list_pos_elem_id(pos);
-                if (vc == 2) {
-                    if ((check & 4) == 0) {
-                        sock = pfds[inum].fd;
-                        dgp = (dg_union*)txbuf[inum].vc2.list[elem_id].dg;
-                        len = 20;
-                        send_to = txbuf[inum].vc2.list[elem_id].send_to;
-                        dgp->end.ser = inc_ser(inum, 2);
-                        struct sockaddr_in addr;
-                        addr.sin_family = AF_INET;
-                        addr.sin_port = PORT_TABLE[send_to];
-                        addr.sin_addr.s_addr = ADDR_TABLE[send_to];
-                        sendto(sock, (void*)dgp, (ssize_t)len, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
-                        tx_bytes += dg_biased_size(len);
-                        tmp_nsec = get_nsec();
-                        delete_retx_entry(pos);
-                        insert_retx_time(pos, tmp_nsec + rtt_pred(send_to, 2));
-                        set_txtime(inum, 2, dgp->end.ser, tmp_nsec);
-                        check |= 4;
-                    }
-                } else if (vc == 1) {
-                    if ((check & 2) == 0) {
-                        sock = pfds[inum].fd;
-                        dgp = (dg_union*)txbuf[inum].vc1.list[elem_id].dg;
-                        len = 24 + dgp->put.len;
-                        send_to = txbuf[inum].vc1.list[elem_id].send_to;
-                        dgp->put.ser = inc_ser(inum, 1);
-                        addr.sin_family = AF_INET;
-                        addr.sin_port = PORT_TABLE[send_to];
-                        addr.sin_addr.s_addr = ADDR_TABLE[send_to];
-                        sendto(sock, (void*)dgp, (ssize_t)len, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
-                        tx_bytes += dg_biased_size(len);
-                        tmp_nsec = get_nsec();
-                        delete_retx_entry(pos);
-                        insert_retx_time(pos, tmp_nsec + rtt_pred(send_to, 1));
-                        set_txtime(inum, 1, dgp->put.ser, tmp_nsec);
-                        check |= 2;
+                
+            } else if (dgp->put.vc == 1) {
+                debug printf("rank %d - transport Receive PUT from = %d, ser = 0x%04x, seq = 0x%04x, dst = 0x%016" PRIx64 ", len = %d\n", MY_RANK, dgp->put.rank, dgp->put.ser, dgp->put.seq, dgp->put.dst, dgp->put.len);
+                send_to = dgp->put.rank;
+                pos = inum * NUM_PROCS + send_to;
+                sock = pfds[inum].fd;
+                dgc.task = TASKID;
+                dgc.c = ACK;
+                dgc.vc = 1;
+                dgc.rank = LMEM_TABLE[inum];
+                dgc.ser = dgp->put.ser;
+                dgc.seq = seq_table[pos].rxseq0;
+                dgc.seq1 = seq_table[pos].rxseq1;
+                dgc.seq2 = seq_table[pos].rxseq2;
+                len = 16;
+                addr.sin_family = AF_INET;
+                addr.sin_port = PORT_TABLE[send_to];
+                addr.sin_addr.s_addr = ADDR_TABLE[send_to];
+                tx_bytes += dg_biased_size(len);
+                if (dgp->put.seq == seq_table[pos].rxseq1fwd) {
+                    if (inum > 0) pthread_mutex_lock(&doorbell[inum].mutex);
+                    if (rxbuf[inum].vc1.dg.num > (RXBUF_VC1_SIZE >> 1)) dgc.c = FULL;
+                    if (rxbuf[inum].vc1.dg.num < RXBUF_VC1_SIZE) {
+                        rxbuf[inum].list[elem_id].next = -1;
+                        if (rxbuf[inum].vc1.dg.tail < 0)
+                            rxbuf[inum].vc1.dg.head = elem_id;
+                        else
+                            rxbuf[inum].list[rxbuf[inum].vc1.dg.tail].next = elem_id;
+                        rxbuf[inum].vc1.dg.tail = elem_id;
+                        rxbuf[inum].vc1.dg.num += 1;
+                        doorbell_ring(inum);
+                        if (inum > 0) pthread_mutex_unlock(&doorbell[inum].mutex);
+                        inc_seq(&seq_table[pos].rxseq1fwd);
+                        debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
+                        continue;
                     }
-                } else { /* vc == 0 */
-                    if ((check & 1) == 0) {
-                        sock = pfds[inum].fd;
-                        dgp = (dg_union*)txbuf[inum].vc0.list[elem_id].dg;
-                        len = dg_size_vc0(dgp->copy.type);
-                        send_to = txbuf[inum].vc0.list[elem_id].send_to;
-                        dgp->copy.ser = inc_ser(inum, 0);
-                        addr.sin_family = AF_INET;
-                        addr.sin_port = PORT_TABLE[send_to];
-                        addr.sin_addr.s_addr = ADDR_TABLE[send_to];
-                        sendto(sock, (void*)dgp, (ssize_t)len, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
-                        tx_bytes += dg_biased_size(len);
-                        tmp_nsec = get_nsec();
-                        delete_retx_entry(pos);
-                        insert_retx_time(pos, tmp_nsec + rtt_pred(send_to, 0));
-                        set_txtime(inum, 0, dgp->copy.ser, tmp_nsec);
-                        check |= 1;
+                    if (inum > 0) pthread_mutex_unlock(&doorbell[inum].mutex);
+                }
+                dgc.c = NACK;
+                rxbuf_push_free(inum, elem_id);
+                transmit_dg(sock, (void*)&dgc, len, &addr, send_to);
+                debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
+                continue;
+                
+            } else if (dgp->copy.vc == 0) {
+                debug printf("rank %d - transport Receive COMMAND %d from = %d, ser = 0x%04x, seq = 0x%04x, ptr = 0x%016" PRIx64 ", s = %d, dst = 0x%016" PRIx64 ", src = 0x%016" PRIx64 "\n", MY_RANK, dgp->copy.type, dgp->copy.rank, dgp->copy.ser, dgp->copy.seq, dgp->copy.ptr, dgp->copy.s, dgp->copy.dst, dgp->copy.src);
+                send_to = dgp->copy.rank;
+                pos = inum * NUM_PROCS + send_to;
+                sock = pfds[inum].fd;
+                dgc.task = TASKID;
+                dgc.c = ACK;
+                dgc.vc = 0;
+                dgc.rank = LMEM_TABLE[inum];
+                dgc.ser = dgp->copy.ser;
+                dgc.seq = seq_table[pos].rxseq0;
+                dgc.seq1 = seq_table[pos].rxseq1;
+                dgc.seq2 = seq_table[pos].rxseq2;
+                len = 16;
+                addr.sin_family = AF_INET;
+                addr.sin_port = PORT_TABLE[send_to];
+                addr.sin_addr.s_addr = ADDR_TABLE[send_to];
+                tx_bytes += dg_biased_size(len);
+                if (dgp->copy.seq == dgc.seq) {
+                    if (inum > 0) pthread_mutex_lock(&doorbell[inum].mutex);
+                    if (rxbuf[inum].vc0.dg.num > (RXBUF_VC0_SIZE >> 1)) dgc.c = FULL;
+                    if (rxbuf[inum].vc0.dg.num < RXBUF_VC0_SIZE) {
+                        rxbuf[inum].list[elem_id].next = -1;
+                        if (rxbuf[inum].vc0.dg.tail < 0)
+                            rxbuf[inum].vc0.dg.head = elem_id;
+                        else
+                            rxbuf[inum].list[rxbuf[inum].vc0.dg.tail].next = elem_id;
+                        rxbuf[inum].vc0.dg.tail = elem_id;
+                        rxbuf[inum].vc0.dg.num += 1;
+                        doorbell_ring(inum);
+                        if (inum > 0) pthread_mutex_unlock(&doorbell[inum].mutex);
+                        inc_seq(&seq_table[pos].rxseq0);
+                        dgc.seq = seq_table[pos].rxseq0;
+                        transmit_dg(sock, (void*)&dgc, len, &addr, send_to);
+                        debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
+                        continue;
                     }
+                    if (inum > 0) pthread_mutex_unlock(&doorbell[inum].mutex);
                 }
-                if (check == 7) break;
-                pos = next;
-            }
-            
-            /*** Check injection rate ***/
-            if (estimated_nsec > current_nsec) {
-                estimated_nsec += tx_bytes * 8000ULL / NETWORK_BANDWIDTH;
+                dgc.c = NACK;
+                rxbuf_push_free(inum, elem_id);
+                transmit_dg(sock, (void*)&dgc, len, &addr, send_to);
+                debug printf("rank %d - transport Transmit control %d to = %d, vc = %d, ser = 0x%04x, seq0 = 0x%04x, seq1 = 0x%04x, seq2 = 0x%04x\n", MY_RANK, dgc.c, send_to, dgc.vc, dgc.ser, dgc.seq, dgc.seq1, dgc.seq2);
                 continue;
             }
-            
-            /*** Transmit datagram ***/
-            
-            /* VC2 */
-            for (i = 0; i < NODE_POP; i++) {
-                inum = tx_vc2_next_inum;
-                tx_vc2_next_inum = (tx_vc2_next_inum < NODE_POP - 1) ? tx_vc2_next_inum + 1 : 0;
-                elem_id = txbuf_vc2_pop_dg(inum);
-                if (elem_id >= 0) {
+        }
+        
+        /*** Check injection rate ***/
+        if (estimated_nsec > current_nsec) {
+            estimated_nsec += tx_bytes * 8000ULL / NETWORK_BANDWIDTH;
+            return;
+        }
+        
+        /*** Retransmit datagram ***/
+        
+        pos = retx_head;
+        check = 0;
+        while (pos >= 0) {
+            if (retx_list[pos].time > current_nsec) break;
+            next = retx_list[pos].next;
+            inum = retx_list_pos_inum(pos);
+            vc = retx_list_pos_vc(pos);
+            elem_id = retx_list_pos_elem_id(pos);
+            if (vc == 2) {
+                if ((check & 4) == 0) {
                     sock = pfds[inum].fd;
                     dgp = (dg_union*)txbuf[inum].vc2.list[elem_id].dg;
                     len = 20;
                     send_to = txbuf[inum].vc2.list[elem_id].send_to;
                     dgp->end.ser = inc_ser(inum, 2);
-                    dgp->end.seq = inc_seq(&seq_table[inum * NUM_PROCS + send_to].txseq2);
                     addr.sin_family = AF_INET;
                     addr.sin_port = PORT_TABLE[send_to];
                     addr.sin_addr.s_addr = ADDR_TABLE[send_to];
-                    debug printf("rank %d - transport Transmit END from = %d, to = %d, ser = 0x%04x, seq = 0x%04x, cqp = 0x%016" PRIx64 "\n", MY_RANK, dgp->end.rank, send_to, dgp->end.ser, dgp->end.seq, dgp->end.ptr);
-                    sendto(sock, (void*)dgp, (ssize_t)len, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
+                    transmit_dg(sock, (void*)dgp, len, &addr, send_to);
+                    iacpbl_stats_write_begin(&stats_seq);
+                    stats.retransmits++;
+                    iacpbl_stats_write_end(&stats_seq);
                     tx_bytes += dg_biased_size(len);
-                    txbuf_vc2_push_wait(inum, elem_id);
                     tmp_nsec = get_nsec();
+                    delete_retx_entry(pos);
+                    insert_retx_time(pos, tmp_nsec + rtt_pred(send_to, 2));
                     set_txtime(inum, 2, dgp->end.ser, tmp_nsec);
-                    insert_retx_time(retx_list_pos(inum, 2, elem_id), tmp_nsec + rtt_pred(send_to, 2));
-                    break;
+                    check |= 4;
                 }
-            }
-            
-            /* VC1 */
-            for (i = 0; i < NODE_POP; i++) {
-                inum = tx_vc1_next_inum;
-                tx_vc1_next_inum = (tx_vc1_next_inum < NODE_POP - 1) ? tx_vc1_next_inum + 1 : 0;
-                elem_id = txbuf_vc1_pop_dg(inum);
-                if (elem_id >= 0) {
+            } else if (vc == 1) {
+                if ((check & 2) == 0) {
                     sock = pfds[inum].fd;
                     dgp = (dg_union*)txbuf[inum].vc1.list[elem_id].dg;
                     len = 24 + dgp->put.len;
                     send_to = txbuf[inum].vc1.list[elem_id].send_to;
                     dgp->put.ser = inc_ser(inum, 1);
-                    dgp->put.seq = inc_seq(&seq_table[inum * NUM_PROCS + send_to].txseq1);
                     addr.sin_family = AF_INET;
                     addr.sin_port = PORT_TABLE[send_to];
                     addr.sin_addr.s_addr = ADDR_TABLE[send_to];
-                    debug printf("rank %d - transport Transmit PUT from = %d, to = %d, ser = 0x%04x, seq = 0x%04x, dst = 0x%016" PRIx64 ", len = %d\n", MY_RANK, dgp->put.rank, send_to, dgp->put.ser, dgp->put.seq, dgp->put.dst, dgp->put.len);
-                    sendto(sock, (void*)dgp, (ssize_t)len, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
+                    transmit_dg(sock, (void*)dgp, len, &addr, send_to);
+                    iacpbl_stats_write_begin(&stats_seq);
+                    stats.retransmits++;
+                    iacpbl_stats_write_end(&stats_seq);
                     tx_bytes += dg_biased_size(len);
-                    txbuf_vc1_push_wait(inum, elem_id);
                     tmp_nsec = get_nsec();
+                    delete_retx_entry(pos);
+                    insert_retx_time(pos, tmp_nsec + rtt_pred(send_to, 1));
                     set_txtime(inum, 1, dgp->put.ser, tmp_nsec);
-                    insert_retx_time(retx_list_pos(inum, 1, elem_id), tmp_nsec + rtt_pred(send_to, 1));
-                    break;
+                    check |= 2;
                 }
-            }
-            
-            /* VC0 */
-            for (i = 0; i < NODE_POP; i++) {
-                inum = tx_vc0_next_inum;
-                tx_vc0_next_inum = (tx_vc0_next_inum < NODE_POP - 1) ? tx_vc0_next_inum + 1 : 0;
-                elem_id = txbuf_vc0_pop_dg(inum);
-                if (elem_id >= 0) {
+            } else { /* vc == 0 */
+                if ((check & 1) == 0) {
                     sock = pfds[inum].fd;
                     dgp = (dg_union*)txbuf[inum].vc0.list[elem_id].dg;
                     len = dg_size_vc0(dgp->copy.type);
                     send_to = txbuf[inum].vc0.list[elem_id].send_to;
                     dgp->copy.ser = inc_ser(inum, 0);
-                    dgp->copy.seq = inc_seq(&seq_table[inum * NUM_PROCS + send_to].txseq0);
                     addr.sin_family = AF_INET;
                     addr.sin_port = PORT_TABLE[send_to];
                     addr.sin_addr.s_addr = ADDR_TABLE[send_to];
-                    debug printf("rank %d - transport Transmit COMMAND %d from = %d, to = %d, ser = 0x%04x, seq = 0x%04x, ptr = 0x%016" PRIx64 ", s = %d, dst = 0x%016" PRIx64 ", dst = 0x%016" PRIx64 "\n", MY_RANK, dgp->copy.type, dgp->copy.rank, send_to, dgp->copy.ser, dgp->copy.seq, dgp->copy.ptr, dgp->copy.s, dgp->copy.dst, dgp->copy.src);
-                    sendto(sock, (void*)dgp, (ssize_t)len, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
+                    transmit_dg(sock, (void*)dgp, len, &addr, send_to);
+                    iacpbl_stats_write_begin(&stats_seq);
+                    stats.retransmits++;
+                    iacpbl_stats_write_end(&stats_seq);
                     tx_bytes += dg_biased_size(len);
-                    txbuf_vc0_push_wait(inum, elem_id);
                     tmp_nsec = get_nsec();
+                    delete_retx_entry(pos);
+                    insert_retx_time(pos, tmp_nsec + rtt_pred(send_to, 0));
                     set_txtime(inum, 0, dgp->copy.ser, tmp_nsec);
-                    insert_retx_time(retx_list_pos(inum, 0, elem_id), tmp_nsec + rtt_pred(send_to, 0));
-                    break;
+                    check |= 1;
                 }
             }
-            
-            /* Update estimated time */
-            estimated_nsec = current_nsec + tx_bytes * 8000ULL / NETWORK_BANDWIDTH;
+            if (check == 7) break;
+            pos = next;
         }
         
-        /******** Protocol processing ********/
-        
-        /*** Recieve VC2 and Complete commands ***/
+        /*** Check injection rate ***/
+        if (estimated_nsec > current_nsec) {
+            estimated_nsec += tx_bytes * 8000ULL / NETWORK_BANDWIDTH;
+            return;
+        }
         
-        pthread_mutex_lock(&doorbell[MY_INUM].mutex);
+        /*** Transmit datagram ***/
         
-        /* Receive END: ibuf and rxbuf vc2 */
-        for (inum = 0; inum < NODE_POP; inum++) {
-            while ((elem_id = ibuf_vc2_pop_dg(inum)) >= 0) {
-                dgp = (dg_union*)ibuf[ibuf_pos(MY_INUM, inum)].vc2.list[elem_id].dg;
-                pos = dgp->end.ptr & MASK_CQ;
-                /* if (cq[pos].stat != CQSTAT_WAIT) exception; */
-                cq[pos].stat = CQSTAT_DONE;
-                ibuf_vc2_push_free(inum, elem_id);
-            }
-        }
-        if (NUM_PROCS != NODE_POP) {
-            while ((elem_id = rxbuf_vc2_pop_dg()) >= 0) {
-                dgp = (dg_union*)rxbuf[MY_INUM].list[elem_id].dg;
-                pos = dgp->end.ptr & MASK_CQ;
-                /* if (cq[pos].stat != CQSTAT_WAIT) exception; */
-                cq[pos].stat = CQSTAT_DONE;
-                rxbuf_push_free(MY_INUM, elem_id);
+        /* VC2 */
+        for (i = 0; i < NODE_POP; i++) {
+            inum = tx_vc2_next_inum;
+            tx_vc2_next_inum = (tx_vc2_next_inum < NODE_POP - 1) ? tx_vc2_next_inum + 1 : 0;
+            elem_id = txbuf_vc2_pop_dg(inum);
+            if (elem_id >= 0) {
+                sock = pfds[inum].fd;
+                dgp = (dg_union*)txbuf[inum].vc2.list[elem_id].dg;
+                len = 20;
+                send_to = txbuf[inum].vc2.list[elem_id].send_to;
+                dgp->end.ser = inc_ser(inum, 2);
+                dgp->end.seq = inc_seq(&seq_table[inum * NUM_PROCS + send_to].txseq2);
+                addr.sin_family = AF_INET;
+                addr.sin_port = PORT_TABLE[send_to];
+                addr.sin_addr.s_addr = ADDR_TABLE[send_to];
+                debug printf("rank %d - transport Transmit END from = %d, to = %d, ser = 0x%04x, seq = 0x%04x, cqp = 0x%016" PRIx64 "\n", MY_RANK, dgp->end.rank, send_to, dgp->end.ser, dgp->end.seq, dgp->end.ptr);
+                transmit_dg(sock, (void*)dgp, len, &addr, send_to);
+                tx_bytes += dg_biased_size(len);
+                txbuf_vc2_push_wait(inum, elem_id);
+                tmp_nsec = get_nsec();
+                set_txtime(inum, 2, dgp->end.ser, tmp_nsec);
+                insert_retx_time(retx_list_pos(inum, 2, elem_id), tmp_nsec + rtt_pred(send_to, 2));
+                break;
             }
         }
         
-        /* Advance completion pointer */
-        pthread_mutex_lock(&mutex_cq);
-        while(cqcp < cqxp) {
-            p = cqcp & MASK_CQ;
-            if (cq[p].stat != CQSTAT_DONE) break;
-            cqcp++;
-            debug printf("rank %d - protocol cqcp advance to 0x%016" PRIx64 " (cqwp 0x%016" PRIx64 ")\n", MY_RANK, cqcp, cqwp);
+        /* VC1 */
+        for (i = 0; i < NODE_POP; i++) {
+            inum = tx_vc1_next_inum;
+            tx_vc1_next_inum = (tx_vc1_next_inum < NODE_POP - 1) ? tx_vc1_next_inum + 1 : 0;
+            elem_id = txbuf_vc1_pop_dg(inum);
+            if (elem_id >= 0) {
+                sock = pfds[inum].fd;
+                dgp = (dg_union*)txbuf[inum].vc1.list[elem_id].dg;
+                len = 24 + dgp->put.len;
+                send_to = txbuf[inum].vc1.list[elem_id].send_to;
+                dgp->put.ser = inc_ser(inum, 1);
+                dgp->put.seq = inc_seq(&seq_table[inum * NUM_PROCS + send_to].txseq1);
+                addr.sin_family = AF_INET;
+                addr.sin_port = PORT_TABLE[send_to];
+                addr.sin_addr.s_addr = ADDR_TABLE[send_to];
+                debug printf("rank %d - transport Transmit PUT from = %d, to = %d, ser = 0x%04x, seq = 0x%04x, dst = 0x%016" PRIx64 ", len = %d\n", MY_RANK, dgp->put.rank, send_to, dgp->put.ser, dgp->put.seq, dgp->put.dst, dgp->put.len);
+                transmit_dg(sock, (void*)dgp, len, &addr, send_to);
+                tx_bytes += dg_biased_size(len);
+                txbuf_vc1_push_wait(inum, elem_id);
+                tmp_nsec = get_nsec();
+                set_txtime(inum, 1, dgp->put.ser, tmp_nsec);
+                insert_retx_time(retx_list_pos(inum, 1, elem_id), tmp_nsec + rtt_pred(send_to, 1));
+                break;
+            }
         }
-        pthread_mutex_unlock(&mutex_cq);
         
-        /* Check empty */
-        if (MY_INUM > 0 && (check_clear = is_dq_empty())) {
-            /* Check rxbuf */
-            if (NUM_PROCS != NODE_POP) {
-                if (rxbuf[MY_INUM].vc0.dg.head >= 0) check_clear = 0;
-                if (rxbuf[MY_INUM].vc1.dg.head >= 0) check_clear = 0;
-            }
-            
-            /* Check ibuf */
-            pos = NODE_POP * MY_INUM;
-            for (i = 0 ; i < NODE_POP; i++) {
-                if (ibuf[pos].vc0.dg.head >= 0) check_clear = 0;
-                if (ibuf[pos].vc1.dg.head >= 0) check_clear = 0;
-                pos++;
-            }
-            
-            /* Check command queue */
-            pthread_mutex_lock(&mutex_cq);
-            if (cqcp < cqwp) check_clear = 0;
-            pthread_mutex_unlock(&mutex_cq);
-            
-            /* Wait and redo if it is clear */
-            if (check_clear) {
-                doorbell_wait();
-                pthread_mutex_unlock(&doorbell[MY_INUM].mutex);
-                continue;
+        /* VC0 */
+        for (i = 0; i < NODE_POP; i++) {
+            inum = tx_vc0_next_inum;
+            tx_vc0_next_inum = (tx_vc0_next_inum < NODE_POP - 1) ? tx_vc0_next_inum + 1 : 0;
+            elem_id = txbuf_vc0_pop_dg(inum);
+            if (elem_id >= 0) {
+                sock = pfds[inum].fd;
+                dgp = (dg_union*)txbuf[inum].vc0.list[elem_id].dg;
+                len = dg_size_vc0(dgp->copy.type);
+                send_to = txbuf[inum].vc0.list[elem_id].send_to;
+                dgp->copy.ser = inc_ser(inum, 0);
+                dgp->copy.seq = inc_seq(&seq_table[inum * NUM_PROCS + send_to].txseq0);
+                addr.sin_family = AF_INET;
+                addr.sin_port = PORT_TABLE[send_to];
+                addr.sin_addr.s_addr = ADDR_TABLE[send_to];
+                debug printf("rank %d - transport Transmit COMMAND %d from = %d, to = %d, ser = 0x%04x, seq = 0x%04x, ptr = 0x%016" PRIx64 ", s = %d, dst = 0x%016" PRIx64 ", dst = 0x%016" PRIx64 "\n", MY_RANK, dgp->copy.type, dgp->copy.rank, send_to, dgp->copy.ser, dgp->copy.seq, dgp->copy.ptr, dgp->copy.s, dgp->copy.dst, dgp->copy.src);
+                transmit_dg(sock, (void*)dgp, len, &addr, send_to);
+                tx_bytes += dg_biased_size(len);
+                txbuf_vc0_push_wait(inum, elem_id);
+                tmp_nsec = get_nsec();
+                set_txtime(inum, 0, dgp->copy.ser, tmp_nsec);
+                insert_retx_time(retx_list_pos(inum, 0, elem_id), tmp_nsec + rtt_pred(send_to, 0));
+                break;
             }
         }
-        pthread_mutex_unlock(&doorbell[MY_INUM].mutex);
         
-        /*** Receive VC1 and Execute PUT ***/
+        /* Update estimated time */
+        estimated_nsec = current_nsec + tx_bytes * 8000ULL / NETWORK_BANDWIDTH;
+    }
+    
+    /******** Protocol processing ********/
+    
+    /*** Recieve VC2 and Complete commands ***/
+    
+    pthread_mutex_lock(&doorbell[MY_INUM].mutex);
+    
+    /* Receive END: ibuf and rxbuf vc2 */
+    for (inum = 0; inum < NODE_POP; inum++) {
+        while ((elem_id = ibuf_vc2_pop_dg(inum)) >= 0) {
+            dgp = (dg_union*)ibuf[ibuf_pos(MY_INUM, inum)].vc2.list[elem_id].dg;
+            /* if (cq_entry(dgp->end.ptr)->stat != CQSTAT_WAIT) exception; */
+            cq_entry(dgp->end.ptr)->stat = CQSTAT_DONE;
+            ibuf_vc2_push_free(inum, elem_id);
+        }
+    }
+    if (NUM_PROCS != NODE_POP) {
+        while ((elem_id = rxbuf_vc2_pop_dg()) >= 0) {
+            dgp = (dg_union*)rxbuf[MY_INUM].list[elem_id].dg;
+            /* if (cq_entry(dgp->end.ptr)->stat != CQSTAT_WAIT) exception; */
+            cq_entry(dgp->end.ptr)->stat = CQSTAT_DONE;
+            rxbuf_push_free(MY_INUM, elem_id);
+        }
+    }
+    
+    /* Advance completion pointers */
+    num_cq = num_cqs;
+    sync_synchronize();
+    for (i = 0; i < num_cq; i++) {
+        q = cqs[i];
+        pthread_mutex_lock(&q->mutex);
+        while(q->cqcp < q->cqxp) {
+            p = q->cqcp & MASK_CQ;
+            if (q->cq[p].stat != CQSTAT_DONE) break;
+            iacpbl_stats_record(&q->op[q->cq[p].type], get_nsec() - q->cq[p].issue_nsec);
+            IACPBL_TRACE(IACPBL_TRACE_ASYNC_END, "gma", iacpbl_trace_gma_name[q->cq[p].type], q->cq[p].ptr, 0);
+            q->cqcp++;
+            debug printf("rank %d - protocol cq %d cqcp advance to 0x%016" PRIx64 " (cqwp 0x%016" PRIx64 ")\n", MY_RANK, i, q->cqcp, q->cqwp);
+        }
+        pthread_mutex_unlock(&q->mutex);
+    }
+    
+    /* Check empty */
+    if (MY_INUM > 0 && (check_clear = is_dq_empty())) {
+        /* Check rxbuf */
+        if (NUM_PROCS != NODE_POP) {
+            if (rxbuf[MY_INUM].vc0.dg.head >= 0) check_clear = 0;
+            if (rxbuf[MY_INUM].vc1.dg.head >= 0) check_clear = 0;
+        }
         
-        /* Receive a datagram: ibuf and rxbuf vc1 */
-        if (NUM_PROCS != NODE_POP) check_not_full = rxbuf_vc1ack_is_not_full(MY_INUM);
-        if (MY_INUM > 0) pthread_mutex_lock(&doorbell[MY_INUM].mutex);
-        for (i = 0; i < NODE_POP + 1; i++) {
-            if (rx_vc1_next_inum == NODE_POP) {
-                if (NUM_PROCS == NODE_POP)
-                    elem_id = -1;
-                else if (check_not_full)
-                    elem_id = rxbuf_vc1_pop_dg();
-                else
-                    elem_id = -1;
-            } else
-                elem_id = ibuf_vc1_pop_dg(rx_vc1_next_inum);
-            if (elem_id >= 0) break;
-            rx_vc1_next_inum = (rx_vc1_next_inum < NODE_POP) ? rx_vc1_next_inum + 1 : 0;
+        /* Check ibuf */
+        pos = NODE_POP * MY_INUM;
+        for (i = 0 ; i < NODE_POP; i++) {
+            if (ibuf[pos].vc0.dg.head >= 0) check_clear = 0;
+            if (ibuf[pos].vc1.dg.head >= 0) check_clear = 0;
+            pos++;
         }
-        if (MY_INUM > 0) pthread_mutex_unlock(&doorbell[MY_INUM].mutex);
         
-        if (elem_id >= 0) {
-            if (rx_vc1_next_inum == NODE_POP) {
-                dgp = (dg_union*)rxbuf[MY_INUM].list[elem_id].dg;
-                memcpy(ga2address(dgp->put.dst), (void*)dgp->put.data, dgp->put.len);
-                rxbuf_push_free_vc1ack(MY_INUM, elem_id);
-            } else {
-                dgp = (dg_union*)ibuf[ibuf_pos(MY_INUM, rx_vc1_next_inum)].vc1.list[elem_id].dg;
-                memcpy(ga2address(dgp->put.dst), (void*)dgp->put.data, dgp->put.len);
-                ibuf_vc1_push_free(rx_vc1_next_inum, elem_id);
-            }
-            rx_vc1_next_inum = (rx_vc1_next_inum + 1 < NODE_POP) ? rx_vc1_next_inum + 1 : 0;
+        /* Check command queues */
+        for (i = 0; i < num_cq; i++) {
+            q = cqs[i];
+            pthread_mutex_lock(&q->mutex);
+            if (q->cqcp < q->cqwp) check_clear = 0;
+            pthread_mutex_unlock(&q->mutex);
         }
         
-        /*** Delegate Queue ***/
+        /* Check bulk transfers being received */
+        if (bulk_rx_active) check_clear = 0;
         
-        /* Sweep txbuf vc1 ack */
-        if (NUM_PROCS != NODE_POP) {
-            while ((elem_id = txbuf_vc1_pop_ack()) >= 0) {
-                if ((pos = txbuf[MY_INUM].vc1.list[elem_id].dq_pos) >= 0) {
-                    /* if (dq[pos].stat != DQSTAT_WAIT) exception */
-                    if (dq[pos].rank != MY_RANK) {
-                        dq[pos].stat = DQSTAT_NOTIFY;
-                        dq[pos].inum = INUM_TABLE[dq[pos].rank];
-                        dq[pos].gateway = GTWY_TABLE[dq[pos].rank];
-                    } else { /* dq[pos].rank == MY_RANK */
-                        /* Notify completion directly to the corresponding CQ entry */
-                        p = dq[pos].ptr & MASK_CQ;
-                        cq[p].stat = CQSTAT_DONE;
-                        dq_free(pos);
-                    }
+        /* Wait and redo if it is clear */
+        if (check_clear) {
+            if (!progress_inline) doorbell_wait();
+            pthread_mutex_unlock(&doorbell[MY_INUM].mutex);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&doorbell[MY_INUM].mutex);
+    
+    /*** Receive VC1 and Execute PUT ***/
+    
+    /* Receive a datagram: ibuf and rxbuf vc1 */
+    if (NUM_PROCS != NODE_POP) check_not_full = rxbuf_vc1ack_is_not_full(MY_INUM);
+    if (MY_INUM > 0) pthread_mutex_lock(&doorbell[MY_INUM].mutex);
+    for (i = 0; i < NODE_POP + 1; i++) {
+        if (rx_vc1_next_inum == NODE_POP) {
+            if (NUM_PROCS == NODE_POP)
+                elem_id = -1;
+            else if (check_not_full)
+                elem_id = rxbuf_vc1_pop_dg();
+            else
+                elem_id = -1;
+        } else
+            elem_id = ibuf_vc1_pop_dg(rx_vc1_next_inum);
+        if (elem_id >= 0) break;
+        rx_vc1_next_inum = (rx_vc1_next_inum < NODE_POP) ? rx_vc1_next_inum + 1 : 0;
+    }
+    if (MY_INUM > 0) pthread_mutex_unlock(&doorbell[MY_INUM].mutex);
+    
+    if (elem_id >= 0) {
+        if (rx_vc1_next_inum == NODE_POP) {
+            dgp = (dg_union*)rxbuf[MY_INUM].list[elem_id].dg;
+            iacpbl_copy_dg(ga2address(dgp->put.dst), (void*)dgp->put.data, dgp->put.len, MAX_DATA_SIZE);
+            rxbuf_push_free_vc1ack(MY_INUM, elem_id);
+        } else {
+            dgp = (dg_union*)ibuf[ibuf_pos(MY_INUM, rx_vc1_next_inum)].vc1.list[elem_id].dg;
+            iacpbl_copy_dg(ga2address(dgp->put.dst), (void*)dgp->put.data, dgp->put.len, MAX_DATA_SIZE);
+            ibuf_vc1_push_free(rx_vc1_next_inum, elem_id);
+        }
+        rx_vc1_next_inum = (rx_vc1_next_inum + 1 < NODE_POP) ? rx_vc1_next_inum + 1 : 0;
+    }
+    
+    /*** Delegate Queue ***/
+    
+    /* Receive bulk transfers and their acks */
+    if (bulk_listen >= 0) bulk_progress();
+    
+    /* Sweep txbuf vc1 ack */
+    if (NUM_PROCS != NODE_POP) {
+        while ((elem_id = txbuf_vc1_pop_ack()) >= 0) {
+            if ((pos = txbuf[MY_INUM].vc1.list[elem_id].dq_pos) >= 0) {
+                /* if (dq[pos].stat != DQSTAT_WAIT) exception */
+                if (dq[pos].rank != MY_RANK) {
+                    dq[pos].stat = DQSTAT_NOTIFY;
+                    dq[pos].inum = INUM_TABLE[dq[pos].rank];
+                    dq[pos].gateway = GTWY_TABLE[dq[pos].rank];
+                } else { /* dq[pos].rank == MY_RANK */
+                    /* Notify completion directly to the corresponding CQ entry */
+                    cq_entry(dq[pos].ptr)->stat = CQSTAT_DONE;
+                    dq_free(pos);
                 }
-                txbuf_vc1_push_free(elem_id);
-                debug printf("rank %d - protocol dq[%d] got ack from txbuf vc1 ack\n", MY_RANK, pos);
             }
+            txbuf_vc1_push_free(elem_id);
+            debug printf("rank %d - protocol dq[%d] got ack from txbuf vc1 ack\n", MY_RANK, pos);
         }
-        
-        /* Check waiting entries */
-        check_wait = 0;
-        if (is_dq_not_empty()) {
-            pos = dqhead;
-            while (pos != dqexec) {
-                next = dqnext[pos];
-                if (dq[pos].stat == DQSTAT_WAIT) {
-                    check_wait |= 2;
-                    if (dq[pos].gateway == MY_GATEWAY) {
-                        if (ibuf_vc1_free_ack_count(dq[pos].inum) >= dqwait[pos]) {
-                            debug printf("rank %d - protocol dq[%d] got ack from ibuf inum =%d vc1 ack_count = %d\n", MY_RANK, pos, dq[pos].inum, dqwait[pos]);
-                            if (dq[pos].rank != MY_RANK) {
-                                dq[pos].stat = DQSTAT_NOTIFY;
-                                dq[pos].inum = INUM_TABLE[dq[pos].rank];
-                                dq[pos].gateway = GTWY_TABLE[dq[pos].rank];
-                            } else { /* dq[pos].rank == MY_RANK */
-                                /* Notify completion directly to the corresponding CQ entry */
-                                p = dq[pos].ptr & MASK_CQ;
-                                cq[p].stat = CQSTAT_DONE;
-                                dq_free(pos);
-                            }
-                            check_wait--;
+    }
+    
+    /* Check waiting entries */
+    check_wait = 0;
+    if (is_dq_not_empty()) {
+        pos = dqhead;
+        while (pos != dqexec) {
+            next = dqnext[pos];
+            if (dq[pos].stat == DQSTAT_WAIT) {
+                check_wait |= 2;
+                if (dq[pos].gateway == MY_GATEWAY) {
+                    if (ibuf_vc1_free_ack_count(dq[pos].inum) >= dqwait[pos]) {
+                        debug printf("rank %d - protocol dq[%d] got ack from ibuf inum =%d vc1 ack_count = %d\n", MY_RANK, pos, dq[pos].inum, dqwait[pos]);
+                        if (dq[pos].rank != MY_RANK) {
+                            dq[pos].stat = DQSTAT_NOTIFY;
+                            dq[pos].inum = INUM_TABLE[dq[pos].rank];
+                            dq[pos].gateway = GTWY_TABLE[dq[pos].rank];
+                        } else { /* dq[pos].rank == MY_RANK */
+                            /* Notify completion directly to the corresponding CQ entry */
+                            cq_entry(dq[pos].ptr)->stat = CQSTAT_DONE;
+                            dq_free(pos);
                         }
+                        check_wait--;
                     }
-                    check_wait >>= 1;
                 }
-                if (dq[pos].stat == DQSTAT_NOTIFY) {
-                    if (dq[pos].gateway == MY_GATEWAY) {
-                        elem_id = ibuf_vc2_pop_free(dq[pos].inum);
-                        if (elem_id >= 0) {
-                            dgp = (dg_union*)ibuf[ibuf_pos(dq[pos].inum, MY_INUM)].vc2.list[elem_id].dg;
-                            dgp->end.task = TASKID;
-                            dgp->end.c    = NORMAL;
-                            dgp->end.vc   = 2;
-                            dgp->end.rank = MY_RANK;
-                            dgp->end.ptr  = dq[pos].ptr;
-                            ibuf_vc2_push_dg(dq[pos].inum, elem_id);
-                            dq_free(pos);
-                       }
-                    } else { /* dq[pos].gateway != MY_GATEWAY */
-                        elem_id = txbuf_vc2_pop_free();
-                        if (elem_id >= 0) {
-                            txbuf[MY_INUM].vc2.list[elem_id].send_to = dq[pos].rank;
-                            dgp = (dg_union*)txbuf[MY_INUM].vc2.list[elem_id].dg;
-                            dgp->end.task = TASKID;
-                            dgp->end.c    = NORMAL;
-                            dgp->end.vc   = 2;
-                            dgp->end.rank = MY_RANK;
-                            dgp->end.ptr  = dq[pos].ptr;
-                            txbuf_vc2_push_dg(elem_id);
-                            dq_free(pos);
-                        }
+                check_wait >>= 1;
+            }
+            if (dq[pos].stat == DQSTAT_NOTIFY) {
+                if (dq[pos].gateway == MY_GATEWAY) {
+                    elem_id = ibuf_vc2_pop_free(dq[pos].inum);
+                    if (elem_id >= 0) {
+                        dgp = (dg_union*)ibuf[ibuf_pos(dq[pos].inum, MY_INUM)].vc2.list[elem_id].dg;
+                        dgp->end.task = TASKID;
+                        dgp->end.c    = NORMAL;
+                        dgp->end.vc   = 2;
+                        dgp->end.rank = MY_RANK;
+                        dgp->end.ptr  = dq[pos].ptr;
+                        ibuf_vc2_push_dg(dq[pos].inum, elem_id);
+                        dq_free(pos);
+                   }
+                } else { /* dq[pos].gateway != MY_GATEWAY */
+                    elem_id = txbuf_vc2_pop_free();
+                    if (elem_id >= 0) {
+                        txbuf[MY_INUM].vc2.list[elem_id].send_to = dq[pos].rank;
+                        dgp = (dg_union*)txbuf[MY_INUM].vc2.list[elem_id].dg;
+                        dgp->end.task = TASKID;
+                        dgp->end.c    = NORMAL;
+                        dgp->end.vc   = 2;
+                        dgp->end.rank = MY_RANK;
+                        dgp->end.ptr  = dq[pos].ptr;
+                        txbuf_vc2_push_dg(elem_id);
+                        dq_free(pos);
                     }
                 }
-                pos = next;
             }
+            pos = next;
         }
-        
-        if (is_dq_not_empty() && dqexec >= 0) {
-            /* Process a command */
-            pos = dqexec;
-            if (dq[pos].stat == DQSTAT_FENCE && check_wait == 0) dq[pos].stat = DQSTAT_ACTIVE;
-            if (dq[pos].stat == DQSTAT_ACTIVE) {
-                if (dq[pos].inum == MY_INUM && dq[pos].gateway == MY_GATEWAY) {
-                    /* Execute a command directly at remote */
+    }
+    
+    if (is_dq_not_empty() && dqexec >= 0) {
+        /* Process a command */
+        pos = dqexec;
+        if (dq[pos].stat == DQSTAT_FENCE && check_wait == 0) dq[pos].stat = DQSTAT_ACTIVE;
+        if (dq[pos].stat == DQSTAT_ACTIVE) {
+            if (dq[pos].inum == MY_INUM && dq[pos].gateway == MY_GATEWAY) {
+                /* Execute a command directly at remote */
+                type = dq[pos].type;
+                if (type == COPY) {
+                    iacpbl_copy(ga2address(dq[pos].dst), ga2address(dq[pos].src), dq[pos].size);
+                } else if (type == CAS4) {
+                    *(uint32_t*)ga2address(dq[pos].dst) = sync_val_compare_and_swap_4((uint32_t*)ga2address(dq[pos].src), dq[pos].old4, dq[pos].new4);
+                } else if (type == CAS8) {
+                    dgp->put.len = 8;
+                    *(uint64_t*)ga2address(dq[pos].dst) = sync_val_compare_and_swap_8((uint64_t*)ga2address(dq[pos].src), dq[pos].old8, dq[pos].new8);
+                } else if (type == SWAP4) {
+                    dgp->put.len = 4;
+                    *(uint32_t*)ga2address(dq[pos].dst) = sync_swap_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
+                } else if (type == SWAP8) {
+                    dgp->put.len = 8;
+                    *(uint64_t*)ga2address(dq[pos].dst) = sync_swap_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
+                } else if (type == ADD4) {
+                    dgp->put.len = 4;
+                    *(uint32_t*)ga2address(dq[pos].dst) = sync_fetch_and_add_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
+                } else if (type == ADD8) {
+                    dgp->put.len = 8;
+                    *(uint64_t*)ga2address(dq[pos].dst) = sync_fetch_and_add_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
+                } else if (type == XOR4) {
+                    dgp->put.len = 4;
+                    *(uint32_t*)ga2address(dq[pos].dst) = sync_fetch_and_xor_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
+                } else if (type == XOR8) {
+                    dgp->put.len = 8;
+                    *(uint64_t*)ga2address(dq[pos].dst) = sync_fetch_and_xor_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
+                } else if (type == OR4) {
+                    dgp->put.len = 4;
+                    *(uint32_t*)ga2address(dq[pos].dst) = sync_fetch_and_or_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
+                } else if (type == OR8) {
+                    dgp->put.len = 8;
+                    *(uint64_t*)ga2address(dq[pos].dst) = sync_fetch_and_or_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
+                } else if (type == AND4) {
+                    dgp->put.len = 4;
+                    *(uint32_t*)ga2address(dq[pos].dst) = sync_fetch_and_and_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
+                } else { /* type == AND8 */
+                    dgp->put.len = 8;
+                    *(uint64_t*)ga2address(dq[pos].dst) = sync_fetch_and_and_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
+                }
+                debug printf("rank %d - protocol Dq %d local execution dqhead = %d, dqexec = %d, dqtail =%d, dqflnum = %d, ds[%d] stat = %d, rank = %d, ptr = 0x%016" PRIx64 ", type = %d\n", MY_RANK, pos, dqhead, dqexec, dqtail, dqflnum, pos, dq[pos].stat, dq[pos].rank, dq[pos].ptr, dq[pos].type);
+                dq[pos].stat = DQSTAT_NOTIFY;
+                dq[pos].inum = INUM_TABLE[dq[pos].rank];
+                dq[pos].gateway = GTWY_TABLE[dq[pos].rank];
+                dqexec = dqnext[pos];
+                dqoffset = 0;
+            } else if (is_bulk(pos) && (bulk = bulk_send(pos)) >= 0) {
+                /* Stream a large copy over TCP, falling back to datagrams if unreachable */
+                if (bulk) {
+                    debug printf("rank %d - protocol Dq %d wait for bulk ack\n", MY_RANK, pos);
+                    dq[pos].stat = DQSTAT_WAIT;
+                    dqexec = dqnext[pos];
+                    dqoffset = 0;
+                }
+            } else {
+                if (dq[pos].gateway == MY_GATEWAY) {
+                    elem_id = ibuf_vc1_pop_free(dq[pos].inum);
+                    if (elem_id >= 0) dgp = (dg_union*)ibuf[ibuf_pos(dq[pos].inum, MY_INUM)].vc1.list[elem_id].dg;
+                    debug printf("rank %d - protocol Dq %d to ibuf[%d][%d] vc1 elem_id = %d\n", MY_RANK, pos, dq[pos].inum, MY_INUM, elem_id);
+                } else {
+                    elem_id = txbuf_vc1_pop_free();
+                    if (elem_id >= 0) {
+                        txbuf[MY_INUM].vc1.list[elem_id].send_to = ga2rank(dq[pos].dst);
+                        dgp = (dg_union*)txbuf[MY_INUM].vc1.list[elem_id].dg;
+                    }
+                }
+                if (elem_id >= 0) {
+                    dgp->put.task = TASKID;
+                    dgp->put.c    = NORMAL;
+                    dgp->put.vc   = 1;
+                    dgp->put.rank = MY_RANK;
+                    dgp->put.dst  = dq[pos].dst;
+                    check_cont = 0;
                     type = dq[pos].type;
                     if (type == COPY) {
-                        memcpy(ga2address(dq[pos].dst), ga2address(dq[pos].src), dq[pos].size);
+                        size = dq[pos].size - dqoffset;
+                        size = (size < MAX_DATA_SIZE) ? size : MAX_DATA_SIZE;
+                        dgp->put.dst += dqoffset;
+                        dgp->put.len = size;
+                        iacpbl_copy_dg(dgp->put.data, ga2address(dq[pos].src) + dqoffset, size, MAX_DATA_SIZE);
+                        dqoffset += size;
+                        if (dq[pos].size > dqoffset) check_cont = 1;
                     } else if (type == CAS4) {
-                        *(uint32_t*)ga2address(dq[pos].dst) = sync_val_compare_and_swap_4((uint32_t*)ga2address(dq[pos].src), dq[pos].old4, dq[pos].new4);
+                        dgp->put.len = 4;
+                        *(uint32_t*)dgp->put.data = sync_val_compare_and_swap_4((uint32_t*)ga2address(dq[pos].src), dq[pos].old4, dq[pos].new4);
                     } else if (type == CAS8) {
                         dgp->put.len = 8;
-                        *(uint64_t*)ga2address(dq[pos].dst) = sync_val_compare_and_swap_8((uint64_t*)ga2address(dq[pos].src), dq[pos].old8, dq[pos].new8);
+                        *(uint64_t*)dgp->put.data = sync_val_compare_and_swap_8((uint64_t*)ga2address(dq[pos].src), dq[pos].old8, dq[pos].new8);
                     } else if (type == SWAP4) {
                         dgp->put.len = 4;
-                        *(uint32_t*)ga2address(dq[pos].dst) = sync_swap_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
+                        *(uint32_t*)dgp->put.data = sync_swap_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
                     } else if (type == SWAP8) {
                         dgp->put.len = 8;
-                        *(uint64_t*)ga2address(dq[pos].dst) = sync_swap_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
+                        *(uint64_t*)dgp->put.data = sync_swap_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
                     } else if (type == ADD4) {
                         dgp->put.len = 4;
-                        *(uint32_t*)ga2address(dq[pos].dst) = sync_fetch_and_add_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
+                        *(uint32_t*)dgp->put.data = sync_fetch_and_add_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
                     } else if (type == ADD8) {
                         dgp->put.len = 8;
-                        *(uint64_t*)ga2address(dq[pos].dst) = sync_fetch_and_add_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
+                        *(uint64_t*)dgp->put.data = sync_fetch_and_add_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
                     } else if (type == XOR4) {
                         dgp->put.len = 4;
-                        *(uint32_t*)ga2address(dq[pos].dst) = sync_fetch_and_xor_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
+                        *(uint32_t*)dgp->put.data = sync_fetch_and_xor_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
                     } else if (type == XOR8) {
                         dgp->put.len = 8;
-                        *(uint64_t*)ga2address(dq[pos].dst) = sync_fetch_and_xor_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
+                        *(uint64_t*)dgp->put.data = sync_fetch_and_xor_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
                     } else if (type == OR4) {
                         dgp->put.len = 4;
-                        *(uint32_t*)ga2address(dq[pos].dst) = sync_fetch_and_or_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
+                        *(uint32_t*)dgp->put.data = sync_fetch_and_or_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
                     } else if (type == OR8) {
                         dgp->put.len = 8;
-                        *(uint64_t*)ga2address(dq[pos].dst) = sync_fetch_and_or_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
+                        *(uint64_t*)dgp->put.data = sync_fetch_and_or_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
                     } else if (type == AND4) {
                         dgp->put.len = 4;
-                        *(uint32_t*)ga2address(dq[pos].dst) = sync_fetch_and_and_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
+                        *(uint32_t*)dgp->put.data = sync_fetch_and_and_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
                     } else { /* type == AND8 */
                         dgp->put.len = 8;
-                        *(uint64_t*)ga2address(dq[pos].dst) = sync_fetch_and_and_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
+                        *(uint64_t*)dgp->put.data = sync_fetch_and_and_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
                     }
-                    debug printf("rank %d - protocol Dq %d local execution dqhead = %d, dqexec = %d, dqtail =%d, dqflnum = %d, ds[%d] stat = %d, rank = %d, ptr = 0x%016" PRIx64 ", type = %d\n", MY_RANK, pos, dqhead, dqexec, dqtail, dqflnum, pos, dq[pos].stat, dq[pos].rank, dq[pos].ptr, dq[pos].type);
-                    dq[pos].stat = DQSTAT_NOTIFY;
-                    dq[pos].inum = INUM_TABLE[dq[pos].rank];
-                    dq[pos].gateway = GTWY_TABLE[dq[pos].rank];
-                    dqexec = dqnext[pos];
-                    dqoffset = 0;
-                } else {
-                    if (dq[pos].gateway == MY_GATEWAY) {
-                        elem_id = ibuf_vc1_pop_free(dq[pos].inum);
-                        if (elem_id >= 0) dgp = (dg_union*)ibuf[ibuf_pos(dq[pos].inum, MY_INUM)].vc1.list[elem_id].dg;
-                        debug printf("rank %d - protocol Dq %d to ibuf[%d][%d] vc1 elem_id = %d\n", MY_RANK, pos, dq[pos].inum, MY_INUM, elem_id);
-                    } else {
-                        elem_id = txbuf_vc1_pop_free();
-                        if (elem_id >= 0) {
-                            txbuf[MY_INUM].vc1.list[elem_id].send_to = ga2rank(dq[pos].dst);
-                            dgp = (dg_union*)txbuf[MY_INUM].vc1.list[elem_id].dg;
+                    if (check_cont) {
+                        if (dq[pos].gateway == MY_GATEWAY) {
+                            ibuf_vc1_push_dg(dq[pos].inum, elem_id);
+                        } else {
+                            txbuf[MY_INUM].vc1.list[elem_id].dq_pos = -1;
+                            txbuf_vc1_push_dg(elem_id);
                         }
-                    }
-                    if (elem_id >= 0) {
-                        dgp->put.task = TASKID;
-                        dgp->put.c    = NORMAL;
-                        dgp->put.vc   = 1;
-                        dgp->put.rank = MY_RANK;
-                        dgp->put.dst  = dq[pos].dst;
-                        check_cont = 0;
-                        type = dq[pos].type;
-                        if (type == COPY) {
-                            size = dq[pos].size - dqoffset;
-                            size = (size < MAX_DATA_SIZE) ? size : MAX_DATA_SIZE;
-                            dgp->put.dst += dqoffset;
-                            dgp->put.len = size;
-                            memcpy(dgp->put.data, ga2address(dq[pos].src) + dqoffset, size);
-                            dqoffset += size;
-                            if (dq[pos].size > dqoffset) check_cont = 1;
-                        } else if (type == CAS4) {
-                            dgp->put.len = 4;
-                            *(uint32_t*)dgp->put.data = sync_val_compare_and_swap_4((uint32_t*)ga2address(dq[pos].src), dq[pos].old4, dq[pos].new4);
-                        } else if (type == CAS8) {
-                            dgp->put.len = 8;
-                            *(uint64_t*)dgp->put.data = sync_val_compare_and_swap_8((uint64_t*)ga2address(dq[pos].src), dq[pos].old8, dq[pos].new8);
-                        } else if (type == SWAP4) {
-                            dgp->put.len = 4;
-                            *(uint32_t*)dgp->put.data = sync_swap_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
-                        } else if (type == SWAP8) {
-                            dgp->put.len = 8;
-                            *(uint64_t*)dgp->put.data = sync_swap_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
-                        } else if (type == ADD4) {
-                            dgp->put.len = 4;
-                            *(uint32_t*)dgp->put.data = sync_fetch_and_add_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
-                        } else if (type == ADD8) {
-                            dgp->put.len = 8;
-                            *(uint64_t*)dgp->put.data = sync_fetch_and_add_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
-                        } else if (type == XOR4) {
-                            dgp->put.len = 4;
-                            *(uint32_t*)dgp->put.data = sync_fetch_and_xor_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
-                        } else if (type == XOR8) {
-                            dgp->put.len = 8;
-                            *(uint64_t*)dgp->put.data = sync_fetch_and_xor_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
-                        } else if (type == OR4) {
-                            dgp->put.len = 4;
-                            *(uint32_t*)dgp->put.data = sync_fetch_and_or_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
-                        } else if (type == OR8) {
-                            dgp->put.len = 8;
-                            *(uint64_t*)dgp->put.data = sync_fetch_and_or_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
-                        } else if (type == AND4) {
-                            dgp->put.len = 4;
-                            *(uint32_t*)dgp->put.data = sync_fetch_and_and_4((uint32_t*)ga2address(dq[pos].src), dq[pos].val4);
-                        } else { /* type == AND8 */
-                            dgp->put.len = 8;
-                            *(uint64_t*)dgp->put.data = sync_fetch_and_and_8((uint64_t*)ga2address(dq[pos].src), dq[pos].val8);
-                        }
-                        if (check_cont) {
-                            if (dq[pos].gateway == MY_GATEWAY) {
-                                ibuf_vc1_push_dg(dq[pos].inum, elem_id);
-                            } else {
-                                txbuf[MY_INUM].vc1.list[elem_id].dq_pos = -1;
-                                txbuf_vc1_push_dg(elem_id);
-                            }
-                        } else { /* check_cont == 0 */
-                            if (dq[pos].gateway == MY_GATEWAY) {
-                                dqwait[pos] = ibuf_vc1_push_dg(dq[pos].inum, elem_id);
-                                debug printf("rank %d - protocol Dq %d wait for ibuf vc1 ack_count %d\n", MY_RANK, pos, dqwait[pos]);
-                            } else {
-                                txbuf[MY_INUM].vc1.list[elem_id].dq_pos = pos;
-                                txbuf_vc1_push_dg(elem_id);
-                                debug printf("rank %d - protocol Dq %d wait for txbuf vc1 ack\n", MY_RANK, pos);
-                            }
-                            dq[pos].stat = DQSTAT_WAIT;
-                            dqexec = dqnext[pos];
-                            dqoffset = 0;
+                    } else { /* check_cont == 0 */
+                        if (dq[pos].gateway == MY_GATEWAY) {
+                            dqwait[pos] = ibuf_vc1_push_dg(dq[pos].inum, elem_id);
+                            debug printf("rank %d - protocol Dq %d wait for ibuf vc1 ack_count %d\n", MY_RANK, pos, dqwait[pos]);
+                        } else {
+                            txbuf[MY_INUM].vc1.list[elem_id].dq_pos = pos;
+                            txbuf_vc1_push_dg(elem_id);
+                            debug printf("rank %d - protocol Dq %d wait for txbuf vc1 ack\n", MY_RANK, pos);
                         }
+                        dq[pos].stat = DQSTAT_WAIT;
+                        dqexec = dqnext[pos];
+                        dqoffset = 0;
                     }
                 }
             }
         }
-        
-        /* Receive VC0 and Enqueue a new command */
-        if (is_dq_not_full()) {
-            if (MY_INUM > 0) pthread_mutex_lock(&doorbell[MY_INUM].mutex);
-            for (i = 0; i < NODE_POP + 1; i++) {
-                if (rx_vc0_next_inum == NODE_POP)
-                    if (NUM_PROCS != NODE_POP)
-                        elem_id = rxbuf_vc0_pop_dg();
-                    else
-                        elem_id = -1;
+    }
+    
+    /* Receive VC0 and Enqueue a new command */
+    if (is_dq_not_full()) {
+        if (MY_INUM > 0) pthread_mutex_lock(&doorbell[MY_INUM].mutex);
+        for (i = 0; i < NODE_POP + 1; i++) {
+            if (rx_vc0_next_inum == NODE_POP)
+                if (NUM_PROCS != NODE_POP)
+                    elem_id = rxbuf_vc0_pop_dg();
                 else
-                    elem_id = ibuf_vc0_pop_dg(rx_vc0_next_inum);
-                if (elem_id >= 0) break;
-                rx_vc0_next_inum = (rx_vc0_next_inum < NODE_POP) ? rx_vc0_next_inum + 1 : 0;
+                    elem_id = -1;
+            else
+                elem_id = ibuf_vc0_pop_dg(rx_vc0_next_inum);
+            if (elem_id >= 0) break;
+            rx_vc0_next_inum = (rx_vc0_next_inum < NODE_POP) ? rx_vc0_next_inum + 1 : 0;
+        }
+        if (MY_INUM > 0) pthread_mutex_unlock(&doorbell[MY_INUM].mutex);
+        
+        if (elem_id >= 0) {
+            if (rx_vc0_next_inum == NODE_POP)
+                dgp = (dg_union*)rxbuf[MY_INUM].list[elem_id].dg;
+            else
+                dgp = (dg_union*)ibuf[ibuf_pos(MY_INUM, rx_vc0_next_inum)].vc0.list[elem_id].dg;
+            pos = dq_push(dgp->copy.ptr, dgp->copy.rank, dgp->copy.s, dgp->copy.type, dgp->copy.dst, dgp->copy.src);
+            type = dq[pos].type;
+            debug printf("rank %d - protocol Exec dq[%d] dqhead = %d, dqexec = %d, dqtail =%d, dqflnum = %d, from = %d, cqp = 0x%016" PRIx64 " type = %d remote to X\n", MY_RANK, pos, dqhead, dqexec, dqtail, dqflnum, dgp->copy.rank, dgp->copy.ptr, type);
+            if (type == COPY) {
+                dq[pos].size = dgp->copy.size;
+            } else if (type == CAS4) {
+                dq[pos].old4 = dgp->cas4.oldval;
+                dq[pos].new4 = dgp->cas4.newval;
+            } else if (type == CAS8) {
+                dq[pos].old8 = dgp->cas8.oldval;
+                dq[pos].new8 = dgp->cas8.newval;
+            } else if (type == SWAP4) {
+                dq[pos].val4 = dgp->swap4.val;
+            } else if (type == SWAP8) {
+                dq[pos].val8 = dgp->swap8.val;
+            } else if (type == ADD4) {
+                dq[pos].val4 = dgp->add4.val;
+            } else if (type == ADD8) {
+                dq[pos].val8 = dgp->add8.val;
+            } else if (type == XOR4) {
+                dq[pos].val4 = dgp->xor4.val;
+            } else if (type == XOR8) {
+                dq[pos].val8 = dgp->xor8.val;
+            } else if (type == OR4) {
+                dq[pos].val4 = dgp->or4.val;
+            } else if (type == OR8) {
+                dq[pos].val8 = dgp->or8.val;
+            } else if (type == AND4) {
+                dq[pos].val4 = dgp->and4.val;
+            } else { /* type == AND8 */
+                dq[pos].val8 = dgp->and8.val;
             }
-            if (MY_INUM > 0) pthread_mutex_unlock(&doorbell[MY_INUM].mutex);
+            if (rx_vc0_next_inum == NODE_POP)
+                rxbuf_push_free(MY_INUM, elem_id);
+            else
+                ibuf_vc0_push_free(rx_vc0_next_inum, elem_id);
             
-            if (elem_id >= 0) {
-                if (rx_vc0_next_inum == NODE_POP)
-                    dgp = (dg_union*)rxbuf[MY_INUM].list[elem_id].dg;
-                else
-                    dgp = (dg_union*)ibuf[ibuf_pos(MY_INUM, rx_vc0_next_inum)].vc0.list[elem_id].dg;
-                pos = dq_push(dgp->copy.ptr, dgp->copy.rank, dgp->copy.s, dgp->copy.type, dgp->copy.dst, dgp->copy.src);
-                type = dq[pos].type;
-                debug printf("rank %d - protocol Exec dq[%d] dqhead = %d, dqexec = %d, dqtail =%d, dqflnum = %d, from = %d, cqp = 0x%016" PRIx64 " type = %d remote to X\n", MY_RANK, pos, dqhead, dqexec, dqtail, dqflnum, dgp->copy.rank, dgp->copy.ptr, type);
-                if (type == COPY) {
-                    dq[pos].size = dgp->copy.size;
-                } else if (type == CAS4) {
-                    dq[pos].old4 = dgp->cas4.oldval;
-                    dq[pos].new4 = dgp->cas4.newval;
-                } else if (type == CAS8) {
-                    dq[pos].old8 = dgp->cas8.oldval;
-                    dq[pos].new8 = dgp->cas8.newval;
-                } else if (type == SWAP4) {
-                    dq[pos].val4 = dgp->swap4.val;
-                } else if (type == SWAP8) {
-                    dq[pos].val8 = dgp->swap8.val;
-                } else if (type == ADD4) {
-                    dq[pos].val4 = dgp->add4.val;
-                } else if (type == ADD8) {
-                    dq[pos].val8 = dgp->add8.val;
-                } else if (type == XOR4) {
-                    dq[pos].val4 = dgp->xor4.val;
-                } else if (type == XOR8) {
-                    dq[pos].val8 = dgp->xor8.val;
-                } else if (type == OR4) {
-                    dq[pos].val4 = dgp->or4.val;
-                } else if (type == OR8) {
-                    dq[pos].val8 = dgp->or8.val;
-                } else if (type == AND4) {
-                    dq[pos].val4 = dgp->and4.val;
-                } else { /* type == AND8 */
-                    dq[pos].val8 = dgp->and8.val;
-                }
-                if (rx_vc0_next_inum == NODE_POP)
-                    rxbuf_push_free(MY_INUM, elem_id);
-                else
-                    ibuf_vc0_push_free(rx_vc0_next_inum, elem_id);
-                
-                rx_vc0_next_inum = (rx_vc0_next_inum < NODE_POP) ? rx_vc0_next_inum + 1 : 0;
-            }
+            rx_vc0_next_inum = (rx_vc0_next_inum < NODE_POP) ? rx_vc0_next_inum + 1 : 0;
         }
-        
-        /*** Command Queue ***/
-        
-        /* Send a command */
-        pthread_mutex_lock(&mutex_cq);
-        p = cqxp & MASK_CQ;
-        if (cqxp < cqwp && (cq[p].order < cqcp || cq[p].rfence == 1)) {
-            if (cq[p].stat == CQSTAT_11) {
+    }
+    
+    /*** Command Queue ***/
+    
+    /* Send a command from each command queue */
+    for (i = 0; i < num_cq; i++) {
+        q = cqs[i];
+        pthread_mutex_lock(&q->mutex);
+        p = q->cqxp & MASK_CQ;
+        if (q->cqxp < q->cqwp && (q->cq[p].order < q->cqcp || q->cq[p].rfence == 1)) {
+            if (q->cq[p].stat == CQSTAT_11) {
                 /* Execute a command directly at local */
-                debug printf("rank %d - protocol Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, cqxp, cq[p].type, cq[p].order);
-                type = cq[p].type;
+                debug printf("rank %d - protocol Exec cq 0x%016" PRIx64 " type = %d order = 0x%016" PRIx64 " local to local\n", MY_RANK, q->cqxp, q->cq[p].type, q->cq[p].order);
+                type = q->cq[p].type;
                 if (type == COPY)
-                    memcpy(ga2address(cq[p].dst), ga2address(cq[p].src), cq[p].size);
+                    iacpbl_copy(ga2address(q->cq[p].dst), ga2address(q->cq[p].src), q->cq[p].size);
                 else if (type == CAS4)
-                    *(uint32_t*)ga2address(cq[p].dst) = sync_val_compare_and_swap_4((uint32_t*)ga2address(cq[p].src), cq[p].old4, cq[p].new4);
+                    *(uint32_t*)ga2address(q->cq[p].dst) = sync_val_compare_and_swap_4((uint32_t*)ga2address(q->cq[p].src), q->cq[p].old4, q->cq[p].new4);
                 else if (type == CAS8)
-                    *(uint64_t*)ga2address(cq[p].dst) = sync_val_compare_and_swap_8((uint64_t*)ga2address(cq[p].src), cq[p].old8, cq[p].new8);
+                    *(uint64_t*)ga2address(q->cq[p].dst) = sync_val_compare_and_swap_8((uint64_t*)ga2address(q->cq[p].src), q->cq[p].old8, q->cq[p].new8);
                 else if (type == SWAP4)
-                    *(uint32_t*)ga2address(cq[p].dst) = sync_swap_4((uint32_t*)ga2address(cq[p].src), cq[p].val4);
+                    *(uint32_t*)ga2address(q->cq[p].dst) = sync_swap_4((uint32_t*)ga2address(q->cq[p].src), q->cq[p].val4);
                 else if (type == SWAP8)
-                    *(uint64_t*)ga2address(cq[p].dst) = sync_swap_8((uint64_t*)ga2address(cq[p].src), cq[p].val8);
+                    *(uint64_t*)ga2address(q->cq[p].dst) = sync_swap_8((uint64_t*)ga2address(q->cq[p].src), q->cq[p].val8);
                 else if (type == ADD4)
-                    *(uint32_t*)ga2address(cq[p].dst) = sync_fetch_and_add_4((uint32_t*)ga2address(cq[p].src), cq[p].val4);
+                    *(uint32_t*)ga2address(q->cq[p].dst) = sync_fetch_and_add_4((uint32_t*)ga2address(q->cq[p].src), q->cq[p].val4);
                 else if (type == ADD8)
-                    *(uint64_t*)ga2address(cq[p].dst) = sync_fetch_and_add_8((uint64_t*)ga2address(cq[p].src), cq[p].val8);
+                    *(uint64_t*)ga2address(q->cq[p].dst) = sync_fetch_and_add_8((uint64_t*)ga2address(q->cq[p].src), q->cq[p].val8);
                 else if (type == XOR4)
-                    *(uint32_t*)ga2address(cq[p].dst) = sync_fetch_and_xor_4((uint32_t*)ga2address(cq[p].src), cq[p].val4);
+                    *(uint32_t*)ga2address(q->cq[p].dst) = sync_fetch_and_xor_4((uint32_t*)ga2address(q->cq[p].src), q->cq[p].val4);
                 else if (type == XOR8)
-                    *(uint64_t*)ga2address(cq[p].dst) = sync_fetch_and_xor_8((uint64_t*)ga2address(cq[p].src), cq[p].val8);
+                    *(uint64_t*)ga2address(q->cq[p].dst) = sync_fetch_and_xor_8((uint64_t*)ga2address(q->cq[p].src), q->cq[p].val8);
                 else if (type == OR4)
-                    *(uint32_t*)ga2address(cq[p].dst) = sync_fetch_and_or_4((uint32_t*)ga2address(cq[p].src), cq[p].val4);
+                    *(uint32_t*)ga2address(q->cq[p].dst) = sync_fetch_and_or_4((uint32_t*)ga2address(q->cq[p].src), q->cq[p].val4);
                 else if (type == OR8)
-                    *(uint64_t*)ga2address(cq[p].dst) = sync_fetch_and_or_8((uint64_t*)ga2address(cq[p].src), cq[p].val8);
+                    *(uint64_t*)ga2address(q->cq[p].dst) = sync_fetch_and_or_8((uint64_t*)ga2address(q->cq[p].src), q->cq[p].val8);
                 else if (type == AND4)
-                    *(uint32_t*)ga2address(cq[p].dst) = sync_fetch_and_and_4((uint32_t*)ga2address(cq[p].src), cq[p].val4);
+                    *(uint32_t*)ga2address(q->cq[p].dst) = sync_fetch_and_and_4((uint32_t*)ga2address(q->cq[p].src), q->cq[p].val4);
                 else /* type == AND8 */
-                    *(uint64_t*)ga2address(cq[p].dst) = sync_fetch_and_and_8((uint64_t*)ga2address(cq[p].src), cq[p].val8);
-                cq[p].stat = CQSTAT_DONE;
-                cqxp++;
-                pthread_mutex_unlock(&mutex_cq);
-            } else if (cq[p].stat == CQSTAT_12) {
+                    *(uint64_t*)ga2address(q->cq[p].dst) = sync_fetch_and_and_8((uint64_t*)ga2address(q->cq[p].src), q->cq[p].val8);
+                q->cq[p].stat = CQSTAT_DONE;
+                q->cqxp++;
+                pthread_mutex_unlock(&q->mutex);
+            } else if (q->cq[p].stat == CQSTAT_12) {
                 /* Enqueue a command directly to the local delegate queue */
                 if (is_dq_not_full()) {
-                    type = cq[p].type;
-                    pos = dq_push(cqxp, MY_RANK, cq[p].rfence, type, cq[p].dst, cq[p].src);
-                    debug printf("rank %d - protocol Exec cq 0x%016" PRIx64 " into dq[%d] type = %d local to remote\n", MY_RANK, cqxp, pos, cq[p].type);
+                    type = q->cq[p].type;
+                    pos = dq_push(cq_ptr(q, q->cqxp), MY_RANK, q->cq[p].rfence, type, q->cq[p].dst, q->cq[p].src);
+                    debug printf("rank %d - protocol Exec cq 0x%016" PRIx64 " into dq[%d] type = %d local to remote\n", MY_RANK, q->cqxp, pos, q->cq[p].type);
                     if (type == COPY) {
-                        dq[pos].size = cq[p].size;
+                        dq[pos].size = q->cq[p].size;
                     } else if (type == CAS4) {
-                        dq[pos].old4 = cq[p].old4;
-                        dq[pos].new4 = cq[p].new4;
+                        dq[pos].old4 = q->cq[p].old4;
+                        dq[pos].new4 = q->cq[p].new4;
                     } else if (type == CAS8) {
-                        dq[pos].old8 = cq[p].old8;
-                        dq[pos].new8 = cq[p].new8;
+                        dq[pos].old8 = q->cq[p].old8;
+                        dq[pos].new8 = q->cq[p].new8;
                     } else if (type == SWAP4 || type == ADD4 || type == XOR4 || type == OR4 || type == AND4) {
-                        dq[pos].val4 = cq[p].val4;
+                        dq[pos].val4 = q->cq[p].val4;
                     } else { /* type == SWAP8 || type == ADD8 || type == XOR8 || type == OR8 || type == AND8 */
-                        dq[pos].val8 = cq[p].val8;
+                        dq[pos].val8 = q->cq[p].val8;
                     }
-                    cq[p].stat = CQSTAT_WAIT;
-                    cqxp++;
+                    q->cq[p].stat = CQSTAT_WAIT;
+                    q->cqxp++;
                 }
-                pthread_mutex_unlock(&mutex_cq);
-            } else if (cq[p].stat == CQSTAT_2X) {
+                pthread_mutex_unlock(&q->mutex);
+            } else if (q->cq[p].stat == CQSTAT_2X) {
                 /* Transmit a command datagram: ibuf and txbuf vc0 */
-                if (cq[p].gateway == MY_GATEWAY) {
-                    elem_id = ibuf_vc0_pop_free(cq[p].inum);
-                    if (elem_id >= 0) dgp = (dg_union*)ibuf[ibuf_pos(cq[p].inum, MY_INUM)].vc0.list[elem_id].dg;
+                if (q->cq[p].gateway == MY_GATEWAY) {
+                    elem_id = ibuf_vc0_pop_free(q->cq[p].inum);
+                    if (elem_id >= 0) dgp = (dg_union*)ibuf[ibuf_pos(q->cq[p].inum, MY_INUM)].vc0.list[elem_id].dg;
                 } else {
                     elem_id = txbuf_vc0_pop_free();
                     if (elem_id >= 0) {
                         dgp = (dg_union*)txbuf[MY_INUM].vc0.list[elem_id].dg;
-                        txbuf[MY_INUM].vc0.list[elem_id].send_to = ga2rank(cq[p].src);
+                        txbuf[MY_INUM].vc0.list[elem_id].send_to = ga2rank(q->cq[p].src);
                     }
                 }
                 if (elem_id >= 0) {
-                    debug printf("rank %d - protocol Exec cq 0x%016" PRIx64 " type = %d remote to X\n", MY_RANK, cqxp, cq[p].type);
-                    type = cq[p].type;
+                    debug printf("rank %d - protocol Exec cq 0x%016" PRIx64 " type = %d remote to X\n", MY_RANK, q->cqxp, q->cq[p].type);
+                    type = q->cq[p].type;
                     dgp->copy.task = TASKID;
                     dgp->copy.c    = NORMAL;
                     dgp->copy.vc   = 0;
                     dgp->copy.rank = MY_RANK;
-                    dgp->copy.ptr  = cqxp;
-                    dgp->copy.s    = cq[p].rfence;
+                    dgp->copy.ptr  = cq_ptr(q, q->cqxp);
+                    dgp->copy.s    = q->cq[p].rfence;
                     dgp->copy.type = type;
-                    dgp->copy.dst  = cq[p].dst;
-                    dgp->copy.src  = cq[p].src;
+                    dgp->copy.dst  = q->cq[p].dst;
+                    dgp->copy.src  = q->cq[p].src;
                     if (type == COPY) {
-                        dgp->copy.size = cq[p].size;
+                        dgp->copy.size = q->cq[p].size;
                     } else if (type == CAS4) {
-                        dgp->cas4.oldval = cq[p].old4;
-                        dgp->cas4.newval = cq[p].new4;
+                        dgp->cas4.oldval = q->cq[p].old4;
+                        dgp->cas4.newval = q->cq[p].new4;
                     } else if (type == CAS8) {
-                        dgp->cas8.oldval = cq[p].old8;
-                        dgp->cas8.newval = cq[p].new8;
+                        dgp->cas8.oldval = q->cq[p].old8;
+                        dgp->cas8.newval = q->cq[p].new8;
                     } else if (type == SWAP4 || type == ADD4 || type == XOR4 || type == OR4 || type == AND4) {
-                        dgp->swap4.val = cq[p].val4;
+                        dgp->swap4.val = q->cq[p].val4;
                     } else { /* type == SWAP8 || type == ADD8 || type == XOR8 || type == OR8 || type == AND8 */
-                        dgp->swap8.val = cq[p].val8;
+                        dgp->swap8.val = q->cq[p].val8;
                     }
-                    cq[p].stat = CQSTAT_WAIT;
-                    cqxp++;
-                    pthread_mutex_unlock(&mutex_cq);
-                    if (cq[p].gateway == MY_GATEWAY)
-                        ibuf_vc0_push_dg(cq[p].inum, elem_id);
+                    q->cq[p].stat = CQSTAT_WAIT;
+                    q->cqxp++;
+                    pthread_mutex_unlock(&q->mutex);
+                    if (q->cq[p].gateway == MY_GATEWAY)
+                        ibuf_vc0_push_dg(q->cq[p].inum, elem_id);
                     else
                         txbuf_vc0_push_dg(elem_id);
                 } else
-                    pthread_mutex_unlock(&mutex_cq);
+                    pthread_mutex_unlock(&q->mutex);
             } else {
-                if (cq[p].stat == CQSTAT_DONE) cqxp++;
-                pthread_mutex_unlock(&mutex_cq);
+                if (q->cq[p].stat == CQSTAT_DONE) q->cqxp++;
+                pthread_mutex_unlock(&q->mutex);
             }
         } else {
-            pthread_mutex_unlock(&mutex_cq);
+            pthread_mutex_unlock(&q->mutex);
+        }
+    }
+    
+    return;
+}
+
+
+/* Communication thread function */
+
+static void* comm_thread_func(void *param)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len;
+    int i, j, check_quit;
+    
+    iacpbl_trace_thread_name("comm");
+    
+    /******** Initinalization for the transport processing ********/
+    
+    if (MY_INUM == 0 && NUM_PROCS != NODE_POP) {
+        debug printf("rank %d - initinalization for the transport processing\n", MY_RANK);
+        init_ser();
+        init_seq();
+        init_txtime(get_nsec());
+        init_rtt_pred();
+        init_retx_list();
+        
+        /*** Setup pollfds for UDP communication ***/
+        
+        pfds = (struct pollfd*)malloc(sizeof(struct pollfd) * NODE_POP);
+        if (pfds == NULL) {
+            pthread_mutex_lock(&mutex_comm_thread_ready);
+            comm_thread_ready = 1;
+            pthread_cond_signal(&cond_comm_thread_ready);
+            pthread_mutex_unlock(&mutex_comm_thread_ready);
+            finalize_retx_list();
+            finalize_rtt_pred();
+            finalize_txtime();
+            finalize_seq();
+            finalize_ser();
+            return NULL;
+        }
+        
+        addr_len = sizeof(struct sockaddr_in);
+        for (i = 0; i < NODE_POP; i++) {
+            /* bind socket */
+            pfds[i].fd = socket(AF_INET, SOCK_DGRAM, 0);
+            addr.sin_family = AF_INET;
+            addr.sin_port = PORT_TABLE[LMEM_TABLE[i]];
+            addr.sin_addr.s_addr = INADDR_ANY;
+            if (bind(pfds[i].fd, (struct sockaddr *)&addr, addr_len)) {
+                for (j = i - 1; j >= 0; j--) close(pfds[j].fd);
+                pthread_mutex_lock(&mutex_comm_thread_ready);
+                comm_thread_ready = 1;
+                pthread_cond_signal(&cond_comm_thread_ready);
+                pthread_mutex_unlock(&mutex_comm_thread_ready);
+                finalize_retx_list();
+                finalize_rtt_pred();
+                finalize_txtime();
+                finalize_seq();
+                finalize_ser();
+                return NULL;
+            }
+            /* set events */
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
         }
     }
     
+    /*** Main loop ***/
+    pthread_mutex_lock(&mutex_comm_thread_ready);
+    comm_thread_ready = 1;
+    pthread_cond_signal(&cond_comm_thread_ready);
+    pthread_mutex_unlock(&mutex_comm_thread_ready);
+    debug printf("rank %d - communication thread ready\n", MY_RANK);
+    
+    pthread_mutex_lock(&mutex_comm_thread_start);
+    while (!comm_thread_start) pthread_cond_wait(&cond_comm_thread_start, &mutex_comm_thread_start);
+    pthread_mutex_unlock(&mutex_comm_thread_start);
+    debug printf("rank %d - communication thread start\n", MY_RANK);
+    
+    while (1) {
+        /*** Quit check ***/
+        
+        pthread_mutex_lock(&mutex_quit_comm_thread);
+        check_quit = quit_comm_thread;
+        pthread_mutex_unlock(&mutex_quit_comm_thread);
+        if (check_quit) break;
+        
+        comm_progress();
+    }
+    
     if (MY_INUM == 0 && NUM_PROCS != NODE_POP) {
         for (i = NODE_POP - 1; i >= 0; i--) close(pfds[i].fd);
         finalize_retx_list();
@@ -2830,23 +3768,41 @@ int iacpbludp_init_gma(void)
     
     r = init_shmbuffer();
     if (r) return r;
-    init_cq();
+    /* with --acp-udp-only the node of the segment is not a real node */
+    r = iacpbl_affinity_init(iacpbl_option.udponly.value ? NULL : affinity_table, MY_RANK, TASKID);
+    if (r) return r;
+    init_stats();
+    iacpbl_copy_init(iacpbl_option.copythreshold.value);
+    init_emu();
+    r = init_cq();
+    if (r) return r;
     init_dq();
+    init_bulk();
     
     pthread_mutex_init(&mutex_comm_thread_ready, NULL);
     pthread_cond_init(&cond_comm_thread_ready, NULL);
     pthread_mutex_init(&mutex_comm_thread_start, NULL);
     pthread_cond_init(&cond_comm_thread_start, NULL);
+    comm_thread_ready = comm_thread_start = 0;
     quit_comm_thread = 0;
     pthread_mutex_init(&mutex_quit_comm_thread, NULL);
     
+    progress_inline = (iacpbl_option.progthread.value == 0 && NUM_PROCS == NODE_POP);
+    if (progress_inline) {
+        pthread_mutex_init(&mutex_progress, NULL);
+        acp_sync();
+        return 0;
+    }
+    
     pthread_create(&comm_thread_id, NULL, comm_thread_func, NULL);
     
     pthread_mutex_lock(&mutex_comm_thread_ready);
-    pthread_cond_wait(&cond_comm_thread_ready, &mutex_comm_thread_ready);
+    while (!comm_thread_ready) pthread_cond_wait(&cond_comm_thread_ready, &mutex_comm_thread_ready);
     pthread_mutex_unlock(&mutex_comm_thread_ready);
     acp_sync();
+    iacpbl_affinity_place(comm_thread_id);
     pthread_mutex_lock(&mutex_comm_thread_start);
+    comm_thread_start = 1;
     pthread_cond_signal(&cond_comm_thread_start);
     pthread_mutex_unlock(&mutex_comm_thread_start);
     
@@ -2855,37 +3811,53 @@ int iacpbludp_init_gma(void)
 
 int iacpbludp_finalize_gma(void)
 {
-    pthread_mutex_lock(&mutex_quit_comm_thread);
-    quit_comm_thread = 1;
-    pthread_mutex_unlock(&mutex_quit_comm_thread);
-    
-    pthread_mutex_lock(&doorbell[MY_INUM].mutex);
-    doorbell_ring(MY_INUM);
-    pthread_mutex_unlock(&doorbell[MY_INUM].mutex);
-    
-    pthread_join(comm_thread_id, NULL);
+    if (progress_inline) {
+        pthread_mutex_destroy(&mutex_progress);
+    } else {
+        pthread_mutex_lock(&mutex_quit_comm_thread);
+        quit_comm_thread = 1;
+        pthread_mutex_unlock(&mutex_quit_comm_thread);
+        
+        pthread_mutex_lock(&doorbell[MY_INUM].mutex);
+        doorbell_ring(MY_INUM);
+        pthread_mutex_unlock(&doorbell[MY_INUM].mutex);
+        
+        pthread_join(comm_thread_id, NULL);
+    }
     
     pthread_mutex_destroy(&mutex_quit_comm_thread);
     
     pthread_cond_destroy(&cond_comm_thread_ready);
     pthread_mutex_destroy(&mutex_comm_thread_ready);
     
+    finalize_stats();
+    finalize_emu();
+    finalize_bulk();
     finalize_cq();
+    iacpbl_affinity_finalize();
     finalize_shmbuffer();
     
     return 0;
 }
 
+int iacpbludp_progress_gma(void)
+{
+    if (!progress_inline) return 0;
+    inline_progress();
+    return 1;
+}
+
 void iacpbludp_abort_gma(void)
 {
     quit_comm_thread = 1;
-    pthread_cancel(comm_thread_id);
+    if (!progress_inline) pthread_cancel(comm_thread_id);
     pthread_mutex_destroy(&mutex_quit_comm_thread);
     
     pthread_cond_destroy(&cond_comm_thread_ready);
     pthread_mutex_destroy(&mutex_comm_thread_ready);
     
     finalize_cq();
+    iacpbl_affinity_finalize();
     finalize_shmbuffer();
     
     return;
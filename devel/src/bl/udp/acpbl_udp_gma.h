@@ -307,6 +307,7 @@ typedef struct {
     uint64_t new8;
     uint32_t val4;
     uint64_t val8;
+    uint64_t issue_nsec;
 } cqe_t;
 
 #ifndef ACPBL_UDP_CQ_SIZE
@@ -364,5 +365,6 @@ typedef struct {
 extern int iacpbludp_init_gma(void);
 extern int iacpbludp_finalize_gma(void);
 extern void iacpbludp_abort_gma(void);
+extern int iacpbludp_progress_gma(void);
 
 #endif /* acpbl_udp_gma.h */
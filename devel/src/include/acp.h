@@ -290,6 +290,13 @@ extern acp_ga_t acp_query_starter_ga(int rank);
  *
  * メモリ領域をアドレス変換機構に登録し、アドレス変換キーを発行する関数。
  * GMAで使用されるカラー番号も同時に登録される。
+ * InfiniBand版でオプション--acp-mr-cache-sizeに0以外を指定すると
+ * (既定値は0)、登録解除したメモリを指定バイト数まで登録したまま再利用する。
+ * その際、プロセス全体のmallocの設定を変更し(M_MMAP_MAXを0、
+ * M_TRIM_THRESHOLDを-1とし、大きな領域もヒープから確保して解放後も
+ * ヒープを縮小しない)、登録を無効にするためにmunmap、mremap、madvise
+ * の各関数を置き換える。置き換えた関数はキャッシュが空であればそのまま
+ * システムコールを呼び出す。
  *
  * @param addr メモリ領域先頭論理アドレス
  * @param size メモリ領域サイズ
@@ -305,6 +312,13 @@ extern acp_ga_t acp_query_starter_ga(int rank);
  * returns an address translation key for it. 
  * The color that will be used for GMA with the address is 
  * also included in the key.
+ * With the InfiniBand layer, a non-zero --acp-mr-cache-size (the default 
+ * is 0) keeps up to that many bytes of unregistered memory registered 
+ * for reuse. The cache then changes malloc for the whole process: 
+ * M_MMAP_MAX is set to 0 and M_TRIM_THRESHOLD to -1, so large blocks come 
+ * from the heap and the heap never shrinks. The library also provides 
+ * munmap, mremap and madvise, which invalidate the cached registrations 
+ * of the pages they release and otherwise make the system call as is.
  *
  * @param addr Logical address of the top of the memory region to be registered.
  * @param size Size of the region to be registered.
@@ -497,6 +511,53 @@ extern int acp_colors(void);
 /** Handle of GMA.  Used as identifiers of the invoked GMAs. */
 typedef int64_t acp_handle_t;
 
+/** Indices of acp_stats_t::op for each type of GMA. */
+#define ACP_STATS_OP_COPY  0
+#define ACP_STATS_OP_CAS4  1
+#define ACP_STATS_OP_CAS8  2
+#define ACP_STATS_OP_SWAP4 3
+#define ACP_STATS_OP_SWAP8 4
+#define ACP_STATS_OP_ADD4  5
+#define ACP_STATS_OP_ADD8  6
+#define ACP_STATS_OP_XOR4  7
+#define ACP_STATS_OP_XOR8  8
+#define ACP_STATS_OP_OR4   9
+#define ACP_STATS_OP_OR8   10
+#define ACP_STATS_OP_AND4  11
+#define ACP_STATS_OP_AND8  12
+#define ACP_STATS_NUM_OPS  13
+
+/** Number of bins of a latency histogram. Bin i counts latencies in [2^i, 2^(i+1)) nsec. */
+#define ACP_STATS_HIST_BINS 32
+
+/** Issue-to-completion latency of one type of GMA. */
+typedef struct {
+    uint64_t count;                      /**< Number of completed GMAs. */
+    uint64_t total_nsec;                 /**< Sum of the latencies in nsec. */
+    uint64_t max_nsec;                   /**< Maximum latency in nsec. */
+    uint64_t hist[ACP_STATS_HIST_BINS];  /**< Log2 histogram of the latencies. */
+} acp_stats_latency_t;
+
+/** Statistics of the basic layer of the caller process. */
+typedef struct {
+    acp_stats_latency_t op[ACP_STATS_NUM_OPS]; /**< Latency per type of GMA. */
+    uint64_t tx_bytes;          /**< Bytes transmitted to the network. */
+    uint64_t tx_packets;        /**< Datagrams (UDP) or work requests (IB) transmitted. */
+    uint64_t rx_bytes;          /**< Bytes received from the network. */
+    uint64_t rx_packets;        /**< Datagrams (UDP) or commands (IB) received. */
+    uint64_t retransmits;       /**< Datagrams retransmitted on timeout (UDP). Always 0 on IB. */
+    uint64_t queue_full_stalls; /**< GMA invocations that waited for a free command queue entry. */
+    uint64_t loop_iterations;   /**< Iterations of the communication thread. */
+} acp_stats_t;
+
+/** Per-peer transport counters of the basic layer. */
+typedef struct {
+    uint64_t tx_bytes;          /**< Bytes transmitted to the peer. */
+    uint64_t tx_packets;        /**< Datagrams or work requests transmitted to the peer. */
+    uint64_t rx_bytes;          /**< Bytes received from the peer. */
+    uint64_t rx_packets;        /**< Datagrams or commands received from the peer. */
+} acp_peer_stats_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -994,6 +1055,159 @@ extern void acp_complete(acp_handle_t handle);
  */
 extern int acp_inquire(acp_handle_t handle);
 
+/**
+ * @JP
+ * @brief 全プロセスの同期を開始する関数。
+ *
+ * acp_sync関数と同じ全プロセスの同期を開始し、完了を待たずに同期ハンドルを返す。
+ * 同期の完了はacp_inquire_sync関数で照会し、acp_wait_sync関数で待つ。
+ * 同期の完了を待つ間もGMAの発行やローカルな計算を行うことができる。
+ * 同時に進行できる同期は1つであり、進行中の同期がある場合は
+ * ACP_HANDLE_NULLを返す。
+ *
+ * @retval ACP_HANDLE_NULL以外 同期ハンドル
+ * @retval ACP_HANDLE_NULL 失敗
+ *
+ * @EN
+ * @brief Start of a non-blocking synchronization
+ *
+ * Starts the same synchronization among all of the processes as acp_sync 
+ * and returns a synchronization handle without waiting for its completion. 
+ * The completion is queried with acp_inquire_sync and waited for with 
+ * acp_wait_sync. GMAs and local computation can go on in the meantime. 
+ * Only one synchronization can be in progress at a time. 
+ * If one is already in progress, this function returns ACP_HANDLE_NULL.
+ *
+ * @retval >=1 Synchronization handle
+ * @retval ACP_HANDLE_NULL Fail
+ * @ENDL
+ */
+extern acp_handle_t acp_isync(void);
+
+/**
+ * @JP
+ * @brief 全プロセスの同期が完了したか照会する関数。
+ *
+ * handleで指定した同期が進行中であれば1を返し、完了していれば0を返す。
+ * 照会の際に同期の処理を進める。
+ * handleにACP_HANDLE_ALLを指定すると最後に開始した同期を照会する。
+ * handleにACP_HANDLE_NULL、もしくは完了済みの同期の同期ハンドルを
+ * 指定した場合、acp_inquire_sync関数は0を返す。
+ *
+ * @param handle 状態を調べる同期の同期ハンドル
+ * @retval 0 同期は完了
+ * @retval 1 同期は進行中
+ *
+ * @EN
+ * @brief Query for the completion of a non-blocking synchronization
+ *
+ * Returns one if the synchronization of the specified handle is still 
+ * in progress, and zero if it has been completed. It also advances the 
+ * synchronization. If ACP_HANDLE_ALL is specified, it checks the latest 
+ * synchronization. If the specified handle is ACP_HANDLE_NULL or the handle 
+ * of a synchronization that has already been completed, it returns zero.
+ *
+ * @param handle Handle of the synchronization to be checked.
+ * @retval 0 The synchronization has been completed.
+ * @retval 1 The synchronization is in progress.
+ * @ENDL
+ */
+extern int acp_inquire_sync(acp_handle_t handle);
+
+/**
+ * @JP
+ * @brief 全プロセスの同期の完了を待つ関数。
+ *
+ * handleで指定した同期が完了すると戻る。acp_isync関数に続けて
+ * acp_wait_sync関数を呼び出すことはacp_sync関数の呼び出しと等しい。
+ * handleにACP_HANDLE_ALLを指定すると最後に開始した同期を待つ。
+ * handleにACP_HANDLE_NULL、もしくは完了済みの同期の同期ハンドルを
+ * 指定した場合、acp_wait_sync関数は即座に戻る。
+ *
+ * @param handle 完了を待つ同期の同期ハンドル
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @EN
+ * @brief Completion of a non-blocking synchronization
+ *
+ * Returns after the synchronization of the specified handle completes. 
+ * Calling acp_isync followed by acp_wait_sync is equivalent to acp_sync. 
+ * If ACP_HANDLE_ALL is specified, it waits for the latest synchronization. 
+ * If the specified handle is ACP_HANDLE_NULL or the handle of a 
+ * synchronization that has already been completed, this function 
+ * returns immediately.
+ *
+ * @param handle Handle of the synchronization to be waited for.
+ * @retval 0 Success
+ * @retval -1 Fail
+ * @ENDL
+ */
+extern int acp_wait_sync(acp_handle_t handle);
+
+/**
+ * @JP
+ * @brief 基本層の統計情報を取得する関数。
+ *
+ * GMAの種類ごとの発行から完了までのレイテンシのヒストグラムと、
+ * 送受信バイト数、再送回数、コマンドキュー満杯による待ち回数、
+ * 通信スレッドのループ回数をstatsに格納する。
+ * 再送回数はUDP版が応答のタイムアウトにより再送したデータグラム数である。
+ * InfiniBand版の再送はHCAが行うため数えられず、常に0である。
+ * 統計情報は常時収集され、acp_init関数の呼び出し時に0に初期化される。
+ * 環境変数ACP_STATSに1を設定すると、acp_finalize関数の呼び出し時に
+ * 統計情報を標準エラー出力に表示する。
+ *
+ * @param stats 統計情報の格納先
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @EN
+ * @brief Query for the statistics of the basic layer
+ *
+ * Stores the issue-to-completion latency histograms of each type of GMA,
+ * the transport counters, the number of retransmits, the number of
+ * stalls on a full command queue and the number of iterations of the
+ * communication thread into stats. The number of retransmits counts the
+ * datagrams the UDP layer resent when their acknowledgement timed out.
+ * The retransmits of the InfiniBand layer are done by the HCA and not
+ * counted, so it is always 0 there.
+ * Statistics are always collected and cleared in acp_init. If the environment variable ACP_STATS is
+ * set to 1, they are printed to the standard error in acp_finalize.
+ *
+ * @param stats Pointer to the buffer of the statistics.
+ * @retval 0 Success
+ * @retval -1 Fail
+ * @ENDL
+ */
+extern int acp_query_stats(acp_stats_t *stats);
+
+/**
+ * @JP
+ * @brief 指定したプロセスとの間の送受信統計情報を取得する関数。
+ *
+ * rankで指定したプロセスとの間の送受信バイト数とパケット数を
+ * statsに格納する。
+ *
+ * @param rank 相手プロセスのランク番号
+ * @param stats 統計情報の格納先
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @EN
+ * @brief Query for the transport statistics with a peer
+ *
+ * Stores the number of bytes and packets transmitted to and received
+ * from the process of the specified rank into stats.
+ *
+ * @param rank Rank of the peer process.
+ * @param stats Pointer to the buffer of the statistics.
+ * @retval 0 Success
+ * @retval -1 Fail
+ * @ENDL
+ */
+extern int acp_query_peer_stats(int rank, acp_peer_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1029,8 +1243,17 @@ extern "C" {
 
 typedef struct chreqitem *acp_request_t;
 
+#define ACP_REQUEST_NULL (acp_request_t)(NULL)
+
 typedef struct chitem *acp_ch_t;
 
+/**
+ * @brief Function invoked at the completion of a request of a channel.
+ *
+ * @see acp_set_callback_ch
+ */
+typedef void (*acp_callback_ch_t)(acp_request_t request, size_t size, void *arg);
+
 typedef struct segbufitem *acp_segbuf_t;
 
 /** 
@@ -1233,6 +1456,28 @@ extern int acp_free_segbuf(volatile acp_segbuf_t segbuf);
 //extern acp_ch_t acp_create_ch(int src, int dest); [ace-yt3 51]
 extern acp_ch_t acp_create_ch(int sender, int receiver);
 
+/**
+ * @brief Creates an endpoint of a mailbox channel that many senders share to send messages to receiver.
+ *
+ * Creates an endpoint of a mailbox channel of the receiver process, and returns
+ * a handle of it. If the caller process is the receiver, the endpoint is the
+ * mailbox itself, and messages from all of the sender endpoints of this
+ * receiver arrive there. Otherwise, the endpoint is a sender endpoint to the
+ * mailbox. Each process can have at most one mailbox, and the memory for it
+ * does not grow with the number of the senders. The senders reserve slots of
+ * the mailbox with atomic operations, so that the order of messages from one
+ * sender endpoint is kept, but messages from different senders are received
+ * in the order of the reservation. Messages do not carry the rank of the
+ * sender. Messages larger than a slot of the mailbox are transferred with
+ * the rendezvous protocol. The receiver must free its endpoint after all of
+ * the sender endpoints have been freed.
+ *
+ * @param receiver  Rank of the receiver process of the mailbox.
+ * @retval ACP_CH_NULL fail
+ * @retval otherwise A handle of the endpoint of the mailbox channel.
+ */
+extern acp_ch_t acp_create_mbox_ch(int receiver);
+
 /**
  * @brief Frees the endpoint of the channel specified by the handle.
  *
@@ -1272,6 +1517,8 @@ extern acp_request_t acp_nbfree_ch(acp_ch_t ch);
  * It returns error if the sender of the channel endpoint specified by the handle is 
  * not the caller process. Otherwise, it returns a handle of the request for waiting 
  * the completion of the nonblocking send. 
+ * Messages larger than 16 KiB are read by the receiver directly from the send 
+ * buffer, which must not be modified until the request completes. 
  *
  * @param ch Handle of the channel endpoint to send a message.
  * @param buf Initial address of the send buffer.
@@ -1315,7 +1562,93 @@ extern acp_request_t acp_nbrecv_ch(acp_ch_t ch, void * buf, size_t size);
  */
 extern size_t acp_wait_ch(acp_request_t request);
 
-extern int acp_waitall_ch(acp_request_t *, int, size_t *);
+/**
+ * @brief Waits for the completion of all of the nonblocking operations
+ *
+ * Waits for the completion of the nonblocking operations specified by the array 
+ * of the request handles, as acp_wait_ch does for each of them. The handles 
+ * are set to ACP_REQUEST_NULL. Handles of ACP_REQUEST_NULL in the array are ignored.
+ *
+ * @param requests Array of the handles of the requests.
+ * @param count Number of the handles in the array.
+ * @param sizes Array to store the sizes of the received data, or NULL. 
+ * The size is 0 for an operation other than a nonblocking receive.
+ * @retval 0 Success
+ * @retval -1 Fail
+ */
+extern int acp_waitall_ch(acp_request_t *requests, int count, size_t *sizes);
+
+/**
+ * @brief Tests the completion of the nonblocking operation 
+ *
+ * Progresses the channels, and tests the completion of the nonblocking operation 
+ * specified by the request handle without waiting. If the operation has completed, 
+ * the request is released as by acp_wait_ch, and the handle must not be used any more.
+ *
+ * @param request Handle of the request of a nonblocking operation.
+ * @param size Address to store the size of the received data if the operation 
+ * is a nonblocking receive, or NULL.
+ * @retval 1 The operation has completed.
+ * @retval 0 The operation has not completed yet.
+ */
+extern int acp_test_ch(acp_request_t request, size_t *size);
+
+/**
+ * @brief Waits for the completion of any of the nonblocking operations
+ *
+ * Waits until one of the nonblocking operations specified by the array of the 
+ * request handles completes, releases its request as acp_wait_ch does, sets its 
+ * handle in the array to ACP_REQUEST_NULL, and returns its index. 
+ * Handles of ACP_REQUEST_NULL in the array are ignored.
+ *
+ * @param requests Array of the handles of the requests.
+ * @param count Number of the handles in the array.
+ * @param size Address to store the size of the received data if the completed 
+ * operation is a nonblocking receive, or NULL.
+ * @retval >=0 Index of the completed operation in the array.
+ * @retval -1 There is no handle other than ACP_REQUEST_NULL in the array.
+ */
+extern int acp_waitany_ch(acp_request_t *requests, int count, size_t *size);
+
+/**
+ * @brief Tests the completion of the nonblocking operations
+ *
+ * Progresses the channels, and finds the nonblocking operations that have completed 
+ * among those specified by the array of the request handles, without waiting. 
+ * Their requests are released as by acp_wait_ch, and their handles in the array 
+ * are set to ACP_REQUEST_NULL. Handles of ACP_REQUEST_NULL in the array are ignored.
+ *
+ * @param requests Array of the handles of the requests.
+ * @param count Number of the handles in the array.
+ * @param indices Array to store the indices of the completed operations, or NULL.
+ * @param sizes Array to store the sizes of the received data of the completed 
+ * operations, in the same order as indices, or NULL.
+ * @retval >=0 Number of the completed operations.
+ */
+extern int acp_testsome_ch(acp_request_t *requests, int count, int *indices, size_t *sizes);
+
+/**
+ * @brief Sets a function invoked at the completion of the nonblocking operation
+ *
+ * Sets a function invoked at the completion of the nonblocking operation specified 
+ * by the request handle, instead of waiting for it. The function is invoked once, 
+ * from the progress of the channels in one of the channel functions called by this 
+ * process, such as acp_test_ch and acp_testsome_ch, or from the progress thread of 
+ * the channels if it is enabled by --acp-cl-progress-interval. It receives the request handle, 
+ * the size of the received data if the operation is a nonblocking receive (0 otherwise), 
+ * and arg. The request has already been released when the function is invoked, 
+ * so the handle cannot be used except for identifying the operation. 
+ * The function may start new nonblocking operations in channels, but must not 
+ * wait for operations, e.g. by acp_wait_ch or acp_free_ch. After this function, 
+ * the request must not be waited or tested.
+ *
+ * @param request Handle of the request of a nonblocking operation.
+ * @param callback Function invoked at the completion.
+ * @param arg Argument passed to the function.
+ * @retval 0 Success
+ * @retval -1 Fail
+ */
+extern int acp_set_callback_ch(acp_request_t request, acp_callback_ch_t callback, void *arg);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1 @@
+../bl/common/acpbl_trace.h
\ No newline at end of file
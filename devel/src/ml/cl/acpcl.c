@@ -23,6 +23,7 @@
 #include "acpbl.h"
 #include "acpbl_sync.h"
 #include "acpcl_progress.h"
+#include "acpbl_trace.h"
 
 // #define DEBUG
 
@@ -33,7 +34,8 @@ int iacp_enable_hybrid = 0; // Flag to permit multiple threads to call the funct
 static int crbsz; // Size of CRB for Channels
 static int crqsz; // Size of CRQ for Segbufs
 static acp_ga_t trashboxga; // GA of trashbox used as a dummy target of remote atomic operations
-static volatile uint64_t chlk; // Lock
+static volatile uint32_t chlk; // Lock of the channel lists and the connection request buffer
+static volatile uint32_t segbuflk; // Lock of the connections of the segment buffers
 static int iacp_initialized_cl = 0; // Flag to check if initialization has been done once or not
 
 /* external global variables */
@@ -51,19 +53,58 @@ typedef struct listobj {
 } listobj_t;
 
 /* functions */
-/* handling locks */
+/* handling locks 
+ *  chlk protects the lists of channels and the connection request buffer.
+ *  each channel endpoint has its own lock protecting its requests and slots,
+ *  so that threads driving different channels do not block each other.
+ *  when both are needed, the lock of the endpoint is taken first.
+ *  segbuflk protects the connections of the segment buffers.
+ */
+static inline int spin_trylock(volatile uint32_t *lk)
+{
+    return (*lk == 0) && (sync_val_compare_and_swap_4(lk, 0, 1) == 0);
+}
+
+static inline void spin_lock(volatile uint32_t *lk)
+{
+    /* wait by reading the lock, not by repeating the atomic operation */
+    while (!spin_trylock(lk))
+        while (*lk != 0) ;
+}
+
+static inline void spin_unlock(volatile uint32_t *lk)
+{
+    sync_synchronize();
+    *lk = 0;
+}
+
 static inline void ch_lock(void)
 {
     if (iacp_enable_hybrid == 1)
-        while (sync_val_compare_and_swap_8(&chlk, 0, 1)) ;
+        spin_lock(&chlk);
 }
 
 static inline void ch_unlock(void)
 {
-    if (iacp_enable_hybrid == 1) {
-        sync_synchronize();
-        chlk = 0;
-    }
+    if (iacp_enable_hybrid == 1)
+        spin_unlock(&chlk);
+}
+
+static inline int segbuf_trylock(void)
+{
+    return (iacp_enable_hybrid != 1) || spin_trylock(&segbuflk);
+}
+
+static inline void segbuf_lock(void)
+{
+    if (iacp_enable_hybrid == 1)
+        spin_lock(&segbuflk);
+}
+
+static inline void segbuf_unlock(void)
+{
+    if (iacp_enable_hybrid == 1)
+        spin_unlock(&segbuflk);
 }
 
 /* handling lists */
@@ -612,6 +653,7 @@ static void progress_src_con_segbuf()
             this_segbuf->remotebufga = CON_SEGBUF_BUFGA(this_item);
             this_segbuf->remotectlga = CON_SEGBUF_CTLGA(this_item);
             this_segbuf->state = SEGBUF_STAT_CON;
+            IACPBL_TRACE(IACPBL_TRACE_INSTANT, "segbuf", "connect", this_segbuf, 0);
             /* set state of segbuf_ctl to SEGBUF_STAT_CON */
             this_segbuf_ctl = this_segbuf->ctlla;
             SEGBUFCTL_STATE(this_segbuf_ctl) = SEGBUF_STAT_CON;
@@ -770,6 +812,7 @@ static int progress_dst_con_segbuf()
             /* set states to CONNECTED */
             CON_SEGBUF_STATE(this_item) = CON_SEGBUF_STAT_CON;
             this_segbuf->state = SEGBUF_STAT_CON;
+            IACPBL_TRACE(IACPBL_TRACE_INSTANT, "segbuf", "connect", this_segbuf, 0);
             SEGBUFCTL_STATE(this_segbuf->ctlla) = SEGBUF_STAT_CON;
             CON_SEGBUF_HANDLE(this_item) = acp_swap4(trashboxga, this_segbuf->remoteconsegbufga + CON_SEGBUF_OFFSET_STATE,
                                                      CON_SEGBUF_STAT_CON, ACP_HANDLE_NULL);
@@ -835,11 +878,17 @@ static int progress_dst_con_segbuf()
 /* progress */
 void iacpcl_progress_segbuf()
 {
+    /* the thread holding the lock progresses them */
+    if (!segbuf_trylock())
+        return;
+
     // progress src segbuf connection: con_src_segbuf_list
     progress_src_con_segbuf();
 
     // progress dst segbuf connection: con_dst_segbuf_list
     progress_dst_con_segbuf();
+
+    segbuf_unlock();
 }
 
 acp_segbuf_t acp_create_src_segbuf(int dst_rank, void *buf, size_t segsize, size_t segnum)
@@ -859,6 +908,9 @@ acp_segbuf_t acp_create_src_segbuf(int dst_rank, void *buf, size_t segsize, size
     this_segbuf->segsize = segsize;
     this_segbuf->segnum = segnum;
     this_segbuf->state = SEGBUF_STAT_INIT;
+    IACPBL_TRACE(IACPBL_TRACE_INSTANT, "segbuf", "init", this_segbuf, 0);
+
+    segbuf_lock();
 
     /* retrieve segbuf_ctl from segbuf_ctl_table */
     for (i = 0; i < num_free_segbuf_ctls; i++) {
@@ -868,6 +920,7 @@ acp_segbuf_t acp_create_src_segbuf(int dst_rank, void *buf, size_t segsize, size
     }
     if (SEGBUFCTL_STATE(this_segbuf_ctl) != SEGBUF_STAT_NOUSE) {
         fprintf(stderr, "acp_create_src_segbuf : %d : Number of segbuf_ctls has been exceeded the limit\n", myrank);
+        segbuf_unlock();
         free(this_segbuf);
         return NULL;
     }
@@ -879,6 +932,7 @@ acp_segbuf_t acp_create_src_segbuf(int dst_rank, void *buf, size_t segsize, size
     this_con_segbuf = free_con_segbuf_list;
     if (this_con_segbuf == NULL) {
         fprintf(stderr, "acp_create_src_segbuf : %d : Number of con_segbuf has been exceeded the limit\n", myrank);
+        segbuf_unlock();
         free(this_segbuf);
         return NULL;
     }
@@ -905,6 +959,7 @@ acp_segbuf_t acp_create_src_segbuf(int dst_rank, void *buf, size_t segsize, size
         this_peer = free_con_segbuf_peer_list;
         if (this_peer == NULL) {
             fprintf(stderr, "acp_create_src_segbuf : %d : Number of con_segbuf_peer has been exceeded the limit\n", myrank);
+            segbuf_unlock();
             free(this_segbuf);
             return NULL;
         }
@@ -924,6 +979,7 @@ acp_segbuf_t acp_create_src_segbuf(int dst_rank, void *buf, size_t segsize, size
         tmp_item = this_peer->conninfos;
         if (tmp_item == NULL) {
             fprintf(stderr, "acp_create_src_segbuf : %d : empty con_segbuf_peer\n", myrank);
+            segbuf_unlock();
             free(this_segbuf);
             return NULL;
         }
@@ -934,6 +990,8 @@ acp_segbuf_t acp_create_src_segbuf(int dst_rank, void *buf, size_t segsize, size
         CON_SEGBUF_NEXT(this_con_segbuf) = NULL;
     }
 
+    segbuf_unlock();
+
 #ifdef DEBUG
     fprintf(stderr, "%d: acp_create_src_segbuf ctl %p %lx con %p %lx peer %p stat %d\n", 
             myrank, this_segbuf->ctlla, this_segbuf->ctlga, this_con_segbuf, CON_SEGBUF_THISGA(this_con_segbuf), this_peer, CON_SEGBUF_STATE(this_con_segbuf));
@@ -965,6 +1023,9 @@ acp_segbuf_t acp_create_dst_segbuf(int src_rank, void *buf, size_t segsize, size
     this_segbuf->segsize = segsize;
     this_segbuf->segnum = segnum;
     this_segbuf->state = SEGBUF_STAT_INIT;
+    IACPBL_TRACE(IACPBL_TRACE_INSTANT, "segbuf", "init", this_segbuf, 0);
+
+    segbuf_lock();
 
     /* retrieve segbuf_ctl from segbuf_ctl_table */
     for (i = 0; i < num_free_segbuf_ctls; i++) {
@@ -974,6 +1035,7 @@ acp_segbuf_t acp_create_dst_segbuf(int src_rank, void *buf, size_t segsize, size
     }
     if (SEGBUFCTL_STATE(this_segbuf_ctl) != SEGBUF_STAT_NOUSE) {
         fprintf(stderr, "acp_create_dst_segbuf : %d : Number of segbuf_ctls has been exceeded the limit\n", myrank);
+        segbuf_unlock();
         free(this_segbuf);
         return NULL;
     }
@@ -985,6 +1047,7 @@ acp_segbuf_t acp_create_dst_segbuf(int src_rank, void *buf, size_t segsize, size
     this_con_segbuf = free_con_segbuf_list;
     if (this_con_segbuf == NULL) {
         fprintf(stderr, "acp_create_dst_segbuf : %d : Number of con_segbuf has been exceeded the limit\n", myrank);
+        segbuf_unlock();
         free(this_segbuf);
         return NULL;
     }
@@ -1011,6 +1074,7 @@ acp_segbuf_t acp_create_dst_segbuf(int src_rank, void *buf, size_t segsize, size
         this_peer = free_con_segbuf_peer_list;
         if (this_peer == NULL) {
             fprintf(stderr, "acp_create_dst_segbuf : %d : Number of con_segbuf_peer has been exceeded the limit\n", myrank);
+            segbuf_unlock();
             free(this_segbuf);
             return NULL;
         }
@@ -1029,6 +1093,7 @@ acp_segbuf_t acp_create_dst_segbuf(int src_rank, void *buf, size_t segsize, size
         tmp_item = this_peer->conninfos;
         if (tmp_item == NULL) {
             fprintf(stderr, "acp_create_dst_segbuf : %d : empty con_segbuf_peer\n", myrank);
+            segbuf_unlock();
             free(this_segbuf);
             return NULL;
         }
@@ -1044,6 +1109,8 @@ acp_segbuf_t acp_create_dst_segbuf(int src_rank, void *buf, size_t segsize, size
     }
     CON_SEGBUF_STATE(this_con_segbuf) = CON_SEGBUF_STAT_WTCON;
 
+    segbuf_unlock();
+
 #ifdef DEBUG
     fprintf(stderr, "%d: acp_create_dst_segbuf ctl %p %lx con %p %lx peer %p stat %d\n", 
             myrank, this_segbuf->ctlla, this_segbuf->ctlga, this_con_segbuf, CON_SEGBUF_THISGA(this_con_segbuf), this_peer, CON_SEGBUF_STATE(this_con_segbuf));
@@ -1285,6 +1352,7 @@ int acp_disconnect_segbuf(acp_segbuf_t segbuf)
     iacpcl_progress();
 
     segbuf->state = SEGBUF_STAT_DISCON;
+    IACPBL_TRACE(IACPBL_TRACE_INSTANT, "segbuf", "disconnect", segbuf, 0);
     acp_swap4(trashboxga, segbuf->remotectlga + SEGBUFCTL_OFFSET_STATE, SEGBUF_STAT_DISCON, ACP_HANDLE_NULL);
 }
 
@@ -1320,7 +1388,12 @@ int acp_free_segbuf(volatile acp_segbuf_t segbuf)
 #define ACPCI_DEFAULT_CRB_ENTRYNUM 8
 #define ACPCI_DEFAULT_REQNUM 8
 #define ACPCI_DEFAULT_RBNUMSLOTS 8
-#define ACPCI_DEFAULT_SBNUMSLOTS 2
+#define ACPCI_DEFAULT_SBNUMSLOTS 8
+#define ACPCI_DEFAULT_RNDV_THRESHOLD 16384
+#define ACPCI_DEFAULT_MBNUMSLOTS 32
+
+/* acp_wait_ch progresses its own channel, and all channels once in this number of polls */
+#define ACPCI_WAIT_SWEEP_INTERVAL 16
 
 /* types and statuses of channels */
 #define CHTYSEND 0
@@ -1339,15 +1412,40 @@ int acp_free_segbuf(volatile acp_segbuf_t segbuf)
 
 /* channel body: 
  *   - sender
- *      | Tail of RecvBuf | slot0 | slot1 | ... 
+ *      | Head of RecvBuf | Tail of RecvBuf | Rendezvous FIN | slot0 | slot1 | ... 
  *   - receiver
- *      | Head of RecvBuf | slot0 | slot1 | ... 
+ *      | Head of RecvBuf | (unused) | Rendezvous FIN | slot0 | slot1 | ... 
  * 
- * Tail / Head of RecvBuf: uint64_t
+ * Head / Tail of RecvBuf: int64_t
+ *   the receiver sends its head back to the sender in batches of credits.
+ *   the sender does not send its tail. the receiver detects the arrival of
+ *   a message by its sequence numbers instead.
+ * Rendezvous FIN: int64_t, number of rendezvous messages the receiver has finished reading
  * 
+ * mailbox body: 
+ *   - sender
+ *      | Head of Mailbox | Ticket | Rendezvous FIN | slot0 | slot1 | ... 
+ *   - receiver
+ *      | Head of Mailbox | Tail of Mailbox | (unused) | slot0 | slot1 | ... 
+ * 
+ *   a mailbox is a receive buffer shared by all senders to a receiver. 
+ *   a sender reserves a slot by adding 1 to the tail of the mailbox with acp_add8,
+ *   and the fetched value (Ticket) is the sequence number of its message - 1.
+ *   it writes the message when the head it gets from the receiver shows that 
+ *   the message of the previous round in the slot has been consumed. 
+ *   the receiver detects the arrival by the sequence numbers as channels do.
+ *   the receiver adds 1 to Rendezvous FIN of the sender by acp_add8.
  */
 // NO ATOMIC  #define CHSLOTOFFSET 8 /* offset of the slot0 in the channel body */
-#define CHSLOTOFFSET 16 /* offset of the slot0 in the channel body */
+#define CHSLOTOFFSET 24 /* offset of the slot0 in the channel body */
+#define CHRNDVFINOFFSET 16 /* offset of the rendezvous FIN counter in the channel body */
+
+/* states of the reservation of a slot by a mailbox sender */
+#define MBSTNOTICKET 0 /* no slot is reserved */
+#define MBSTTICKET   1 /* a ticket has been fetched */
+
+/* maximum number of polls a mailbox sender skips between two gets of the head */
+#define MBMAXBACKOFF 256
 
 /* signal on the connection information */
 #define CONNSTVALID 0
@@ -1358,20 +1456,35 @@ int acp_free_segbuf(volatile acp_segbuf_t segbuf)
 #define REQSTEGR    1 /* Eager protocol */
 #define REQSTDISCONN 2 /* Disconnection */
 #define REQSTFIN    3 /* Finished */
+#define REQSTRNDV   4 /* Rendezvous protocol */
+#define REQSTRNDVWT 5 /* Rendezvous protocol: waiting for the receiver to finish reading */
+#define REQSTCALLBACK 6 /* Finished, waiting for its callback to be invoked */
+#define REQSTRNDVSLOT 7 /* Rendezvous protocol: reading the payload through the slot of the message */
 
 /* macros for messages 
  *   Message:
- *     | Header | Payload |
+ *     | Seq | Header | Payload | Seq |
+ *   Seq:
+ *     sequence number of the message in the channel, starting from 1.
+ *     the message is written by one acp_copy, and has arrived when both
+ *     Seq words carry the expected number. the Seq behind the payload
+ *     is aligned to 8 bytes.
  *   Header:
  *     | Type(3bits) | Size(61bits) |
+ *   Payload of a rendezvous message:
+ *     | GA of the send buffer | GA of Rendezvous FIN of the sender |
+ *     the latter is used by mailboxes.
  */ 
 #define MSGTYBITS 3
 #define MSGTYEGR     0x2000000000000000LL /* Eager */
+#define MSGTYRNDV    0x4000000000000000LL /* Rendezvous */
 #define MSGTYDISCONN 0xe000000000000000LL /* Disconnection */
 #define MSGMAXSZ    ((1LL << (64 - MSGTYBITS)) - 1LL)
 #define MSGSIZEMASK ((1LL << (64 - MSGTYBITS)) - 1LL)
 #define MSGTYPEMASK 0xe000000000000000LL
 #define MSGHDRSZ 8
+#define MSGSEQSZ 8
+#define MSGALIGN(sz) (((sz) + 7) & ~((size_t)7))
 
 /* statuses of CRB messages */
 #define CRBSTINUSE 0  
@@ -1415,9 +1528,18 @@ typedef struct chitem {
     struct listobj reqs;
     int64_t sbhead;
     int64_t sbtail;
+    int64_t rndvseq; /* sender: number of rendezvous messages sent */
+    int64_t rbcredit; /* receiver: head of RecvBuf last sent back to the sender */
+    acp_handle_t credithdl; /* receiver: handle of the last head sent back */
+    int ncallbacks; /* number of requests whose callbacks have not been invoked */
+    int mbox; /* 1 if this is an endpoint of a mailbox */
+    int mbstate; /* mailbox sender: state of the reservation of a slot */
+    acp_handle_t mbhdl; /* mailbox sender: handle of getting the mailbox info, a ticket or the head */
+    int mbbackoff; /* mailbox sender: polls to skip after the next get of the head */
+    int mbskip; /* mailbox sender: polls left to skip before getting the head again */
 // NO ATOMIC   uint64_t rbhead;
 // NO ATOMIC   uint64_t rbtail;
-    int lock;
+    volatile uint32_t lock;
 } chitem_t;
 
 /* struct of request item in channel  */
@@ -1430,6 +1552,12 @@ typedef struct chreqitem {
     size_t size;
     size_t receivedsize;
     acp_handle_t hdl;
+    acp_atkey_t atkey; /* rendezvous: key of the registered user buffer */
+    acp_ga_t ga;       /* rendezvous: GA of the registered user buffer */
+    acp_ga_t srcga;    /* rendezvous through the slot: GA of the send buffer */
+    int64_t rndvseq;   /* rendezvous: sequence number of the message in the channel */
+    acp_callback_ch_t callback; /* function invoked at the completion, or NULL */
+    void *cbarg;       /* argument of the callback */
 } chreqitem_t;
 
 /* struct of connection request messages */
@@ -1457,6 +1585,19 @@ typedef struct conninfo {
     chitem_t *nextch;
 } conninfo_t;
 
+/* struct of the information of a mailbox.
+ * the receiver publishes it in the starter memory behind the trashbox.
+ * ga is ACP_GA_NULL while the receiver has no mailbox.
+ */
+typedef struct mbinfo {
+    acp_ga_t ga;
+    int entrynum;
+    int buf_entrysz;
+} mbinfo_t;
+
+/* offset of mbinfo in the starter memory */
+#define MBINFO_OFFSET MSGALIGN(crbsz + crqsz + sizeof(acp_ga_t))
+
 /** local variables **/
 static char *crbreqmsg;      /* buffer used for sending connection request  */
 static acp_ga_t crbreqmsgga; /* global address of crbreqmsg  */
@@ -1473,36 +1614,93 @@ static acp_ga_t trashboxga; /* dummy GA used as a target of remote atomics  */
 static char *crbreqmsg;      /* buffer used for sending connection request  */
 static acp_ga_t crbreqmsgga; /* global address of crbreqmsg  */
 
+static mbinfo_t *mbinfo;    /* information of the mailbox of this process */
+static acp_ch_t mbrecvch;   /* receiver endpoint of the mailbox of this process */
+
 /** global variables **/
 int iacpci_eager_limit = ACPCI_DEFAULT_EAGER_LIMIT;
 int iacpci_crb_entrynum = ACPCI_DEFAULT_CRB_ENTRYNUM;
 int iacpci_reqnum = ACPCI_DEFAULT_REQNUM;
 int iacpci_sbnumslots = ACPCI_DEFAULT_SBNUMSLOTS;
 int iacpci_rbnumslots = ACPCI_DEFAULT_RBNUMSLOTS;
+size_t iacpci_rndv_threshold = ACPCI_DEFAULT_RNDV_THRESHOLD;
+int iacpci_mbnumslots = ACPCI_DEFAULT_MBNUMSLOTS;
+
+/* handling locks of channel endpoints */
+static inline int ep_trylock(acp_ch_t ch)
+{
+    return (iacp_enable_hybrid != 1) || spin_trylock(&(ch->lock));
+}
+
+static inline void ep_lock(acp_ch_t ch)
+{
+    if (iacp_enable_hybrid == 1)
+        spin_lock(&(ch->lock));
+}
+
+static inline void ep_unlock(acp_ch_t ch)
+{
+    if (iacp_enable_hybrid == 1)
+        spin_unlock(&(ch->lock));
+}
+
+/* size of a slot */
+static inline size_t slotsz(acp_ch_t ch)
+{
+    return MSGSEQSZ + MSGHDRSZ + MSGALIGN(ch->buf_entrysz) + MSGSEQSZ;
+}
 
 /* query for the local address of the local slot specified by idx */
 static inline void *localslotaddr(acp_ch_t ch, int idx)
 {
-    return ch->chbody + CHSLOTOFFSET + idx * (ch->buf_entrysz + MSGHDRSZ);
+    return ch->chbody + CHSLOTOFFSET + idx * slotsz(ch);
 }
 
 /* query for the global address of the local slot specified by idx */
 static inline acp_ga_t localslotga(acp_ch_t ch, int idx)
 {
-    return ch->localga + CHSLOTOFFSET + idx * (ch->buf_entrysz + MSGHDRSZ);
+    return ch->localga + CHSLOTOFFSET + idx * slotsz(ch);
 }
 
 /* query for the global address of the remote slot specified by idx */
 static inline acp_ga_t remoteslotga(acp_ch_t ch, int idx)
 {
-    return ch->remotega + CHSLOTOFFSET + idx * (ch->buf_entrysz + MSGHDRSZ);
+    return ch->remotega + CHSLOTOFFSET + idx * slotsz(ch);
+}
+
+/* size of the payload of a message in a slot */
+static inline size_t msgpayloadsz(acp_ch_t ch, int64_t msghdr)
+{
+    size_t size = msghdr & MSGSIZEMASK;
+
+    switch (msghdr & MSGTYPEMASK) {
+    case MSGTYEGR:
+        return (size < ch->buf_entrysz) ? size : ch->buf_entrysz;
+    case MSGTYRNDV:
+        return 2 * sizeof(acp_ga_t);
+    default:
+        return 0;
+    }
+}
+
+/* local address of the Seq behind the payload of a message */
+static inline int64_t *msgtailseq(char *msg, size_t payloadsz)
+{
+    return (int64_t *)(msg + MSGSEQSZ + MSGHDRSZ + MSGALIGN(payloadsz));
 }
 
 /* check arrival of messages */
 static inline int msgarrive(acp_ch_t ch)
 {
+    int64_t seq;
+    char *msg;
+
 // NO ATOMIC    return ((*((uint64_t *)ch->chbody) - ch->rbhead) > 0);
-    return (*((int64_t *)ch->chbody+1) > (*((int64_t *)ch->chbody)));
+    seq = *((int64_t *)ch->chbody) + 1;
+    msg = localslotaddr(ch, (seq - 1) % ch->rbuf_entrynum);
+    if (*(volatile int64_t *)msg != seq)
+        return 0;
+    return (*(volatile int64_t *)msgtailseq(msg, msgpayloadsz(ch, *(volatile int64_t *)(msg + MSGSEQSZ))) == seq);
 }
 
 /* check availability of Recv Buffer */
@@ -1530,16 +1728,117 @@ static inline int64_t mkmsghdr(int64_t type, size_t size)
     return (type | size);
 }
 
-/* local address of temporal slot for sending tail */
-static inline int64_t *localtailla(acp_ch_t ch, int sbidx)
+/* put a message prepared in the local slot sbidx to the tail of RecvBuf.
+ * it is sent with its sequence numbers by one acp_copy. */
+static inline void putmsg(acp_ch_t ch, int sbidx, size_t payloadsz)
+{
+    char *msg = localslotaddr(ch, sbidx);
+    int64_t seq;
+    acp_ga_t targetga;
+
+// NO ATOMIC            targetga = remoteslotga(ch, ch->rbtail % ch->rbuf_entrynum);
+    targetga = remoteslotga(ch, *((int64_t *)ch->chbody + 1) % ch->rbuf_entrynum);
+    seq = ++(*((int64_t *)ch->chbody + 1));
+    *(int64_t *)msg = seq;
+    *msgtailseq(msg, payloadsz) = seq;
+    ch->shdl[sbidx] = acp_copy(targetga, localslotga(ch, sbidx), 
+                               MSGSEQSZ + MSGHDRSZ + MSGALIGN(payloadsz) + MSGSEQSZ, ACP_HANDLE_NULL);
+    ch->sbtail++;
+    /* the slot of the ticket of a mailbox sender has been used */
+    ch->mbstate = MBSTNOTICKET;
+}
+
+/* check if the receiver has credits that have not been sent back.
+ * the senders of a mailbox get its head by themselves. */
+static inline int creditpending(acp_ch_t ch)
+{
+    return (ch->type == CHTYRECV) && !ch->mbox && (*((int64_t *)ch->chbody) != ch->rbcredit);
+}
+
+/* check if a connected channel belongs to the idle channels list */
+static inline int chisidle(acp_ch_t ch)
+{
+    return list_isempty(&(ch->reqs)) && !creditpending(ch) && (ch->ncallbacks == 0);
+}
+
+/* send the head of RecvBuf back to the sender, when a batch of credits
+ * (half of the slots) is available or when force is set.
+ * only one of them is in flight, so that the sender never sees the head
+ * going back. */
+static void sendcredit(acp_ch_t ch, int force)
+{
+    int64_t head;
+    acp_handle_t hdl;
+
+    if (ch->mbox)
+        return;
+    head = *((int64_t *)ch->chbody);
+    if ((head == ch->rbcredit) 
+        || (!force && (head - ch->rbcredit < (ch->rbuf_entrynum + 1) / 2)))
+        return;
+    if (acp_inquire(ch->credithdl) != 0)
+        return;
+    hdl = acp_copy(ch->remotega, ch->localga, sizeof(int64_t), ACP_HANDLE_NULL);
+    if (hdl != ACP_HANDLE_NULL) {
+        ch->credithdl = hdl;
+        ch->rbcredit = head;
+    }
+}
+
+/* release the slot of the message at the head of RecvBuf.
+ * the payload and its Seq are cleared, so that stale data is not taken
+ * for the Seq behind the payload of a later message in the slot. */
+static void consumemsg(acp_ch_t ch, char *msg, size_t payloadsz)
+{
+    memset(msg + MSGSEQSZ + MSGHDRSZ, 0, MSGALIGN(payloadsz) + MSGSEQSZ);
+// NO ATOMIC            ch->rbhead++;
+// NO ATOMIC            acp_add8(trashboxga, ch->remotega, 1LL, ACP_HANDLE_NULL);
+    (*((int64_t *)ch->chbody))++;
+    sendcredit(ch, 0);
+}
+
+/* local address of the rendezvous FIN counter */
+static inline int64_t *rndvfinla(acp_ch_t ch)
 {
-    return ((int64_t *)(ch->chbody + CHSLOTOFFSET + ch->sbuf_entrynum * (ch->buf_entrysz + MSGHDRSZ) + sbidx * sizeof(int64_t)));
+    return (int64_t *)(ch->chbody + CHRNDVFINOFFSET);
 }
 
-/* global address of temporal slot for sending tail */
-static inline acp_ga_t localtailga(acp_ch_t ch, int sbidx)
+/* reserve a slot of the mailbox for the next message of a mailbox sender.
+ * returns 1 when the slot of the Ticket is available. */
+static int mbreserve(acp_ch_t ch)
 {
-    return (ch->localga + CHSLOTOFFSET + ch->sbuf_entrynum * (ch->buf_entrysz + MSGHDRSZ) + sbidx * sizeof(int64_t));
+    /* wait for the ticket or the head being fetched */
+    if (acp_inquire(ch->mbhdl) != 0)
+        return 0;
+
+    switch (ch->mbstate) {
+    case MBSTNOTICKET:
+        ch->mbhdl = acp_add8(ch->localga + sizeof(int64_t), ch->remotega + sizeof(int64_t), 
+                             1LL, ACP_HANDLE_NULL);
+        if (ch->mbhdl != ACP_HANDLE_NULL)
+            ch->mbstate = MBSTTICKET;
+        return 0;
+    case MBSTTICKET:
+        if (rbavail(ch)) {
+            ch->mbbackoff = 0;
+            ch->mbskip = 0;
+            return 1;
+        }
+        /* the message of the previous round may remain in the slot. get the head 
+         * again, doubling the polls skipped in between while the receiver is busy,
+         * so that waiting senders do not keep a round trip to it in flight. */
+        if (ch->mbskip > 0) {
+            ch->mbskip--;
+            return 0;
+        }
+        ch->mbhdl = acp_copy(ch->localga, ch->remotega, sizeof(int64_t), ACP_HANDLE_NULL);
+        ch->mbskip = ch->mbbackoff;
+        ch->mbbackoff = (ch->mbbackoff == 0) ? 1 : 
+            ((ch->mbbackoff < MBMAXBACKOFF) ? ch->mbbackoff * 2 : MBMAXBACKOFF);
+        return 0;
+    default:
+        return 0;
+    }
 }
 
 /* initialize connection info
@@ -1572,6 +1871,49 @@ static void init_conninfo(acp_ch_t ch)
 
 }
 
+/* connect a mailbox sender when the information of the mailbox has arrived.
+ * the caller holds chlk and the lock of the channel. */
+static void handl_mbconn(acp_ch_t ch)
+{
+    mbinfo_t *info = (mbinfo_t *)(ch->chbody);
+
+    if (acp_inquire(ch->mbhdl) != 0)
+        return;
+
+    /* the receiver has not created the mailbox yet. get the information again. */
+    if ((info->ga == ACP_GA_NULL) || (info->entrynum <= 0)) {
+        ch->mbhdl = acp_copy(ch->localga, iacp_query_starter_ga_cl(ch->peer) + MBINFO_OFFSET,
+                             sizeof(mbinfo_t), ACP_HANDLE_NULL);
+        return;
+    }
+
+    if (info->buf_entrysz != ch->buf_entrysz) {
+        fprintf(stderr, "handl_mbconn: rank %d : Error: mailbox parameter does not match. peer sz %d/%d\n", 
+                acp_rank(), info->buf_entrysz, ch->buf_entrysz);
+        ch_unlock();
+        iacp_abort_cl();
+    }
+
+    ch->remotega = info->ga;
+    ch->rbuf_entrynum = info->entrynum;
+    ch->state = CHSETSTAT(ch, CHSTCONN);
+    ch->mbhdl = ACP_HANDLE_NULL;
+    ch->mbstate = MBSTNOTICKET;
+#ifdef DEBUG
+    fprintf(stderr, "%d: handl_mbconn: mailbox of rank %d has been connected ga %p slots %d\n", 
+            acp_rank(), ch->peer, ch->remotega, ch->rbuf_entrynum);
+#endif
+
+    /* clear head, ticket and FIN */
+    memset (ch->chbody, 0, CHSLOTOFFSET);
+
+    list_remove(&conch_list, (listitem_t *)ch);
+    if (chisidle(ch))
+        list_add(&idlech_list, (listitem_t *)ch);
+    else
+        list_add(&reqch_list, (listitem_t *)ch);
+}
+
 /* check connecting channels list
  * 
  *  connecting channels list:
@@ -1600,15 +1942,23 @@ static int handl_conchlist(void)
 
     while (ch != NULL) {
         nextch = ch->next;
+        /* skip the channel being used by another thread. it is checked next time. */
+        if (!ep_trylock(ch)) {
+            ch = nextch;
+            continue;
+        }
         switch (ch->type) {
         case CHTYSEND:
+            if (ch->mbox) {
+                handl_mbconn(ch);
+                break;
+            }
             conninfo = (conninfo_t *)(ch->chbody);
             switch (CHCHECKSTAT(ch)) {
             case CHSTINIT:
-                fprintf(stderr, "handl_conchlist: rank %d : Error: head of the connecting channel list cannot be CHSTINIT. \n", 
-                       myrank);
-                ch_unlock();
-                iacp_abort_cl();
+                /* this channel has just become the head of the channels 
+                 * with the same type and peer. start requesting connection. */
+                init_conninfo(ch);
                 break;
             case CHSTWTHD:
                 /* check if head (and tail) has arrived */
@@ -1666,21 +2016,20 @@ static int handl_conchlist(void)
                     list_remove(&conch_list, (listitem_t *)ch);
 
                     /* check if there are pending requests in this channel already */
-                    if (list_isempty(&(ch->reqs)))
+                    if (chisidle(ch))
                         list_add(&idlech_list, (listitem_t *)ch); /* add this channel to idle channels list  */
                     else
                         list_add(&reqch_list, (listitem_t *)ch); /* add this channel to requesting channels list  */
 
                     tmpch = conninfo->nextch;
 
-                    /* check if there is a connecting channel with the same type and peer */
-                    if (tmpch != NULL) {
+                    /* check if there is a connecting channel with the same type and peer.
+                     * the connection of the next channel starts when it is checked in this list. */
+                    if (tmpch != NULL)
                         list_add(&conch_list, (listitem_t *)tmpch); /* add the next channel to the connecting channels list  */
-                        init_conninfo(tmpch); /* start requesting connection of the next channel  */
-                    }
 
                     /* clear chbody */
-                    memset (ch->chbody, 0, CHSLOTOFFSET + ch->sbuf_entrynum * (ch->buf_entrysz + MSGHDRSZ));
+                    memset (ch->chbody, 0, CHSLOTOFFSET + ch->sbuf_entrynum * slotsz(ch));
                 }
                 break;
             default:
@@ -1727,7 +2076,7 @@ static int handl_conchlist(void)
 #endif
 
                     /* clear chbody */
-                    memset (ch->chbody, 0, CHSLOTOFFSET + ch->rbuf_entrynum * (ch->buf_entrysz + MSGHDRSZ));
+                    memset (ch->chbody, 0, CHSLOTOFFSET + ch->rbuf_entrynum * slotsz(ch));
 
                     /* send back GA of this channel to the sender */
                     acp_swap8(trashboxga, ch->remotega + CONNINFO_REMGA_OFFSET,
@@ -1742,7 +2091,7 @@ static int handl_conchlist(void)
                     list_remove(&conch_list, (listitem_t *)ch);
 
                     /* check if there are pending requests in this channel already */
-                    if (list_isempty(&(ch->reqs)))
+                    if (chisidle(ch))
                         list_add(&idlech_list, (listitem_t *)ch); /* add this channel to idle channels list  */
                     else
                         list_add(&reqch_list, (listitem_t *)ch); /* add this channel to requesting channels list  */
@@ -1767,6 +2116,7 @@ static int handl_conchlist(void)
             ch_unlock();
             iacp_abort_cl();
         }
+        ep_unlock(ch);
         ch = nextch;
     }
     ch_unlock();
@@ -1877,6 +2227,9 @@ static chreqitem_t *newreq(acp_ch_t ch)
         req->addr = NULL;
         req->size = 0;
         req->hdl = ACP_HANDLE_NULL;
+        req->atkey = ACP_ATKEY_NULL;
+        req->ga = ACP_GA_NULL;
+        req->callback = NULL;
 #ifdef DEBUG
         fprintf(stderr, "%d: newreq: req %p \n", myrank, req);
 #endif
@@ -1903,6 +2256,22 @@ static int freereq(chreqitem_t *req)
     return 0;
 }
 
+/* check completion of a request. the caller holds the lock of the channel.
+ * a rendezvous send request completes when the receiver has sent FIN for it. */
+static int reqdone(chreqitem_t *req)
+{
+    acp_ch_t ch = req->ch;
+
+    if ((req->status == REQSTRNDVWT) && (*rndvfinla(ch) >= req->rndvseq)) {
+        acp_unregister_memory(req->atkey);
+        req->status = REQSTFIN;
+    }
+    if (req->status != REQSTFIN)
+        return 0;
+
+    return (ch->type == CHTYRECV) || (acp_inquire(req->hdl) == 0);
+}
+
 /* progress send requests in a channel */
 static void progress_send(acp_ch_t ch)
 {
@@ -1911,8 +2280,6 @@ static void progress_send(acp_ch_t ch)
     int myrank;
     char *msg;
     size_t thissize;
-    acp_ga_t targetga;
-    acp_handle_t hdl;
 
     myrank = acp_rank();
     req = (chreqitem_t *)(ch->reqs.head);
@@ -1926,7 +2293,19 @@ static void progress_send(acp_ch_t ch)
                 break;
         }
 
-        if (!(sbavail(ch)) || !(rbavail(ch)))
+        /* a mailbox has no connection to close. the sender finishes after
+         * its messages have been sent and read by the receiver. */
+        if (ch->mbox && (req->status == REQSTDISCONN)) {
+            if (sbnotempty(ch) || (*rndvfinla(ch) < ch->rndvseq))
+                break;
+            ch->state = CHSTDISCONN;
+            req->status = REQSTFIN;
+            req->hdl = ACP_HANDLE_NULL;
+            list_remove (&(ch->reqs), (listitem_t *)req);
+            break;
+        }
+
+        if (!(sbavail(ch)) || (ch->mbox && !mbreserve(ch)) || !(rbavail(ch)))
             break;
 
 // NANRI
@@ -1940,35 +2319,23 @@ static void progress_send(acp_ch_t ch)
 
         switch(req->status){
         case REQSTEGR:
-            *(int64_t *)msg = mkmsghdr(MSGTYEGR, req->size);
+            *(int64_t *)(msg + MSGSEQSZ) = mkmsghdr(MSGTYEGR, req->size);
             thissize = (req->size < ch->buf_entrysz) ? req->size : ch->buf_entrysz;
-            memcpy(msg + MSGHDRSZ, req->addr, thissize);
-// NO ATOMIC            targetga = remoteslotga(ch, ch->rbtail % ch->rbuf_entrynum);
-            targetga = remoteslotga(ch, *((int64_t *)ch->chbody + 1) % ch->rbuf_entrynum);
+            memcpy(msg + MSGSEQSZ + MSGHDRSZ, req->addr, thissize);
 // NANRI
 #ifdef DEBUG
     fprintf(stderr, "%d: progress_send: acp_copy target %p source %p size %d req->size %d\n", 
-            myrank, targetga, localslotga(ch, sbidx), thissize + MSGHDRSZ, req->size);
+            myrank, remoteslotga(ch, *((int64_t *)ch->chbody + 1) % ch->rbuf_entrynum), localslotga(ch, sbidx), thissize, req->size);
 #endif
-            hdl = acp_copy(targetga, localslotga(ch, sbidx), thissize + MSGHDRSZ, ACP_HANDLE_NULL);
 // NO ATOMIC            ch->rbtail++;
-#ifdef DEBUG
-    fprintf(stderr, "%d: progress_send: acp_add8 target %p source %p \n", 
-            myrank, trashboxga, ch->remotega);
-#endif
 // NO ATOMIC            acp_add8(trashboxga, ch->remotega, 1LL, ch->shdl[sbidx]);
-            (*((int64_t *)ch->chbody + 1))++;
-//            acp_copy(ch->remotega + 8, ch->localga + 8, sizeof(uint64_t), ch->shdl[sbidx]);
-            *((int64_t *)localtailla(ch, sbidx)) = *((int64_t *)ch->chbody + 1);
-//            ch->shdl[sbidx] = acp_copy(ch->remotega + 8, localtailga(ch, sbidx), sizeof(int64_t), hdl);
-            ch->shdl[sbidx] = acp_copy(ch->remotega + 8, localtailga(ch, sbidx), sizeof(int64_t), ACP_HANDLE_NULL);
+            putmsg(ch, sbidx, thissize);
 
 // NANRI
 #ifdef DEBUG
     fprintf(stderr, "%d: progress_send: done\n", 
             myrank);
 #endif
-            ch->sbtail++;
             req->addr += thissize;
             req->size -= thissize;
             if (req->size <= 0) {
@@ -1979,20 +2346,26 @@ static void progress_send(acp_ch_t ch)
                 req = nextreq;
             }
             break;
+        case REQSTRNDV:
+            /* send only the GA of the user buffer. the receiver reads the payload from it. */
+            *(int64_t *)(msg + MSGSEQSZ) = mkmsghdr(MSGTYRNDV, req->size);
+            *(acp_ga_t *)(msg + MSGSEQSZ + MSGHDRSZ) = req->ga;
+            *(acp_ga_t *)(msg + MSGSEQSZ + MSGHDRSZ + sizeof(acp_ga_t)) = ch->localga + CHRNDVFINOFFSET;
+            putmsg(ch, sbidx, 2 * sizeof(acp_ga_t));
+
+            req->rndvseq = ++ch->rndvseq;
+            req->status = REQSTRNDVWT;
+            req->hdl = ch->shdl[sbidx];
+            nextreq = req->next;
+            list_remove (&(ch->reqs), (listitem_t *)req);
+            req = nextreq;
+            break;
         case REQSTDISCONN:
-            *(int64_t *)msg = mkmsghdr(MSGTYDISCONN, 0);
-// NO ATOMIC            targetga = remoteslotga(ch, ch->rbtail % ch->rbuf_entrynum);
-            targetga = remoteslotga(ch, *((int64_t *)ch->chbody + 1) % ch->rbuf_entrynum);
-            hdl = acp_copy(targetga, localslotga(ch, sbidx), MSGHDRSZ, ACP_HANDLE_NULL);
+            *(int64_t *)(msg + MSGSEQSZ) = mkmsghdr(MSGTYDISCONN, 0);
 // NO ATOMIC            ch->rbtail++;
 // NO ATOMIC            acp_add8(trashboxga, ch->remotega, 1LL, ch->shdl[sbidx]);
-            (*((int64_t *)ch->chbody + 1))++;
-//            acp_copy(ch->remotega + 8, ch->localga + 8, sizeof(uint64_t), ch->shdl[sbidx]);
-            *((int64_t *)localtailla(ch, sbidx)) = *((int64_t *)ch->chbody + 1);
-//            ch->shdl[sbidx] = acp_copy(ch->remotega + 8, localtailga(ch, sbidx), sizeof(int64_t), hdl);
-            ch->shdl[sbidx] = acp_copy(ch->remotega + 8, localtailga(ch, sbidx), sizeof(int64_t), ACP_HANDLE_NULL);
+            putmsg(ch, sbidx, 0);
 
-            ch->sbtail++;
             req->status = REQSTFIN;
             req->hdl = ch->shdl[sbidx];
             if (req->next != NULL) {
@@ -2022,19 +2395,76 @@ static void progress_recv(acp_ch_t ch)
     int64_t msghdr, msgtype;
     int myrank, rbidx;
     size_t msgsz, thissize, tmpsize;
-    acp_handle_t hdl;
+    acp_ga_t srcga;
 
     myrank = acp_rank();
     req = (chreqitem_t *)(ch->reqs.head);
 
     while (req) {
+        if (req->status == REQSTRNDVSLOT) {
+            /* copy the piece read into the slot at the head, and read the next one.
+             * the slot is released after the last piece. */
+            if (acp_inquire(req->hdl) != 0)
+                break;
+            rbidx = *((int64_t *)ch->chbody) % ch->rbuf_entrynum;
+            msg = localslotaddr(ch, rbidx);
+            if (req->hdl != ACP_HANDLE_NULL) {
+                thissize = req->size - req->receivedsize;
+                thissize = (thissize < ch->buf_entrysz) ? thissize : ch->buf_entrysz;
+                memcpy((char *)req->addr + req->receivedsize, msg + MSGSEQSZ + MSGHDRSZ, thissize);
+                req->receivedsize += thissize;
+                req->hdl = ACP_HANDLE_NULL;
+            }
+            if (req->receivedsize < req->size) {
+                thissize = req->size - req->receivedsize;
+                thissize = (thissize < ch->buf_entrysz) ? thissize : ch->buf_entrysz;
+                do {
+                    req->hdl = acp_copy(localslotga(ch, rbidx) + MSGSEQSZ + MSGHDRSZ, 
+                                        req->srcga + req->receivedsize, thissize, ACP_HANDLE_NULL);
+                } while (req->hdl == ACP_HANDLE_NULL);
+                break;
+            }
+            consumemsg(ch, msg, ch->buf_entrysz);
+            /* send FIN to the sender */
+            req->status = REQSTRNDV;
+            continue;
+        }
+
+        if (req->status == REQSTRNDV) {
+            /* wait for the read of the rendezvous message, then send FIN to the sender */
+            if (acp_inquire(req->hdl) != 0)
+                break;
+            if (req->atkey != ACP_ATKEY_NULL)
+                acp_unregister_memory(req->atkey);
+            if (ch->mbox) {
+                /* req->ga is the GA of Rendezvous FIN of the sender */
+                acp_add8(trashboxga, req->ga, 1LL, ACP_HANDLE_NULL);
+            } else {
+                (*rndvfinla(ch))++;
+                acp_copy(ch->remotega + CHRNDVFINOFFSET, ch->localga + CHRNDVFINOFFSET, sizeof(int64_t), ACP_HANDLE_NULL);
+            }
+            req->status = REQSTFIN;
+            nextreq = req->next;
+            list_remove(&(ch->reqs), (listitem_t *)req);
+            req = nextreq;
+            continue;
+        }
+
+        /* a mailbox has no connection to close */
+        if (ch->mbox && (req->status == REQSTDISCONN)) {
+            ch->state = CHSTDISCONN;
+            req->status = REQSTFIN;
+            list_remove (&(ch->reqs), (listitem_t *)req);
+            break;
+        }
+
         if (!msgarrive(ch)) 
             break;
 
 // NO ATOMIC        rbidx = ch->rbhead % ch->rbuf_entrynum;
         rbidx = *((int64_t *)ch->chbody) % ch->rbuf_entrynum;
         msg = localslotaddr(ch, rbidx);
-        msghdr = *((int64_t *)msg);
+        msghdr = *((int64_t *)(msg + MSGSEQSZ));
         msgtype = msghdr & MSGTYPEMASK;
 
 // NANRI
@@ -2046,31 +2476,57 @@ static void progress_recv(acp_ch_t ch)
 
         switch (req->status) {
         case REQSTINIT:
+            if (msgtype == MSGTYRNDV) {
+                /* rendezvous: read the payload from the send buffer directly into the receive buffer */
+                msgsz = msghdr & MSGSIZEMASK;
+                srcga = *(acp_ga_t *)(msg + MSGSEQSZ + MSGHDRSZ);
+                req->ga = *(acp_ga_t *)(msg + MSGSEQSZ + MSGHDRSZ + sizeof(acp_ga_t));
+                thissize = (msgsz < req->size) ? msgsz : req->size;
+                if (thissize > 0) {
+                    req->atkey = acp_register_memory(req->addr, thissize, 0);
+                    if (req->atkey == ACP_ATKEY_NULL) {
+                        /* as acp_nbsend_ch falls back to eager messages, read the
+                         * payload in pieces through the slot of this message, which 
+                         * is kept until the last piece has been read. */
+                        req->srcga = srcga;
+                        req->size = thissize;
+                        req->receivedsize = 0;
+                        req->hdl = ACP_HANDLE_NULL;
+                        req->status = REQSTRNDVSLOT;
+                        continue;
+                    }
+                }
+
+                /* release the slot before reading the payload */
+                consumemsg(ch, msg, msgpayloadsz(ch, msghdr));
+
+                req->hdl = ACP_HANDLE_NULL;
+                if (thissize > 0) {
+                    do {
+                        req->hdl = acp_copy(acp_query_ga(req->atkey, req->addr), srcga, thissize, ACP_HANDLE_NULL);
+                    } while (req->hdl == ACP_HANDLE_NULL);
+                }
+                req->receivedsize = thissize;
+                req->status = REQSTRNDV;
+                continue;
+            }
+            /* fall through */
         case REQSTEGR:
-            /* At this point, since there is only one protocol, 
-             * REQSTINIT does the same thing as REQSTEGR.
-             * When other protocols become available, REQSTINIT chooses
-             * the protocol to use according to the first message.
-             */
             if (msgtype != MSGTYEGR){
                 fprintf(stderr, "progress_recv: %d : Error: Types of the request and the message does not match req: %d, msg: %lld\n", 
                         myrank, req->status, msgtype);
                 iacp_abort_cl();
             }
+            msgsz = msghdr & MSGSIZEMASK;
             if (req->size > req->receivedsize){
-                msgsz = msghdr & MSGSIZEMASK;
                 thissize = (msgsz < ch->buf_entrysz) ? msgsz : ch->buf_entrysz;
                 tmpsize = req->size - req->receivedsize;
                 thissize = (thissize < tmpsize) ? thissize : tmpsize;
-                memcpy(req->addr, msg + MSGHDRSZ, thissize);
+                memcpy(req->addr, msg + MSGSEQSZ + MSGHDRSZ, thissize);
                 req->receivedsize += thissize;
                 req->addr += thissize;
             }
-// NO ATOMIC            ch->rbhead++;
-// NO ATOMIC            acp_add8(trashboxga, ch->remotega, 1LL, ACP_HANDLE_NULL);
-            (*((int64_t *)ch->chbody))++;
-            hdl = acp_copy(ch->remotega, ch->localga, sizeof(int64_t), ACP_HANDLE_NULL);
-            acp_complete(hdl);
+            consumemsg(ch, msg, msgpayloadsz(ch, msghdr));
             if (msgsz <= ch->buf_entrysz) {
                 req->status = REQSTFIN;
                 nextreq = req->next;
@@ -2097,11 +2553,11 @@ static void progress_recv(acp_ch_t ch)
                 iacp_abort_cl();
             }
 
-// NO ATOMIC            ch->rbhead++;
-// NO ATOMIC            acp_add8(trashboxga, ch->remotega, 1LL, ACP_HANDLE_NULL);
-            (*((int64_t *)ch->chbody))++;
-            hdl = acp_copy(ch->remotega, ch->localga, sizeof(int64_t), ACP_HANDLE_NULL);
-            acp_complete(hdl);
+            /* the sender waits for all credits before freeing the channel */
+            consumemsg(ch, msg, 0);
+            while (creditpending(ch))
+                sendcredit(ch, 1);
+            acp_complete(ch->credithdl);
 
             ch->state = CHSTDISCONN;
             req->status = REQSTFIN;
@@ -2119,45 +2575,137 @@ static void progress_recv(acp_ch_t ch)
             iacp_abort_cl();
         }
     }
+
+    /* no receive request is waiting for more messages. send the remaining credits back.
+     * otherwise, retry a batch skipped while the previous one was in flight, 
+     * since the sender may be waiting for it to send the next message. */
+    sendcredit(ch, list_isempty(&(ch->reqs)));
 }
 
-/* check requesting channels */
+/* progress requests of a connected channel.
+ * the caller holds the lock of the channel. */
+static void progress_ep(acp_ch_t ch)
+{
+    int myrank;
+
+    myrank = acp_rank();
+
+    switch(ch->type) {
+    case CHTYSEND:
+        progress_send(ch);
+        break;
+    case CHTYRECV:
+        progress_recv(ch);
+        break;
+    default:
+        fprintf(stderr, "progress_ep: rank %d : Error: wrong channel type %d\n", 
+               myrank, ch->type);
+        ep_unlock(ch);
+        iacp_abort_cl();
+    }
+}
+
+/* move a channel from the requesting channels list to the idle channels list
+ * if its request list is empty and all credits have been sent back.
+ * the caller holds the lock of the channel and chlk. */
+static void idle_ep(acp_ch_t ch)
+{
+    if (chisidle(ch)) {
+        list_remove(&reqch_list, (listitem_t *)ch);
+        list_add(&idlech_list, (listitem_t *)ch);
+#ifdef DEBUG
+        fprintf(stderr, "%d: idle_ep: move channel %p from request list to idle list crbhead %lld crbtail %lld\n", acp_rank(), ch, *crbhead, *crbtail);
+#endif
+    }
+}
+
+/* take the completed requests with callbacks out of a channel, and chain 
+ * them to the list done. the caller holds the lock of the channel, and 
+ * invokes the callbacks with invoke_callbacks() after releasing all locks. */
+static chreqitem_t *take_callbacks(acp_ch_t ch, chreqitem_t *done)
+{
+    chreqitem_t *req;
+    int i;
+
+    for (i = 0; i < iacpci_reqnum; i++) {
+        req = &(ch->reqtable[i]);
+        if ((req->callback != NULL) && (req->status != REQSTCALLBACK) && reqdone(req)) {
+            req->status = REQSTCALLBACK;
+            req->next = done;
+            done = req;
+        }
+    }
+
+    return done;
+}
+
+/* invoke the callbacks of the requests taken by take_callbacks().
+ * each request is freed before its callback, so that the callback can 
+ * start new requests in the channel. */
+static void invoke_callbacks(chreqitem_t *done)
+{
+    chreqitem_t *req;
+    acp_ch_t ch;
+    acp_callback_ch_t callback;
+    void *cbarg;
+    size_t size;
+
+    while (done != NULL) {
+        req = done;
+        done = req->next;
+        ch = req->ch;
+        callback = req->callback;
+        cbarg = req->cbarg;
+        size = (ch->type == CHTYRECV) ? req->receivedsize : 0;
+        IACPBL_TRACE(IACPBL_TRACE_ASYNC_END, "cl", (ch->type == CHTYSEND) ? "send" : "recv", req, 0);
+
+        ep_lock(ch);
+        req->callback = NULL;
+        freereq(req);
+        ch->ncallbacks--;
+        /* the channel has stayed in the requesting channels list for this callback */
+        ch_lock();
+        idle_ep(ch);
+        ch_unlock();
+        ep_unlock(ch);
+
+        callback(req, size, cbarg);
+    }
+}
+
+/* check requesting channels.
+ * chlk is released while a channel is progressed, so that other threads can
+ * create, use and progress other channels meanwhile. the channel stays in 
+ * the list since only the holder of its lock moves it to the idle list. */
 static void handl_reqchlist(void)
 {
     acp_ch_t ch, nextch;
-    int myrank;
+    chreqitem_t *done = NULL;
 
     ch_lock();
-    myrank = acp_rank();
     ch = (acp_ch_t)(reqch_list.head);
 
     while (ch != NULL) {
-        switch(ch->type) {
-        case CHTYSEND:
-            progress_send(ch);
-            break;
-        case CHTYRECV:
-            progress_recv(ch);
-            break;
-        default:
-            fprintf(stderr, "handl_reqchlist: rank %d : Error: wrong channel type %d\n", 
-                   myrank, ch->type);
-            ch_unlock();
-            iacp_abort_cl();
+        /* skip the channel being progressed by another thread */
+        if (!ep_trylock(ch)) {
+            ch = ch->next;
+            continue;
         }
+        ch_unlock();
 
+        progress_ep(ch);
+        if (ch->ncallbacks > 0)
+            done = take_callbacks(ch, done);
+
+        ch_lock();
         nextch = ch->next;
-        /* if request list is empty, move the channel to the idle channels list */
-        if (list_isempty(&(ch->reqs))) {
-            list_remove(&reqch_list, (listitem_t *)ch);
-            list_add(&idlech_list, (listitem_t *)ch);
-#ifdef DEBUG
-            fprintf(stderr, "%d: handl_reqchlist: move channel %p from request list to idle list crbhead %lld crbtail %lld\n", myrank, ch, *crbhead, *crbtail);
-#endif
-        }
+        idle_ep(ch);
+        ep_unlock(ch);
         ch = nextch;
     }
     ch_unlock();
+
+    invoke_callbacks(done);
 }
 
 /* progress */
@@ -2241,10 +2789,10 @@ int iacp_init_cl(void)
     /* crq (connection request queue for Segbuf) */
     crqsz = 16 + crq_num_slots * sizeof(acp_ga_t);
 
-    /* starter_memory_cl = crb + crq + trashbox */
-    if (iacp_starter_memory_size_cl < (crbsz + crqsz + sizeof(acp_ga_t))) {
-        fprintf(stderr, "iacp_init_cl: %d : Error iacp_starter_memory_size_cl %lu is too small for %d + %d + %d\n",
-                myrank, iacp_starter_memory_size_cl, crbsz, crqsz, sizeof(acp_ga_t));
+    /* starter_memory_cl = crb + crq + trashbox + mbinfo */
+    if (iacp_starter_memory_size_cl < (MBINFO_OFFSET + sizeof(mbinfo_t))) {
+        fprintf(stderr, "iacp_init_cl: %d : Error iacp_starter_memory_size_cl %zu is too small for %d + %d + %zu + %zu\n",
+                myrank, iacp_starter_memory_size_cl, crbsz, crqsz, sizeof(acp_ga_t), sizeof(mbinfo_t));
         iacp_abort_cl();
     }
 #ifdef DEBUG
@@ -2253,6 +2801,11 @@ int iacp_init_cl(void)
 
     trashboxga = iacp_query_starter_ga_cl(myrank) + crbsz + crqsz;
 
+    /* no mailbox yet */
+    mbinfo = (mbinfo_t *)((char *)acp_query_address(iacp_query_starter_ga_cl(myrank)) + MBINFO_OFFSET);
+    mbinfo->ga = ACP_GA_NULL;
+    mbrecvch = NULL;
+
     init_ch();
 
     init_segbuf();
@@ -2262,6 +2815,9 @@ int iacp_init_cl(void)
   
     ch_unlock();
 
+    /* progress thread of the channels, if requested */
+    if (iacpcl_start_progress_thread()) return -1;
+
     return 0; 
 };
 
@@ -2304,6 +2860,9 @@ int iacp_finalize_cl(void)
     iacp_initialized_cl = 0;
     ch_unlock();
 
+    /* stop progressing the channels before freeing them */
+    iacpcl_stop_progress_thread();
+
     finalize_ch();
     finalize_segbuf();
 
@@ -2347,12 +2906,12 @@ void iacp_abort_cl(void)
  *  allocate
  *    - src process:
  *        endpoint: sizeof(chitem_t)
- *        send buffer: 8*3+sbuf_entrynum*(buf_entrysz+MSGHDRSZ)
+ *        send buffer: 8*3+sbuf_entrynum*(MSGSEQSZ+MSGHDRSZ+buf_entrysz+MSGSEQSZ)
  *        send handle table: sizeof(acp_handle_t)*sbuf_entrynum
  *        requests: sizeof(chreqitem_t)*acpch_chreqnum
  *    - dst process: 
  *        endpoint: sizeof(chitem_t)
- *        receive buffer: 8*3+rbuf_entrynum*(buf_entrysz+MSGHDRSZ)
+ *        receive buffer: 8*3+rbuf_entrynum*(MSGSEQSZ+MSGHDRSZ+buf_entrysz+MSGSEQSZ)
  *        requests: sizeof(chreqitem_t)*acpch_chreqnum
  *
  */
@@ -2364,7 +2923,6 @@ acp_ch_t acp_create_ch(int src, int dst)
     acp_ch_t ch, conch;
     conninfo_t *conninfo;
 
-    ch_lock();
     myrank = acp_rank();
     procs = acp_procs();
 
@@ -2375,13 +2933,11 @@ acp_ch_t acp_create_ch(int src, int dst)
     if ((src < 0) || (src >= procs) || (dst < 0) || (dst >= procs)) {
         fprintf(stderr, "acp_create_ch: rank %d : Error: Wrong paramter src %d, dst %d (procs = %d) \n",
                myrank, src, dst, procs);
-        ch_unlock();
         iacp_abort_cl();
     }
     if (src == dst) {
         fprintf(stderr, "acp_create_ch: rank %d : Error: ACP does not support loop back channel (src %d, dst %d) \n",
                myrank, src, dst);
-        ch_unlock();
         iacp_abort_cl();
     }
 
@@ -2393,7 +2949,6 @@ acp_ch_t acp_create_ch(int src, int dst)
     } else {
         fprintf(stderr, "acp_create_ch: rank %d : Error: ACP does not support remote-to-remote channel (src %d, dst %d) \n",
                myrank, src, dst);
-        ch_unlock();
         iacp_abort_cl();
     }
 
@@ -2401,7 +2956,6 @@ acp_ch_t acp_create_ch(int src, int dst)
     ch = (acp_ch_t)malloc(sizeof(chitem_t));
     if (ch == NULL) {
         fprintf(stderr, "acp_create_ch: rank %d : Error: cannot allocate channel endpoint structure \n", myrank);
-        ch_unlock();
         iacp_abort_cl();
     }
 
@@ -2411,6 +2965,8 @@ acp_ch_t acp_create_ch(int src, int dst)
     ch->buf_entrysz = iacpci_eager_limit;
     ch->sbuf_entrynum = iacpci_sbnumslots;
     ch->rbuf_entrynum = iacpci_rbnumslots;
+    ch->lock = 0;
+    ch->mbox = 0;
 
     /* setup request list */
     initreq(ch);
@@ -2419,38 +2975,39 @@ acp_ch_t acp_create_ch(int src, int dst)
     if (ch->type == CHTYSEND) { /* sender */
         ch->peer = dst;
 
-        memsize = CHSLOTOFFSET + ch->sbuf_entrynum * (ch->buf_entrysz + MSGHDRSZ) + ch->sbuf_entrynum * sizeof(int64_t);
+        memsize = CHSLOTOFFSET + ch->sbuf_entrynum * slotsz(ch);
         ch->shdl = (acp_handle_t *)malloc(sizeof(acp_handle_t) * ch->sbuf_entrynum);
     } else { /* receiver */
         ch->peer = src;
 
-        memsize = CHSLOTOFFSET + ch->rbuf_entrynum * (ch->buf_entrysz + MSGHDRSZ);
+        memsize = CHSLOTOFFSET + ch->rbuf_entrynum * slotsz(ch);
         ch->shdl = NULL;
     }
 
     ch->chbody = (char *)malloc(memsize);
     if (ch->chbody == NULL) {
         fprintf(stderr, "acp_create_ch: rank %d : Error: cannot allocate chbody \n", myrank);
-        ch_unlock();
         iacp_abort_cl();
     }
 
     /* initialize head and tail */
     ch->sbhead = 0LL;
     ch->sbtail = 0LL;
+    ch->rndvseq = 0LL;
+    ch->rbcredit = 0LL;
+    ch->credithdl = ACP_HANDLE_NULL;
+    ch->ncallbacks = 0;
 // NO ATOMIC    ch->rbhead = 0LL;
 // NO ATOMIC    ch->rbtail = 0LL;
 
     ch->localatkey = acp_register_memory(ch->chbody, memsize, 0);
     if (ch->localatkey == ACP_ATKEY_NULL){
         fprintf(stderr, "acp_create_ch: rank %d : Error: acp_register_memory failed for creating channel. \n", myrank);
-        ch_unlock();
         iacp_abort_cl();
     }
     ch->localga = acp_query_ga(ch->localatkey, ch->chbody);
     if (ch->localga == ACP_ATKEY_NULL){
         fprintf(stderr, "acp_create_ch: rank %d : Error: acp_query_ga failed for creating channel. \n", myrank);
-        ch_unlock();
         iacp_abort_cl();
     }
 
@@ -2484,10 +3041,13 @@ acp_ch_t acp_create_ch(int src, int dst)
     /* prepare value 1 to be used for sending flag to CRB */
     *((char *)(ch->chbody) + CRBFLG_OFFSET) = 1;
 
+    /* the connecting channels list is shared among threads */
+    ch_lock();
+
     /* search for the connection requests with same peer and type */
     conch = (acp_ch_t)(conch_list.head);
     while (conch != NULL) {
-        if ((conch->type == ch->type) && (conch->peer == ch->peer))
+        if ((conch->type == ch->type) && (conch->peer == ch->peer) && !conch->mbox)
             break;
         conch = conch->next;
     }
@@ -2526,12 +3086,154 @@ acp_ch_t acp_create_ch(int src, int dst)
     return ch;
 }
 
+/* acp_ch_t acp_create_mbox_ch(int receiver)
+ *  parameters: 
+ *    int receiver : receiver process of the mailbox
+ *
+ *  return:
+ *    acp_ch_t : success. an endpoint handle of the mailbox.
+ *
+ *  error:
+ *    - receiver is not within the 0 <= p < procs
+ *    - the receiver already has a mailbox
+ *    - memory not available
+ *    
+ *  behavior
+ *    - receiver: allocate the mailbox, publish its information in the starter
+ *      memory, and connect this endpoint to idlech_list
+ *    - sender: start getting the information of the mailbox, and connect this
+ *      endpoint to conch_list
+ *    - progress
+ *
+ *  allocate
+ *    - sender:
+ *        endpoint: sizeof(chitem_t)
+ *        send buffer: 8*3+sbuf_entrynum*(MSGSEQSZ+MSGHDRSZ+buf_entrysz+MSGSEQSZ)
+ *        send handle table: sizeof(acp_handle_t)*sbuf_entrynum
+ *        requests: sizeof(chreqitem_t)*acpch_chreqnum
+ *    - receiver: 
+ *        endpoint: sizeof(chitem_t)
+ *        mailbox: 8*3+iacpci_mbnumslots*(MSGSEQSZ+MSGHDRSZ+buf_entrysz+MSGSEQSZ)
+ *        requests: sizeof(chreqitem_t)*acpch_chreqnum
+ *
+ */
+acp_ch_t acp_create_mbox_ch(int receiver)
+{
+    int myrank, procs;
+    size_t memsize;
+    acp_ch_t ch;
+
+    myrank = acp_rank();
+    procs = acp_procs();
+
+    /* check parameters */
+    if ((receiver < 0) || (receiver >= procs)) {
+        fprintf(stderr, "acp_create_mbox_ch: rank %d : Error: Wrong paramter receiver %d (procs = %d) \n",
+               myrank, receiver, procs);
+        iacp_abort_cl();
+    }
+
+    /* allocate channel endpoint */
+    ch = (acp_ch_t)malloc(sizeof(chitem_t));
+    if (ch == NULL) {
+        fprintf(stderr, "acp_create_mbox_ch: rank %d : Error: cannot allocate channel endpoint structure \n", myrank);
+        iacp_abort_cl();
+    }
+
+    /* set common members */
+    ch->type = (receiver == myrank) ? CHTYRECV : CHTYSEND;
+    ch->state = CHSTINIT;
+    ch->peer = receiver;
+    ch->buf_entrysz = iacpci_eager_limit;
+    ch->sbuf_entrynum = iacpci_sbnumslots;
+    ch->rbuf_entrynum = iacpci_mbnumslots;
+    ch->lock = 0;
+    ch->mbox = 1;
+    ch->mbstate = MBSTNOTICKET;
+    ch->mbhdl = ACP_HANDLE_NULL;
+    ch->mbbackoff = 0;
+    ch->mbskip = 0;
+
+    /* setup request list */
+    initreq(ch);
+
+    if (ch->type == CHTYSEND) { /* sender */
+        memsize = CHSLOTOFFSET + ch->sbuf_entrynum * slotsz(ch);
+        ch->shdl = (acp_handle_t *)malloc(sizeof(acp_handle_t) * ch->sbuf_entrynum);
+    } else { /* receiver */
+        memsize = CHSLOTOFFSET + ch->rbuf_entrynum * slotsz(ch);
+        ch->shdl = NULL;
+    }
+
+    ch->chbody = (char *)malloc(memsize);
+    if (ch->chbody == NULL) {
+        fprintf(stderr, "acp_create_mbox_ch: rank %d : Error: cannot allocate chbody \n", myrank);
+        iacp_abort_cl();
+    }
+    memset (ch->chbody, 0, memsize);
+
+    ch->sbhead = 0LL;
+    ch->sbtail = 0LL;
+    ch->rndvseq = 0LL;
+    ch->rbcredit = 0LL;
+    ch->credithdl = ACP_HANDLE_NULL;
+    ch->ncallbacks = 0;
+
+    ch->localatkey = acp_register_memory(ch->chbody, memsize, 0);
+    if (ch->localatkey == ACP_ATKEY_NULL){
+        fprintf(stderr, "acp_create_mbox_ch: rank %d : Error: acp_register_memory failed for creating mailbox. \n", myrank);
+        iacp_abort_cl();
+    }
+    ch->localga = acp_query_ga(ch->localatkey, ch->chbody);
+    ch->remotega = ACP_GA_NULL;
+
+    /* the channel lists and the information of the mailbox are shared among threads */
+    ch_lock();
+
+    if (ch->type == CHTYRECV) {
+        if (mbrecvch != NULL) {
+            fprintf(stderr, "acp_create_mbox_ch: rank %d : Error: this process already has a mailbox \n", myrank);
+            ch_unlock();
+            iacp_abort_cl();
+        }
+        mbrecvch = ch;
+
+        /* publish the information. ga is set last, since senders 
+         * take the information with a non-null ga as valid. */
+        mbinfo->entrynum = ch->rbuf_entrynum;
+        mbinfo->buf_entrysz = ch->buf_entrysz;
+        sync_synchronize();
+        mbinfo->ga = ch->localga;
+
+        ch->state = CHSTCONN;
+        list_add(&idlech_list, (listitem_t *)ch);
+    } else {
+        /* start getting the information of the mailbox */
+        ch->mbhdl = acp_copy(ch->localga, iacp_query_starter_ga_cl(receiver) + MBINFO_OFFSET,
+                             sizeof(mbinfo_t), ACP_HANDLE_NULL);
+        ch->state = CHSTWTHD;
+        list_add(&conch_list, (listitem_t *)ch);
+    }
+#ifdef DEBUG
+    fprintf(stderr, "%d: acp_create_mbox_ch: ch %p receiver %d localga %016llx sz %d sb %d mb %d\n", 
+            myrank, ch, receiver, ch->localga, ch->buf_entrysz, ch->sbuf_entrynum, ch->rbuf_entrynum);
+#endif
+
+    ch_unlock();
+
+    /* progress requests */
+    iacpcl_progress();
+
+    /* return channel endpoint handle */
+    return ch;
+}
+
 acp_request_t acp_nbfree_ch(acp_ch_t ch)
 {
     chreqitem_t *req;
     int myrank;
 
-    ch_lock();
+    ep_lock(ch);
     myrank = acp_rank();
 
 #ifdef DEBUG
@@ -2540,20 +3242,30 @@ acp_request_t acp_nbfree_ch(acp_ch_t ch)
     if (CHCHECKDISCON(ch) != 0) {
         fprintf(stderr, "acp_nbfree_ch: rank %d : Error: channel has already been requested to disconnect\n", 
                myrank);
-        ch_unlock();
+        ep_unlock(ch);
         iacp_abort_cl();
     }
 
     /* if the request list of this channel is empty, move it to reqch_list  */
-    if ((CHCHECKSTAT(ch) == CHSTCONN) && (list_isempty(&(ch->reqs)))) {
+    if ((CHCHECKSTAT(ch) == CHSTCONN) && chisidle(ch)) {
+        ch_lock();
         list_remove(&idlech_list, (listitem_t *)ch);
         list_add(&reqch_list, (listitem_t *)ch);
+        ch_unlock();
 #ifdef DEBUG
         fprintf(stderr, "%d: acp_nbfree_ch: moved channel %p from idle to requesting crbhead %lld crbtail %lld\n", 
                 myrank, ch, *crbhead, *crbtail);
 #endif
     }
 
+    /* a mailbox does not accept new senders after this */
+    if (ch->mbox && (ch->type == CHTYRECV)) {
+        ch_lock();
+        mbinfo->ga = ACP_GA_NULL;
+        mbrecvch = NULL;
+        ch_unlock();
+    }
+
     /* add disconnection request */
     req = newreq(ch);
     if (req != NULL) {
@@ -2565,7 +3277,7 @@ acp_request_t acp_nbfree_ch(acp_ch_t ch)
         ch->state = CHSETDISCON(ch);
     }
 
-    ch_unlock();
+    ep_unlock(ch);
 
     /* progress */
     iacpcl_progress();
@@ -2588,7 +3300,7 @@ acp_request_t acp_nbsend_ch(acp_ch_t ch, void *sbuf, size_t sz)
     chreqitem_t *req;
     int myrank;
 
-    ch_lock();
+    ep_lock(ch);
     myrank = acp_rank();
 
 #ifdef DEBUG
@@ -2598,21 +3310,23 @@ acp_request_t acp_nbsend_ch(acp_ch_t ch, void *sbuf, size_t sz)
     if (sz > MSGMAXSZ){
         fprintf(stderr, "acp_nbsend_ch: rank %d : Error: message size is too large: %lu\n", 
                 myrank, sz);
-        ch_unlock();
+        ep_unlock(ch);
         iacp_abort_cl();
     }
 
     if (CHCHECKDISCON(ch) != 0) {
         fprintf(stderr, "acp_nbsend_ch: rank %d : Error: requesting nbsend to the channel that has been requested to disconnect\n", 
                myrank);
-        ch_unlock();
+        ep_unlock(ch);
         iacp_abort_cl();
     }
 
     /* if the request list of this channel is empty, move it to reqch_list  */
-    if ((CHCHECKSTAT(ch) == CHSTCONN) && (list_isempty(&(ch->reqs)))) {
+    if ((CHCHECKSTAT(ch) == CHSTCONN) && chisidle(ch)) {
+        ch_lock();
         list_remove(&idlech_list, (listitem_t *)ch);
         list_add(&reqch_list, (listitem_t *)ch);
+        ch_unlock();
 #ifdef DEBUG
         fprintf(stderr, "%d: acp_nbsend_ch: moved channel %p from idle to requesting\n", 
                myrank, ch);
@@ -2626,13 +3340,29 @@ acp_request_t acp_nbsend_ch(acp_ch_t ch, void *sbuf, size_t sz)
         req->addr = sbuf;
         req->size = sz;
         req->status = REQSTEGR;
+        /* large messages are read by the receiver directly from sbuf,
+         * unless sbuf cannot be registered. a message of a mailbox must fit in 
+         * a slot, since the slots for its fragments would not be contiguous. */
+        if ((sz > iacpci_rndv_threshold) || (ch->mbox && (sz > ch->buf_entrysz))) {
+            req->atkey = acp_register_memory(sbuf, sz, 0);
+            if (req->atkey != ACP_ATKEY_NULL) {
+                req->ga = acp_query_ga(req->atkey, sbuf);
+                req->status = REQSTRNDV;
+            } else if (ch->mbox) {
+                fprintf(stderr, "acp_nbsend_ch: rank %d : Error: acp_register_memory failed for a mailbox message of %lu bytes\n", 
+                        myrank, sz);
+                ep_unlock(ch);
+                iacp_abort_cl();
+            }
+        }
+        IACPBL_TRACE(IACPBL_TRACE_ASYNC_BEGIN, "cl", "send", req, sz);
 #ifdef DEBUG
             fprintf(stderr, "%d: acp_nbsend_ch: prepared eager mesg in channel %p \n", 
                     myrank, ch);
 #endif
     }
 
-    ch_unlock();
+    ep_unlock(ch);
 
     /* progress */
     iacpcl_progress();
@@ -2646,7 +3376,7 @@ acp_request_t acp_nbrecv_ch(acp_ch_t ch, void *rbuf, size_t sz)
     chreqitem_t *req;
     int myrank;
 
-    ch_lock();
+    ep_lock(ch);
 
     myrank = acp_rank();
 
@@ -2656,21 +3386,23 @@ acp_request_t acp_nbrecv_ch(acp_ch_t ch, void *rbuf, size_t sz)
     if (sz > MSGMAXSZ){
         fprintf(stderr, "acp_nbrecv_ch: rank %d : Error: message size is too large: %lu\n", 
                 myrank, sz);
-        ch_unlock();
+        ep_unlock(ch);
         iacp_abort_cl();
     }
 
     if (CHCHECKDISCON(ch) != 0) {
         fprintf(stderr, "acp_nbrecv_ch: rank %d : Error: channel has been requested to disconnect\n", 
                myrank);
-        ch_unlock();
+        ep_unlock(ch);
         iacp_abort_cl();
     }
 
     /* if the request list of this channel is empty, move it to reqch_list  */
-    if ((CHCHECKSTAT(ch) == CHSTCONN) && (list_isempty(&(ch->reqs)))) {
+    if ((CHCHECKSTAT(ch) == CHSTCONN) && chisidle(ch)) {
+        ch_lock();
         list_remove(&idlech_list, (listitem_t *)ch);
         list_add(&reqch_list, (listitem_t *)ch);
+        ch_unlock();
 #ifdef DEBUG
         fprintf(stderr, "%d: acp_nbrecv_ch: moved channel %p from idle to requesting crbhead %lld crbtail %lld\n", 
                 myrank, ch, *crbhead, *crbtail);
@@ -2685,6 +3417,7 @@ acp_request_t acp_nbrecv_ch(acp_ch_t ch, void *rbuf, size_t sz)
         req->size = sz;
         req->receivedsize = 0;
         req->status = REQSTINIT;
+        IACPBL_TRACE(IACPBL_TRACE_ASYNC_BEGIN, "cl", "recv", req, sz);
         
 #ifdef DEBUG
         fprintf(stderr, "%d: acp_nbrecv_ch: prepared receive in channel %p crbhead %lld crbtail %lld\n", 
@@ -2692,7 +3425,7 @@ acp_request_t acp_nbrecv_ch(acp_ch_t ch, void *rbuf, size_t sz)
 #endif
     }
 
-    ch_unlock();
+    ep_unlock(ch);
 
     /* progress */
     iacpcl_progress();
@@ -2720,7 +3453,64 @@ int acp_recv_ch(acp_ch_t ch, void *rbuf, size_t sz)
     return 0;
 }
 
-size_t acp_wait_ch(acp_request_t req)
+/* check completion of a request waited by the user */
+static int reqcomplete(chreqitem_t *req)
+{
+    acp_ch_t ch = req->ch;
+    int ret;
+
+    switch (req->status) {
+    case REQSTRNDVWT:
+        if (*rndvfinla(ch) < req->rndvseq)
+            return 0;
+        ep_lock(ch);
+        ret = reqdone(req);
+        ep_unlock(ch);
+        return ret;
+    case REQSTFIN:
+        return (ch->type == CHTYRECV) || (acp_inquire(req->hdl) == 0);
+    default:
+        return 0;
+    }
+}
+
+/* progress for a waiting request.
+ * a connected channel is progressed by itself, and all channels are 
+ * progressed only once in ACPCI_WAIT_SWEEP_INTERVAL polls, so that threads
+ * waiting on different channels do not walk all channels each time. */
+static void progress_wait(acp_ch_t ch, unsigned int poll)
+{
+    chreqitem_t *done = NULL;
+
+    if ((CHCHECKSTAT(ch) != CHSTCONN) || (poll % ACPCI_WAIT_SWEEP_INTERVAL == 0)) {
+        iacpcl_progress();
+        return;
+    }
+
+    /* the basic layer may progress only inside its functions */
+    acp_inquire(ACP_HANDLE_ALL);
+
+    /* skip if another thread is progressing this channel */
+    if (!ep_trylock(ch))
+        return;
+    /* an idle channel has nothing to progress. its requests may have completed
+     * with all credits sent back, and it is moved to the idle list already. */
+    if (!chisidle(ch)) {
+        progress_ep(ch);
+        if (ch->ncallbacks > 0)
+            done = take_callbacks(ch, done);
+        ch_lock();
+        idle_ep(ch);
+        ch_unlock();
+    }
+    ep_unlock(ch);
+
+    invoke_callbacks(done);
+}
+
+/* release a completed request, and the channel if it has been disconnected.
+ * returns the size of the received data. */
+static size_t finishreq(acp_request_t req)
 {
     acp_ch_t ch;
     int myrank;
@@ -2730,35 +3520,25 @@ size_t acp_wait_ch(acp_request_t req)
     myrank = acp_rank();
     ch = req->ch;
 
-#ifdef DEBUG
-    fprintf(stderr, "%d: wait: ch %p crbhead %lld crbtail %lld \n", myrank, ch, *crbhead, *crbtail);
-#endif
-
-    switch(ch->type) {
-    case CHTYSEND:
-        while ((req->status != REQSTFIN) || (acp_inquire(req->hdl)!=0))
-            iacpcl_progress();
-        break;
-    case CHTYRECV:
-        while (req->status != REQSTFIN) 
-            iacpcl_progress();
+    if (ch->type == CHTYRECV)
         retsz = req->receivedsize;
-        break;
-    default:
-        fprintf(stderr, "acp_wait_ch: rank %d : Error: Wrong channel type %d\n", myrank, ch->type);
-        iacp_abort_cl();
-    }
+    IACPBL_TRACE(IACPBL_TRACE_ASYNC_END, "cl", (ch->type == CHTYSEND) ? "send" : "recv", req, 0);
 
     if (ch->state != CHSTDISCONN){
-        ch_lock();
+        ep_lock(ch);
         freereq(req);
-        ch_unlock();
+        ep_unlock(ch);
     } else {
-        if (ch->type == CHTYSEND){
+        if ((ch->type == CHTYSEND) && !ch->mbox){
 // NO ATOMIC            while ((ch->rbtail - *((uint64_t *)ch->chbody)) > 0)
             while ((*((int64_t *)ch->chbody + 1) - *((int64_t *)ch->chbody)) > 0)
                 iacpcl_progress();
         }
+        /* the channel leaves the requesting channels list after the callbacks */
+        while (ch->ncallbacks > 0)
+            iacpcl_progress();
+        /* wait until the thread progressing this channel, if any, leaves it */
+        ep_lock(ch);
         ch_lock();
         ret = acp_unregister_memory(ch->localatkey); /* unregister chbody */
         if (ret < 0){
@@ -2777,3 +3557,157 @@ size_t acp_wait_ch(acp_request_t req)
 
     return retsz;
 }
+
+size_t acp_wait_ch(acp_request_t req)
+{
+    acp_ch_t ch;
+    int myrank;
+    unsigned int poll = 0;
+
+    myrank = acp_rank();
+    ch = req->ch;
+
+#ifdef DEBUG
+    fprintf(stderr, "%d: wait: ch %p crbhead %lld crbtail %lld \n", myrank, ch, *crbhead, *crbtail);
+#endif
+
+    if ((ch->type != CHTYSEND) && (ch->type != CHTYRECV)) {
+        fprintf(stderr, "acp_wait_ch: rank %d : Error: Wrong channel type %d\n", myrank, ch->type);
+        iacp_abort_cl();
+    }
+
+    while (!reqcomplete(req))
+        progress_wait(ch, poll++);
+
+    return finishreq(req);
+}
+
+int acp_waitall_ch(acp_request_t *reqs, int count, size_t *sizes)
+{
+    int i;
+    size_t size;
+
+    for (i = 0; i < count; i++) {
+        if (reqs[i] == ACP_REQUEST_NULL) {
+            if (sizes != NULL)
+                sizes[i] = 0;
+            continue;
+        }
+        size = acp_wait_ch(reqs[i]);
+        reqs[i] = ACP_REQUEST_NULL;
+        if (sizes != NULL)
+            sizes[i] = size;
+    }
+
+    return 0;
+}
+
+/* polls of acp_test_ch by each thread. all channels are progressed once in 
+ * ACPCI_WAIT_SWEEP_INTERVAL polls, as in acp_wait_ch. */
+static __thread unsigned int testpoll = 0;
+
+int acp_test_ch(acp_request_t req, size_t *size)
+{
+    size_t retsz;
+
+    progress_wait(req->ch, testpoll++);
+    if (!reqcomplete(req))
+        return 0;
+
+    retsz = finishreq(req);
+    if (size != NULL)
+        *size = retsz;
+
+    return 1;
+}
+
+/* find and release completed requests in the array. 
+ * returns the number of them. */
+static int testsome(acp_request_t *reqs, int count, int *indices, size_t *sizes)
+{
+    int i, n = 0;
+    size_t size;
+
+    for (i = 0; i < count; i++) {
+        if ((reqs[i] == ACP_REQUEST_NULL) || !reqcomplete(reqs[i]))
+            continue;
+        size = finishreq(reqs[i]);
+        reqs[i] = ACP_REQUEST_NULL;
+        if (indices != NULL)
+            indices[n] = i;
+        if (sizes != NULL)
+            sizes[n] = size;
+        n++;
+    }
+
+    return n;
+}
+
+int acp_testsome_ch(acp_request_t *reqs, int count, int *indices, size_t *sizes)
+{
+    /* requests may be in many channels. progress all of them. */
+    iacpcl_progress();
+
+    return testsome(reqs, count, indices, sizes);
+}
+
+int acp_waitany_ch(acp_request_t *reqs, int count, size_t *size)
+{
+    int i;
+    size_t retsz;
+
+    for (i = 0; i < count; i++)
+        if (reqs[i] != ACP_REQUEST_NULL)
+            break;
+    if (i == count)
+        return -1;
+
+    while (1) {
+        for (i = 0; i < count; i++) {
+            if ((reqs[i] != ACP_REQUEST_NULL) && reqcomplete(reqs[i])) {
+                retsz = finishreq(reqs[i]);
+                reqs[i] = ACP_REQUEST_NULL;
+                if (size != NULL)
+                    *size = retsz;
+                return i;
+            }
+        }
+        iacpcl_progress();
+    }
+}
+
+int acp_set_callback_ch(acp_request_t req, acp_callback_ch_t callback, void *arg)
+{
+    acp_ch_t ch;
+    int myrank;
+
+    if ((req == ACP_REQUEST_NULL) || (callback == NULL))
+        return -1;
+
+    ch = req->ch;
+    ep_lock(ch);
+    myrank = acp_rank();
+
+    if (req->callback != NULL) {
+        fprintf(stderr, "acp_set_callback_ch: rank %d : Error: callback has already been set to the request\n", 
+               myrank);
+        ep_unlock(ch);
+        iacp_abort_cl();
+    }
+
+    /* the channel stays in the requesting channels list until the callback is invoked */
+    if ((CHCHECKSTAT(ch) == CHSTCONN || CHCHECKSTAT(ch) == CHSTDISCONN) && chisidle(ch)) {
+        ch_lock();
+        list_remove(&idlech_list, (listitem_t *)ch);
+        list_add(&reqch_list, (listitem_t *)ch);
+        ch_unlock();
+    }
+
+    req->cbarg = arg;
+    req->callback = callback;
+    ch->ncallbacks++;
+
+    ep_unlock(ch);
+
+    return 0;
+}
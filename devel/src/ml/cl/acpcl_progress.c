@@ -18,15 +18,71 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <acp.h>
+#include "acpbl_input.h"
 #include "acpcl_progress.h"
 
+extern int iacp_enable_hybrid;
+
 extern void iacpcl_progress_ch(void);
 
 extern void iacpcl_progress_segbuf(void);
 
 void iacpcl_progress(void)
 {
+    /* the basic layer may progress only inside its functions (inline progress
+     * of udp), while the channels can wait on the memory without calling them */
+    acp_inquire(ACP_HANDLE_ALL);
     iacpcl_progress_ch();
     iacpcl_progress_segbuf();
 }
+
+/* progress thread of the channels
+ *  a send posted before a long computation moves only one window of slots 
+ *  ahead unless something progresses the channels. with 
+ *  --acp-cl-progress-interval, a thread calls iacpcl_progress at the given 
+ *  interval. the channels are then driven by two threads, so the locks of 
+ *  the channels are enabled as in the hybrid mode.
+ */
+static pthread_t progress_thread;
+static volatile int progress_thread_running = 0;
+
+static void *progress_thread_main(void *arg)
+{
+    struct timespec interval;
+
+    interval.tv_sec = iacpbl_option.clprogress.value / 1000000;
+    interval.tv_nsec = (iacpbl_option.clprogress.value % 1000000) * 1000;
+
+    while (progress_thread_running) {
+        iacpcl_progress();
+        nanosleep(&interval, NULL);
+    }
+    return NULL;
+}
+
+int iacpcl_start_progress_thread(void)
+{
+    if (iacpbl_option.clprogress.value == 0 || progress_thread_running)
+        return 0;
+
+    iacp_enable_hybrid = 1;
+    progress_thread_running = 1;
+    if (pthread_create(&progress_thread, NULL, progress_thread_main, NULL) != 0) {
+        fprintf(stderr, "iacpcl_start_progress_thread: %d : Error: cannot create the progress thread\n", acp_rank());
+        progress_thread_running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void iacpcl_stop_progress_thread(void)
+{
+    if (!progress_thread_running)
+        return;
+
+    progress_thread_running = 0;
+    pthread_join(progress_thread, NULL);
+}
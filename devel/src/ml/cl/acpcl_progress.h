@@ -26,6 +26,10 @@ extern "C" {
 
 void iacpcl_progress(void);
 
+int iacpcl_start_progress_thread(void);
+
+void iacpcl_stop_progress_thread(void);
+
 
 #ifdef __cplusplus
 }
@@ -16,8 +16,10 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
 #include <acp.h>
 #include "acpdl.h"
+#include "acpbl_trace.h"
 
 /** Deque
  *      [00:07]  ga of queue body
@@ -29,6 +31,7 @@
 
 void acp_assign_deque(acp_deque_t deque1, acp_deque_t deque2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(64, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -95,6 +98,7 @@ void acp_assign_deque(acp_deque_t deque1, acp_deque_t deque2)
 
 void acp_assign_range_deque(acp_deque_t deque, acp_deque_it_t start, acp_deque_it_t end)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (start.deque.ga != end.deque.ga) return;
     
     acp_ga_t buf = acp_malloc(64, acp_rank());
@@ -166,6 +170,7 @@ void acp_assign_range_deque(acp_deque_t deque, acp_deque_it_t start, acp_deque_i
 
 acp_ga_t acp_at_deque(acp_deque_t deque, int index)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (index < 0) return ACP_GA_NULL;
     
     acp_ga_t buf = acp_malloc(32, acp_rank());
@@ -193,6 +198,7 @@ acp_ga_t acp_at_deque(acp_deque_t deque, int index)
 
 acp_deque_it_t acp_begin_deque(acp_deque_t deque)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_deque_it_t it;
     
     it.deque.ga = deque.ga;
@@ -221,6 +227,7 @@ acp_deque_it_t acp_begin_deque(acp_deque_t deque)
 
 size_t acp_capacity_deque(acp_deque_t deque)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(32, acp_rank());
     if (buf == ACP_GA_NULL) return 0;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -243,6 +250,7 @@ size_t acp_capacity_deque(acp_deque_t deque)
 
 void acp_clear_deque(acp_deque_t deque)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(32, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -270,6 +278,7 @@ void acp_clear_deque(acp_deque_t deque)
 
 acp_deque_t acp_create_deque(size_t size, int rank)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_deque_t deque;
     deque.ga = ACP_GA_NULL;
     
@@ -314,6 +323,7 @@ acp_deque_t acp_create_deque(size_t size, int rank)
 
 void acp_destroy_deque(acp_deque_t deque)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(32, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -338,6 +348,7 @@ void acp_destroy_deque(acp_deque_t deque)
 
 int acp_empty_deque(acp_deque_t deque)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(32, acp_rank());
     if (buf == ACP_GA_NULL) return 1;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -360,6 +371,7 @@ int acp_empty_deque(acp_deque_t deque)
 
 acp_deque_it_t acp_end_deque(acp_deque_t deque)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_deque_it_t it;
     
     it.deque.ga = deque.ga;
@@ -389,6 +401,7 @@ acp_deque_it_t acp_end_deque(acp_deque_t deque)
 
 acp_deque_it_t acp_erase_deque(acp_deque_it_t it, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     int index = it.index;
     
     acp_ga_t buf = acp_malloc(32, acp_rank());
@@ -449,12 +462,14 @@ acp_deque_it_t acp_erase_deque(acp_deque_it_t it, size_t size)
 
 acp_deque_it_t acp_erase_range_deque(acp_deque_it_t start, acp_deque_it_t end)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (start.deque.ga != end.deque.ga || start.index >= end.index) return end;
     return acp_erase_deque(start, end.index - start.index);
 }
 
 acp_deque_it_t acp_insert_deque(acp_deque_it_t it, const acp_ga_t ga, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     int index = it.index;
     
     acp_ga_t buf = acp_malloc(32, acp_rank());
@@ -576,6 +591,7 @@ acp_deque_it_t acp_insert_deque(acp_deque_it_t it, const acp_ga_t ga, size_t siz
 
 acp_deque_it_t acp_insert_range_deque(acp_deque_it_t it, acp_deque_it_t start, acp_deque_it_t end)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (start.deque.ga != end.deque.ga || start.index >= end.index) return end;
     acp_pair_t pair = acp_dereference_deque_it(start, end.index - start.index);
     if (pair.second.ga != ACP_GA_NULL) acp_insert_deque(it, pair.second.ga, pair.second.size);
@@ -584,6 +600,7 @@ acp_deque_it_t acp_insert_range_deque(acp_deque_it_t it, acp_deque_it_t start, a
 
 void acp_pop_back_deque(acp_deque_t deque, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(32, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -610,6 +627,7 @@ void acp_pop_back_deque(acp_deque_t deque, size_t size)
 
 void acp_pop_front_deque(acp_deque_t deque, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(32, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -641,6 +659,7 @@ void acp_pop_front_deque(acp_deque_t deque, size_t size)
 
 void acp_push_back_deque(acp_deque_t deque, const acp_ga_t ga, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(32, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -712,6 +731,7 @@ void acp_push_back_deque(acp_deque_t deque, const acp_ga_t ga, size_t size)
 
 void acp_push_front_deque(acp_deque_t deque, const acp_ga_t ga, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(32, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -784,6 +804,7 @@ void acp_push_front_deque(acp_deque_t deque, const acp_ga_t ga, size_t size)
 
 void acp_reserve_deque(acp_deque_t deque, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(32, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -845,6 +866,7 @@ void acp_reserve_deque(acp_deque_t deque, size_t size)
 
 size_t acp_size_deque(acp_deque_t deque)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(32, acp_rank());
     if (buf == ACP_GA_NULL) return 0;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -867,6 +889,7 @@ size_t acp_size_deque(acp_deque_t deque)
 
 void acp_swap_deque(acp_deque_t deque1, acp_deque_t deque2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(64, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -949,12 +972,14 @@ void acp_swap_deque(acp_deque_t deque1, acp_deque_t deque2)
 
 acp_deque_it_t acp_advance_deque_it(acp_deque_it_t it, int n)
 {
+    IACPBL_TRACE_SCOPE("dl");
     it.index += n;
     return it;
 }
 
 acp_pair_t acp_dereference_deque_it(acp_deque_it_t it, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_pair_t pair;
     
     pair.first.ga = ACP_GA_NULL;
@@ -1003,6 +1028,7 @@ acp_pair_t acp_dereference_deque_it(acp_deque_it_t it, size_t size)
 
 int acp_distance_deque_it(acp_deque_it_t first, acp_deque_it_t last)
 {
+    IACPBL_TRACE_SCOPE("dl");
     return last.index - first.index;
 }
 
@@ -16,8 +16,10 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
 #include <acp.h>
 #include "acpdl.h"
+#include "acpbl_trace.h"
 
 /** List
  *      [0]  ga of head element
@@ -32,6 +34,7 @@
 
 void acp_assign_list(acp_list_t list1, acp_list_t list2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(64, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -112,6 +115,7 @@ void acp_assign_list(acp_list_t list1, acp_list_t list2)
 
 void acp_assign_range_list(acp_list_t list, acp_list_it_t start, acp_list_it_t end)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (start.list.ga != end.list.ga) return;
     
     acp_ga_t buf = acp_malloc(64, acp_rank());
@@ -186,6 +190,7 @@ void acp_assign_range_list(acp_list_t list, acp_list_it_t start, acp_list_it_t e
 
 acp_list_it_t acp_begin_list(acp_list_t list)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_list_it_t it;
     it.list = list;
     it.elem = list.ga;
@@ -212,6 +217,7 @@ acp_list_it_t acp_begin_list(acp_list_t list)
 
 void acp_clear_list(acp_list_t list)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(48, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -249,6 +255,7 @@ void acp_clear_list(acp_list_t list)
 
 acp_list_t acp_create_list(int rank)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_list_t list;
     list.ga = ACP_GA_NULL;
     
@@ -277,6 +284,7 @@ acp_list_t acp_create_list(int rank)
 
 void acp_destroy_list(acp_list_t list)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(48, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -309,6 +317,7 @@ void acp_destroy_list(acp_list_t list)
 
 int acp_empty_list(acp_list_t list)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return 0;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -329,6 +338,7 @@ int acp_empty_list(acp_list_t list)
 
 acp_list_it_t acp_end_list(acp_list_t list)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_list_it_t it;
     
     it.list = list;
@@ -338,6 +348,7 @@ acp_list_it_t acp_end_list(acp_list_t list)
 
 acp_list_it_t acp_erase_list(acp_list_it_t it)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /* if the iterator is null or end, it fails */
     if (it.elem == ACP_GA_NULL || it.elem == it.list.ga) {
         it.elem = ACP_GA_NULL;
@@ -410,6 +421,7 @@ acp_list_it_t acp_erase_list(acp_list_it_t it)
 
 acp_list_it_t acp_erase_range_list(acp_list_it_t start, acp_list_it_t end)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (start.list.ga != end.list.ga || start.list.ga == ACP_GA_NULL || end.elem == ACP_GA_NULL || start.elem == start.list.ga || start.elem == end.elem) return end;
     
     acp_ga_t buf = acp_malloc(48, acp_rank());
@@ -515,6 +527,7 @@ acp_list_it_t acp_erase_range_list(acp_list_it_t start, acp_list_it_t end)
 
 acp_list_it_t acp_insert_list(acp_list_it_t it, const acp_element_t elem, int rank)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(56, acp_rank());
     if (buf == ACP_GA_NULL) return it;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -564,6 +577,7 @@ acp_list_it_t acp_insert_list(acp_list_it_t it, const acp_element_t elem, int ra
 
 acp_list_it_t acp_insert_range_list(acp_list_it_t it, acp_list_it_t start, acp_list_it_t end)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(64, acp_rank());
     if (buf == ACP_GA_NULL) return it;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -629,6 +643,7 @@ acp_list_it_t acp_insert_range_list(acp_list_it_t it, acp_list_it_t start, acp_l
 
 void acp_merge_list(acp_list_t list1, acp_list_t list2, int (*comp)(const acp_element_t elem1, const acp_element_t elem2))
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(112, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -757,6 +772,7 @@ void acp_merge_list(acp_list_t list1, acp_list_t list2, int (*comp)(const acp_el
 
 void acp_pop_back_list(acp_list_t list)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(48, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -806,6 +822,7 @@ void acp_pop_back_list(acp_list_t list)
 
 void acp_pop_front_list(acp_list_t list)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(48, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -854,6 +871,7 @@ void acp_pop_front_list(acp_list_t list)
 
 void acp_push_back_list(acp_list_t list, const acp_element_t elem, int rank)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(56, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -909,6 +927,7 @@ void acp_push_back_list(acp_list_t list, const acp_element_t elem, int rank)
 
 void acp_push_front_list(acp_list_t list, const acp_element_t elem, int rank)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(56, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -964,6 +983,7 @@ void acp_push_front_list(acp_list_t list, const acp_element_t elem, int rank)
 
 void acp_remove_list(acp_list_t list, const acp_element_t elem)
 {
+    IACPBL_TRACE_SCOPE("dl");
     int local = (acp_query_rank(elem.ga) == acp_rank()) ? 1 : 0;
     int size = local ? elem.size : elem.size + elem.size;
     
@@ -1038,6 +1058,7 @@ void acp_remove_list(acp_list_t list, const acp_element_t elem)
 
 void acp_reverse_list(acp_list_t list)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(56, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -1080,6 +1101,7 @@ void acp_reverse_list(acp_list_t list)
 
 size_t acp_size_list(acp_list_t list)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return 0;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -1127,6 +1149,7 @@ static inline int pop_lower_count(uint64_t x)
 
 void acp_sort_list(acp_list_t list, int (*comp)(const acp_element_t elem1, const acp_element_t elem2))
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -1199,6 +1222,7 @@ void acp_sort_list(acp_list_t list, int (*comp)(const acp_element_t elem1, const
 
 void acp_splice_list(acp_list_it_t it1, acp_list_it_t it2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (it2.elem == it2.list.ga) return;
     
     acp_ga_t buf = acp_malloc(88, acp_rank());
@@ -1259,6 +1283,7 @@ void acp_splice_list(acp_list_it_t it1, acp_list_it_t it2)
 
 void acp_splice_range_list(acp_list_it_t it, acp_list_it_t start, acp_list_it_t end)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (start.list.ga != end.list.ga || end.elem == end.list.ga ) return;
     
     acp_ga_t buf = acp_malloc(112, acp_rank());
@@ -1339,6 +1364,7 @@ void acp_splice_range_list(acp_list_it_t it, acp_list_it_t start, acp_list_it_t
 
 void acp_swap_list(acp_list_t list1, acp_list_t list2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(64, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -1396,6 +1422,7 @@ void acp_swap_list(acp_list_t list1, acp_list_t list2)
 
 void acp_unique_list(acp_list_t list)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(64, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -1477,6 +1504,7 @@ void acp_unique_list(acp_list_t list)
 
 acp_list_it_t acp_advance_list_it(acp_list_it_t it, int n)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return it;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -1505,6 +1533,7 @@ acp_list_it_t acp_advance_list_it(acp_list_it_t it, int n)
 
 acp_list_it_t acp_decrement_list_it(acp_list_it_t it)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return it;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -1527,6 +1556,7 @@ acp_list_it_t acp_decrement_list_it(acp_list_it_t it)
 
 acp_element_t acp_dereference_list_it(acp_list_it_t it)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_element_t elem;
     elem.ga = ACP_GA_NULL;
     elem.size = 0;
@@ -1554,6 +1584,7 @@ acp_element_t acp_dereference_list_it(acp_list_it_t it)
 
 int acp_distance_list_it(acp_list_it_t first, acp_list_it_t last)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (first.list.ga != last.list.ga) return 0;
     
     acp_ga_t buf = acp_malloc(24, acp_rank());
@@ -1584,6 +1615,7 @@ int acp_distance_list_it(acp_list_it_t first, acp_list_it_t last)
 
 acp_list_it_t acp_increment_list_it(acp_list_it_t it)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf;
     if (it.elem == it.list.ga)
         return it;
@@ -16,8 +16,10 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
 #include <acp.h>
 #include "acpdl.h"
+#include "acpbl_trace.h"
 
 /** Map
  *      [0-] directory of hash table
@@ -178,6 +180,7 @@ static inline acp_map_it_t iacp_null_map_it(acp_map_t map)
 
 void acp_assign_local_map(acp_map_t map1, acp_map_t map2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = map1.num_ranks * 8;
@@ -319,6 +322,7 @@ void acp_assign_local_map(acp_map_t map1, acp_map_t map2)
 
 void acp_assign_map(acp_map_t map1, acp_map_t map2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = map1.num_ranks * 8;
@@ -457,6 +461,7 @@ void acp_assign_map(acp_map_t map1, acp_map_t map2)
 
 acp_map_it_t acp_begin_local_map(acp_map_t map)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = map.num_ranks * 8;
@@ -516,6 +521,7 @@ acp_map_it_t acp_begin_local_map(acp_map_t map)
 
 acp_map_it_t acp_begin_map(acp_map_t map)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = map.num_ranks * 8;
@@ -573,6 +579,7 @@ acp_map_it_t acp_begin_map(acp_map_t map)
 
 void acp_clear_local_map(acp_map_t map)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = map.num_ranks * 8;
@@ -629,6 +636,7 @@ void acp_clear_local_map(acp_map_t map)
 
 void acp_clear_map(acp_map_t map)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = map.num_ranks * 8;
@@ -683,6 +691,7 @@ void acp_clear_map(acp_map_t map)
 
 acp_map_t acp_create_map(int num_ranks, const int* ranks, int num_slots, int rank)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_map_t map;
     map.ga = ACP_GA_NULL;
     map.num_ranks = num_ranks;
@@ -743,6 +752,7 @@ acp_map_t acp_create_map(int num_ranks, const int* ranks, int num_slots, int ran
 
 void acp_destroy_map(acp_map_t map)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = map.num_ranks * 8;
@@ -796,6 +806,7 @@ void acp_destroy_map(acp_map_t map)
 
 int acp_empty_local_map(acp_map_t map)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = map.num_ranks * 8;
@@ -850,6 +861,7 @@ int acp_empty_local_map(acp_map_t map)
 
 int acp_empty_map(acp_map_t map)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = map.num_ranks * 8;
@@ -902,6 +914,7 @@ int acp_empty_map(acp_map_t map)
 
 acp_map_it_t acp_end_local_map(acp_map_t map)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = map.num_ranks * 8;
@@ -961,11 +974,13 @@ acp_map_it_t acp_end_local_map(acp_map_t map)
 
 acp_map_it_t acp_end_map(acp_map_t map)
 {
+    IACPBL_TRACE_SCOPE("dl");
     return iacp_null_map_it(map);
 }
 
 acp_map_it_t acp_find_map(acp_map_t map, acp_element_t key)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (key.size == 0) return iacp_null_map_it(map);
     
     /*** local buffer variables ***/
@@ -1062,6 +1077,7 @@ acp_map_it_t acp_find_map(acp_map_t map, acp_element_t key)
 
 int acp_insert_map(acp_map_t map, acp_pair_t pair)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (pair.first.size == 0) return 0;
     if (pair.second.size == 0) {
         acp_remove_map(map, pair.first);
@@ -1205,6 +1221,7 @@ int acp_insert_map(acp_map_t map, acp_pair_t pair)
 
 void acp_merge_local_map(acp_map_t map1, acp_map_t map2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = map1.num_ranks * 8;
@@ -1322,6 +1339,7 @@ void acp_merge_local_map(acp_map_t map1, acp_map_t map2)
 
 void acp_merge_map(acp_map_t map1, acp_map_t map2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = map1.num_ranks * 8;
@@ -1437,6 +1455,7 @@ void acp_merge_map(acp_map_t map1, acp_map_t map2)
 
 void acp_move_local_map(acp_map_t map1, acp_map_t map2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = map1.num_ranks * 8;
@@ -1564,6 +1583,7 @@ void acp_move_local_map(acp_map_t map1, acp_map_t map2)
 
 void acp_move_map(acp_map_t map1, acp_map_t map2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = map1.num_ranks * 8;
@@ -1689,6 +1709,7 @@ void acp_move_map(acp_map_t map1, acp_map_t map2)
 
 void acp_remove_map(acp_map_t map, acp_element_t key)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (key.size == 0) return;
     
     /*** local buffer variables ***/
@@ -1811,6 +1832,7 @@ void acp_remove_map(acp_map_t map, acp_element_t key)
 
 size_t acp_retrieve_map(acp_map_t map, acp_pair_t pair)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (pair.first.size == 0) return 0;
     
     /*** local buffer variables ***/
@@ -1905,6 +1927,7 @@ size_t acp_retrieve_map(acp_map_t map, acp_pair_t pair)
 
 size_t acp_size_local_map(acp_map_t map)
 {
+    IACPBL_TRACE_SCOPE("dl");
     size_t ret = 0;
     
     /*** local buffer variables ***/
@@ -1946,6 +1969,7 @@ size_t acp_size_local_map(acp_map_t map)
 
 size_t acp_size_map(acp_map_t map)
 {
+    IACPBL_TRACE_SCOPE("dl");
     size_t ret = 0;
     
     /*** local buffer variables ***/
@@ -1985,6 +2009,7 @@ size_t acp_size_map(acp_map_t map)
 
 void acp_swap_map(acp_map_t map1, acp_map_t map2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = map2.num_ranks * 8;
@@ -2093,6 +2118,7 @@ void acp_swap_map(acp_map_t map1, acp_map_t map2)
 
 acp_pair_t acp_dereference_map_it(acp_map_it_t it)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_pair_t pair;
     pair.first.ga    = ACP_GA_NULL;
     pair.first.size  = 0;
@@ -2130,6 +2156,7 @@ acp_pair_t acp_dereference_map_it(acp_map_it_t it)
 
 acp_map_it_t acp_increment_map_it(acp_map_it_t it)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (it.rank >= it.map.num_ranks || it.slot >= it.map.num_slots || it.elem == ACP_GA_NULL) return iacp_null_map_it(it.map);
     
     /*** local buffer variables ***/
@@ -16,8 +16,10 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
 #include <acp.h>
 #include "acpdl.h"
+#include "acpbl_trace.h"
 
 /** Multiset
  *      [0-] directory of hash table
@@ -160,6 +162,7 @@ static inline acp_multiset_it_t iacp_null_multiset_it(acp_multiset_t set)
 
 void acp_assign_local_multiset(acp_multiset_t set1, acp_multiset_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set1.num_ranks * 8;
@@ -294,6 +297,7 @@ void acp_assign_local_multiset(acp_multiset_t set1, acp_multiset_t set2)
 
 void acp_assign_multiset(acp_multiset_t set1, acp_multiset_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set1.num_ranks * 8;
@@ -425,6 +429,7 @@ void acp_assign_multiset(acp_multiset_t set1, acp_multiset_t set2)
 
 acp_multiset_it_t acp_begin_local_multiset(acp_multiset_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -484,6 +489,7 @@ acp_multiset_it_t acp_begin_local_multiset(acp_multiset_t set)
 
 acp_multiset_it_t acp_begin_multiset(acp_multiset_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -541,6 +547,7 @@ acp_multiset_it_t acp_begin_multiset(acp_multiset_t set)
 
 void acp_clear_local_multiset(acp_multiset_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -597,6 +604,7 @@ void acp_clear_local_multiset(acp_multiset_t set)
 
 void acp_clear_multiset(acp_multiset_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -651,6 +659,7 @@ void acp_clear_multiset(acp_multiset_t set)
 
 acp_set_t acp_collapse_multiset(acp_multiset_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_set_t ret;
     ret.ga = set.ga;
     ret.num_ranks = set.num_ranks;
@@ -725,6 +734,7 @@ acp_set_t acp_collapse_multiset(acp_multiset_t set)
 
 acp_multiset_t acp_create_multiset(int num_ranks, const int* ranks, int num_slots, int rank)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_multiset_t set;
     set.ga = ACP_GA_NULL;
     set.num_ranks = num_ranks;
@@ -785,6 +795,7 @@ acp_multiset_t acp_create_multiset(int num_ranks, const int* ranks, int num_slot
 
 void acp_destroy_multiset(acp_multiset_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -838,6 +849,7 @@ void acp_destroy_multiset(acp_multiset_t set)
 
 int acp_empty_local_multiset(acp_multiset_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -892,6 +904,7 @@ int acp_empty_local_multiset(acp_multiset_t set)
 
 int acp_empty_multiset(acp_multiset_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -944,6 +957,7 @@ int acp_empty_multiset(acp_multiset_t set)
 
 acp_multiset_it_t acp_end_local_multiset(acp_multiset_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -1003,11 +1017,13 @@ acp_multiset_it_t acp_end_local_multiset(acp_multiset_t set)
 
 acp_multiset_it_t acp_end_multiset(acp_multiset_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     return iacp_null_multiset_it(set);
 }
 
 acp_multiset_it_t acp_find_multiset(acp_multiset_t set, acp_element_t key)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (key.size == 0) return iacp_null_multiset_it(set);
     
     /*** local buffer variables ***/
@@ -1104,6 +1120,7 @@ acp_multiset_it_t acp_find_multiset(acp_multiset_t set, acp_element_t key)
 
 int acp_insert_multiset(acp_multiset_t set, acp_element_t key)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (key.size == 0) return 0;
     
     /*** local buffer variables ***/
@@ -1222,6 +1239,7 @@ int acp_insert_multiset(acp_multiset_t set, acp_element_t key)
 
 void acp_merge_local_multiset(acp_multiset_t set1, acp_multiset_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set1.num_ranks * 8;
@@ -1332,6 +1350,7 @@ void acp_merge_local_multiset(acp_multiset_t set1, acp_multiset_t set2)
 
 void acp_merge_multiset(acp_multiset_t set1, acp_multiset_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set1.num_ranks * 8;
@@ -1440,6 +1459,7 @@ void acp_merge_multiset(acp_multiset_t set1, acp_multiset_t set2)
 
 void acp_move_local_multiset(acp_multiset_t set1, acp_multiset_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set1.num_ranks * 8;
@@ -1560,6 +1580,7 @@ void acp_move_local_multiset(acp_multiset_t set1, acp_multiset_t set2)
 
 void acp_move_multiset(acp_multiset_t set1, acp_multiset_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set1.num_ranks * 8;
@@ -1678,6 +1699,7 @@ void acp_move_multiset(acp_multiset_t set1, acp_multiset_t set2)
 
 void acp_remove_multiset(acp_multiset_t set, acp_element_t key)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (key.size == 0) return;
     
     /*** local buffer variables ***/
@@ -1810,6 +1832,7 @@ void acp_remove_multiset(acp_multiset_t set, acp_element_t key)
 
 void acp_remove_all_multiset(acp_multiset_t set, acp_element_t key)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (key.size == 0) return;
     
     /*** local buffer variables ***/
@@ -1932,6 +1955,7 @@ void acp_remove_all_multiset(acp_multiset_t set, acp_element_t key)
 
 uint64_t acp_retrieve_multiset(acp_multiset_t set, acp_element_t key)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (key.size == 0) return 0;
     
     /*** local buffer variables ***/
@@ -2024,6 +2048,7 @@ uint64_t acp_retrieve_multiset(acp_multiset_t set, acp_element_t key)
 
 size_t acp_size_local_multiset(acp_multiset_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     size_t ret = 0;
     
     /*** local buffer variables ***/
@@ -2065,6 +2090,7 @@ size_t acp_size_local_multiset(acp_multiset_t set)
 
 size_t acp_size_multiset(acp_multiset_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     size_t ret = 0;
     
     /*** local buffer variables ***/
@@ -2104,6 +2130,7 @@ size_t acp_size_multiset(acp_multiset_t set)
 
 void acp_swap_multiset(acp_multiset_t set1, acp_multiset_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set2.num_ranks * 8;
@@ -2212,6 +2239,7 @@ void acp_swap_multiset(acp_multiset_t set1, acp_multiset_t set2)
 
 acp_element_t acp_dereference_multiset_it(acp_multiset_it_t it)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_element_t key;
     key.ga    = ACP_GA_NULL;
     key.size  = 0;
@@ -2244,6 +2272,7 @@ acp_element_t acp_dereference_multiset_it(acp_multiset_it_t it)
 
 acp_multiset_it_t acp_increment_multiset_it(acp_multiset_it_t it)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (it.rank >= it.set.num_ranks || it.slot >= it.set.num_slots || it.elem == ACP_GA_NULL) return iacp_null_multiset_it(it.set);
     
     /*** local buffer variables ***/
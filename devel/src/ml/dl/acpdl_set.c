@@ -16,8 +16,10 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
 #include <acp.h>
 #include "acpdl.h"
+#include "acpbl_trace.h"
 
 /** Set
  *      [0-] directory of hash table
@@ -156,6 +158,7 @@ static inline acp_set_it_t iacp_null_set_it(acp_set_t set)
 
 void acp_assign_local_set(acp_set_t set1, acp_set_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set1.num_ranks * 8;
@@ -289,6 +292,7 @@ void acp_assign_local_set(acp_set_t set1, acp_set_t set2)
 
 void acp_assign_set(acp_set_t set1, acp_set_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set1.num_ranks * 8;
@@ -419,6 +423,7 @@ void acp_assign_set(acp_set_t set1, acp_set_t set2)
 
 acp_set_it_t acp_begin_local_set(acp_set_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -478,6 +483,7 @@ acp_set_it_t acp_begin_local_set(acp_set_t set)
 
 acp_set_it_t acp_begin_set(acp_set_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -535,6 +541,7 @@ acp_set_it_t acp_begin_set(acp_set_t set)
 
 void acp_clear_local_set(acp_set_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -591,6 +598,7 @@ void acp_clear_local_set(acp_set_t set)
 
 void acp_clear_set(acp_set_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -645,6 +653,7 @@ void acp_clear_set(acp_set_t set)
 
 acp_list_t acp_collapse_set(acp_set_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_list_t list;
     list.ga = ACP_GA_NULL;
     
@@ -729,6 +738,7 @@ acp_list_t acp_collapse_set(acp_set_t set)
 
 acp_set_t acp_create_set(int num_ranks, const int* ranks, int num_slots, int rank)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_set_t set;
     set.ga = ACP_GA_NULL;
     set.num_ranks = num_ranks;
@@ -789,6 +799,7 @@ acp_set_t acp_create_set(int num_ranks, const int* ranks, int num_slots, int ran
 
 void acp_destroy_set(acp_set_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -842,6 +853,7 @@ void acp_destroy_set(acp_set_t set)
 
 int acp_empty_local_set(acp_set_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -896,6 +908,7 @@ int acp_empty_local_set(acp_set_t set)
 
 int acp_empty_set(acp_set_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -948,6 +961,7 @@ int acp_empty_set(acp_set_t set)
 
 acp_set_it_t acp_end_local_set(acp_set_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory = set.num_ranks * 8;
@@ -1007,11 +1021,13 @@ acp_set_it_t acp_end_local_set(acp_set_t set)
 
 acp_set_it_t acp_end_set(acp_set_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     return iacp_null_set_it(set);
 }
 
 acp_set_it_t acp_find_set(acp_set_t set, acp_element_t key)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (key.size == 0) return iacp_null_set_it(set);
     
     /*** local buffer variables ***/
@@ -1108,6 +1124,7 @@ acp_set_it_t acp_find_set(acp_set_t set, acp_element_t key)
 
 int acp_insert_set(acp_set_t set, acp_element_t key)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (key.size == 0) return 0;
     
     /*** local buffer variables ***/
@@ -1223,6 +1240,7 @@ int acp_insert_set(acp_set_t set, acp_element_t key)
 
 void acp_merge_local_set(acp_set_t set1, acp_set_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set1.num_ranks * 8;
@@ -1332,6 +1350,7 @@ void acp_merge_local_set(acp_set_t set1, acp_set_t set2)
 
 void acp_merge_set(acp_set_t set1, acp_set_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set1.num_ranks * 8;
@@ -1439,6 +1458,7 @@ void acp_merge_set(acp_set_t set1, acp_set_t set2)
 
 void acp_move_local_set(acp_set_t set1, acp_set_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set1.num_ranks * 8;
@@ -1558,6 +1578,7 @@ void acp_move_local_set(acp_set_t set1, acp_set_t set2)
 
 void acp_move_set(acp_set_t set1, acp_set_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set1.num_ranks * 8;
@@ -1675,6 +1696,7 @@ void acp_move_set(acp_set_t set1, acp_set_t set2)
 
 void acp_remove_set(acp_set_t set, acp_element_t key)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (key.size == 0) return;
     
     /*** local buffer variables ***/
@@ -1797,6 +1819,7 @@ void acp_remove_set(acp_set_t set, acp_element_t key)
 
 size_t acp_size_local_set(acp_set_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     size_t ret = 0;
     
     /*** local buffer variables ***/
@@ -1838,6 +1861,7 @@ size_t acp_size_local_set(acp_set_t set)
 
 size_t acp_size_set(acp_set_t set)
 {
+    IACPBL_TRACE_SCOPE("dl");
     size_t ret = 0;
     
     /*** local buffer variables ***/
@@ -1877,6 +1901,7 @@ size_t acp_size_set(acp_set_t set)
 
 void acp_swap_set(acp_set_t set1, acp_set_t set2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     /*** local buffer variables ***/
     
     uint64_t size_directory  = set2.num_ranks * 8;
@@ -1985,6 +2010,7 @@ void acp_swap_set(acp_set_t set1, acp_set_t set2)
 
 acp_element_t acp_dereference_set_it(acp_set_it_t it)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_element_t key;
     key.ga    = ACP_GA_NULL;
     key.size  = 0;
@@ -2017,6 +2043,7 @@ acp_element_t acp_dereference_set_it(acp_set_it_t it)
 
 acp_set_it_t acp_increment_set_it(acp_set_it_t it)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (it.rank >= it.set.num_ranks || it.slot >= it.set.num_slots || it.elem == ACP_GA_NULL) return iacp_null_set_it(it.set);
     
     /*** local buffer variables ***/
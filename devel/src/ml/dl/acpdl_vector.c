@@ -16,8 +16,10 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
 #include <acp.h>
 #include "acpdl.h"
+#include "acpbl_trace.h"
 
 /** Vector
  *      [00:07]  ga of array body
@@ -27,6 +29,7 @@
 
 void acp_assign_vector(acp_vector_t vector1, acp_vector_t vector2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(48, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -89,6 +92,7 @@ void acp_assign_vector(acp_vector_t vector1, acp_vector_t vector2)
 
 void acp_assign_range_vector(acp_vector_t vector, acp_vector_it_t start, acp_vector_it_t end)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (start.vector.ga != end.vector.ga) return;
     
     acp_ga_t buf = acp_malloc(48, acp_rank());
@@ -155,6 +159,7 @@ void acp_assign_range_vector(acp_vector_t vector, acp_vector_it_t start, acp_vec
 
 acp_ga_t acp_at_vector(acp_vector_t vector, int index)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (index < 0) return ACP_GA_NULL;
     
     acp_ga_t buf = acp_malloc(24, acp_rank());
@@ -177,6 +182,7 @@ acp_ga_t acp_at_vector(acp_vector_t vector, int index)
 
 acp_vector_it_t acp_begin_vector(acp_vector_t vector)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_vector_it_t it;
     
     it.vector.ga = vector.ga;
@@ -187,6 +193,7 @@ acp_vector_it_t acp_begin_vector(acp_vector_t vector)
 
 size_t acp_capacity_vector(acp_vector_t vector)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return 0;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -207,6 +214,7 @@ size_t acp_capacity_vector(acp_vector_t vector)
 
 void acp_clear_vector(acp_vector_t vector)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -232,6 +240,7 @@ void acp_clear_vector(acp_vector_t vector)
 
 acp_vector_t acp_create_vector(size_t size, int rank)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_vector_t vector;
     vector.ga = ACP_GA_NULL;
     
@@ -274,6 +283,7 @@ acp_vector_t acp_create_vector(size_t size, int rank)
 
 void acp_destroy_vector(acp_vector_t vector)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -296,6 +306,7 @@ void acp_destroy_vector(acp_vector_t vector)
 
 int acp_empty_vector(acp_vector_t vector)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return 1;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -316,6 +327,7 @@ int acp_empty_vector(acp_vector_t vector)
 
 acp_vector_it_t acp_end_vector(acp_vector_t vector)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_vector_it_t it;
     
     it.vector.ga = vector.ga;
@@ -343,6 +355,7 @@ acp_vector_it_t acp_end_vector(acp_vector_t vector)
 
 acp_vector_it_t acp_erase_vector(acp_vector_it_t it, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return it;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -379,12 +392,14 @@ acp_vector_it_t acp_erase_vector(acp_vector_it_t it, size_t size)
 
 acp_vector_it_t acp_erase_range_vector(acp_vector_it_t start, acp_vector_it_t end)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (start.vector.ga != end.vector.ga || start.index >= end.index) return end;
     return acp_erase_vector(start, end.index - start.index);
 }
 
 acp_vector_it_t acp_insert_vector(acp_vector_it_t it, const acp_ga_t ga, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     int index = it.index;
     
     acp_ga_t buf = acp_malloc(24, acp_rank());
@@ -445,12 +460,14 @@ acp_vector_it_t acp_insert_vector(acp_vector_it_t it, const acp_ga_t ga, size_t
 
 acp_vector_it_t acp_insert_range_vector(acp_vector_it_t it, acp_vector_it_t start, acp_vector_it_t end)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (start.vector.ga != end.vector.ga || start.index >= end.index) return it;
     return acp_insert_vector(it, start.vector.ga + start.index, end.index - start.index);
 }
 
 void acp_pop_back_vector(acp_vector_t vector, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -475,6 +492,7 @@ void acp_pop_back_vector(acp_vector_t vector, size_t size)
 
 void acp_push_back_vector(acp_vector_t vector, const acp_ga_t ga, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -523,6 +541,7 @@ void acp_push_back_vector(acp_vector_t vector, const acp_ga_t ga, size_t size)
 
 void acp_reserve_vector(acp_vector_t vector, size_t size)
 {
+    IACPBL_TRACE_SCOPE("dl");
     size += (((size + 7) & 7) ^ 7);
     
     acp_ga_t buf = acp_malloc(24, acp_rank());
@@ -555,6 +574,7 @@ void acp_reserve_vector(acp_vector_t vector, size_t size)
 
 size_t acp_size_vector(acp_vector_t vector)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(24, acp_rank());
     if (buf == ACP_GA_NULL) return 0;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -575,6 +595,7 @@ size_t acp_size_vector(acp_vector_t vector)
 
 void acp_swap_vector(acp_vector_t vector1, acp_vector_t vector2)
 {
+    IACPBL_TRACE_SCOPE("dl");
     acp_ga_t buf = acp_malloc(48, acp_rank());
     if (buf == ACP_GA_NULL) return;
     uintptr_t ptr = (uintptr_t)acp_query_address(buf);
@@ -633,12 +654,14 @@ void acp_swap_vector(acp_vector_t vector1, acp_vector_t vector2)
 
 acp_vector_it_t acp_advance_vector_it(acp_vector_it_t it, int n)
 {
+    IACPBL_TRACE_SCOPE("dl");
     it.index += n;
     return it;
 }
 
 acp_ga_t acp_dereference_vector_it(acp_vector_it_t it)
 {
+    IACPBL_TRACE_SCOPE("dl");
     if (it.index < 0) return ACP_GA_NULL;
     
     acp_ga_t buf = acp_malloc(24, acp_rank());
@@ -661,6 +684,7 @@ acp_ga_t acp_dereference_vector_it(acp_vector_it_t it)
 
 int acp_distance_vector_it(acp_vector_it_t first, acp_vector_it_t last)
 {
+    IACPBL_TRACE_SCOPE("dl");
     return last.index - first.index;
 }
 
@@ -0,0 +1,391 @@
+/*
+ * ACP Basic Layer benchmark suite
+ *
+ * Copyright (c) 2014-2014 Kyushu University
+ * Copyright (c) 2014      Institute of Systems, Information Technologies
+ *                         and Nanotechnologies 2014
+ * Copyright (c) 2014      FUJITSU LIMITED
+ *
+ * This software is released under the BSD License, see LICENSE.
+ *
+ * Note:
+ *   Measures put/get latency, streaming bandwidth, atomic rate,
+ *   message rate and acp_sync latency.  Point-to-point tests are run
+ *   by rank 0 against the first peer on the same node (intra) and the
+ *   first peer on another node (inter), if any.  Every result is one
+ *   record, printed as a table (-f text), CSV (-f csv) or JSON lines
+ *   (-f json), so that runs can be compared by scripts.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <acp.h>
+
+#define BENCH_LATENCY   0x01
+#define BENCH_BANDWIDTH 0x02
+#define BENCH_ATOMIC    0x04
+#define BENCH_MSGRATE   0x08
+#define BENCH_SYNC      0x10
+#define BENCH_ALL       0x1f
+
+#define FORMAT_TEXT 0
+#define FORMAT_CSV  1
+#define FORMAT_JSON 2
+
+/* layout of the starter memory of each rank */
+#define STARTER_GA      0
+#define STARTER_HOSTID  8
+#define STARTER_INFO    16
+
+/* layout of the registered buffer of each rank */
+#define BUF_ATOMIC      0
+#define BUF_RESULT      64
+#define BUF_DATA        4096
+
+typedef struct {
+    acp_ga_t ga;
+    uint64_t hostid;
+} peer_info_t;
+
+static int myrank, nprocs;
+static int format = FORMAT_TEXT;
+static int iters = 100;
+static int warmup = 10;
+static int window = 64;
+static size_t minsize = 1;
+static size_t maxsize = 1 << 20;
+
+static char *buf;
+static acp_atkey_t bufkey;
+static acp_ga_t bufga;
+static peer_info_t *peers;
+
+static double now_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1.0e6 + ts.tv_nsec * 1.0e-3;
+}
+
+static uint64_t host_id(void)
+{
+    char name[256];
+    uint64_t h = 1469598103934665603ULL;
+    char *p;
+
+    memset(name, 0, sizeof(name));
+    gethostname(name, sizeof(name) - 1);
+    for (p = name; *p != '\0'; p++) h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+    return h;
+}
+
+static void report(const char *test, const char *op, const char *locality, int peer,
+                   size_t size, int win, int n, double value, const char *unit)
+{
+    static int header = 0;
+
+    switch (format) {
+    case FORMAT_CSV:
+        if (!header) printf("test,op,locality,peer,size,window,iters,value,unit\n");
+        printf("%s,%s,%s,%d,%zu,%d,%d,%.3f,%s\n", test, op, locality, peer, size, win, n, value, unit);
+        break;
+    case FORMAT_JSON:
+        printf("{\"test\":\"%s\",\"op\":\"%s\",\"locality\":\"%s\",\"peer\":%d,\"size\":%zu,"
+               "\"window\":%d,\"iters\":%d,\"value\":%.3f,\"unit\":\"%s\"}\n",
+               test, op, locality, peer, size, win, n, value, unit);
+        break;
+    default:
+        if (!header) printf("# %-9s %-6s %-8s %5s %10s %6s %8s %14s %s\n",
+                            "test", "op", "locality", "peer", "size", "window", "iters", "value", "unit");
+        printf("  %-9s %-6s %-8s %5d %10zu %6d %8d %14.3f %s\n", test, op, locality, peer, size, win, n, value, unit);
+        break;
+    }
+    header = 1;
+    fflush(stdout);
+}
+
+/* exchange the address of the buffer and the host of every rank */
+static void exchange_info(void)
+{
+    acp_ga_t starter, infoga;
+    acp_atkey_t infokey;
+    int i;
+
+    starter = acp_query_starter_ga(myrank);
+    *(acp_ga_t *)((char *)acp_query_address(starter) + STARTER_GA) = bufga;
+    *(uint64_t *)((char *)acp_query_address(starter) + STARTER_HOSTID) = host_id();
+    acp_sync();
+
+    peers = (peer_info_t *)malloc(sizeof(peer_info_t) * nprocs);
+    infokey = acp_register_memory(peers, sizeof(peer_info_t) * nprocs, 0);
+    infoga = acp_query_ga(infokey, peers);
+    for (i = 0; i < nprocs; i++)
+        acp_copy(infoga + sizeof(peer_info_t) * i, acp_query_starter_ga(i), STARTER_INFO, ACP_HANDLE_NULL);
+    acp_complete(ACP_HANDLE_ALL);
+    acp_unregister_memory(infokey);
+    acp_sync();
+}
+
+/* one-at-a-time copies, dir 0 is put and 1 is get */
+static void bench_latency(int peer, const char *locality)
+{
+    acp_ga_t local, remote;
+    size_t size;
+    double t0 = 0.0, t1;
+    int dir, i;
+
+    local = bufga + BUF_DATA;
+    remote = peers[peer].ga + BUF_DATA;
+    for (dir = 0; dir < 2; dir++) {
+        for (size = minsize; size <= maxsize; size *= 2) {
+            for (i = -warmup; i < iters; i++) {
+                if (i == 0) t0 = now_usec();
+                if (dir == 0)
+                    acp_complete(acp_copy(remote, local, size, ACP_HANDLE_NULL));
+                else
+                    acp_complete(acp_copy(local, remote, size, ACP_HANDLE_NULL));
+            }
+            t1 = now_usec();
+            report("latency", (dir == 0) ? "put" : "get", locality, peer, size, 1, iters,
+                   (t1 - t0) / iters, "usec");
+        }
+    }
+}
+
+/* streaming copies with up to window outstanding operations */
+static void bench_bandwidth(int peer, const char *locality)
+{
+    acp_ga_t local, remote;
+    size_t size;
+    double t0 = 0.0, t1;
+    int dir, i;
+
+    local = bufga + BUF_DATA;
+    remote = peers[peer].ga + BUF_DATA;
+    for (dir = 0; dir < 2; dir++) {
+        for (size = minsize; size <= maxsize; size *= 2) {
+            for (i = -warmup; i < iters; i++) {
+                if (i == 0) {
+                    acp_complete(ACP_HANDLE_ALL);
+                    t0 = now_usec();
+                }
+                if (dir == 0)
+                    acp_copy(remote, local, size, ACP_HANDLE_NULL);
+                else
+                    acp_copy(local, remote, size, ACP_HANDLE_NULL);
+                if ((i + 1) % window == 0) acp_complete(ACP_HANDLE_ALL);
+            }
+            acp_complete(ACP_HANDLE_ALL);
+            t1 = now_usec();
+            report("bandwidth", (dir == 0) ? "put" : "get", locality, peer, size, window, iters,
+                   (double)size * iters / (t1 - t0), "MB/s");
+        }
+    }
+}
+
+static acp_handle_t issue_atomic(int op, acp_ga_t dst, acp_ga_t src)
+{
+    switch (op) {
+    case 0:  return acp_cas4(dst, src, 0, 0, ACP_HANDLE_NULL);
+    case 1:  return acp_cas8(dst, src, 0, 0, ACP_HANDLE_NULL);
+    case 2:  return acp_swap4(dst, src, 0, ACP_HANDLE_NULL);
+    case 3:  return acp_swap8(dst, src, 0, ACP_HANDLE_NULL);
+    case 4:  return acp_add4(dst, src, 1, ACP_HANDLE_NULL);
+    case 5:  return acp_add8(dst, src, 1, ACP_HANDLE_NULL);
+    case 6:  return acp_xor4(dst, src, 1, ACP_HANDLE_NULL);
+    case 7:  return acp_xor8(dst, src, 1, ACP_HANDLE_NULL);
+    case 8:  return acp_or4(dst, src, 1, ACP_HANDLE_NULL);
+    case 9:  return acp_or8(dst, src, 1, ACP_HANDLE_NULL);
+    case 10: return acp_and4(dst, src, 0xffffffffU, ACP_HANDLE_NULL);
+    default: return acp_and8(dst, src, 0xffffffffffffffffULL, ACP_HANDLE_NULL);
+    }
+}
+
+/* rate of each atomic operation with up to window outstanding operations */
+static void bench_atomic(int peer, const char *locality)
+{
+    static const char *name[] = {
+        "cas4", "cas8", "swap4", "swap8", "add4", "add8",
+        "xor4", "xor8", "or4", "or8", "and4", "and8"
+    };
+    acp_ga_t result, target;
+    double t0 = 0.0, t1;
+    int op, i;
+
+    result = bufga + BUF_RESULT;
+    target = peers[peer].ga + BUF_ATOMIC;
+    for (op = 0; op < 12; op++) {
+        for (i = -warmup; i < iters; i++) {
+            if (i == 0) {
+                acp_complete(ACP_HANDLE_ALL);
+                t0 = now_usec();
+            }
+            issue_atomic(op, result, target);
+            if ((i + 1) % window == 0) acp_complete(ACP_HANDLE_ALL);
+        }
+        acp_complete(ACP_HANDLE_ALL);
+        t1 = now_usec();
+        report("atomic", name[op], locality, peer, (op % 2 == 0) ? 4 : 8, window, iters,
+               iters * 1.0e6 / (t1 - t0), "ops/s");
+    }
+}
+
+/* small puts from every rank to all the other ranks in turn */
+static void bench_msgrate(void)
+{
+    acp_ga_t local;
+    double t0 = 0.0, t1, rate, total;
+    int i, peer;
+
+    if (nprocs < 2) return;
+    local = bufga + BUF_DATA;
+    acp_sync();
+    peer = myrank;
+    for (i = -warmup; i < iters; i++) {
+        if (i == 0) {
+            acp_complete(ACP_HANDLE_ALL);
+            acp_sync();
+            t0 = now_usec();
+        }
+        peer = (peer + 1) % nprocs;
+        if (peer == myrank) peer = (peer + 1) % nprocs;
+        acp_copy(peers[peer].ga + BUF_DATA, local, minsize, ACP_HANDLE_NULL);
+        if ((i + 1) % window == 0) acp_complete(ACP_HANDLE_ALL);
+    }
+    acp_complete(ACP_HANDLE_ALL);
+    t1 = now_usec();
+
+    /* gather the rate of every rank to rank 0 */
+    acp_sync();
+    rate = iters * 1.0e6 / (t1 - t0);
+    *(double *)(buf + BUF_RESULT) = rate;
+    acp_complete(acp_copy(peers[0].ga + BUF_DATA + sizeof(double) * myrank,
+                          bufga + BUF_RESULT, sizeof(double), ACP_HANDLE_NULL));
+    acp_sync();
+    if (myrank == 0) {
+        total = 0.0;
+        for (i = 0; i < nprocs; i++) total += *(double *)(buf + BUF_DATA + sizeof(double) * i);
+        report("msgrate", "put", "all", -1, minsize, window, iters, total, "msgs/s");
+    }
+}
+
+static void bench_sync(void)
+{
+    double t0 = 0.0, t1;
+    int i;
+
+    for (i = -warmup; i < iters; i++) {
+        if (i == 0) t0 = now_usec();
+        acp_sync();
+    }
+    t1 = now_usec();
+    if (myrank == 0) report("sync", "sync", "all", -1, 0, 1, iters, (t1 - t0) / iters, "usec");
+}
+
+static int parse_tests(char *arg)
+{
+    char *tok;
+    int tests = 0;
+
+    for (tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if      (strcmp(tok, "latency")   == 0) tests |= BENCH_LATENCY;
+        else if (strcmp(tok, "bandwidth") == 0) tests |= BENCH_BANDWIDTH;
+        else if (strcmp(tok, "atomic")    == 0) tests |= BENCH_ATOMIC;
+        else if (strcmp(tok, "msgrate")   == 0) tests |= BENCH_MSGRATE;
+        else if (strcmp(tok, "sync")      == 0) tests |= BENCH_SYNC;
+        else if (strcmp(tok, "all")       == 0) tests |= BENCH_ALL;
+        else return -1;
+    }
+    return tests;
+}
+
+static void usage(char *name)
+{
+    fprintf(stderr, "usage: %s [-t latency,bandwidth,atomic,msgrate,sync|all] [-f text|csv|json]\n"
+            "       [-s min size] [-S max size] [-i iterations] [-x warmup] [-w window]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    size_t bufsize;
+    int tests = BENCH_ALL;
+    int intra = -1, inter = -1;
+    int c, i;
+
+    acp_init(&argc, &argv);
+    myrank = acp_rank();
+    nprocs = acp_procs();
+
+    while ((c = getopt(argc, argv, "t:f:s:S:i:x:w:h")) != -1) {
+        switch (c) {
+        case 't':
+            tests = parse_tests(optarg);
+            break;
+        case 'f':
+            if      (strcmp(optarg, "text") == 0) format = FORMAT_TEXT;
+            else if (strcmp(optarg, "csv")  == 0) format = FORMAT_CSV;
+            else if (strcmp(optarg, "json") == 0) format = FORMAT_JSON;
+            else tests = -1;
+            break;
+        case 's': minsize = strtoul(optarg, NULL, 0); break;
+        case 'S': maxsize = strtoul(optarg, NULL, 0); break;
+        case 'i': iters   = atoi(optarg); break;
+        case 'x': warmup  = atoi(optarg); break;
+        case 'w': window  = atoi(optarg); break;
+        default:
+            tests = -1;
+        }
+    }
+    if (tests < 0 || minsize < 1 || maxsize < minsize || iters < 1 || warmup < 0 || window < 1) {
+        if (myrank == 0) usage(argv[0]);
+        acp_finalize();
+        return 1;
+    }
+
+    /* the message rate test gathers one double per rank into the data region */
+    bufsize = BUF_DATA + ((maxsize > sizeof(double) * nprocs) ? maxsize : sizeof(double) * nprocs);
+    buf = (char *)calloc(1, bufsize);
+    bufkey = (buf != NULL) ? acp_register_memory(buf, bufsize, 0) : ACP_ATKEY_NULL;
+    if (bufkey == ACP_ATKEY_NULL) {
+        fprintf(stderr, "%d: acpbench: cannot register %zu bytes\n", myrank, bufsize);
+        acp_abort("acpbench");
+    }
+    bufga = acp_query_ga(bufkey, buf);
+    exchange_info();
+
+    if (myrank == 0) {
+        for (i = 1; i < nprocs; i++) {
+            if (intra < 0 && peers[i].hostid == peers[0].hostid) intra = i;
+            if (inter < 0 && peers[i].hostid != peers[0].hostid) inter = i;
+        }
+        if (intra < 0 && inter < 0) intra = 0;
+        if (tests & BENCH_LATENCY) {
+            if (intra >= 0) bench_latency(intra, (intra == 0) ? "self" : "intra");
+            if (inter >= 0) bench_latency(inter, "inter");
+        }
+        if (tests & BENCH_BANDWIDTH) {
+            if (intra >= 0) bench_bandwidth(intra, (intra == 0) ? "self" : "intra");
+            if (inter >= 0) bench_bandwidth(inter, "inter");
+        }
+        if (tests & BENCH_ATOMIC) {
+            if (intra >= 0) bench_atomic(intra, (intra == 0) ? "self" : "intra");
+            if (inter >= 0) bench_atomic(inter, "inter");
+        }
+    }
+    acp_sync();
+
+    if (tests & BENCH_MSGRATE) bench_msgrate();
+    if (tests & BENCH_SYNC) bench_sync();
+
+    acp_sync();
+    acp_unregister_memory(bufkey);
+    free(buf);
+    free(peers);
+    acp_finalize();
+
+    return 0;
+}
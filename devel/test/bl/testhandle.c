@@ -0,0 +1,148 @@
+/*
+ * ACP Basic Layer test of GMA handles shared by threads
+ *
+ * Copyright (c) 2014-2014 Kyushu University
+ * Copyright (c) 2014      Institute of Systems, Information Technologies
+ *                         and Nanotechnologies 2014
+ * Copyright (c) 2014      FUJITSU LIMITED
+ *
+ * This software is released under the BSD License, see LICENSE.
+ *
+ * Note:
+ *   A thread issues GMAs and the main thread completes, inquires or
+ *   orders after their handles, as the communication library does with
+ *   its progress thread. ACP_HANDLE_ALL covers only the GMAs of the
+ *   calling thread. The GMAs get values from the starter memory
+ *   of the next rank. --acp-thread-multiple is enabled unless given,
+ *   so that the two threads issue into different command queues.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <acp.h>
+
+#define N 64
+
+static int myrank, nprocs, peer;
+static int64_t *buf;
+static acp_ga_t bufga, srcga;
+static acp_handle_t hdl[N];
+static volatile int issued;
+static int all;
+static int errors = 0;
+
+static int64_t value(int rank, int i)
+{
+    return (int64_t)rank * 1000 + i;
+}
+
+/* issue N gets from the peer into buf, publishing each handle */
+static void *issuer(void *arg)
+{
+    int i;
+
+    for (i = 0; i < N; i++) {
+        hdl[i] = acp_copy(bufga + sizeof(int64_t) * i, srcga + sizeof(int64_t) * i,
+                          sizeof(int64_t), ACP_HANDLE_NULL);
+        __sync_synchronize();
+        issued = i + 1;
+    }
+    if (all) acp_complete(ACP_HANDLE_ALL);
+    return NULL;
+}
+
+static void start_issuer(pthread_t *th)
+{
+    memset(buf, 0, sizeof(int64_t) * 2 * N);
+    issued = 0;
+    __sync_synchronize();
+    pthread_create(th, NULL, issuer, NULL);
+}
+
+static void check(const char *name, int i, int64_t got)
+{
+    if (got != value(peer, i)) {
+        fprintf(stderr, "rank %d: %s: wrong data %ld at %d (should be %ld)\n",
+                myrank, name, (long)got, i, (long)value(peer, i));
+        errors++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int64_t *starter;
+    acp_atkey_t key;
+    acp_handle_t h;
+    pthread_t th;
+    char **args;
+
+    /* options given on the command line come later and override these */
+    args = (char **)malloc(sizeof(char *) * (argc + 3));
+    args[0] = argv[0];
+    args[1] = "--acp-thread-multiple";
+    args[2] = "1";
+    for (i = 1; i <= argc; i++) args[i + 2] = argv[i];
+    argc += 2;
+    argv = args;
+    acp_init(&argc, &argv);
+    myrank = acp_rank();
+    nprocs = acp_procs();
+    peer = (myrank + 1) % nprocs;
+
+    starter = (int64_t *)acp_query_address(acp_query_starter_ga(myrank));
+    for (i = 0; i < N; i++) starter[i] = value(myrank, i);
+    srcga = acp_query_starter_ga(peer);
+
+    buf = (int64_t *)malloc(sizeof(int64_t) * 2 * N);
+    key = acp_register_memory(buf, sizeof(int64_t) * 2 * N, 0);
+    bufga = acp_query_ga(key, buf);
+    acp_sync();
+
+    /* acp_complete on each handle of the other thread */
+    start_issuer(&th);
+    for (i = 0; i < N; i++) {
+        while (issued <= i) ;
+        acp_complete(hdl[i]);
+        check("complete", i, buf[i]);
+    }
+    pthread_join(th, NULL);
+
+    /* acp_inquire on each handle of the other thread */
+    start_issuer(&th);
+    for (i = 0; i < N; i++) {
+        while (issued <= i) ;
+        while (acp_inquire(hdl[i])) ;
+        check("inquire", i, buf[i]);
+    }
+    pthread_join(th, NULL);
+
+    /* ACP_HANDLE_ALL of the other thread covers its own queue */
+    all = 1;
+    start_issuer(&th);
+    pthread_join(th, NULL);
+    all = 0;
+    for (i = 0; i < N; i++) check("all", i, buf[i]);
+
+    /* a local copy ordered after the handles of the other thread */
+    start_issuer(&th);
+    for (i = 0; i < N; i++) {
+        while (issued <= i) ;
+        h = acp_copy(bufga + sizeof(int64_t) * (N + i), bufga + sizeof(int64_t) * i,
+                     sizeof(int64_t), hdl[i]);
+        acp_complete(h);
+        check("order", i, buf[N + i]);
+    }
+    pthread_join(th, NULL);
+
+    acp_sync();
+    acp_unregister_memory(key);
+    free(buf);
+
+    if (errors == 0) fprintf(stderr, "rank %d: testhandle ok\n", myrank);
+    acp_finalize();
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * ACP Basic Layer test of the return value of acp_inquire
+ *
+ * Copyright (c) 2014-2014 Kyushu University
+ * Copyright (c) 2014      Institute of Systems, Information Technologies
+ *                         and Nanotechnologies 2014
+ * Copyright (c) 2014      FUJITSU LIMITED
+ *
+ * This software is released under the BSD License, see LICENSE.
+ *
+ * Note:
+ *   acp_inquire returns 1 while the GMA of the handle, or a GMA issued
+ *   before it, is incomplete, and 0 after all of them have completed.
+ *   Each rank gets buffers of several sizes from the next rank by
+ *   polling acp_inquire, and checks the data as soon as it returns 0.
+ *   With --acp-udp-only 1 the larger gets overrun the socket buffers on
+ *   loopback, so they also check that dropped datagrams are resent.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <acp.h>
+
+#define MAXSZ (256 * 1024)
+
+static int myrank, errors = 0;
+
+static void expect(const char *name, int got, int should)
+{
+    if (got != should) {
+        fprintf(stderr, "rank %d: %s: acp_inquire returned %d (should be %d)\n",
+                myrank, name, got, should);
+        errors++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int nprocs, peer, i, k;
+    size_t sz;
+    unsigned char *src, *dst;
+    acp_ga_t *starter, srcga, dstga, peerga;
+    acp_atkey_t srckey, dstkey;
+    acp_handle_t h;
+
+    acp_init(&argc, &argv);
+    myrank = acp_rank();
+    nprocs = acp_procs();
+    peer = (myrank + 1) % nprocs;
+
+    src = (unsigned char *)malloc(MAXSZ);
+    dst = (unsigned char *)malloc(MAXSZ + sizeof(acp_ga_t));
+    for (i = 0; i < MAXSZ; i++) src[i] = (unsigned char)(i * 7 + myrank);
+    srckey = acp_register_memory(src, MAXSZ, 0);
+    dstkey = acp_register_memory(dst, MAXSZ + sizeof(acp_ga_t), 0);
+    srcga = acp_query_ga(srckey, src);
+    dstga = acp_query_ga(dstkey, dst);
+
+    /* publish the GA of src in the starter memory */
+    starter = (acp_ga_t *)acp_query_address(acp_query_starter_ga(myrank));
+    starter[0] = srcga;
+    acp_sync();
+    h = acp_copy(dstga + MAXSZ, acp_query_starter_ga(peer), sizeof(acp_ga_t), ACP_HANDLE_NULL);
+    acp_complete(h);
+    memcpy(&peerga, dst + MAXSZ, sizeof(acp_ga_t));
+
+    expect("null", acp_inquire(ACP_HANDLE_NULL), 0);
+
+    for (sz = 8; sz <= MAXSZ; sz *= 8) {
+        memset(dst, 0, sz);
+        h = acp_copy(dstga, peerga, sz, ACP_HANDLE_NULL);
+        while (acp_inquire(h)) ;
+        for (k = 0; k < sz; k++)
+            if (dst[k] != (unsigned char)(k * 7 + peer)) {
+                fprintf(stderr, "rank %d: wrong data at %d of %zu bytes after acp_inquire returned 0\n",
+                        myrank, k, sz);
+                errors++;
+                break;
+            }
+        expect("completed", acp_inquire(h), 0);
+        expect("all", acp_inquire(ACP_HANDLE_ALL), 0);
+        acp_complete(h);
+        expect("after acp_complete", acp_inquire(h), 0);
+    }
+
+    acp_sync();
+    acp_unregister_memory(srckey);
+    acp_unregister_memory(dstkey);
+    free(src);
+    free(dst);
+
+    if (errors == 0) fprintf(stderr, "rank %d: testinquire ok\n", myrank);
+    acp_finalize();
+    return errors ? 1 : 0;
+}
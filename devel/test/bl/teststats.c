@@ -0,0 +1,163 @@
+/*
+ * ACP Basic Layer test of the statistics
+ *
+ * Copyright (c) 2014-2014 Kyushu University
+ * Copyright (c) 2014      Institute of Systems, Information Technologies
+ *                         and Nanotechnologies 2014
+ * Copyright (c) 2014      FUJITSU LIMITED
+ *
+ * This software is released under the BSD License, see LICENSE.
+ *
+ * Note:
+ *   Each rank gets values from the starter memory of the next rank and
+ *   adds to its own, while a thread queries the statistics and checks
+ *   that no counter goes back. Then the latency counts of the GMAs and
+ *   the per-peer transport counters are checked against the totals.
+ *   Run with --acp-udp-only 1 to have datagrams counted on one node.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <acp.h>
+
+#define N 200
+
+static int myrank, nprocs, errors = 0;
+static volatile int done;
+
+static uint64_t histsum(acp_stats_latency_t *lat)
+{
+    uint64_t sum = 0;
+    int k;
+
+    for (k = 0; k < ACP_STATS_HIST_BINS; k++) sum += lat->hist[k];
+    return sum;
+}
+
+/* check that no counter of cur is less than that of prev */
+static int monotonic(acp_stats_t *prev, acp_stats_t *cur)
+{
+    int j;
+
+    for (j = 0; j < ACP_STATS_NUM_OPS; j++)
+        if (cur->op[j].count < prev->op[j].count || cur->op[j].total_nsec < prev->op[j].total_nsec
+            || cur->op[j].max_nsec < prev->op[j].max_nsec) return 0;
+    return cur->tx_bytes >= prev->tx_bytes && cur->tx_packets >= prev->tx_packets
+        && cur->rx_bytes >= prev->rx_bytes && cur->rx_packets >= prev->rx_packets
+        && cur->retransmits >= prev->retransmits && cur->queue_full_stalls >= prev->queue_full_stalls
+        && cur->loop_iterations >= prev->loop_iterations;
+}
+
+static void *reader(void *arg)
+{
+    acp_stats_t prev, cur;
+    acp_peer_stats_t pprev, pcur;
+    int peer = (myrank + 1) % nprocs;
+
+    acp_query_stats(&prev);
+    acp_query_peer_stats(peer, &pprev);
+    while (!done) {
+        acp_query_stats(&cur);
+        acp_query_peer_stats(peer, &pcur);
+        if (!monotonic(&prev, &cur)) {
+            fprintf(stderr, "rank %d: a counter went back in acp_query_stats\n", myrank);
+            errors++;
+            break;
+        }
+        if (pcur.tx_bytes < pprev.tx_bytes || pcur.tx_packets < pprev.tx_packets
+            || pcur.rx_bytes < pprev.rx_bytes || pcur.rx_packets < pprev.rx_packets) {
+            fprintf(stderr, "rank %d: a counter went back in acp_query_peer_stats\n", myrank);
+            errors++;
+            break;
+        }
+        prev = cur;
+        pprev = pcur;
+        sched_yield();
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int i, r, peer;
+    int64_t *starter;
+    acp_ga_t myga, peerga;
+    acp_stats_t before, after;
+    acp_peer_stats_t ps, sum;
+    pthread_t th;
+
+    acp_init(&argc, &argv);
+    myrank = acp_rank();
+    nprocs = acp_procs();
+    peer = (myrank + 1) % nprocs;
+
+    if (acp_query_stats(NULL) != -1 || acp_query_peer_stats(0, NULL) != -1
+        || acp_query_peer_stats(-1, &ps) != -1 || acp_query_peer_stats(nprocs, &ps) != -1) {
+        fprintf(stderr, "rank %d: wrong arguments are not refused\n", myrank);
+        errors++;
+    }
+
+    starter = (int64_t *)acp_query_address(acp_query_starter_ga(myrank));
+    starter[0] = myrank;
+    starter[1] = 0;
+    myga = acp_query_starter_ga(myrank);
+    peerga = acp_query_starter_ga(peer);
+    acp_sync();
+
+    acp_query_stats(&before);
+    done = 0;
+    pthread_create(&th, NULL, reader, NULL);
+    for (i = 0; i < N; i++) {
+        acp_complete(acp_copy(myga + 2 * sizeof(int64_t), peerga, sizeof(int64_t), ACP_HANDLE_NULL));
+        acp_complete(acp_add8(myga + 3 * sizeof(int64_t), myga + sizeof(int64_t), 1, ACP_HANDLE_NULL));
+    }
+    done = 1;
+    pthread_join(th, NULL);
+    acp_sync();
+
+    /* the totals are queried after the peers, so that they are not less than the sums */
+    memset(&sum, 0, sizeof(sum));
+    for (r = 0; r < nprocs; r++) {
+        acp_query_peer_stats(r, &ps);
+        sum.tx_bytes += ps.tx_bytes;
+        sum.tx_packets += ps.tx_packets;
+        sum.rx_bytes += ps.rx_bytes;
+        sum.rx_packets += ps.rx_packets;
+    }
+    acp_query_stats(&after);
+
+    if (starter[1] != N || starter[2] != peer) {
+        fprintf(stderr, "rank %d: wrong data %ld %ld\n", myrank, (long)starter[1], (long)starter[2]);
+        errors++;
+    }
+    if (after.op[ACP_STATS_OP_COPY].count - before.op[ACP_STATS_OP_COPY].count < N
+        || after.op[ACP_STATS_OP_ADD8].count - before.op[ACP_STATS_OP_ADD8].count < N) {
+        fprintf(stderr, "rank %d: GMAs are not counted: copy %lu add8 %lu\n", myrank,
+                (unsigned long)(after.op[ACP_STATS_OP_COPY].count - before.op[ACP_STATS_OP_COPY].count),
+                (unsigned long)(after.op[ACP_STATS_OP_ADD8].count - before.op[ACP_STATS_OP_ADD8].count));
+        errors++;
+    }
+    for (i = 0; i < ACP_STATS_NUM_OPS; i++)
+        if (histsum(&after.op[i]) != after.op[i].count
+            || (after.op[i].count > 0 && after.op[i].max_nsec > after.op[i].total_nsec)) {
+            fprintf(stderr, "rank %d: inconsistent latencies of op %d\n", myrank, i);
+            errors++;
+        }
+    if (sum.tx_bytes > after.tx_bytes || sum.tx_packets > after.tx_packets
+        || sum.rx_bytes > after.rx_bytes || sum.rx_packets > after.rx_packets) {
+        fprintf(stderr, "rank %d: per-peer counters exceed the totals\n", myrank);
+        errors++;
+    }
+
+    fprintf(stderr, "rank %d: tx %lu bytes %lu packets, rx %lu bytes %lu packets, retransmits %lu, loop iterations %lu\n",
+            myrank, (unsigned long)after.tx_bytes, (unsigned long)after.tx_packets,
+            (unsigned long)after.rx_bytes, (unsigned long)after.rx_packets,
+            (unsigned long)after.retransmits, (unsigned long)after.loop_iterations);
+    if (errors == 0) fprintf(stderr, "rank %d: teststats ok\n", myrank);
+    acp_finalize();
+    return errors ? 1 : 0;
+}
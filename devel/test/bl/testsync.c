@@ -0,0 +1,122 @@
+/*
+ * ACP Basic Layer test of the split-phase synchronization
+ *
+ * Copyright (c) 2014-2014 Kyushu University
+ * Copyright (c) 2014      Institute of Systems, Information Technologies
+ *                         and Nanotechnologies 2014
+ * Copyright (c) 2014      FUJITSU LIMITED
+ *
+ * This software is released under the BSD License, see LICENSE.
+ *
+ * Note:
+ *   The other ranks start a synchronization with acp_isync, see it in
+ *   progress with acp_inquire_sync, and tell rank 0 with a GMA issued
+ *   in the meantime, before rank 0 arrives at the synchronization.
+ *   Then rounds of acp_isync are run back to back. A value put to the
+ *   next rank before each round must be seen after it, and the handles
+ *   of the earlier rounds must be completed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <acp.h>
+
+#define ROUNDS 20
+
+static int myrank, errors = 0;
+
+static void expect(const char *name, int round, int got, int should)
+{
+    if (got != should) {
+        fprintf(stderr, "rank %d: %s at round %d: returned %d (should be %d)\n",
+                myrank, name, round, got, should);
+        errors++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int nprocs, next, prev, i, r;
+    volatile int64_t *starter;
+    acp_ga_t mystarter, nextstarter, rank0starter;
+    acp_handle_t h, hs[ROUNDS];
+
+    acp_init(&argc, &argv);
+    myrank = acp_rank();
+    nprocs = acp_procs();
+    next = (myrank + 1) % nprocs;
+    prev = (myrank + nprocs - 1) % nprocs;
+
+    /* starter memory: | arrival flags of the ranks (rank 0) | round from prev | source | */
+    starter = (volatile int64_t *)acp_query_address(acp_query_starter_ga(myrank));
+    for (i = 0; i < nprocs + 2; i++) starter[i] = 0;
+    mystarter = acp_query_starter_ga(myrank);
+    nextstarter = acp_query_starter_ga(next);
+    rank0starter = acp_query_starter_ga(0);
+    acp_sync();
+
+    /* the synchronization is in progress until rank 0 arrives */
+    if (myrank != 0) {
+        h = acp_isync();
+        if (h == ACP_HANDLE_NULL) {
+            fprintf(stderr, "rank %d: acp_isync failed\n", myrank);
+            errors++;
+        }
+        expect("acp_inquire_sync before rank 0 arrives", 0, acp_inquire_sync(h), 1);
+        expect("acp_inquire_sync(ACP_HANDLE_ALL) before rank 0 arrives", 0, acp_inquire_sync(ACP_HANDLE_ALL), 1);
+        expect("second acp_isync", 0, acp_isync() == ACP_HANDLE_NULL, 1);
+        expect("acp_sync in progress", 0, acp_sync(), -1);
+        starter[nprocs + 1] = 1;
+        acp_complete(acp_copy(rank0starter + sizeof(int64_t) * myrank, mystarter + sizeof(int64_t) * (nprocs + 1),
+                              sizeof(int64_t), ACP_HANDLE_NULL));
+    } else {
+        for (i = 1; i < nprocs; i++)
+            while (starter[i] == 0) ;
+        h = acp_isync();
+    }
+    while (acp_inquire_sync(h)) ;
+    expect("acp_inquire_sync after all ranks arrive", 0, acp_inquire_sync(h), 0);
+    expect("acp_inquire_sync(ACP_HANDLE_ALL) after all ranks arrive", 0, acp_inquire_sync(ACP_HANDLE_ALL), 0);
+    expect("acp_wait_sync after all ranks arrive", 0, acp_wait_sync(h), 0);
+
+    /* rounds of synchronizations back to back */
+    for (r = 0; r < ROUNDS; r++) {
+        starter[nprocs + 1] = r + 1;
+        h = acp_copy(nextstarter + sizeof(int64_t) * nprocs, mystarter + sizeof(int64_t) * (nprocs + 1),
+                     sizeof(int64_t), ACP_HANDLE_NULL);
+        acp_complete(h);
+        hs[r] = acp_isync();
+        if (hs[r] == ACP_HANDLE_NULL) {
+            fprintf(stderr, "rank %d: acp_isync failed at round %d\n", myrank, r);
+            errors++;
+            break;
+        }
+        for (i = 0; i < r; i++) {
+            if (hs[i] == hs[r]) {
+                fprintf(stderr, "rank %d: the handle of round %d is reused at round %d\n", myrank, i, r);
+                errors++;
+            }
+            expect("acp_inquire_sync of an earlier round", r, acp_inquire_sync(hs[i]), 0);
+        }
+        if (r % 2 == 0)
+            while (acp_inquire_sync(ACP_HANDLE_ALL)) ;
+        else
+            acp_wait_sync(hs[r]);
+        expect("acp_inquire_sync of this round", r, acp_inquire_sync(hs[r]), 0);
+        /* prev may have written the next round already */
+        if (starter[nprocs] < r + 1) {
+            fprintf(stderr, "rank %d: round %ld from rank %d after round %d\n",
+                    myrank, (long)starter[nprocs], prev, r);
+            errors++;
+        }
+    }
+
+    expect("acp_inquire_sync(ACP_HANDLE_NULL)", ROUNDS, acp_inquire_sync(ACP_HANDLE_NULL), 0);
+    expect("acp_wait_sync(ACP_HANDLE_NULL)", ROUNDS, acp_wait_sync(ACP_HANDLE_NULL), 0);
+
+    if (errors == 0) fprintf(stderr, "rank %d: testsync ok\n", myrank);
+    acp_finalize();
+    return errors ? 1 : 0;
+}
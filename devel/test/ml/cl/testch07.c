@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "acp.h"
+
+/* completion of requests of many channels: acp_waitany_ch, acp_testsome_ch,
+ * acp_test_ch, acp_waitall_ch and acp_set_callback_ch.
+ * rank 0 receives from every other rank through its own channel.
+ * the entry of rank 0 in the arrays of requests is ACP_REQUEST_NULL. */
+
+static int errors = 0;
+static int ncallbacks = 0;
+
+static void callback(acp_request_t req, size_t size, void *arg)
+{
+    int *data = (int *)arg;
+
+    if (size != sizeof(int)) {
+        fprintf(stderr, "rank: 0 callback: wrong size %zu\n", size);
+        errors++;
+    }
+    if (*data < 0) {
+        fprintf(stderr, "rank: 0 callback: data not received\n");
+        errors++;
+    }
+    ncallbacks++;
+}
+
+static void check(const char *name, int i, int data, int r)
+{
+    if (data != i * 10000 + r) {
+        fprintf(stderr, "rank: 0 %s: Wrong data %d (should be %d) i = %d\n",
+                name, data, i * 10000 + r, i);
+        errors++;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int rank, procs, data, i, k, n, r, c;
+    int *recv_data, *indices, *done;
+    size_t size, *sizes;
+    acp_ch_t *ch;
+    acp_request_t req, *reqs;
+    int rep = 1;
+
+    acp_init(&argc, &argv);
+    procs = acp_procs();
+    rank = acp_rank();
+
+    while ((c = getopt(argc, argv, "r:")) != -1){
+        switch(c){
+        case 'r':
+            rep = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r num]\n", argv[0]);
+        }
+    }
+
+    ch = (acp_ch_t *)calloc(procs, sizeof(acp_ch_t));
+    reqs = (acp_request_t *)calloc(procs, sizeof(acp_request_t));
+    recv_data = (int *)calloc(procs, sizeof(int));
+    indices = (int *)calloc(procs, sizeof(int));
+    done = (int *)calloc(procs, sizeof(int));
+    sizes = (size_t *)calloc(procs, sizeof(size_t));
+
+    if (rank != 0)
+        ch[0] = acp_create_ch(rank, 0);
+    else
+        for (i = 1; i < procs; i++)
+            ch[i] = acp_create_ch(i, 0);
+
+    for (r = 0; r < rep; r++){
+        /* acp_waitany_ch returns the requests in the order of arrival.
+         * the senders send one by one, from the last rank, while the others
+         * wait in acp_sync. */
+        if (rank == 0) {
+            for (i = 1; i < procs; i++)
+                reqs[i] = acp_nbrecv_ch(ch[i], &recv_data[i], sizeof(int));
+            reqs[0] = ACP_REQUEST_NULL;
+        }
+        for (k = procs - 1; k > 0; k--) {
+            if (rank == k) {
+                data = rank * 10000 + r;
+                acp_wait_ch(acp_nbsend_ch(ch[0], &data, sizeof(int)));
+            }
+            if (rank == 0) {
+                i = acp_waitany_ch(reqs, procs, &size);
+                if (i != k || size != sizeof(int)) {
+                    fprintf(stderr, "rank: 0 waitany: returned %d size %zu (should be %d)\n", i, size, k);
+                    errors++;
+                } else {
+                    check("waitany", i, recv_data[i], r);
+                }
+            }
+            acp_sync();
+        }
+        if (rank == 0 && acp_waitany_ch(reqs, procs, &size) != -1) {
+            fprintf(stderr, "rank: 0 waitany: no -1 for an array of null requests\n");
+            errors++;
+        }
+
+        /* acp_testsome_ch returns each request once */
+        if (rank == 0) {
+            for (i = 1; i < procs; i++) {
+                recv_data[i] = -1;
+                done[i] = 0;
+                reqs[i] = acp_nbrecv_ch(ch[i], &recv_data[i], sizeof(int));
+            }
+            for (k = 1; k < procs; ) {
+                n = acp_testsome_ch(reqs, procs, indices, sizes);
+                for (i = 0; i < n; i++) {
+                    if (indices[i] < 1 || indices[i] >= procs || done[indices[i]] || sizes[i] != sizeof(int)) {
+                        fprintf(stderr, "rank: 0 testsome: wrong index %d size %zu\n", indices[i], sizes[i]);
+                        errors++;
+                        continue;
+                    }
+                    if (reqs[indices[i]] != ACP_REQUEST_NULL) {
+                        fprintf(stderr, "rank: 0 testsome: request %d is not released\n", indices[i]);
+                        errors++;
+                    }
+                    done[indices[i]] = 1;
+                    check("testsome", indices[i], recv_data[indices[i]], r);
+                }
+                k += n;
+            }
+            if (acp_testsome_ch(reqs, procs, indices, sizes) != 0) {
+                fprintf(stderr, "rank: 0 testsome: completed requests in an array of null requests\n");
+                errors++;
+            }
+        } else {
+            data = rank * 10000 + r;
+            acp_wait_ch(acp_nbsend_ch(ch[0], &data, sizeof(int)));
+        }
+        acp_sync();
+
+        /* acp_test_ch and acp_waitall_ch */
+        if (rank == 0) {
+            for (i = 1; i < procs; i++) {
+                recv_data[i] = -1;
+                reqs[i] = acp_nbrecv_ch(ch[i], &recv_data[i], sizeof(int));
+            }
+            size = 0;
+            while (!acp_test_ch(reqs[1], &size)) ;
+            reqs[1] = ACP_REQUEST_NULL;
+            if (size != sizeof(int)) {
+                fprintf(stderr, "rank: 0 test: wrong size %zu\n", size);
+                errors++;
+            }
+            check("test", 1, recv_data[1], r);
+            acp_waitall_ch(reqs, procs, sizes);
+            for (i = 0; i < procs; i++) {
+                if (reqs[i] != ACP_REQUEST_NULL || sizes[i] != ((i > 1) ? sizeof(int) : 0)) {
+                    fprintf(stderr, "rank: 0 waitall: wrong request or size %zu at %d\n", sizes[i], i);
+                    errors++;
+                }
+                if (i > 1)
+                    check("waitall", i, recv_data[i], r);
+            }
+        } else {
+            data = rank * 10000 + r;
+            acp_wait_ch(acp_nbsend_ch(ch[0], &data, sizeof(int)));
+        }
+        acp_sync();
+
+        /* callbacks are invoked once by the progress of other functions */
+        if (rank == 0) {
+            ncallbacks = 0;
+            for (i = 1; i < procs; i++) {
+                recv_data[i] = -1;
+                req = acp_nbrecv_ch(ch[i], &recv_data[i], sizeof(int));
+                acp_set_callback_ch(req, callback, &recv_data[i]);
+            }
+            while (ncallbacks < procs - 1)
+                acp_testsome_ch(reqs, procs, indices, sizes);
+            for (i = 1; i < procs; i++)
+                check("callback", i, recv_data[i], r);
+        } else {
+            data = rank * 10000 + r;
+            acp_wait_ch(acp_nbsend_ch(ch[0], &data, sizeof(int)));
+        }
+        acp_sync();
+        if (rank == 0 && ncallbacks != procs - 1) {
+            fprintf(stderr, "rank: 0 callback: invoked %d times (should be %d)\n", ncallbacks, procs - 1);
+            errors++;
+        }
+    }
+
+    if (rank != 0)
+        acp_wait_ch(acp_nbfree_ch(ch[0]));
+    else
+        for (i = 1; i < procs; i++)
+            acp_wait_ch(acp_nbfree_ch(ch[i]));
+
+    fprintf(stderr, "rank: %d | errors: %d\n", rank, errors);
+    free(ch);
+    free(reqs);
+    free(recv_data);
+    free(indices);
+    free(done);
+    free(sizes);
+
+    acp_sync();
+    acp_finalize();
+    return (errors != 0);
+}
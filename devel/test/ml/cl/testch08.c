@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "acp.h"
+
+/* mailbox channel of rank 0 shared by all other ranks.
+ * each sender sends messages of eager and rendezvous sizes, and frees its
+ * endpoint without waiting for the receiver. the receiver checks the order
+ * of the messages of each sender, and frees the mailbox after all of the
+ * senders. */
+
+#define NSIZES 5
+#define MAXSZ 20000
+
+static size_t sizes[NSIZES] = { 8, 100, 2048, 2049, MAXSZ };
+
+static size_t msgsize(int i)
+{
+    return sizes[i % NSIZES];
+}
+
+static char msgbyte(int rank, int i, size_t k)
+{
+    return (char)(k + i * 7 + rank * 13);
+}
+
+int main(int argc, char** argv)
+{
+    int rank, procs, i, r, c, s, n;
+    int *next;
+    int errors = 0;
+    int rep = 1;
+    size_t k, sz, size;
+    char *buf;
+    acp_ch_t ch;
+
+    acp_init(&argc, &argv);
+    procs = acp_procs();
+    rank = acp_rank();
+
+    while ((c = getopt(argc, argv, "r:")) != -1){
+        switch(c){
+        case 'r':
+            rep = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r num]\n", argv[0]);
+        }
+    }
+
+    n = rep * NSIZES;
+    buf = (char *)malloc(MAXSZ);
+    ch = acp_create_mbox_ch(0);
+
+    if (rank != 0) {
+        for (i = 0; i < n; i++) {
+            sz = msgsize(i);
+            ((int *)buf)[0] = rank;
+            ((int *)buf)[1] = i;
+            for (k = 2 * sizeof(int); k < sz; k++)
+                buf[k] = msgbyte(rank, i, k);
+            acp_wait_ch(acp_nbsend_ch(ch, buf, sz));
+        }
+        acp_wait_ch(acp_nbfree_ch(ch));
+    } else {
+        next = (int *)calloc(procs, sizeof(int));
+        for (r = 0; r < n * (procs - 1); r++) {
+            memset(buf, 0, MAXSZ);
+            size = acp_wait_ch(acp_nbrecv_ch(ch, buf, MAXSZ));
+            s = ((int *)buf)[0];
+            i = ((int *)buf)[1];
+            if ((s < 1) || (s >= procs) || (i != next[s])) {
+                fprintf(stderr, "rank: 0 Wrong message %d from %d (should be %d)\n",
+                        i, s, ((s < 1) || (s >= procs)) ? -1 : next[s]);
+                errors++;
+                continue;
+            }
+            next[s]++;
+            if (size != msgsize(i)) {
+                fprintf(stderr, "rank: 0 Wrong size %zu (should be %zu) of message %d from %d\n",
+                        size, msgsize(i), i, s);
+                errors++;
+                continue;
+            }
+            for (k = 2 * sizeof(int); k < size; k++)
+                if (buf[k] != msgbyte(s, i, k)) {
+                    fprintf(stderr, "rank: 0 Wrong data at %zu of message %d from %d\n", k, i, s);
+                    errors++;
+                    break;
+                }
+        }
+        free(next);
+    }
+
+    /* the receiver frees the mailbox after all of the senders */
+    acp_sync();
+    if (rank == 0)
+        acp_wait_ch(acp_nbfree_ch(ch));
+
+    fprintf(stderr, "rank: %d | errors: %d\n", rank, errors);
+    free(buf);
+
+    acp_sync();
+    acp_finalize();
+    return (errors != 0);
+}
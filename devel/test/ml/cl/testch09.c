@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "acp.h"
+
+/* channels progressed by the progress thread of the communication library.
+ * each rank sends to the next rank and receives from the previous one in a
+ * ring, with eager and rendezvous sizes. the receive requests complete by
+ * their callbacks while the receiver spins without calling ACP.
+ * the progress thread and --acp-thread-multiple are enabled unless given. */
+
+#define NSIZES 3
+#define MAXSZ 20000
+
+static size_t sizes[NSIZES] = { 8, 2048, MAXSZ };
+static volatile int arrived;
+static volatile size_t arrivedsz;
+
+static void callback(acp_request_t req, size_t size, void *arg)
+{
+    arrivedsz = size;
+    __sync_synchronize();
+    arrived = 1;
+}
+
+int main(int argc, char** argv)
+{
+    int rank, procs, i, j, r, c, n;
+    int errors = 0;
+    int rep = 1;
+    int *sbuf, *rbuf;
+    char **args;
+    acp_ch_t sch, rch;
+    acp_request_t req;
+
+    /* options given on the command line come later and override these */
+    args = (char **)malloc(sizeof(char *) * (argc + 5));
+    args[0] = argv[0];
+    args[1] = "--acp-cl-progress-interval";
+    args[2] = "10";
+    args[3] = "--acp-thread-multiple";
+    args[4] = "1";
+    for (i = 1; i <= argc; i++) args[i + 4] = argv[i];
+    argc += 4;
+    argv = args;
+    acp_init(&argc, &argv);
+    procs = acp_procs();
+    rank = acp_rank();
+
+    while ((c = getopt(argc, argv, "r:")) != -1){
+        switch(c){
+        case 'r':
+            rep = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r num]\n", argv[0]);
+        }
+    }
+
+    sbuf = (int *)malloc(MAXSZ);
+    rbuf = (int *)malloc(MAXSZ);
+
+    sch = acp_create_ch(rank, (rank + 1) % procs);
+    rch = acp_create_ch((rank + procs - 1) % procs, rank);
+
+    for (r = 0; r < rep; r++){
+        for (i = 0; i < NSIZES; i++) {
+            n = sizes[i] / sizeof(int);
+            for (j = 0; j < n; j++) {
+                sbuf[j] = rank * 100000 + r * 100 + j;
+                rbuf[j] = -1;
+            }
+
+            arrived = 0;
+            req = acp_nbrecv_ch(rch, rbuf, sizes[i]);
+            acp_set_callback_ch(req, callback, NULL);
+            req = acp_nbsend_ch(sch, sbuf, sizes[i]);
+
+            while (!arrived) ;
+            __sync_synchronize();
+            acp_wait_ch(req);
+
+            if (arrivedsz != sizes[i]) {
+                fprintf(stderr, "rank: %d Wrong size %zu (should be %zu)\n", rank, arrivedsz, sizes[i]);
+                errors++;
+            }
+            for (j = 0; j < n; j++)
+                if (rbuf[j] != ((rank + procs - 1) % procs) * 100000 + r * 100 + j) {
+                    fprintf(stderr, "rank: %d Wrong data %d at %d of size %zu\n", rank, rbuf[j], j, sizes[i]);
+                    errors++;
+                    break;
+                }
+        }
+    }
+
+    acp_wait_ch(acp_nbfree_ch(sch));
+    acp_wait_ch(acp_nbfree_ch(rch));
+
+    fprintf(stderr, "rank: %d | errors: %d\n", rank, errors);
+    free(sbuf);
+    free(rbuf);
+
+    acp_sync();
+    acp_finalize();
+    return (errors != 0);
+}